@@ -44,4 +44,6 @@ sudo cp -v init.elf $TARGET_PATH/init
 sudo cp -v shell.elf $TARGET_PATH
 sudo cp -v loop.elf $TARGET_PATH/loop
 sudo cp -v snake.elf $TARGET_PATH/snake
+sudo cp -v strace.elf $TARGET_PATH/strace
+sudo cp -v fsbench.elf $TARGET_PATH/fsbench
 sudo umount $TARGET_PATH
\ No newline at end of file
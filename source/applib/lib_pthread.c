@@ -0,0 +1,414 @@
+/**
+ * @file lib_pthread.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief 基于clone系统调用的最小线程库
+ *        线程的栈由堆空间分配，回收线程时一并释放；互斥锁与条件变量在无竞争时只用原子指令完成，
+ *        发生竞争时才通过futex系统调用在内核中睡眠与唤醒
+ * @version 0.1
+ * @date 2023-09-26
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "lib_pthread.h"
+#include "lib_syscall.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <reent.h>
+
+//线程的描述结构，pthread_t即为该结构的地址
+typedef struct _pthread_info_t {
+    int tid;                    //内核中的线程id
+    void *(*start)(void *);     //线程函数
+    void *arg;                  //线程函数的参数
+    void *stack;                //线程的用户栈，在回收线程时释放
+}pthread_info_t;
+
+//是否已创建过线程，之后堆空间的分配才需要加锁
+static volatile int threads_started = 0;
+
+/**
+ * @brief 原子地交换同步变量的值
+ *
+ * @param addr
+ * @param value 新值
+ * @return uint32_t 原值
+ */
+static inline uint32_t atomic_xchg(volatile uint32_t *addr, uint32_t value) {
+    __asm__ __volatile__("xchg %[v], %[m]"
+                         : [v] "+r"(value), [m] "+m"(*addr)
+                         :
+                         : "memory");
+    return value;
+}
+
+/**
+ * @brief 同步变量的值等于old时原子地将其替换为value
+ *
+ * @param addr
+ * @param old 期望的原值
+ * @param value 新值
+ * @return uint32_t 原值，与old相等表示替换成功
+ */
+static inline uint32_t atomic_cmpxchg(volatile uint32_t *addr, uint32_t old, uint32_t value) {
+    uint32_t prev;
+    __asm__ __volatile__("lock cmpxchg %[v], %[m]"
+                         : "=a"(prev), [m] "+m"(*addr)
+                         : [v] "r"(value), "0"(old)
+                         : "memory");
+    return prev;
+}
+
+/**
+ * @brief 不经系统调用获取当前线程的标识，线程栈按其大小对齐，栈指针向下对齐即为栈的起始地址
+ *        主线程的栈不在堆空间中，统一以1标识
+ *
+ * @return uint32_t
+ */
+static inline uint32_t pthread_self_key(void) {
+    uint32_t esp;
+    __asm__ __volatile__("mov %%esp, %[v]" : [v] "=r"(esp));
+    if (esp >= PTHREAD_MAIN_STACK_BASE) {
+        return 1;
+    }
+
+    return esp & ~(PTHREAD_STACK_SIZE - 1);
+}
+
+/**
+ * @brief 所有线程的入口，执行完线程函数后以其返回值退出线程
+ *
+ * @param info
+ */
+static void pthread_entry(pthread_info_t *info) {
+    pthread_exit(info->start(info->arg));
+}
+
+/**
+ * @brief 创建线程，忽略线程属性
+ *
+ * @param thread 传出参数，新线程
+ * @param attr
+ * @param start 线程函数
+ * @param arg 线程函数的参数
+ * @return int 0:成功, EAGAIN:资源不足
+ */
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start)(void *), void *arg) {
+    //1.分配线程的描述结构与用户栈
+    pthread_info_t *info = (pthread_info_t *)malloc(sizeof(pthread_info_t));
+    if (info == (pthread_info_t *)0) {
+        return EAGAIN;
+    }
+
+    info->start = start;
+    info->arg = arg;
+    info->stack = memalign(PTHREAD_STACK_SIZE, PTHREAD_STACK_SIZE);
+    if (info->stack == (void *)0) {
+        free(info);
+        return EAGAIN;
+    }
+
+    //2.在栈顶放入pthread_entry的参数与模拟调用压入的返回地址
+    uint32_t *stack = (uint32_t *)((char *)info->stack + PTHREAD_STACK_SIZE);
+    *(--stack) = (uint32_t)info;
+    *(--stack) = 0;
+
+    //3.创建线程前标记已有多个线程，之后的堆空间分配都需要加锁
+    threads_started = 1;
+    info->tid = clone(pthread_entry, stack);
+    if (info->tid < 0) {
+        free(info->stack);
+        free(info);
+        return EAGAIN;
+    }
+
+    *thread = (pthread_t)info;
+    return 0;
+}
+
+/**
+ * @brief 等待线程退出，回收其资源并获取线程函数的返回值
+ *
+ * @param thread
+ * @param retval 传出参数，可以为0
+ * @return int 0:成功, ESRCH:线程不存在
+ */
+int pthread_join(pthread_t thread, void **retval) {
+    pthread_info_t *info = (pthread_info_t *)thread;
+    int status;
+
+    if (thread_join(info->tid, &status) < 0) {
+        return ESRCH;
+    }
+
+    if (retval) {
+        *retval = (void *)status;
+    }
+
+    free(info->stack);
+    free(info);
+    return 0;
+}
+
+/**
+ * @brief 退出当前线程，主线程调用时进程在其它线程都退出后结束
+ *
+ * @param retval
+ */
+void pthread_exit(void *retval) {
+    thread_exit((int)retval);
+}
+
+/**
+ * @brief 初始化互斥锁，忽略互斥锁属性
+ *
+ * @param mutex
+ * @param attr
+ * @return int
+ */
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr) {
+    *mutex = PTHREAD_MUTEX_UNLOCKED;
+    return 0;
+}
+
+/**
+ * @brief 销毁互斥锁，互斥锁不占用其它资源
+ *
+ * @param mutex
+ * @return int
+ */
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+    return 0;
+}
+
+/**
+ * @brief 对互斥锁加锁，无竞争时只用一次原子比较交换完成，
+ *        锁已被其它线程持有时将其标记为有等待者，并在内核中等待持有者解锁
+ *
+ * @param mutex
+ * @return int
+ */
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    volatile uint32_t *addr = (volatile uint32_t *)mutex;
+
+    //1.快速路径，锁未被持有时直接加锁
+    uint32_t c = atomic_cmpxchg(addr, PTHREAD_MUTEX_UNLOCKED, PTHREAD_MUTEX_LOCKED);
+    if (c == PTHREAD_MUTEX_UNLOCKED) {
+        return 0;
+    }
+
+    //2.标记锁有等待者，持有者解锁时需进入内核唤醒等待者
+    //  交换后原值为未加锁表示已获取锁，此时保守地保持有等待者状态
+    if (c != PTHREAD_MUTEX_CONTENDED) {
+        c = atomic_xchg(addr, PTHREAD_MUTEX_CONTENDED);
+    }
+
+    while (c != PTHREAD_MUTEX_UNLOCKED) {
+        futex_wait(addr, PTHREAD_MUTEX_CONTENDED);
+        c = atomic_xchg(addr, PTHREAD_MUTEX_CONTENDED);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 尝试对互斥锁加锁
+ *
+ * @param mutex
+ * @return int 0:成功, EBUSY:锁已被持有
+ */
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+    volatile uint32_t *addr = (volatile uint32_t *)mutex;
+    if (atomic_cmpxchg(addr, PTHREAD_MUTEX_UNLOCKED, PTHREAD_MUTEX_LOCKED) != PTHREAD_MUTEX_UNLOCKED) {
+        return EBUSY;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 对互斥锁解锁，只有锁被标记为有等待者时才进入内核唤醒其中一个
+ *
+ * @param mutex
+ * @return int
+ */
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+    volatile uint32_t *addr = (volatile uint32_t *)mutex;
+    if (atomic_xchg(addr, PTHREAD_MUTEX_UNLOCKED) == PTHREAD_MUTEX_CONTENDED) {
+        futex_wake(addr, 1);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 初始化条件变量，忽略条件变量属性
+ *
+ * @param cond
+ * @param attr
+ * @return int
+ */
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr) {
+    *cond = PTHREAD_COND_CLEAR;
+    return 0;
+}
+
+/**
+ * @brief 读取条件变量的值，仍为newlib的静态初始化值时先替换为初始值
+ *
+ * @param addr
+ * @return uint32_t
+ */
+static uint32_t cond_load(volatile uint32_t *addr) {
+    uint32_t seq = *addr;
+    if (seq == (uint32_t)_PTHREAD_COND_INITIALIZER) {
+        atomic_cmpxchg(addr, seq, PTHREAD_COND_CLEAR);
+        seq = *addr;
+    }
+
+    return seq;
+}
+
+/**
+ * @brief 销毁条件变量，条件变量不占用其它资源
+ *
+ * @param cond
+ * @return int
+ */
+int pthread_cond_destroy(pthread_cond_t *cond) {
+    return 0;
+}
+
+/**
+ * @brief 释放互斥锁并等待条件变量被通知，返回前重新获取互斥锁
+ *        等待前记录条件变量的序号，释放锁之后发生的通知会改变序号，内核比较序号时不会进入等待
+ *
+ * @param cond
+ * @param mutex 调用者已持有的互斥锁
+ * @return int
+ */
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    volatile uint32_t *addr = (volatile uint32_t *)cond;
+
+    //1.设置有等待者标志，通知者只在该标志置位时进入内核
+    uint32_t seq = cond_load(addr);
+    while (!(seq & PTHREAD_COND_WAITERS)) {
+        uint32_t prev = atomic_cmpxchg(addr, seq, seq | PTHREAD_COND_WAITERS);
+        if (prev == seq) {
+            seq |= PTHREAD_COND_WAITERS;
+            break;
+        }
+        seq = prev;
+    }
+
+    //2.释放锁后在序号未改变时等待，被唤醒后重新获取锁，锁可能仍有其它等待者
+    pthread_mutex_unlock(mutex);
+    futex_wait(addr, seq);
+    while (atomic_xchg((volatile uint32_t *)mutex, PTHREAD_MUTEX_CONTENDED) != PTHREAD_MUTEX_UNLOCKED) {
+        futex_wait((volatile uint32_t *)mutex, PTHREAD_MUTEX_CONTENDED);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 将条件变量的序号前进一步，返回前进前的值
+ *
+ * @param cond
+ * @param clear 是否同时清除有等待者标志
+ * @return uint32_t
+ */
+static uint32_t cond_advance(pthread_cond_t *cond, int clear) {
+    volatile uint32_t *addr = (volatile uint32_t *)cond;
+    uint32_t seq = cond_load(addr);
+    for (;;) {
+        uint32_t next = seq + PTHREAD_COND_SEQ_INC;
+        if ((next | PTHREAD_COND_WAITERS) == (uint32_t)_PTHREAD_COND_INITIALIZER) {
+            next += PTHREAD_COND_SEQ_INC;  //不能与静态初始化值相同
+        }
+        if (clear) {
+            next &= ~PTHREAD_COND_WAITERS;
+        }
+
+        uint32_t prev = atomic_cmpxchg(addr, seq, next);
+        if (prev == seq) {
+            return seq;
+        }
+        seq = prev;
+    }
+}
+
+/**
+ * @brief 唤醒一个等待条件变量的线程，没有等待者时不进入内核
+ *        只唤醒一个时不清除有等待者标志，其它等待者仍需被后续的通知唤醒
+ *
+ * @param cond
+ * @return int
+ */
+int pthread_cond_signal(pthread_cond_t *cond) {
+    if (cond_advance(cond, 0) & PTHREAD_COND_WAITERS) {
+        futex_wake((volatile uint32_t *)cond, 1);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 唤醒所有等待条件变量的线程，并清除有等待者标志
+ *
+ * @param cond
+ * @return int
+ */
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+    if (cond_advance(cond, 1) & PTHREAD_COND_WAITERS) {
+        futex_wake((volatile uint32_t *)cond, 0x7FFFFFFF);
+    }
+
+    return 0;
+}
+
+//保护newlib堆空间分配的互斥锁，realloc等函数会嵌套加锁，需记录持有者与嵌套深度
+//持有者为pthread_self_key得到的线程标识，判断嵌套时不进入内核
+static pthread_mutex_t malloc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t malloc_owner = 0;
+static int malloc_depth = 0;
+
+/**
+ * @brief 替换newlib的空实现，多个线程共享同一个堆空间，分配前需加锁
+ *
+ * @param reent
+ */
+void __malloc_lock(struct _reent *reent) {
+    if (!threads_started) {
+        return;
+    }
+
+    uint32_t tid = pthread_self_key();
+    if (malloc_owner == tid) {
+        malloc_depth++;
+        return;
+    }
+
+    pthread_mutex_lock(&malloc_mutex);
+    malloc_owner = tid;
+    malloc_depth = 1;
+}
+
+/**
+ * @brief 替换newlib的空实现，释放堆空间分配的锁
+ *
+ * @param reent
+ */
+void __malloc_unlock(struct _reent *reent) {
+    if (!threads_started) {
+        return;
+    }
+
+    if (--malloc_depth == 0) {
+        malloc_owner = 0;
+        pthread_mutex_unlock(&malloc_mutex);
+    }
+}
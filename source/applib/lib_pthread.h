@@ -0,0 +1,61 @@
+/**
+ * @file lib_pthread.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief 基于clone系统调用的最小线程库，提供线程的创建、回收、互斥锁与条件变量
+ *        newlib只为该平台提供了线程相关的类型，函数声明在此给出
+ * @version 0.1
+ * @date 2023-09-26
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef LIB_PTHREAD_H
+#define LIB_PTHREAD_H
+
+#include <sys/types.h>
+
+//每个线程的用户栈大小，栈按该大小对齐分配，栈指针向下对齐即可得到线程的标识
+#define PTHREAD_STACK_SIZE          (16 * 1024)
+
+//主线程的用户栈区域的起始地址，与内核中的MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE一致，
+//线程栈都从其下方的堆空间中分配
+#define PTHREAD_MAIN_STACK_BASE     (0xE0000000 - 50 * 4096)
+
+//互斥锁的三种状态，未加锁状态与newlib的静态初始化值一致
+#define PTHREAD_MUTEX_UNLOCKED      _PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_MUTEX_LOCKED        0   //已加锁且没有等待者，解锁时不进入内核
+#define PTHREAD_MUTEX_CONTENDED     1   //已加锁且可能有等待者，解锁时需唤醒等待者
+
+//条件变量的最低位标记可能有等待者，其余位为每次通知递增的序号
+//newlib的静态初始化值0xFFFFFFFF带有等待者标志，第一次使用时替换为初始值，序号前进时跳过该值
+#define PTHREAD_COND_WAITERS        1
+#define PTHREAD_COND_SEQ_INC        2
+#define PTHREAD_COND_CLEAR          0
+
+#ifndef PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_MUTEX_INITIALIZER   PTHREAD_MUTEX_UNLOCKED
+#endif
+
+#ifndef PTHREAD_COND_INITIALIZER
+#define PTHREAD_COND_INITIALIZER    ((pthread_cond_t)PTHREAD_COND_CLEAR)
+#endif
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start)(void *), void *arg);
+int pthread_join(pthread_t thread, void **retval);
+void pthread_exit(void *retval);
+
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr);
+int pthread_mutex_destroy(pthread_mutex_t *mutex);
+int pthread_mutex_lock(pthread_mutex_t *mutex);
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
+int pthread_mutex_unlock(pthread_mutex_t *mutex);
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr);
+int pthread_cond_destroy(pthread_cond_t *cond);
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int pthread_cond_signal(pthread_cond_t *cond);
+int pthread_cond_broadcast(pthread_cond_t *cond);
+
+#endif
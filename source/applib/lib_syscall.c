@@ -12,11 +12,80 @@
 #include    "common/types.h"
 #include    "cpu/syscall.h"
 #include    "os_cfg.h"
+#include    "core/vsys.h"
 #include    "lib_syscall.h"
 #include    <stdlib.h>
 
 
+//cpu是否支持sysenter快速系统调用，-1表示还未检测
+static int sysenter_state = -1;
+
+/**
+ * @brief 检测cpu是否支持sysenter，内核以相同的条件开启该入口，结果缓存后不再检测
+ * 
+ * @return int 1:支持 0:不支持，只能使用调用门
+ */
+int sysenter_supported(void) {
+    if (sysenter_state < 0) {
+        uint32_t eax, ebx, ecx, edx;
+        __asm__ __volatile__("cpuid"
+                             : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                             : "a"(1), "c"(0));
+        sysenter_state = (edx & CPUID_FEAT_EDX_SEP) ? 1 : 0;
+    }
+
+    return sysenter_state;
+}
+
+/**
+ * @brief 通过sysenter进入内核，参数在用户栈中的布局与调用门相同
+ *        ecx传递压入参数后的用户栈顶，edx传递返回地址，内核返回时跳过栈中的参数
+ * 
+ * @param args 
+ * @return int 
+ */
+int sys_call_sysenter(syscall_args_t *args) {
+    int ret;
+
+    __asm__ __volatile__(
+        "pushl 16(%[args])\n\t"
+        "pushl 12(%[args])\n\t"
+        "pushl 8(%[args])\n\t"
+        "pushl 4(%[args])\n\t"
+        "pushl 0(%[args])\n\t"
+        "movl %%esp, %%ecx\n\t"
+        "movl $1f, %%edx\n\t"
+        "sysenter\n\t"
+        "1:\n\t"
+        :"=a"(ret)
+        :[args]"r"(args)
+        :"ecx", "edx", "memory", "cc"
+    );
+
+    return ret;
+}
+
+/**
+ * @brief 优先使用sysenter进入内核，cpu不支持时使用调用门
+ * 
+ * @param args 
+ * @return int 
+ */
 int sys_call(syscall_args_t *args) {
+    if (sysenter_supported()) {
+        return sys_call_sysenter(args);
+    }
+
+    return sys_call_gate(args);
+}
+
+/**
+ * @brief 通过调用门进入内核
+ * 
+ * @param args 
+ * @return int 
+ */
+int sys_call_gate(syscall_args_t *args) {
     // 传入远跳转需要的参数, 即cs = selector, eip = offset 
     //为调用门选择子赋予0特权级,调用门的 cpl 和 RPL <= 系统调用段描述符的DPL
     //门描述符中目标选择子的 CPL <= 门描述符的 DPL
@@ -74,12 +143,52 @@ void msleep(int ms) {
  * @return int 
  */
 int getpid(void) {
+    //进程只有一个线程时，直接读取vsys数据页中的pid
+    int pid = ((vsys_proc_t *)MEM_VSYS_PROC)->pid;
+    if (pid) {
+        return pid;
+    }
+
     syscall_args_t args;
     args.id = SYS_getpid;
 
     return sys_call(&args);
 }
 
+/**
+ * @brief 读取内核启动后经过的时间片数，不进入内核
+ *        内核只在时钟中断中更新vsys数据页，用当前的时间戳计数器推算出之后经过的时间片数
+ *
+ * @return uint32_t
+ */
+uint32_t get_ticks(void) {
+    vsys_data_t *data = (vsys_data_t *)MEM_VSYS_BASE;
+    uint32_t seq, ticks, tsc_low, tsc_high, per_tick, now_low, now_high;
+
+    //1.序号为奇数或读取前后序号不同时，说明内核正在更新，重新读取
+    do {
+        seq = data->seq;
+        __asm__ __volatile__("" ::: "memory");
+        ticks = data->ticks;
+        tsc_low = data->tsc_low;
+        tsc_high = data->tsc_high;
+        per_tick = data->tsc_per_tick;
+        __asm__ __volatile__("" ::: "memory");
+    } while ((seq & 1) || seq != data->seq);
+
+    if (per_tick == 0) {
+        return ticks;
+    }
+
+    //2.计算距上次更新经过的时间戳计数器周期数，不使用64位除法
+    __asm__ __volatile__("rdtsc" : "=a"(now_low), "=d"(now_high));
+    uint32_t diff_low = now_low - tsc_low;
+    uint32_t diff_high = now_high - tsc_high - (now_low < tsc_low);
+
+    //3.高32位部分按每2^32个周期约含的时间片数近似计算
+    return ticks + diff_high * (0xFFFFFFFF / per_tick) + diff_low / per_tick;
+}
+
 void print_msg(const char *fmt, int arg) {
     syscall_args_t args;
     args.id = SYS_printmsg;
@@ -284,6 +393,34 @@ int dup(int file) {
     return sys_call(&args);
 }
 
+/**
+ * @brief 创建管道，fd[0]为读端，fd[1]为写端
+ * 
+ * @param fd 
+ * @return int 0:成功, -1:失败
+ */
+int pipe(int *fd) {
+    syscall_args_t args;
+    args.id = SYS_pipe;
+    args.arg0 = (int)fd;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 获取块缓存的命中与磁盘访问统计
+ * 
+ * @param stat 
+ * @return int 0:成功, -1:失败
+ */
+int bcache_stat(bcache_stat_t *stat) {
+    syscall_args_t args;
+    args.id = SYS_bcache_stat;
+    args.arg0 = (int)stat;
+
+    return sys_call(&args);
+}
+
 /**
  * @brief 进程退出的系统调用
  * 
@@ -311,6 +448,147 @@ int wait(int *status) {
     return sys_call(&args);
 }
 
+/**
+ * @brief 调整进程的基础优先级
+ * 
+ * @param inc 基础优先级的增量，为正时降低优先级
+ * @return int 调整后的基础优先级
+ */
+int nice(int inc) {
+    syscall_args_t args;
+    args.id = SYS_nice;
+    args.arg0 = inc;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 创建与当前进程共享地址空间和打开文件表的线程
+ * 
+ * @param entry 线程入口地址
+ * @param stack 线程的栈顶，栈顶处已放好入口函数的返回地址与参数
+ * @return int 线程id，失败时为-1
+ */
+int clone(void *entry, void *stack) {
+    syscall_args_t args;
+    args.id = SYS_clone;
+    args.arg0 = (int)entry;
+    args.arg1 = (int)stack;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 只退出当前线程，进程中的其它线程继续运行
+ * 
+ * @param status 
+ */
+void thread_exit(int status) {
+    syscall_args_t args;
+    args.id = SYS_thread_exit;
+    args.arg0 = status;
+
+    sys_call(&args);
+}
+
+/**
+ * @brief 等待同一进程中的线程退出并回收其资源
+ * 
+ * @param tid 
+ * @param status 线程退出的状态值，可以为0
+ * @return int 
+ */
+int thread_join(int tid, int *status) {
+    syscall_args_t args;
+    args.id = SYS_thread_join;
+    args.arg0 = tid;
+    args.arg1 = (int)status;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 地址处的值仍等于val时进入等待，直到其它线程调用futex_wake
+ * 
+ * @param addr 
+ * @param val 
+ * @return int 0:被唤醒, -1:值已改变
+ */
+int futex_wait(volatile uint32_t *addr, uint32_t val) {
+    syscall_args_t args;
+    args.id = SYS_futex_wait;
+    args.arg0 = (int)addr;
+    args.arg1 = (int)val;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 唤醒最多count个在地址上等待的线程
+ * 
+ * @param addr 
+ * @param count 
+ * @return int 实际唤醒的线程数
+ */
+int futex_wake(volatile uint32_t *addr, int count) {
+    syscall_args_t args;
+    args.id = SYS_futex_wake;
+    args.arg0 = (int)addr;
+    args.arg1 = count;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 开启或关闭任务的系统调用跟踪，只能设置自身或子进程
+ * 
+ * @param pid 为0时设置当前任务
+ * @param enable 
+ * @return int 0:成功, -1:失败
+ */
+int trace(int pid, int enable) {
+    syscall_args_t args;
+    args.id = SYS_trace;
+    args.arg0 = pid;
+    args.arg1 = enable;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 读取所有cpu上的系统调用跟踪记录，按调用完成的先后排列
+ * 
+ * @param buf 
+ * @param count 最多读取的记录数
+ * @param pid 被跟踪的任务，不为0时该任务已退出且没有剩余记录则返回-1
+ * @return int 读取的记录数
+ */
+int trace_read(systrace_entry_t *buf, int count, int pid) {
+    syscall_args_t args;
+    args.id = SYS_trace_read;
+    args.arg0 = (int)buf;
+    args.arg1 = count;
+    args.arg2 = pid;
+
+    return sys_call(&args);
+}
+
+/**
+ * @brief 获取系统调用在所有cpu上的耗时统计
+ * 
+ * @param id 系统调用id
+ * @param stat 
+ * @return int 0:成功, -1:id非法
+ */
+int trace_stat(int id, systrace_stat_t *stat) {
+    syscall_args_t args;
+    args.id = SYS_trace_stat;
+    args.arg0 = id;
+    args.arg1 = (int)stat;
+
+    return sys_call(&args);
+}
+
 
 /**
  * @brief 打开一个目录
@@ -14,6 +14,8 @@
 
 #include "common/types.h"
 #include "cpu/syscall.h"
+#include "cpu/systrace.h"
+#include "fs/bcache.h"
 #include "os_cfg.h"
 #include "dev/tty.h"
 #include <sys/stat.h>  
@@ -31,16 +33,31 @@ typedef struct _syscall_args_t {
     int arg3;
 }syscall_args_t;
 
+int sys_call(syscall_args_t *args);
+int sys_call_gate(syscall_args_t *args);
+int sys_call_sysenter(syscall_args_t *args);
+int sysenter_supported(void);
+
 void print_msg(const char *fmt, int arg);
 
 //进程相关系统调用
 int getpid(void);
+uint32_t get_ticks(void);
 void msleep(int ms);
 int fork (void);
 int execve(const char *name, char * const * argv, char * const * env);
 int yield (void);
 int wait(int *status);
+int nice(int inc);
 void _exit(int status);
+int clone(void *entry, void *stack);
+void thread_exit(int status);
+int thread_join(int tid, int *status);
+int futex_wait(volatile uint32_t *addr, uint32_t val);
+int futex_wake(volatile uint32_t *addr, int count);
+int trace(int pid, int enable);
+int trace_read(systrace_entry_t *buf, int count, int pid);
+int trace_stat(int id, systrace_stat_t *stat);
 
 
 
@@ -60,6 +77,8 @@ int fstat(int file, struct stat *st);
 char *sbrk(ptrdiff_t incr);
 
 int dup(int file);
+int pipe(int *fd);
+int bcache_stat(bcache_stat_t *stat);
 
 
 //文件目录项结构
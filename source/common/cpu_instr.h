@@ -234,6 +234,77 @@ static inline void write_cr4(uint32_t data) {
   __asm__ __volatile__("mov %[v], %%cr4" : : [v] "r"(data));
 }
 
+/**
+ * @brief  使TLB中虚拟地址vaddr所在页的缓存失效
+ *
+ * @param vaddr
+ */
+static inline void invlpg(uint32_t vaddr) {
+  __asm__ __volatile__("invlpg (%[v])" : : [v] "r"(vaddr) : "memory");
+}
+
+/**
+ * @brief  从低位开始查找第一个为1的位，data不能为0
+ *
+ * @param data
+ * @return uint32_t 该位的索引
+ */
+static inline uint32_t bsf(uint32_t data) {
+  uint32_t index;
+  __asm__ __volatile__("bsf %[d], %[i]" : [i] "=r"(index) : [d] "rm"(data));
+  return index;
+}
+
+/**
+ * @brief  从高位开始查找第一个为1的位，data不能为0
+ *
+ * @param data
+ * @return uint32_t 该位的索引
+ */
+static inline uint32_t bsr(uint32_t data) {
+  uint32_t index;
+  __asm__ __volatile__("bsr %[d], %[i]" : [i] "=r"(index) : [d] "rm"(data));
+  return index;
+}
+
+/**
+ * @brief  执行cpuid指令，获取cpu支持的功能信息
+ *
+ * @param leaf 功能号
+ * @param eax
+ * @param ebx
+ * @param ecx
+ * @param edx
+ */
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+  __asm__ __volatile__("cpuid"
+                       : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                       : "a"(leaf), "c"(0));
+}
+
+/**
+ * @brief  写入模型特定寄存器
+ *
+ * @param msr 寄存器编号
+ * @param value
+ */
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+  __asm__ __volatile__("wrmsr"
+                       :
+                       : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+/**
+ * @brief  读取时间戳计数器，即cpu上电以来经过的时钟周期数
+ *
+ * @return uint64_t
+ */
+static inline uint64_t rdtsc(void) {
+  uint32_t low, high;
+  __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+  return ((uint64_t)high << 32) | low;
+}
+
 /**
  * @brief  远跳转，当跳转发生在TSS段之间时，cpu将会保存状态到当前TR寄存器指向的TSS段
  *
@@ -257,6 +328,35 @@ static inline void write_tr(uint16_t tss_selector) {
   __asm__ __volatile__("ltr %[v]" : : [v]"r"(tss_selector));
 }
 
+/**
+ * @brief  读取TR寄存器中当前cpu所用TSS段的选择子
+ *
+ * @return uint16_t 未加载过TSS时为0
+ */
+static inline uint16_t read_tr(void) {
+  uint16_t tss_selector;
+  __asm__ __volatile__("str %[v]" : [v] "=r"(tss_selector));
+  return tss_selector;
+}
+
+/**
+ * @brief  原子地将value写入addr处，并返回该处原来的值，xchg访问内存时自带lock语义
+ *
+ * @param addr
+ * @param value
+ * @return uint32_t
+ */
+static inline uint32_t xchg(volatile uint32_t *addr, uint32_t value) {
+  __asm__ __volatile__("xchg %[v], %[a]" : [v] "+r"(value), [a] "+m"(*addr) : : "memory");
+  return value;
+}
+
+/**
+ * @brief  自旋等待时提示cpu降低功耗，并避免退出循环时因内存顺序冲突清空流水线
+ *
+ */
+static inline void pause(void) { __asm__ __volatile__("pause" : : : "memory"); }
+
 /**
  * @brief  读取当前cpu的eflags寄存器
  * 
@@ -0,0 +1,174 @@
+/**
+ * @file main.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  写入一个大文件后以不同的缓冲区大小读回，打印各自的吞吐量与磁盘访问次数
+ *         用法: fsbench [-s 大小(KB)] [文件名]
+ * @version 0.1
+ * @date 2023-10-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/file.h>
+#include "lib_syscall.h"
+#include "main.h"
+
+//读回文件时依次使用的缓冲区大小
+static const int buf_sizes[] = {512, 4096, 32 * 1024, FSBENCH_BUF_MAX};
+
+static char buf[FSBENCH_BUF_MAX];
+
+/**
+ * @brief 打印吞吐量，单位为KB/ms，约等于MB/s
+ *
+ * @param name
+ * @param bytes
+ * @param ms
+ */
+static void print_speed(const char *name, int bytes, uint32_t ms) {
+    if (ms == 0) {
+        ms = 1;
+    }
+    int kb_per_s = (bytes / 1024) * 1000 / ms;
+    printf("%-12s %6d KB in %6d ms, %d.%d MB/s", name, bytes / 1024, (int)ms,
+           kb_per_s / 1024, (kb_per_s % 1024) * 10 / 1024);
+}
+
+/**
+ * @brief 打印两次统计之间的磁盘命令数
+ *
+ * @param before
+ * @param after
+ */
+static void print_disk(const bcache_stat_t *before, const bcache_stat_t *after) {
+    printf(", disk cmds: %u cached + %u direct\n",
+           (unsigned int)(after->disk_reads + after->disk_writes
+                          - before->disk_reads - before->disk_writes),
+           (unsigned int)(after->direct_reads + after->direct_writes
+                          - before->direct_reads - before->direct_writes));
+}
+
+/**
+ * @brief 以最大的缓冲区写入指定大小的文件
+ *
+ * @param path
+ * @param total
+ * @return int 0:成功, -1:失败
+ */
+static int bench_write(const char *path, int total) {
+    bcache_stat_t before, after;
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY);
+    if (fd < 0) {
+        fprintf(stderr, "fsbench: open %s failed\n", path);
+        return -1;
+    }
+
+    for (int i = 0; i < FSBENCH_BUF_MAX; ++i) {
+        buf[i] = (char)i;
+    }
+
+    bcache_stat(&before);
+    uint32_t start = get_ticks();
+    int written = 0;
+    while (written < total) {
+        int size = total - written < FSBENCH_BUF_MAX ? total - written : FSBENCH_BUF_MAX;
+        int n = write(fd, buf, size);
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    //关闭文件时会写回文件分配表与脏块，计入写入耗时
+    close(fd);
+    uint32_t ms = (get_ticks() - start) * OS_TICKS_MS;
+    bcache_stat(&after);
+
+    print_speed("write", written, ms);
+    print_disk(&before, &after);
+
+    if (written < total) {
+        fprintf(stderr, "fsbench: write failed after %d bytes\n", written);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 以指定的缓冲区大小读回整个文件
+ *
+ * @param path
+ * @param size
+ * @return int 0:成功, -1:失败
+ */
+static int bench_read(const char *path, int size) {
+    bcache_stat_t before, after;
+    char name[16];
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "fsbench: open %s failed\n", path);
+        return -1;
+    }
+
+    bcache_stat(&before);
+    uint32_t start = get_ticks();
+    int received = 0;
+    int n;
+    while ((n = read(fd, buf, size)) > 0) {
+        received += n;
+    }
+    uint32_t ms = (get_ticks() - start) * OS_TICKS_MS;
+    bcache_stat(&after);
+    close(fd);
+
+    snprintf(name, sizeof(name), "read %d", size);
+    print_speed(name, received, ms);
+    print_disk(&before, &after);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int total_kb = FSBENCH_DEFAULT_KB;
+    int ch;
+
+    while ((ch = getopt(argc, argv, "s:h")) != -1) {
+        switch (ch) {
+            case 's':
+                total_kb = atoi(optarg);
+                break;
+            case 'h':
+                puts("fsbench: measure file read/write throughput");
+                puts("Usage: fsbench [-s size_kb] [file]");
+                return 0;
+            default:
+                return -1;
+        }
+    }
+
+    if (total_kb <= 0) {
+        fprintf(stderr, "fsbench: size must be positive\n");
+        return -1;
+    }
+
+    const char *path = optind < argc ? argv[optind] : FSBENCH_DEFAULT_FILE;
+
+    //1.写入测试文件
+    if (bench_write(path, total_kb * 1024) < 0) {
+        unlink(path);
+        return -1;
+    }
+
+    //2.以不同的缓冲区大小读回
+    for (int i = 0; i < sizeof(buf_sizes) / sizeof(buf_sizes[0]); ++i) {
+        bench_read(path, buf_sizes[i]);
+    }
+
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file main.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  测量文件系统读写吞吐量的程序
+ * @version 0.1
+ * @date 2023-10-05
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAIN_H
+#define MAIN_H
+
+//默认的测试文件大小(KB)
+#define FSBENCH_DEFAULT_KB      4096
+
+//默认的测试文件名
+#define FSBENCH_DEFAULT_FILE    "fsbench.dat"
+
+//最大的读写缓冲区大小
+#define FSBENCH_BUF_MAX         (128 * 1024)
+
+#endif
@@ -0,0 +1,294 @@
+/**
+ * @file kmalloc.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义内核对象缓存(slab)及kmalloc，用于分配小于一页的内核对象
+ *         每个缓存管理若干个一页大小的slab，slab内的空闲对象组成单链表，
+ *         分配和释放对象都只需操作链表头，时间复杂度为O(1)
+ * @version 0.1
+ * @date 2023-09-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "core/kmalloc.h"
+#include "core/memory.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+//所有已初始化的缓存，用于打印统计信息
+static list_t cache_list;
+
+//kmalloc各尺寸等级对应的缓存
+static kmem_cache_t size_caches[KMEM_SIZE_CLASS_COUNT];
+
+//kmalloc各尺寸等级缓存的名称
+static const char *size_cache_names[KMEM_SIZE_CLASS_COUNT] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+/**
+ * @brief  获取slab中第一个对象的偏移量
+ *
+ * @return uint32_t
+ */
+static inline uint32_t slab_obj_offset(void) {
+    return up2(sizeof(kmem_slab_t), 8);
+}
+
+/**
+ * @brief  通过对象地址获取其所在的slab，slab总是按页对齐的
+ *
+ * @param obj
+ * @return kmem_slab_t*
+ */
+static inline kmem_slab_t *obj_to_slab(void *obj) {
+    return (kmem_slab_t *)down2((uint32_t)obj, KMEM_SLAB_SIZE);
+}
+
+/**
+ * @brief  初始化内核对象缓存
+ *
+ * @param cache 缓存对象
+ * @param name 缓存名称
+ * @param obj_size 对象的大小
+ */
+void kmem_cache_init(kmem_cache_t *cache, const char *name, uint32_t obj_size) {
+    //1.对象大小至少能存放空闲链表的指针，并按4字节对齐
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    obj_size = up2(obj_size, 4);
+    ASSERT(obj_size <= KMEM_SLAB_SIZE - slab_obj_offset());
+
+    //2.初始化缓存的各个字段
+    cache->name = name;
+    cache->obj_size = obj_size;
+    cache->obj_per_slab = (KMEM_SLAB_SIZE - slab_obj_offset()) / obj_size;
+    list_init(&cache->partial_list);
+    list_init(&cache->full_list);
+    list_node_init(&cache->node);
+    cache->slab_count = 0;
+    cache->obj_in_use = 0;
+    cache->alloc_count = 0;
+    cache->free_count = 0;
+    mutex_init(&cache->mutex, name);
+
+    //3.加入全局缓存链表
+    list_insert_last(&cache_list, &cache->node);
+}
+
+/**
+ * @brief  为缓存分配一个新的slab，并将其所有对象串成空闲链表
+ *
+ * @param cache
+ * @return kmem_slab_t* 0:分配失败
+ */
+static kmem_slab_t *slab_create(kmem_cache_t *cache) {
+    //1.分配一页内核内存作为slab
+    kmem_slab_t *slab = (kmem_slab_t *)memory_alloc_page();
+    if (slab == (kmem_slab_t *)0) {
+        return (kmem_slab_t *)0;
+    }
+
+    //2.初始化slab的管理结构
+    slab->cache = cache;
+    list_node_init(&slab->node);
+    slab->in_use = 0;
+    slab->free_obj = (void *)0;
+
+    //3.从后往前将对象插入空闲链表，使分配顺序与地址顺序一致
+    uint8_t *obj_start = (uint8_t *)slab + slab_obj_offset();
+    for (int i = cache->obj_per_slab - 1; i >= 0; --i) {
+        void **obj = (void **)(obj_start + i * cache->obj_size);
+        *obj = slab->free_obj;
+        slab->free_obj = obj;
+    }
+
+    cache->slab_count++;
+    return slab;
+}
+
+/**
+ * @brief  从缓存中分配一个对象
+ *
+ * @param cache
+ * @return void* 对象地址，0:分配失败
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    void *obj = (void *)0;
+
+    mutex_lock(&cache->mutex);
+
+    //1.取第一个还有空闲对象的slab，没有则新建一个
+    kmem_slab_t *slab;
+    list_node_t *node = list_get_first(&cache->partial_list);
+    if (node) {
+        slab = list_node_parent(node, kmem_slab_t, node);
+    } else {
+        slab = slab_create(cache);
+        if (slab == (kmem_slab_t *)0) {
+            log_printf("kmem cache %s: no memory\n", cache->name);
+            goto alloc_end;
+        }
+        list_insert_first(&cache->partial_list, &slab->node);
+    }
+
+    //2.从slab的空闲链表头部取出一个对象
+    obj = slab->free_obj;
+    slab->free_obj = *(void **)obj;
+    slab->in_use++;
+
+    //3.slab已满，移入full_list
+    if (slab->in_use == cache->obj_per_slab) {
+        list_remove(&cache->partial_list, &slab->node);
+        list_insert_last(&cache->full_list, &slab->node);
+    }
+
+    cache->obj_in_use++;
+    cache->alloc_count++;
+
+alloc_end:
+    mutex_unlock(&cache->mutex);
+    return obj;
+}
+
+/**
+ * @brief  将对象归还给缓存
+ *
+ * @param cache
+ * @param obj
+ */
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    if (obj == (void *)0) {
+        return;
+    }
+
+    //1.通过对象地址找到所在的slab
+    kmem_slab_t *slab = obj_to_slab(obj);
+    ASSERT(slab->cache == cache && slab->in_use > 0);
+
+    mutex_lock(&cache->mutex);
+
+    //2.slab原本已满，移回partial_list
+    if (slab->in_use == cache->obj_per_slab) {
+        list_remove(&cache->full_list, &slab->node);
+        list_insert_first(&cache->partial_list, &slab->node);
+    }
+
+    //3.将对象插入slab的空闲链表头部
+    *(void **)obj = slab->free_obj;
+    slab->free_obj = obj;
+    slab->in_use--;
+
+    cache->obj_in_use--;
+    cache->free_count++;
+
+    //4.slab已全部空闲，且缓存中还有其它可用的slab，则将该页归还
+    if (slab->in_use == 0 && list_get_size(&cache->partial_list) > 1) {
+        list_remove(&cache->partial_list, &slab->node);
+        cache->slab_count--;
+        memory_free_page((uint32_t)slab);
+    }
+
+    mutex_unlock(&cache->mutex);
+}
+
+/**
+ * @brief  获取能容纳size字节的kmalloc尺寸等级
+ *
+ * @param size
+ * @return int 尺寸等级，-1:超出最大等级
+ */
+static int size_class_index(uint32_t size) {
+    uint32_t class_size = KMEM_SIZE_MIN;
+    for (int i = 0; i < KMEM_SIZE_CLASS_COUNT; ++i, class_size <<= 1) {
+        if (size <= class_size) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief  分配size字节的内核内存
+ *         不超过KMEM_SIZE_MAX的请求从对应尺寸等级的缓存中分配，
+ *         更大的请求直接分配连续的整页，页首存放slab管理结构以便kfree识别
+ *
+ * @param size
+ * @return void* 0:分配失败
+ */
+void *kmalloc(uint32_t size) {
+    if (size == 0) {
+        return (void *)0;
+    }
+
+    //1.从尺寸等级缓存中分配
+    int index = size_class_index(size);
+    if (index >= 0) {
+        return kmem_cache_alloc(size_caches + index);
+    }
+
+    //2.大块分配，直接分配连续的页
+    int page_count = up2(size + slab_obj_offset(), MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    kmem_slab_t *slab = (kmem_slab_t *)memory_alloc_pages(page_count);
+    if (slab == (kmem_slab_t *)0) {
+        log_printf("kmalloc %d bytes: no memory\n", size);
+        return (void *)0;
+    }
+
+    slab->cache = (kmem_cache_t *)0;
+    list_node_init(&slab->node);
+    slab->free_obj = (void *)0;
+    slab->in_use = page_count;
+
+    return (uint8_t *)slab + slab_obj_offset();
+}
+
+/**
+ * @brief  释放kmalloc分配的内存
+ *
+ * @param ptr
+ */
+void kfree(void *ptr) {
+    if (ptr == (void *)0) {
+        return;
+    }
+
+    kmem_slab_t *slab = obj_to_slab(ptr);
+    if (slab->cache) {  //小块分配，归还给所属的缓存
+        kmem_cache_free(slab->cache, ptr);
+    } else {    //大块分配，直接归还所有页
+        memory_free_pages((uint32_t)slab, slab->in_use);
+    }
+}
+
+/**
+ * @brief  打印所有缓存的使用情况
+ *
+ */
+void kmem_show_info(void) {
+    log_printf("kmem cache info:\n");
+    log_printf("%s\t%s\t%s\t%s\t%s\t%s\n", "name", "size", "slabs", "in use", "allocs", "frees");
+
+    for (list_node_t *node = list_get_first(&cache_list); node; node = list_node_next(node)) {
+        kmem_cache_t *cache = list_node_parent(node, kmem_cache_t, node);
+        log_printf("%s\t%d\t%d\t%d\t%d\t%d\n", cache->name, cache->obj_size, cache->slab_count,
+                   cache->obj_in_use, cache->alloc_count, cache->free_count);
+    }
+}
+
+/**
+ * @brief  初始化内核对象缓存模块及kmalloc的各尺寸等级缓存，需在memory_init之后调用
+ *
+ */
+void kmem_init(void) {
+    list_init(&cache_list);
+
+    uint32_t class_size = KMEM_SIZE_MIN;
+    for (int i = 0; i < KMEM_SIZE_CLASS_COUNT; ++i, class_size <<= 1) {
+        kmem_cache_init(size_caches + i, size_cache_names[i], class_size);
+    }
+}
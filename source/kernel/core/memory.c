@@ -10,11 +10,15 @@
  */
 
 #include "core/memory.h"
+#include "core/vsys.h"
+#include "core/kmalloc.h"
 #include "tools/log.h"
 #include "tools/klib.h"
 #include "tools/assert.h"
 #include "cpu/mmu.h"
 #include "dev/console.h"
+#include "cpu/apic.h"
+#include "cpu/smp.h"
 
 //定义全局内存页分配对象
 static addr_alloc_t paddr_alloc;
@@ -28,8 +32,12 @@ static pde_t kernel_page_dir[PDE_CNT] __attribute__((aligned(MEM_PAGE_SIZE)));
  * 
  * @param alloc 
  * @param page_addr 
+ * @return int 页的索引，若该页不由alloc管理则返回-1
  */
 static inline int page_index(addr_alloc_t *alloc, uint32_t page_addr) {
+  if (page_addr < alloc->start || page_addr >= alloc->start + alloc->size) {
+    return -1;
+  }
   return (page_addr - alloc->start) / alloc->page_size;
 }
 
@@ -40,11 +48,13 @@ static inline int page_index(addr_alloc_t *alloc, uint32_t page_addr) {
  * @param page_addr 页起始地址
  */
 static inline void page_ref_add(addr_alloc_t *alloc, uint32_t page_addr) {
-  //计算出页的索引
+  //计算出页的索引，不由alloc管理的页(如内核的一一映射区域)不记录引用
   int index = page_index(alloc, page_addr);
+  if (index < 0) return;
   
   mutex_lock(&alloc->mutex);
-  //引用计数+1
+  //引用计数+1，不能回绕为0，否则仍在使用的页会被释放
+  ASSERT(alloc->page_ref[index] < 0xFFFF);
   alloc->page_ref[index]++;
 
   mutex_unlock(&alloc->mutex);
@@ -59,6 +69,7 @@ static inline void page_ref_add(addr_alloc_t *alloc, uint32_t page_addr) {
 static inline void page_ref_sub(addr_alloc_t *alloc, uint32_t page_addr) {
   //计算出页的索引
   int index = page_index(alloc, page_addr);
+  if (index < 0) return;
 
   mutex_lock(&alloc->mutex);
   //引用计数-1
@@ -77,6 +88,7 @@ static inline void page_ref_sub(addr_alloc_t *alloc, uint32_t page_addr) {
 static inline int get_page_ref(addr_alloc_t *alloc, uint32_t page_addr) {
     //计算出页的索引
   int index = page_index(alloc, page_addr);
+  if (index < 0) return 0;
 
   mutex_lock(&alloc->mutex);
 
@@ -97,32 +109,163 @@ static inline void clear_page_ref(addr_alloc_t *alloc) {
 
   mutex_lock(&alloc->mutex);
 
-  kernel_memset(alloc->page_ref, 0, alloc->size / alloc->page_size);
+  kernel_memset(alloc->page_ref, 0, alloc->page_count * sizeof(uint16_t));
 
   mutex_unlock(&alloc->mutex);
 }
 
+/**
+ * @brief 将以index为首页，阶数为order的空闲块插入对应阶的空闲链表头部
+ * 
+ * @param alloc 
+ * @param index 
+ * @param order 
+ */
+static void buddy_list_insert(addr_alloc_t *alloc, int index, int order) {
+  uint16_t first = alloc->free_list[order];
+
+  alloc->pre[index] = MEM_BUDDY_NONE;
+  alloc->next[index] = first;
+  if (first != MEM_BUDDY_NONE) {
+    alloc->pre[first] = index;
+  }
+  alloc->free_list[order] = index;
+  alloc->order[index] = MEM_BUDDY_FREE | order;
+}
+
+/**
+ * @brief 将以index为首页，阶数为order的空闲块从对应阶的空闲链表中取下
+ * 
+ * @param alloc 
+ * @param index 
+ * @param order 
+ */
+static void buddy_list_remove(addr_alloc_t *alloc, int index, int order) {
+  uint16_t pre = alloc->pre[index];
+  uint16_t next = alloc->next[index];
+
+  if (pre != MEM_BUDDY_NONE) {
+    alloc->next[pre] = next;
+  } else {
+    alloc->free_list[order] = next;
+  }
+
+  if (next != MEM_BUDDY_NONE) {
+    alloc->pre[next] = pre;
+  }
+
+  alloc->order[index] = 0;
+}
+
+/**
+ * @brief 释放以index为首页，阶数为order的块，并与空闲的伙伴块逐级合并
+ * 
+ * @param alloc 
+ * @param index 
+ * @param order 
+ */
+static void buddy_free_block(addr_alloc_t *alloc, int index, int order) {
+  alloc->free_count += 1 << order;
+
+  while (order < MEM_BUDDY_ORDER_COUNT - 1) {
+    //伙伴块的首页索引只与当前块在第order位上不同
+    int buddy = index ^ (1 << order);
+    if (buddy + (1 << order) > alloc->page_count ||
+        alloc->order[buddy] != (MEM_BUDDY_FREE | order)) {
+      break;  //伙伴块越界或不是同阶的空闲块，不能合并
+    }
+
+    //取下伙伴块，合并为更高一阶的块
+    buddy_list_remove(alloc, buddy, order);
+    index &= ~(1 << order);
+    order++;
+  }
+
+  buddy_list_insert(alloc, index, order);
+}
+
+/**
+ * @brief 从伙伴系统中分配一个阶数为order的块，若没有同阶空闲块则拆分更高阶的块
+ * 
+ * @param alloc 
+ * @param order 
+ * @return int 块首页的索引，-1：分配失败
+ */
+static int buddy_alloc_block(addr_alloc_t *alloc, int order) {
+  //1.找到第一个不为空的空闲链表
+  int curr = order;
+  while (curr < MEM_BUDDY_ORDER_COUNT && alloc->free_list[curr] == MEM_BUDDY_NONE) {
+    curr++;
+  }
 
+  if (curr >= MEM_BUDDY_ORDER_COUNT) {
+    return -1;
+  }
+
+  //2.取下该空闲块
+  int index = alloc->free_list[curr];
+  buddy_list_remove(alloc, index, curr);
+
+  //3.将多余的后半部分逐级拆分放回低阶的空闲链表
+  while (curr > order) {
+    curr--;
+    buddy_list_insert(alloc, index + (1 << curr), curr);
+  }
 
+  alloc->free_count -= 1 << order;
+  return index;
+}
 
 /**
- * @brief  初始化内存分配对象
+ * @brief  初始化内存分配对象，伙伴系统的管理数据与页的引用计数数组
+ *         存放在被管理内存区域的起始处
  *
  * @param alloc 内存分配对象
- * @param bits 内存分配对象所管理的位图数组的起始地址
  * @param start 管理内存的起始地址
  * @param size 管理内存的大小
  * @param page_size 管理的内存页的大小
  */
-static void addr_alloc_init(addr_alloc_t *alloc, uint8_t *bits, uint32_t start,
+static void addr_alloc_init(addr_alloc_t *alloc, uint32_t start,
                             uint32_t size, uint32_t page_size) {
-  mutex_init(&alloc->mutex);
-  alloc->start = start;
-  alloc->size = size;
+  mutex_init(&alloc->mutex, "page_alloc");
+
+  //1.计算管理数据所占用的页数，每页需要pre，next，page_ref，order四项
+  int total_count = size / page_size;
+  ASSERT(total_count < MEM_BUDDY_NONE);
+  uint32_t meta_size = up2(total_count * (3 * sizeof(uint16_t) + sizeof(uint8_t)), page_size);
+
+  //2.管理数据之后的内存才用于分配
+  uint8_t *meta = (uint8_t*)start;
+  alloc->start = start + meta_size;
+  alloc->size = size - meta_size;
   alloc->page_size = page_size;
-  bitmap_init(&alloc->bitmap, bits, alloc->size / alloc->page_size, 0);
-  //清空页的引用数组
-  kernel_memset(alloc->page_ref, 0,  alloc->size / alloc->page_size);
+  alloc->page_count = alloc->size / page_size;
+  alloc->free_count = 0;
+
+  alloc->pre = (uint16_t*)meta;
+  alloc->next = alloc->pre + total_count;
+  alloc->page_ref = alloc->next + total_count;
+  alloc->order = (uint8_t*)(alloc->page_ref + total_count);
+
+  //3.清空页的引用数组与块的阶数
+  kernel_memset(alloc->order, 0, alloc->page_count);
+  kernel_memset(alloc->page_ref, 0,  alloc->page_count * sizeof(uint16_t));
+  for (int i = 0; i < MEM_BUDDY_ORDER_COUNT; ++i) {
+    alloc->free_list[i] = MEM_BUDDY_NONE;
+  }
+
+  //4.将所有页按尽可能大的对齐块放入空闲链表
+  int index = 0;
+  while (index < alloc->page_count) {
+    int order = MEM_BUDDY_ORDER_COUNT - 1;
+    while ((index & ((1 << order) - 1)) || (index + (1 << order) > alloc->page_count)) {
+      order--;
+    }
+
+    buddy_list_insert(alloc, index, order);
+    alloc->free_count += 1 << order;
+    index += 1 << order;
+  }
 }
 
 /**
@@ -135,12 +278,26 @@ static void addr_alloc_init(addr_alloc_t *alloc, uint8_t *bits, uint32_t start,
 static uint32_t addr_alloc_page(addr_alloc_t *alloc, int page_count) {
   uint32_t addr = 0;  // 记录分配的页的起始地址
 
+  //计算能容纳page_count个页的最小阶数
+  int order = 0;
+  while ((1 << order) < page_count) {
+    order++;
+  }
+  if (order >= MEM_BUDDY_ORDER_COUNT) {
+    return 0;
+  }
+
   //TODO：加锁
   mutex_lock(&alloc->mutex);
 
-  // 在位图中取连续的page_count个页进行分配
-  int page_index = bitmap_alloc_nbits(&alloc->bitmap, 0, page_count);
-  if (page_count >= 0) {
+  // 在伙伴系统中取一个2^order页大小的块进行分配
+  int page_index = buddy_alloc_block(alloc, order);
+  if (page_index >= 0) {
+    // 页是逐个释放的，超出page_count的部分直接归还
+    for (int i = page_count; i < (1 << order); ++i) {
+      buddy_free_block(alloc, page_index + i, 0);
+    }
+
     // 计算出申请到的第一个页的起始地址
     addr = alloc->start + page_index * alloc->page_size;
   }
@@ -166,12 +323,14 @@ static void addr_free_page(addr_alloc_t *alloc, uint32_t addr, int page_count) {
   for (int i = 0; i < page_count; ++i) {
     //获取当前页的地址
     uint32_t page_addr = addr + i * MEM_PAGE_SIZE;
+    int index = page_index(alloc, page_addr);
+    ASSERT(index >= 0 && !(alloc->order[index] & MEM_BUDDY_FREE));
     //引用-1
     page_ref_sub(alloc, page_addr);
     //获取当前页引用
     int ref = get_page_ref(alloc, page_addr);
-    if (ref == 0)  {//引用为0，释放该页
-        bitmap_set_bit(&alloc->bitmap, page_index(alloc, page_addr), 1, 0);
+    if (ref == 0)  {//引用为0，释放该页并与伙伴块合并
+        buddy_free_block(alloc, index, 0);
     }
 
   }
@@ -225,7 +384,12 @@ pte_t* find_pte(pde_t* page_dir, uint32_t vstart, int is_alloc) {
   //1.通过虚拟地址高10位索引到对应的页目录项
   pde_t* pde = page_dir + pde_index(vstart);
 
-  //2.判断该页目录项是否已存在，及该页目录项是否已指向一个被分配的页表
+  //2.页目录项直接映射了一个4mb大页，不存在对应的页表
+  if (pde->present && pde->ps) {
+    return (pte_t*)0;
+  }
+
+  //3.判断该页目录项是否已存在，及该页目录项是否已指向一个被分配的页表
   if (pde->present) { //该页目录项存在，及存在对应的页表，可以索引到对应的页表
     page_table = (pte_t*)pde_to_pt_addr(pde);
   } else {//该目录项不存在内存中，及对应的页表不存在
@@ -241,7 +405,7 @@ pte_t* find_pte(pde_t* page_dir, uint32_t vstart, int is_alloc) {
 
     //分配成功, 索引对应的页表
     page_table = (pte_t*)pg_addr;
-    kernel_memset(page_table, 0, MEM_PAGE_SIZE);
+    kernel_memset_page(page_table);
 
     //将该页表的起始地址放入对应的页目录项中并放入页目录表中，方便后续索引到该页表
     //且权限都放宽，即普通用户可访问，对应的页表的所有页可读写，将具体的权限交给每一页来进一步限制
@@ -251,7 +415,7 @@ pte_t* find_pte(pde_t* page_dir, uint32_t vstart, int is_alloc) {
   // log_printf("sizeof(pte_t) = %d", sizeof(pte_t));
 
 
-  //3.返回在该页表中索引到的页表项
+  //4.返回在该页表中索引到的页表项
   return page_table + pte_index(vstart);
 
 }
@@ -290,8 +454,10 @@ int  memory_creat_map(pde_t *page_dir, uint32_t vstart, uint32_t pstart, int pag
     //4.在页表项中创建对应的映射关系，并该页权限，页权限以当前权限为主，因为pde处已放宽权限
     pte->v = pstart | privilege | PTE_P;
 
-    //5.将该页引用计数+1
-    page_ref_add(&paddr_alloc, pstart);
+    //5.将该页引用计数+1，内核持有的页不计引用
+    if (!(privilege & PTE_KERNEL)) {
+      page_ref_add(&paddr_alloc, pstart);
+    }
 
     //6.切换为下一页
     vstart += MEM_PAGE_SIZE;
@@ -317,6 +483,7 @@ void create_kernal_table(void) {
     {&s_data, (void*)MEM_EBDA_START, &s_data, PTE_W},    //可读写段的映射关系，一直到bios的拓展数据区(内核.data与.bss段再加上剩余的可用数据区域)
     {(void*)CONSOLE_DISP_START_ADDR, (void*)CONSOLE_DISP_END_ADDR, (void*)CONSOLE_DISP_START_ADDR, PTE_W},//显存区域的映射关系
     {(void*)MEM_EXT_START, (void*)MEM_EXT_END, (void*)MEM_EXT_START, PTE_W}, //将1mb到127mb都映射给操作系统使用
+    {(void*)LAPIC_VADDR, (void*)(LAPIC_VADDR + MEM_PAGE_SIZE), (void*)LAPIC_PADDR, PTE_W | PTE_PCD | PTE_PWT}, //本地APIC的寄存器，禁止缓存
 
   };
 
@@ -331,11 +498,27 @@ void create_kernal_table(void) {
     uint32_t pstart = down2((uint32_t)map->pstart, MEM_PAGE_SIZE);
     //将虚拟地址的结束地址按页大小4kb对齐, 为了不丢失原有的虚拟地址空间，所以向上对齐vend
     uint32_t vend = up2((uint32_t)map->vend, MEM_PAGE_SIZE);
-    //计算该虚拟空间需要的页数
-    int page_count = (vend - vstart) / MEM_PAGE_SIZE;
 
-    //创建内存映射关系
-    memory_creat_map(kernel_page_dir, vstart, pstart, page_count, map->privilege);
+    //内核空间在所有进程中都相同，标记为全局页，切换cr3时不会从TLB中驱逐
+    uint32_t privilege = map->privilege | PTE_G;
+
+    while (vstart < vend) {
+      pde_t *pde = kernel_page_dir + pde_index(vstart);
+
+      if ((vstart & (PDE_LARGE_PAGE_SIZE - 1)) == 0 && (pstart & (PDE_LARGE_PAGE_SIZE - 1)) == 0
+          && vend - vstart >= PDE_LARGE_PAGE_SIZE && !pde->present) {
+        //1.对齐且完整的4mb区域，直接用一个页目录项映射为大页
+        pde->v = pstart | map->privilege | PDE_G | PDE_PS | PDE_P;
+        vstart += PDE_LARGE_PAGE_SIZE;
+        pstart += PDE_LARGE_PAGE_SIZE;
+      } else {
+        //2.未对齐或与其它属性的映射共用同一个4mb区域，按4kb页逐页映射
+        memory_creat_map(kernel_page_dir, vstart, pstart, 1, privilege);
+        vstart += MEM_PAGE_SIZE;
+        pstart += MEM_PAGE_SIZE;
+      }
+    }
+
     //清空内核空间对页的引用
     clear_page_ref(&paddr_alloc);
 
@@ -355,7 +538,7 @@ uint32_t memory_creat_uvm() {
   //TODO:新分配的页并未做虚拟内存映射，会触发缺页异常，需要处理,这里先将1mb以上的所有空间都映射给内核进程
 
   //2.将该页的内容清空
-  kernel_memset((void*)page_dir, 0, MEM_PAGE_SIZE);
+  kernel_memset_page((void*)page_dir);
 
   //3.获取用户进程空间的第一个页目录项索引, 用户进程空间的起始地址MEM_TASK_BASE = 0x800 00000
   uint32_t user_pde_start = pde_index(MEM_TASK_BASE);
@@ -365,11 +548,27 @@ uint32_t memory_creat_uvm() {
       page_dir[i].v = kernel_page_dir[i].v; //所有进程都共享操作系统的页表
   }
 
+  //5.映射应用程序可直接读取的时间与pid数据页
+  if (vsys_map((uint32_t)page_dir) < 0) {
+    memory_destroy_uvm((uint32_t)page_dir);
+    return 0;
+  }
 
   return (uint32_t)page_dir;
 }
 
 
+/**
+ * @brief 当前进程的页表项被降低权限或指向了其它物理页，进程中还有其它线程时，
+ *        它们可能正在其它cpu上使用旧的TLB项，需通知所有cpu刷新TLB并等待完成
+ * 
+ */
+static void memory_shootdown_tlb(void) {
+  if (task_current()->group->threads > 1) {
+    smp_tlb_shootdown();
+  }
+}
+
 /**
  * @brief 拷贝页目录表的映射关系
  * 
@@ -390,43 +589,39 @@ int memory_copy_uvm(uint32_t to_page_dir, uint32_t from_page_dir) {
     //3.获取页目录项指向的页表的起始地址
     pte_t *pte = (pte_t*)pde_to_pt_addr(pde);
 
-    //4.遍历页表的页表项，进行读共享写复制的映射操作
+    //4.遍历页表的页表项，进行读共享写时复制的映射操作
     for (int j = 0; j < PTE_CNT; ++j, ++pte) {
       if (!pte->present)  //当前页表项不存在
         continue;
       
-      //5.获取该页表项对应的虚拟地址
+      //5.获取该页表项对应的虚拟地址，目标进程已在创建时映射了自己的vsys数据页
       uint32_t vaddr = (i << 22) | (j << 12);
+      if (vaddr >= MEM_VSYS_BASE && vaddr < MEM_VSYS_END)
+        continue;
       
       //6.判断当前页表项指向的页是否支持写操作
-      if (pte->v & PTE_W) { //7当前页支持写操作，需进行复制操作
-        //7.1分配一个新的页，进行拷贝
-        uint32_t page = addr_alloc_page(&paddr_alloc, 1);
-        if (page == 0)  //分配失败
-          goto copy_uvm_failed;
-        
-        //7.2在目标进程空间中记录映射关系
-        int err = memory_creat_map((pde_t*)to_page_dir, vaddr, page, 1, get_pte_privilege(pte));
-        if (err < 0)
-          goto copy_uvm_failed;
-        
-        //7.3将该页内容拷贝到目标进程空间中
-        kernel_memcpy((void*)page, (void*)vaddr, MEM_PAGE_SIZE);
-
-      } else {  //8.当前页为只读页，直接共享该页即可，即只复制页表项即可
-        //8.1获取该页的物理地址
-        uint32_t page = pte_to_pg_addr(pte);
-        //8.2直接在目标进程空间中记录映射关系
-        int err = memory_creat_map((pde_t*)to_page_dir, vaddr, page, 1, get_pte_privilege(pte));
-        if (err < 0)
-          goto copy_uvm_failed;
+      if (pte->v & (PTE_W | PTE_COW)) { //7.当前页支持写操作，进行写时复制处理
+        //7.1去除写权限并标记为写时复制页，父子进程共享该页，直到有一方对其进行写操作
+        pte->v = (pte->v & ~PTE_W) | PTE_COW;
       }
 
+      //8.父子进程共享该物理页，只复制页表项即可，memory_creat_map会将该页引用计数+1
+      //8.1获取该页的物理地址
+      uint32_t page = pte_to_pg_addr(pte);
+      //8.2直接在目标进程空间中记录映射关系，并保留写时复制标志
+      int err = memory_creat_map((pde_t*)to_page_dir, vaddr, page, 1, get_pte_privilege(pte) | (pte->v & PTE_COW));
+      if (err < 0)
+        goto copy_uvm_failed;
     }
   }
 
-  return 1;
+  //9.源页表中可写页已被改为只读，刷新TLB，使源进程后续的写操作能触发page_fault
+  if (from_page_dir == read_cr3()) {
+    mmu_set_page_dir(from_page_dir);
+    memory_shootdown_tlb();
+  }
 
+  return 1;
 
 copy_uvm_failed:
   memory_destroy_uvm(to_page_dir);
@@ -434,6 +629,159 @@ copy_uvm_failed:
 }
 
 
+/**
+ * @brief 返回当前进程的页目录表的地址
+ * 
+ * @return pde_t* 
+ */
+static pde_t* curr_page_dir() {
+  return (pde_t*)(task_current()->tss.cr3);
+}
+
+/**
+ * @brief 处理对写时复制页的写操作，由page_fault异常处理程序调用
+ *        若该页只被当前进程引用，则直接恢复写权限，
+ *        否则为当前进程复制一个新页，并将原页的引用计数-1
+ * 
+ * @param vaddr 触发异常的虚拟地址
+ * @return int 0:已处理, -1:不是写时复制页或分配失败
+ */
+int memory_copy_on_write(uint32_t vaddr) {
+  if (vaddr < MEM_TASK_BASE || task_current() == (task_t*)0) {
+    return -1;
+  }
+
+  //1.获取该虚拟地址对应的页表项，同一进程的其它线程可能已在当前线程等待内核锁时完成了复制
+  pte_t *pte = find_pte(curr_page_dir(), vaddr, 0);
+  if (pte && pte->present && (pte->v & PTE_W)) {
+    invlpg(down2(vaddr, MEM_PAGE_SIZE));
+    return 0;
+  }
+
+  //判断是否为写时复制页
+  if (pte == (pte_t*)0 || !pte->present || !(pte->v & PTE_COW)) {
+    return -1;
+  }
+
+  mutex_lock(&paddr_alloc.mutex);
+
+  uint32_t old_page = pte_to_pg_addr(pte);
+  uint32_t privilege = get_pte_privilege(pte) | PTE_W;
+
+  if (get_page_ref(&paddr_alloc, old_page) == 1) {
+    //2.该页已不被其它进程共享，直接恢复写权限即可
+    pte->v = old_page | privilege;
+  } else {
+    //3.该页仍被其它进程共享，为当前进程分配新页并拷贝内容
+    uint32_t new_page = addr_alloc_page(&paddr_alloc, 1);
+    if (new_page == 0) {
+      mutex_unlock(&paddr_alloc.mutex);
+      log_printf("copy on write failed. no memory\n");
+      return -1;
+    }
+
+    //内核空间为一一映射，物理地址即为内核中的虚拟地址
+    kernel_memcpy_page((void*)new_page, (void*)old_page);
+    page_ref_add(&paddr_alloc, new_page);
+    pte->v = new_page | privilege;
+
+    //当前进程不再引用原页
+    addr_free_page(&paddr_alloc, old_page, 1);
+  }
+
+  mutex_unlock(&paddr_alloc.mutex);
+
+  //4.刷新该页在TLB中的缓存，其它线程的TLB中可能还缓存着原页的只读映射
+  invlpg(down2(vaddr, MEM_PAGE_SIZE));
+  memory_shootdown_tlb();
+  return 0;
+}
+
+/**
+ * @brief 为进程记录一块按需分配的内存区域，区域内的页在第一次被访问时才分配
+ * 
+ * @param task 
+ * @param vstart 区域起始虚拟地址
+ * @param vend 区域结束虚拟地址
+ * @param privilege 区域内页的权限
+ * @return int 0:成功, -1:区域表已满
+ */
+int memory_add_region(task_t *task, uint32_t vstart, uint32_t vend, uint32_t privilege) {
+  vstart = down2(vstart, MEM_PAGE_SIZE);
+  vend = up2(vend, MEM_PAGE_SIZE);
+  if (vstart >= vend) {
+    return 0;
+  }
+
+  for (int i = 0; i < TASK_MEM_REGION_COUNT; ++i) {
+    task_mem_region_t *region = task->group->mem_regions + i;
+    if (region->end == 0) {
+      region->start = vstart;
+      region->end = vend;
+      region->privilege = privilege;
+      return 0;
+    }
+  }
+
+  log_printf("task %s: mem region table is full\n", task->name);
+  return -1;
+}
+
+/**
+ * @brief 访问按需分配区域中还未分配的页时，由page_fault异常处理程序调用
+ *        为该页分配一个清零的物理页并建立映射关系
+ * 
+ * @param vaddr 触发异常的虚拟地址
+ * @return int 0:已处理, -1:不属于任何按需分配区域或分配失败
+ */
+int memory_alloc_on_demand(uint32_t vaddr) {
+  task_t *task = task_current();
+  if (vaddr < MEM_TASK_BASE || task == (task_t*)0) {
+    return -1;
+  }
+
+  //1.同一进程的其它线程可能已在当前线程等待内核锁时为该页分配了物理页
+  pte_t *pte = find_pte(curr_page_dir(), vaddr, 0);
+  if (pte && pte->present) {
+    return 0;
+  }
+
+  //2.判断该地址是否在堆区或已记录的区域中，并获取对应的页权限
+  task_group_t *group = task->group;
+  uint32_t privilege = 0;
+  if (vaddr >= group->heap_start && vaddr < group->heap_end) {
+    privilege = PTE_P | PTE_U | PTE_W;
+  } else {
+    for (int i = 0; i < TASK_MEM_REGION_COUNT; ++i) {
+      task_mem_region_t *region = group->mem_regions + i;
+      if (vaddr >= region->start && vaddr < region->end) {
+        privilege = region->privilege;
+        break;
+      }
+    }
+  }
+
+  if (privilege == 0) {
+    return -1;
+  }
+
+  //3.分配一页并清零，内核空间为一一映射，可直接访问
+  uint32_t page = addr_alloc_page(&paddr_alloc, 1);
+  if (page == 0) {
+    log_printf("alloc on demand failed. no memory\n");
+    return -1;
+  }
+  kernel_memset_page((void*)page);
+
+  //4.建立映射关系
+  if (memory_creat_map(curr_page_dir(), down2(vaddr, MEM_PAGE_SIZE), page, 1, privilege) < 0) {
+    addr_free_page(&paddr_alloc, page, 1);
+    return -1;
+  }
+
+  return 0;
+}
+
 /**
  * @brief 销毁该页目录表对应的所有虚拟空间资源，包括映射关系与内存空间
  * 
@@ -458,8 +806,9 @@ void memory_destroy_uvm(uint32_t page_dir) {
       if (!pte->present)
         continue;
       
-      //5.释放该物理页
-      addr_free_page(&paddr_alloc, pte_to_pg_addr(pte), 1);
+      //5.释放该物理页，内核持有的页(如vsys共享页)不属于该进程
+      if (!(pte->v & PTE_KERNEL))
+        addr_free_page(&paddr_alloc, pte_to_pg_addr(pte), 1);
     }
 
     //6.释放存储该页表的物理页
@@ -480,7 +829,7 @@ void memory_destroy_uvm(uint32_t page_dir) {
 void memory_init(boot_info_t *boot_info) {
 
   
-    //声明紧邻内核first_task段后面的空间地址，用于存储位图，该变量定义在kernel.lds中
+    //声明紧邻内核first_task段后面的空间地址，该变量定义在kernel.lds中
     extern char mem_free_start;
 
     log_printf("memory init\n");
@@ -497,23 +846,30 @@ void memory_init(boot_info_t *boot_info) {
     
     log_printf("free memory: 0x%x, size: 0x%x\n", MEM_EXT_START, mem_up1MB_free);
 
-    //mem_free_start被分配的地址在链接文件中定义，紧邻着first_task段
-    uint8_t *mem_free = (uint8_t*)&mem_free_start;
-
     //用paddr_alloc，内存页分配对象管理1mb以上的所有空闲空间，页大小为MEM_PAGE_SIZE=4kb
-    addr_alloc_init(&paddr_alloc, mem_free, MEM_EXT_START, mem_up1MB_free, MEM_PAGE_SIZE);
+    //伙伴系统的管理数据放在1mb处，位于loader已映射的低4mb内，开启内核分页前也可访问
+    addr_alloc_init(&paddr_alloc, MEM_EXT_START, mem_up1MB_free, MEM_PAGE_SIZE);
 
-    //跳过存储位图的内存区域, 位图的每一位表示一个页，计算位图所站的字节数即可跳过该区域
-    mem_free += bitmap_byte_count(paddr_alloc.size / MEM_PAGE_SIZE);  
+    log_printf("page alloc: start: 0x%x, free pages: %d\n", paddr_alloc.start, paddr_alloc.free_count);
 
-    //判断mem_free是否已越过可用数据区
-    ASSERT(mem_free < (uint8_t*)MEM_EBDA_START);
+    //判断内核及first_task段是否已越过可用数据区
+    ASSERT((uint8_t*)&mem_free_start < (uint8_t*)MEM_EBDA_START);
     
     //创建内核的页表映射
     create_kernal_table();
 
-    //设置内核的页目录表到CR3寄存器，并开启分页机制
+    //设置内核的页目录表到CR3寄存器，并开启分页机制，内核页表中使用了4mb大页
+    write_cr4(read_cr4() | CR4_PSE);
     mmu_set_page_dir((uint32_t)kernel_page_dir);
+
+    //开启全局页，内核空间的映射在任务切换时保留在TLB中
+    write_cr4(read_cr4() | CR4_PGE);
+
+    //开启写保护，使内核对用户写时复制页的写操作也能触发page_fault
+    write_cr0(read_cr0() | CR0_WP);
+
+    //初始化内核对象缓存，之后的模块可通过kmalloc分配小块内存
+    kmem_init();
 }
 
 /**
@@ -566,15 +922,6 @@ int memory_alloc_page_for(uint32_t vaddr, uint32_t alloc_size, uint32_t privileg
   return memory_alloc_for_page_dir(task_current()->tss.cr3, vaddr, alloc_size, privilege);
 }
 
-/**
- * @brief 返回当前进程的页目录表的地址
- * 
- * @return pde_t* 
- */
-static pde_t* curr_page_dir() {
-  return (pde_t*)(task_current()->tss.cr3);
-}
-
 
 
 /**
@@ -593,6 +940,37 @@ uint32_t memory_alloc_page() {
 
 
 
+/**
+ * @brief 为内核分配连续的多页内存，需特权级0访问
+ * 
+ * @param page_count 页数
+ * @return uint32_t 内存的起始地址，0：分配失败
+ */
+uint32_t memory_alloc_pages(int page_count) {
+  return addr_alloc_page(&paddr_alloc, page_count);
+}
+
+/**
+ * @brief 分配一页由内核持有的共享页，需以PTE_KERNEL标志映射到进程中，
+ *        映射与进程销毁都不改变其引用计数，该页不会因进程数量而溢出引用或被释放
+ * 
+ * @return uint32_t 页的起始地址，0：分配失败
+ */
+uint32_t memory_alloc_shared_page(void) {
+  return addr_alloc_page(&paddr_alloc, 1);
+}
+
+/**
+ * @brief 释放由memory_alloc_pages分配的连续内核页
+ * 
+ * @param addr 内存的起始地址
+ * @param page_count 页数
+ */
+void memory_free_pages(uint32_t addr, int page_count) {
+  ASSERT(addr < MEM_TASK_BASE);
+  addr_free_page(&paddr_alloc, addr, page_count);
+}
+
 /**
  * @brief 释放一页内存空间
  * 
@@ -636,6 +1014,39 @@ uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr) {
 
 }
 
+/**
+ * @brief 获取虚拟地址对应的可写物理地址，用于内核直接写入其它进程的虚拟空间
+ * 
+ * @param page_dir 
+ * @param vaddr 
+ * @return uint32_t 页不存在或不可写(包括写时复制页)时返回0
+ */
+uint32_t memory_get_write_paddr(uint32_t page_dir, uint32_t vaddr) {
+  pte_t * pte = find_pte((pde_t*)page_dir, vaddr, 0);
+  if (!pte || !pte->present || !pte->write_enable) {
+    return 0;
+  }
+
+  return pte_to_pg_addr(pte) | (vaddr & (MEM_PAGE_SIZE - 1));
+}
+
+/**
+ * @brief  获取当前进程中用户地址对应的物理地址，页还未分配时按需分配
+ *         内核直接经物理地址读取，非法地址不会在持有内核锁时触发缺页异常
+ *
+ * @param vaddr
+ * @return uint32_t 物理地址，0:地址未映射且不属于任何按需分配区域
+ */
+uint32_t memory_get_user_paddr(uint32_t vaddr) {
+  uint32_t page_dir = task_current()->tss.cr3;
+  uint32_t paddr = memory_get_paddr(page_dir, vaddr);
+  if (paddr == 0 && memory_alloc_on_demand(vaddr) == 0) {
+    paddr = memory_get_paddr(page_dir, vaddr);
+  }
+
+  return paddr;
+}
+
 /**
  * @brief 将当前任务的虚拟空间中的内容拷贝到目标虚拟空间中
  * 
@@ -685,7 +1096,8 @@ int memory_copy_uvm_data(uint32_t to_vaddr, uint32_t to_page_dir, uint32_t from_
 char *sys_sbrk(int incr) {
   ASSERT(incr >= 0); //只处理堆区内存增加的情况
   task_t *task = task_current();
-  char * pre_heap_end = (char *)task->heap_end;
+  task_group_t *group = task->group;  //堆空间由进程中的所有线程共享
+  char * pre_heap_end = (char *)group->heap_end;
   int pre_incr = incr;
 
   if (incr == 0) {
@@ -693,13 +1105,13 @@ char *sys_sbrk(int incr) {
     return pre_heap_end;
   }
 
-  uint32_t start = task->heap_end;  //堆区原始末尾位置
+  uint32_t start = group->heap_end;  //堆区原始末尾位置
   uint32_t end = start + incr;  //需要拓展到的末尾位置
 
   uint32_t start_offset = start % MEM_PAGE_SIZE;  //获取末尾位置在当前页内的偏移量
   if (start_offset) { //先将当前页的剩余空间分配出去
     if (start_offset + incr <= MEM_PAGE_SIZE) { //当前页剩余内存可供分配
-      task->heap_end = end; 
+      group->heap_end = end; 
       incr = 0;
     } else {  //当前页剩余内存不够分配
       uint32_t curr_size = MEM_PAGE_SIZE - start_offset;  //获取当前页剩余大小
@@ -709,6 +1121,7 @@ char *sys_sbrk(int incr) {
     }
   }
 
+#if !MEM_DEMAND_PAGING
   if (incr) { //还需要继续拓展
     uint32_t curr_size = end - start; //还需拓展的大小
     int err = memory_alloc_page_for(start, curr_size, PTE_P | PTE_U |  PTE_W);  //为该部分内存创建映射关系
@@ -718,9 +1131,11 @@ char *sys_sbrk(int incr) {
     }
 
   }
+#endif
+  //开启按需分配时只移动堆区的结束位置，新增的页在第一次访问时再分配
 
   log_printf("sbrk(%d): end=0x%x\n", pre_incr, end);
-  task->heap_end = end;
+  group->heap_end = end;
 
   return (char*)pre_heap_end;
 }
\ No newline at end of file
@@ -13,23 +13,32 @@
 
 #include "common/cpu_instr.h"
 #include "common/elf.h"
+#include "core/kmalloc.h"
 #include "core/memory.h"
+#include "core/vsys.h"
+#include "core/timer.h"
+#include "dev/time.h"
+#include "cpu/apic.h"
 #include "cpu/gdt.h"
 #include "cpu/idt.h"
 #include "cpu/mmu.h"
+#include "cpu/smp.h"
 #include "cpu/syscall.h"
 #include "fs/fs.h"
 #include "os_cfg.h"
 #include "tools/assert.h"
 #include "tools/klib.h"
 #include "tools/log.h"
+#include "ipc/futex.h"
+#include "ipc/mutex.h"
+#include "ipc/spinlock.h"
 
 // 定义全局唯一的任务管理器对象
 static task_manager_t task_manager;
-// 定义静态的任务表，用于任务的静态分配
-static task_t task_table[TASK_COUNT];
-// 定义用于维护task_table的互斥锁
-static mutex_t task_table_lock;
+// 定义任务对象缓存，用于任务对象的动态分配
+static kmem_cache_t task_cache;
+// 定义线程组对象缓存，用于线程组对象的动态分配
+static kmem_cache_t group_cache;
 
 /**
  * @brief 根据文件描述符从当前任务进程的打开文件表中返回对应的文件结构指针
@@ -41,7 +50,7 @@ file_t *task_file(int fd) {
   file_t *file = (file_t *)0;
 
   if (fd >= 0 && fd < TASK_OFILE_SIZE) {
-    file = task_current()->file_table[fd];
+    file = task_current()->group->file_table[fd];
   }
 
   return file;
@@ -54,11 +63,11 @@ file_t *task_file(int fd) {
  * @return int 文件描述符
  */
 int task_alloc_fd(file_t *file) {
-  task_t *task = task_current();
+  task_group_t *group = task_current()->group;
   for (int i = 0; i < TASK_OFILE_SIZE; ++i) {
-    file_t *p = task->file_table[i];
+    file_t *p = group->file_table[i];
     if (p == (file_t *)0) {  // 打开文件表中的第i项未分配，对其进行分配操作
-      task->file_table[i] = file;
+      group->file_table[i] = file;
       return i;
     }
   }
@@ -74,24 +83,94 @@ int task_alloc_fd(file_t *file) {
 void task_remove_fd(int fd) {
   // 清空文件描述符对应的内存资源即可
   if (fd >= 0 && fd < TASK_OFILE_SIZE) {
-    task_current()->file_table[fd] = (file_t *)0;
+    task_current()->group->file_table[fd] = (file_t *)0;
   }
 }
 
-static void switch_to_tss(uint16_t tss_selector) {
-  // 进行远跳转，让cpu访问该tss段的描述符，cpu将重启到之前运行该tss对应的任务的状态继续运行该任务
-  far_jump(tss_selector, 0);
-}
+// 定义在start.S中的软件任务切换函数及新任务的入口
+void simple_switch(uint32_t **from, uint32_t **to);
+void task_entry(void);
+void task_fork_entry(void);
 
 /**
- * @brief  将任务从from切换到to
+ * @brief  将任务从from切换到to，调用时当前cpu持有内核锁
  *
  * @param from 切换前的任务
  * @param to 切换后的任务
  */
 void task_switch_from_to(task_t *from, task_t *to) {
-  // 跳转到对应的tss段读取并恢复cpu任务状态
-  switch_to_tss(to->tss_selector);
+  cpu_t *cpu = cpu_current();
+
+  // 1.更新当前cpu的TSS的esp0，使to从3特权级进入内核时使用自己的内核栈
+  cpu->tss.esp0 = to->tss.esp0;
+
+  // 2.地址空间不同时才切换页目录表，内核任务也切换到自己的页目录表，
+  // 不能沿用上一个任务的页表，否则该任务退出或execve后其页目录表被释放时仍是当前cpu的cr3
+  // 任务在其它cpu上运行过时，该cpu的TLB中可能还有其修改前的映射，需重新加载页目录表
+  if (to->tss.cr3 != read_cr3() || to->last_cpu != cpu->id) {
+    mmu_set_page_dir(to->tss.cr3);
+  }
+  to->last_cpu = cpu->id;
+
+  // 3.保存当前任务持有内核锁的深度，内核锁在切换过程中一直由当前cpu持有
+  from->lock_depth = kernel_lock_depth();
+
+  // 4.保存当前任务的内核栈并切换到目标任务的内核栈
+  simple_switch(&from->kernel_esp, &to->kernel_esp);
+
+  // 5.from再次被切换到时从此处继续执行，此时可能已在其它cpu上
+  task_switch_finish();
+}
+
+/**
+ * @brief  任务切换完成后恢复当前任务持有内核锁的深度，任务不在内核中时释放内核锁
+ *         新任务第一次被切换到时由task_entry或task_fork_entry调用
+ *
+ */
+void task_switch_finish(void) {
+  kernel_lock_set_depth(task_current()->lock_depth);
+}
+
+/**
+ * @brief  在任务的栈中构造第一次被切换到时的上下文，
+ *         simple_switch返回到task_entry后，由iret进入任务入口
+ *
+ * @param task
+ * @param flag 任务属性标志位，如特权级
+ */
+static void task_stack_init(task_t *task, uint32_t flag) {
+  uint32_t *stack;
+
+  // 1.压入iret需要的栈帧，用户任务在内核栈中构造并切换到用户栈，内核任务直接使用其自己的栈
+  if (flag & TASK_FLAGS_SYSTEM) {
+    stack = (uint32_t *)task->tss.esp;
+  } else {
+    stack = (uint32_t *)task->tss.esp0;
+    *(--stack) = task->tss.ss;
+    *(--stack) = task->tss.esp;
+  }
+  *(--stack) = task->tss.eflags;
+  *(--stack) = task->tss.cs;
+  *(--stack) = task->tss.eip;
+
+  // 2.压入popa恢复的8个通用寄存器
+  for (int i = 0; i < 8; ++i) {
+    *(--stack) = 0;
+  }
+
+  // 3.压入段寄存器，task_entry依次弹出gs, fs, es, ds
+  *(--stack) = task->tss.ds;
+  *(--stack) = task->tss.es;
+  *(--stack) = task->tss.fs;
+  *(--stack) = task->tss.gs;
+
+  // 4.压入simple_switch的返回地址及其恢复的ebp, ebx, esi, edi
+  *(--stack) = (uint32_t)task_entry;
+  for (int i = 0; i < 4; ++i) {
+    *(--stack) = 0;
+  }
+
+  task->kernel_esp = stack;
 }
 
 /**
@@ -103,20 +182,11 @@ void task_switch_from_to(task_t *from, task_t *to) {
  * @param flag 任务属性标志位，如特权级
  */
 static int tss_init(task_t *task, uint32_t entry, uint32_t esp, uint32_t flag) {
-  // 1.将该TSS段绑定到GDT中的某个段描述符
-  uint32_t tss_selector = gdt_alloc_desc();
-  if (tss_selector < 0) {
-    log_printf("alloc tss failed!\n");
-    return -1;
-  }
-  segment_desc_set(tss_selector, (uint32_t)&task->tss, sizeof(task->tss),
-                   SEG_ATTR_P | SEG_ATTR_DPL_0 | SEG_ATTR_TYPE_TSS);
-
+  // 1.任务的tss只作为上下文记录，不再绑定GDT描述符，任务数量不受GDT大小限制
   // 2.将tss段的值置空
   kernel_memset(&task->tss, 0, sizeof(task->tss));
 
-  // 3.记录tss绑定到的描述符的选择子
-  task->tss_selector = tss_selector;
+  // 3.所有任务共用任务管理器中的TSS，切换时只更新其esp0
 
   // 4.根据任务的特权级来设置对应选择子的cpl
   uint32_t code_selector, data_selector;
@@ -141,6 +211,11 @@ static int tss_init(task_t *task, uint32_t entry, uint32_t esp, uint32_t flag) {
   else
     task->tss.esp0 = kernel_stack + MEM_PAGE_SIZE;  // 特权级为0的栈空间
 
+  // 内核线程未指定栈时直接使用其内核栈，栈顶预留入口函数的返回地址与参数
+  if ((flag & TASK_FLAGS_SYSTEM) && esp == 0) {
+    task->tss.esp = task->tss.esp0 - TASK_KTHREAD_ARG_SIZE;
+  }
+
   // 7.平坦模型，初始化栈空间段寄存器
   task->tss.ss = data_selector;  // 特权级为3时使用的栈段
   task->tss.ss0 =
@@ -156,23 +231,28 @@ static int tss_init(task_t *task, uint32_t entry, uint32_t esp, uint32_t flag) {
   // 10.初始化eflags寄存器，使cpu中断保持开启
   task->tss.eflags = EFLAGS_DEFAULT_1 | EFLAGS_IF;
 
-  // 11.创建当前进程的虚拟页目录表，并设置cr3寄存器
-  uint32_t page_dir = memory_creat_uvm();
-  if (page_dir == 0) goto tss_init_failed;
-  task->tss.cr3 = page_dir;
+  // 11.创建当前进程的虚拟页目录表，并设置cr3寄存器，线程的cr3由调用者设置为线程组的页目录表
+  if (!(flag & TASK_FLAGS_THREAD)) {
+    uint32_t page_dir = memory_creat_uvm();
+    if (page_dir == 0) goto tss_init_failed;
+    task->tss.cr3 = page_dir;
+  }
+
+  // 12.构造任务第一次被切换到时的栈上下文
+  task_stack_init(task, flag);
 
   return 0;
 
 // tss初始化失败
 tss_init_failed:
-  gdt_free(tss_selector);  // 释放选择子
-
   if (kernel_stack) {  // 内核栈空间分配有效，需要释放
     memory_free_page(kernel_stack);
   }
   return -1;
 }
 
+static int task_select_cpu(void);
+
 /**
  * @brief 将任务插入任务链表中并设为就绪态，标志该任务可被调度
  *
@@ -181,13 +261,216 @@ tss_init_failed:
 void task_start(task_t *task) {
   idt_state_t state = idt_enter_protection();  // TODO:加锁
 
-  //将任务设置为就绪态
+  //将任务分配给就绪任务最少的cpu，并设置为就绪态
+  task->cpu = task_select_cpu();
   task_set_ready(task);
   task->state = TASK_READY;
 
   idt_leave_protection(state);  // TODO:解锁
 }
 
+/**
+ * @brief  获取优先级对应的时间片数，优先级每降低一级时间片数翻倍
+ *
+ * @param priority
+ * @return int
+ */
+static inline int task_priority_slice(int priority) {
+  return TASK_TIME_SLICE_MIN << priority;
+}
+
+/**
+ * @brief  获取当前cpu的调度队列，调用者需已关中断，防止中途被切换到其它cpu
+ *
+ * @return task_rq_t*
+ */
+static inline task_rq_t *this_rq(void) {
+  return task_manager.rqs + cpu_id();
+}
+
+/**
+ * @brief  获取任务实际调度使用的优先级，即自身优先级与继承的优先级中较高的一个
+ *         任务在就绪队列中时两者都不会被直接修改，插入与取下时总能得到同一个队列
+ *
+ * @param task
+ * @return int
+ */
+int task_sched_priority(task_t *task) {
+  return task->inherit_priority < task->priority ? task->inherit_priority : task->priority;
+}
+
+/**
+ * @brief  将任务插入其所属cpu的当前优先级就绪队列的尾部，并在就绪位图中标记该队列非空
+ *
+ * @param task
+ */
+static void ready_list_insert(task_t *task) {
+  task_rq_t *rq = task_manager.rqs + task->cpu;
+  int priority = task_sched_priority(task);
+  list_insert_last(&rq->ready_lists[priority], &task->ready_node);
+  rq->ready_bitmap |= (1 << priority);
+  rq->ready_count++;
+}
+
+/**
+ * @brief  将任务从其所属cpu的当前优先级就绪队列中取下，队列为空时清除就绪位图中的标记
+ *
+ * @param task
+ */
+static void ready_list_remove(task_t *task) {
+  task_rq_t *rq = task_manager.rqs + task->cpu;
+  int priority = task_sched_priority(task);
+  list_t *list = &rq->ready_lists[priority];
+  list_remove(list, &task->ready_node);
+  if (list_is_empty(list)) {
+    rq->ready_bitmap &= ~(1 << priority);
+  }
+  rq->ready_count--;
+}
+
+/**
+ * @brief  设置任务从互斥锁等待者继承的优先级，任务在就绪队列中时移入新的优先级队列
+ *         没有因等待资源离开就绪队列的任务都在其所属cpu的就绪队列中，包括正在运行的任务
+ *
+ * @param task
+ * @param priority 继承的优先级，为TASK_PRIORITY_COUNT表示不继承
+ */
+void task_set_inherit_priority(task_t *task, int priority) {
+  if (task->inherit_priority == priority) {
+    return;
+  }
+
+  if (task->blocked) {
+    task->inherit_priority = priority;
+    return;
+  }
+
+  ready_list_remove(task);
+  task->inherit_priority = priority;
+  ready_list_insert(task);
+}
+
+/**
+ * @brief  为新任务选择就绪任务最少的已启动cpu，数量相同时优先选择当前cpu
+ *
+ * @return int
+ */
+static int task_select_cpu(void) {
+  int best = cpu_id();
+  for (int i = 0; i < smp_cpu_count(); ++i) {
+    if (smp_cpu(i)->started &&
+        task_manager.rqs[i].ready_count < task_manager.rqs[best].ready_count) {
+      best = i;
+    }
+  }
+
+  return best;
+}
+
+/**
+ * @brief  任务延时定时器到期的回调函数，在时钟中断中将任务重新加入就绪队列
+ *
+ * @param arg 延时的任务
+ */
+static void task_sleep_timeout(void *arg) {
+  task_t *task = (task_t *)arg;
+
+  // 时间轮只精确到时间片边界，还未到期时继续用高精度定时器定时剩余的部分
+  if (time_hrtimer_start(&task->sleep_timer, task->sleep_deadline) == 0) {
+    return;
+  }
+
+  task->state = TASK_CREATED;
+  task_set_ready(task);
+}
+
+/**
+ * @brief  为任务创建新的线程组，任务成为该组的主线程，线程组接管tss_init为其创建的页目录表
+ *
+ * @param leader
+ * @return task_group_t*
+ */
+static task_group_t *task_group_create(task_t *leader) {
+  task_group_t *group = (task_group_t *)kmem_cache_alloc(&group_cache);
+  if (group == (task_group_t *)0) {
+    return group;
+  }
+
+  kernel_memset(group, 0, sizeof(task_group_t));
+  group->refs = group->threads = 1;
+  group->leader = leader;
+  group->page_dir = leader->tss.cr3;
+  list_init(&group->members);
+  list_insert_last(&group->members, &leader->group_node);
+
+  return group;
+}
+
+/**
+ * @brief  将线程加入线程组，与组内其它线程共用同一个页目录表
+ *
+ * @param task 以TASK_FLAGS_THREAD初始化的任务
+ * @param group
+ */
+static void task_group_join(task_t *task, task_group_t *group) {
+  group->refs++;
+  group->threads++;
+  list_insert_last(&group->members, &task->group_node);
+  task->group = group;
+  task->tss.cr3 = group->page_dir;
+}
+
+/**
+ * @brief  释放任务对线程组的引用，最后一个引用被释放时销毁整个地址空间
+ *
+ * @param group
+ */
+static void task_group_put(task_group_t *group) {
+  if (--group->refs > 0) {
+    return;
+  }
+
+  if (group->page_dir) {
+    memory_destroy_uvm(group->page_dir);
+  }
+  kmem_cache_free(&group_cache, group);
+}
+
+/**
+ * @brief  根据pid在散列表中查找任务
+ *
+ * @param pid
+ * @return task_t* 没有该任务时为0
+ */
+task_t *task_find(int pid) {
+  list_t *bucket = &task_manager.pid_hash[(uint32_t)pid % TASK_PID_HASH_SIZE];
+  for (list_node_t *node = list_get_first(bucket); node; node = list_node_next(node)) {
+    task_t *task = list_node_parent(node, task_t, pid_node);
+    if (task->pid == pid) {
+      return task;
+    }
+  }
+
+  return (task_t *)0;
+}
+
+/**
+ * @brief  为任务分配一个未被使用的pid，并将任务加入pid散列表
+ *
+ * @param task
+ */
+static void task_alloc_pid(task_t *task) {
+  do {
+    if (++task_manager.next_pid <= 0) {
+      task_manager.next_pid = 1;
+    }
+  } while (task_find(task_manager.next_pid));
+
+  task->pid = task_manager.next_pid;
+  list_insert_last(&task_manager.pid_hash[(uint32_t)task->pid % TASK_PID_HASH_SIZE],
+                   &task->pid_node);
+}
+
 /**
  * @brief  初始化任务
  *
@@ -204,6 +487,17 @@ int task_init(task_t *task, const char *name, uint32_t entry, uint32_t esp,
   int err = tss_init(task, entry, esp, flag);
   if (err == -1) return err;
 
+  // 线程由调用者加入创建者的线程组，其它任务创建自己的线程组
+  task->group = (task_group_t *)0;
+  if (!(flag & TASK_FLAGS_THREAD)) {
+    task->group = task_group_create(task);
+    if (task->group == (task_group_t *)0) {
+      memory_destroy_uvm(task->tss.cr3);
+      memory_free_page(task->tss.esp0 - MEM_PAGE_SIZE);
+      return -1;
+    }
+  }
+
   // 2.初始化任务名称
   kernel_strncpy(task->name, name, TASK_NAME_SIZE);
 
@@ -211,18 +505,32 @@ int task_init(task_t *task, const char *name, uint32_t entry, uint32_t esp,
   list_node_init(&task->ready_node);
   list_node_init(&task->task_node);
   list_node_init(&task->wait_node);
-
-  // 4.初始化最大时间片数与当前拥有时间片数,以及延时时间片数
+  list_node_init(&task->child_node);
+  list_init(&task->children);
+  list_init(&task->wait_list);
+  task->wait_child = (task_t *)0;
+  timer_init(&task->sleep_timer, task_sleep_timeout, task);
+
+  // 4.初始化优先级，最大时间片数与当前拥有时间片数,以及延时时间片数
+  // 新任务从最高优先级开始运行，若为计算型任务会在用完时间片后逐级降低
   task->state = TASK_CREATED;
-  task->slice_max = task->slice_curr = TASK_TIME_SLICE_DEFAULT;
-  task->sleep = 0;
-  task->pid = (uint32_t)task;
+  task->priority = task->nice = 0;
+  task->blocked = 0;
+  task->inherit_priority = TASK_PRIORITY_COUNT;
+  list_init(&task->held_mutexes);
+  task->wait_mutex = (struct _mutex_t *)0;
+  task->slice_max = task->slice_curr = task_priority_slice(task->priority);
+  task->cpu = task->last_cpu = 0;
+  task->lock_depth = 0;
+  task->trace = 0;
+  task_alloc_pid(task);
+  if (!(flag & TASK_FLAGS_THREAD)) {
+    vsys_set_pid(task->tss.cr3, task->pid);
+  }
   task->parent = (task_t *)0;
-  task->heap_start = task->heap_end = 0;
   task->status = 0;
 
-  // 5.初始化文件表
-  kernel_memset(&task->file_table, 0, sizeof(task->file_table));
+  // 5.堆空间、按需分配区域与文件表由线程组在创建时清空
 
   // 6.将任务加入任务队列
   list_insert_last(&task_manager.task_list, &task->task_node);
@@ -231,6 +539,7 @@ int task_init(task_t *task, const char *name, uint32_t entry, uint32_t esp,
 }
 
 
+static task_t *alloc_task(void);
 static void free_task(task_t* task);
 /**
  * @brief 反初始化任务对象，释放对应的资源
@@ -238,26 +547,29 @@ static void free_task(task_t* task);
  * @param task
  */
 void task_uninit(task_t *task) {
-  //释放已分配的选择子
-  if (task->tss_selector) {  
-    gdt_free(task->tss_selector);
-  }
-
   //释放已分配的内核栈空间
   if (task->tss.esp0) {  
     memory_free_page((uint32_t)(task->tss.esp0 - MEM_PAGE_SIZE));
   }
   
-  //释放为页目录分配的页空间及其映射关系
-  if (task->tss.cr3) {  
-    memory_destroy_uvm(task->tss.cr3);
+  //离开线程组并释放对线程组的引用，最后一个引用释放时销毁页目录表及其映射关系
+  if (task->group) {
+    list_remove(&task->group->members, &task->group_node);
+    task_group_put(task->group);
   }
 
+  //将任务从pid散列表中取下，其pid可被再次分配
+  list_remove(&task_manager.pid_hash[(uint32_t)task->pid % TASK_PID_HASH_SIZE],
+              &task->pid_node);
+
+
+  //取消还未到期的延时定时器
+  timer_remove(&task->sleep_timer);
 
   //将任务结构从任务管理器的任务队列中取下
   list_remove(&task_manager.task_list, &task->task_node);
   
-  //释放全局任务表中的task结构资源
+  //将task结构归还给任务对象缓存
   free_task(task);
 }
 
@@ -279,37 +591,53 @@ static void empty_task(void) {
  *
  */
 void task_manager_init(void) {
-  // 1.初始化应用程序及所有任务的代码段选择子和数据段选择子，以区分和内核选择子的特权级
+  // 1.记录应用程序的代码段选择子和数据段选择子，以区分和内核选择子的特权级
   // 应用程序运行在 DPL_3 下，
   // 内核运行在DPL_0下，配合分页机制中的us位，0为内核特权级，1为用户特权级
-  // 就可做到特权级保护
-  uint32_t data_selector = gdt_alloc_desc();
-  uint32_t code_selector = gdt_alloc_desc();
-  segment_desc_set(data_selector, 0, 0xffffffff,
-                   SEG_ATTR_P | SEG_ATTR_DPL_3 | SEG_ATTR_S_NORMAL |
-                       SEG_ATTR_TYPE_DATA | SEG_ATTR_TYPE_RW | SEG_ATTR_D_OR_B);
-  segment_desc_set(code_selector, 0, 0xffffffff,
-                   SEG_ATTR_P | SEG_ATTR_DPL_3 | SEG_ATTR_S_NORMAL |
-                       SEG_ATTR_TYPE_CODE | SEG_ATTR_TYPE_RW | SEG_ATTR_D_OR_B);
-  task_manager.app_code_selector = code_selector;
-  task_manager.app_data_selector = data_selector;
-
-  // 2.初始化所有任务队列
-  list_init(&task_manager.ready_list);
+  // 就可做到特权级保护，两个段描述符已由gdt_init设置在sysexit要求的固定位置
+  task_manager.app_code_selector = APP_SELECTOR_CS;
+  task_manager.app_data_selector = APP_SELECTOR_DS;
+
+  // 2.每个cpu的TSS已由smp_cpu_init初始化，只有ss0与esp0会被cpu使用
+
+  // 3.初始化每个cpu的调度队列，并将其当前任务置零
+  for (int cpu = 0; cpu < SMP_CPU_MAX; ++cpu) {
+    task_rq_t *rq = task_manager.rqs + cpu;
+    for (int i = 0; i < TASK_PRIORITY_COUNT; ++i) {
+      list_init(&rq->ready_lists[i]);
+    }
+    rq->ready_bitmap = 0;
+    rq->ready_count = 0;
+    rq->curr_task = rq->idle_task = (task_t *)0;
+  }
+  task_manager.boost_ticks = TASK_BOOST_TICKS;
   list_init(&task_manager.task_list);
-  list_init(&task_manager.sleep_list);
 
-  // 3.将当前任务置零
-  task_manager.curr_task = (task_t *)0;
+  // 4.初始化任务对象缓存与pid散列表
+  kmem_cache_init(&task_cache, "task_t", sizeof(task_t));
+  kmem_cache_init(&group_cache, "task_group_t", sizeof(task_group_t));
+  for (int i = 0; i < TASK_PID_HASH_SIZE; ++i) {
+    list_init(&task_manager.pid_hash[i]);
+  }
+  task_manager.next_pid = 0;
 
-  // 4.初始化空闲进程
+  // 5.初始化BSP的空闲进程
   task_init(&task_manager.empty_task, "empty_task", (uint32_t)empty_task,
             (uint32_t)&empty_task_stack[EMPTY_TASK_STACK_SIZE],
             TASK_FLAGS_SYSTEM);
-
-  // 5.初始化静态任务表,及其互斥锁
-  kernel_memset(task_table, 0, sizeof(task_table));
-  mutex_init(&task_table_lock);
+  task_manager.rqs[0].idle_task = &task_manager.empty_task;
+
+  // 6.初始化每个AP的空闲进程，AP启动后直接在其栈上运行，成为该AP的当前任务
+  for (int cpu = 1; cpu < smp_cpu_count(); ++cpu) {
+    task_t *idle = alloc_task();
+    uint32_t stack = memory_alloc_page();
+    ASSERT(idle != (task_t *)0 && stack != 0);
+
+    task_init(idle, "empty_task", (uint32_t)empty_task, stack + MEM_PAGE_SIZE,
+              TASK_FLAGS_SYSTEM);
+    idle->cpu = idle->last_cpu = cpu;
+    task_manager.rqs[cpu].idle_task = task_manager.rqs[cpu].curr_task = idle;
+  }
 }
 
 /**
@@ -374,21 +702,23 @@ void task_first_init(void) {
             task_start_addr + alloc_size, TASK_FLAGS_USER);
 
   // 4.初始化进程的起始堆空间
-  task_manager.first_task.heap_start =
+  task_manager.first_task.group->heap_start =
       (uint32_t)e_first_task;  // 堆起始地址紧靠程序bss段之后
-  task_manager.first_task.heap_end = (uint32_t)e_first_task;  // 堆大小初始为0
+  task_manager.first_task.group->heap_end = (uint32_t)e_first_task;  // 堆大小初始为0
 
-  // 5.将当前任务的TSS选择子告诉cpu，用来切换任务时保存状态
-  write_tr(task_manager.first_task.tss_selector);
+  // 5.将BSP的TSS的选择子告诉cpu，并设置第一个任务的内核栈，用于特权级提升时切换栈
+  cpu_t *cpu = cpu_current();
+  cpu->tss.esp0 = task_manager.first_task.tss.esp0;
+  write_tr(cpu->tss_selector);
 
-  // 6.将当前任务执行第一个任务
-  task_manager.curr_task = &task_manager.first_task;
+  // 6.将当前任务执行第一个任务，第一个任务固定运行在BSP上
+  task_manager.rqs[0].curr_task = &task_manager.first_task;
 
   // 7.将当前页表设置为第一个任务的页表
   mmu_set_page_dir(task_manager.first_task.tss.cr3);
 
   // 8.将当前任务状态设置为运行态
-  task_manager.curr_task->state = TASK_RUNNING;
+  task_manager.first_task.state = TASK_RUNNING;
 
   // 9.进程的各个段还只是在虚拟地址中，所以要为各个段分配物理地址页空间，并进行映射
   memory_alloc_page_for(task_start_addr, alloc_size, PTE_P | PTE_W | PTE_U);
@@ -396,8 +726,10 @@ void task_first_init(void) {
   // 10.将任务进程各个段从内核四个段之后的紧邻位置，拷贝到已分配好的且与虚拟地址对应的物理地址空间，实现代码隔离
   kernel_memcpy(first_task_entry, s_first_task, alloc_size);
 
-  // 11.将任务设为可被调度
-  task_start(&task_manager.first_task);
+  // 11.将任务设为可被调度，第一个任务已在BSP上运行，直接加入BSP的就绪队列
+  idt_state_t state = idt_enter_protection();
+  task_set_ready(&task_manager.first_task);
+  idt_leave_protection(state);
 }
 
 /**
@@ -408,73 +740,237 @@ void task_first_init(void) {
 task_t *task_first_task(void) { return &task_manager.first_task; }
 
 /**
- * @brief  将任务task加入就绪队列
+ * @brief  将任务task加入其所属cpu的就绪队列，该cpu正在运行空闲进程或更低优先级的任务时通知其重新调度
  *
  * @param task 需要加入就绪队列的任务
  */
 void task_set_ready(task_t *task) {
   ASSERT(task != (task_t *)0);
   // if (task == (task_t*)0) return;
-  // 1.将任务插入到就绪队列的尾部
-  list_insert_last(&task_manager.ready_list, &task->ready_node);
+  // 1.任务因等待资源离开过就绪队列，视为交互型任务，提升一级优先级并重置时间片
+  if (task->blocked) {
+    task->blocked = 0;
+    if (task->priority > task->nice) {
+      task->priority--;
+    }
+    task->slice_max = task->slice_curr = task_priority_slice(task->priority);
+  }
+
+  // 2.将任务插入到对应优先级就绪队列的尾部
+  ready_list_insert(task);
+
+  // 3.任务属于其它cpu时，向该cpu发送重新调度中断，当前cpu的调度由调用者负责
+  task_rq_t *rq = task_manager.rqs + task->cpu;
+  if (task->cpu != cpu_id() && lapic_enabled() &&
+      (rq->curr_task == rq->idle_task ||
+       task_sched_priority(rq->curr_task) > task_sched_priority(task))) {
+    lapic_send_ipi(smp_cpu(task->cpu)->apic_id, IRQ_RESCHEDULE);
+  }
 
-  // 2.将任务状态设置为就绪态
+  // 4.将任务状态设置为就绪态
   // task->state = TASK_READY;
 }
 
 /**
- * @brief  将任务task从就绪队列中取下
+ * @brief  将任务task从就绪队列中取下，并标记其正在等待资源
  *
  * @param task
  */
 void task_set_unready(task_t *task) {
   ASSERT(task != (task_t *)0);
   // if (task == (task_t*)0) return;
-  list_remove(&task_manager.ready_list, &task->ready_node);
+  ready_list_remove(task);
+  task->blocked = 1;
 }
 
 /**
- * @brief  获取就绪队列中的第一个任务
+ * @brief  获取当前cpu就绪队列中的第一个任务，通过就绪位图直接找到最高优先级的非空队列
  *
  */
 task_t *task_ready_first(void) {
-  list_node_t *ready_node = list_get_first(&task_manager.ready_list);
+  task_rq_t *rq = this_rq();
+  if (rq->ready_bitmap == 0) {
+    return (task_t *)0;
+  }
+
+  list_t *list = &rq->ready_lists[bsf(rq->ready_bitmap)];
+  list_node_t *ready_node = list_get_first(list);
 
   return list_node_parent(ready_node, task_t, ready_node);
 }
 
 /**
- * @brief  获取当前正在运行的任务
+ * @brief  当前cpu没有就绪任务时，从等待运行的任务最多的cpu窃取一个优先级最高且未在运行的任务
+ *
+ * @return task_t* 窃取到的任务，已移入当前cpu的就绪队列，没有可窃取的任务时为0
+ */
+static task_t *task_steal(void) {
+  int self = cpu_id();
+
+  // 1.找到等待运行的任务最多的cpu，正在运行的任务也在就绪队列中，不计入等待的任务数
+  int busiest = -1, max_wait = 0;
+  for (int i = 0; i < smp_cpu_count(); ++i) {
+    task_rq_t *rq = task_manager.rqs + i;
+    int wait = rq->ready_count - (rq->curr_task != rq->idle_task ? 1 : 0);
+    if (i != self && smp_cpu(i)->started && wait > max_wait) {
+      busiest = i;
+      max_wait = wait;
+    }
+  }
+  if (busiest < 0) {
+    return (task_t *)0;
+  }
+
+  // 2.从最高优先级开始查找第一个不在运行的任务，将其迁移到当前cpu
+  task_rq_t *rq = task_manager.rqs + busiest;
+  for (int level = 0; level < TASK_PRIORITY_COUNT; ++level) {
+    for (list_node_t *node = list_get_first(&rq->ready_lists[level]); node;
+         node = list_node_next(node)) {
+      task_t *task = list_node_parent(node, task_t, ready_node);
+      if (task != rq->curr_task) {
+        ready_list_remove(task);
+        task->cpu = self;
+        ready_list_insert(task);
+        return task;
+      }
+    }
+  }
+
+  return (task_t *)0;
+}
+
+/**
+ * @brief  优先级提升，将所有cpu上的任务恢复到其基础优先级，防止低优先级任务长期得不到运行
+ *
+ */
+static void task_priority_boost(void) {
+  // 1.将各级就绪队列中低于基础优先级的任务移到其基础优先级队列的尾部
+  for (int cpu = 0; cpu < smp_cpu_count(); ++cpu) {
+    for (int level = 1; level < TASK_PRIORITY_COUNT; ++level) {
+      list_node_t *node = list_get_first(&task_manager.rqs[cpu].ready_lists[level]);
+      while (node) {
+        list_node_t *next = list_node_next(node);
+        task_t *task = list_node_parent(node, task_t, ready_node);
+        if (task->nice < level) {
+          ready_list_remove(task);
+          task->priority = task->nice;
+          task->slice_max = task->slice_curr = task_priority_slice(task->priority);
+          ready_list_insert(task);
+        }
+        node = next;
+      }
+    }
+  }
+
+  // 2.不在就绪队列中的任务直接修改优先级，再次就绪时即进入基础优先级队列
+  list_node_t *node = list_get_first(&task_manager.task_list);
+  while (node) {
+    task_t *task = list_node_parent(node, task_t, task_node);
+    if (task->priority != task->nice) {
+      task->priority = task->nice;
+      task->slice_max = task->slice_curr = task_priority_slice(task->priority);
+    }
+    node = list_node_next(node);
+  }
+}
+
+/**
+ * @brief  判断处理定时器中断的BSP是否只有空闲进程可以运行
+ *
+ * @return int
+ */
+int task_is_idle(void) {
+  task_rq_t *rq = task_manager.rqs;
+  return rq->curr_task == rq->idle_task && rq->ready_bitmap == 0;
+}
+
+/**
+ * @brief  有比当前任务优先级更高的任务就绪时立即切换，用于时间片之间唤醒任务的中断
  *
+ */
+void task_preempt(void) {
+  task_t *first = task_ready_first();
+  if (first && first != this_rq()->curr_task) {
+    task_switch();
+  }
+}
+
+/**
+ * @brief  获取当前cpu正在运行的任务，读取期间关中断，防止被切换到其它cpu后读到其它cpu的任务
+ *
+ * @return task_t*
+ */
+task_t *task_current(void) {
+  uint32_t eflags = read_eflags();
+  cli();
+  task_t *curr = this_rq()->curr_task;
+  write_eflags(eflags);
+
+  return curr;
+}
+
+/**
+ * @brief  获取cpu的空闲进程
+ *
+ * @param cpu
  * @return task_t*
  */
-task_t *task_current(void) { return task_manager.curr_task; }
+task_t *task_idle_task(int cpu) {
+  return task_manager.rqs[cpu].idle_task;
+}
 
 /**
- * @brief  任务管理器进行任务切换
+ * @brief  AP完成初始化后调用，当前执行流成为该AP的空闲进程，不会返回
+ *
+ */
+void task_ap_enter(void) {
+  idt_state_t state = idt_enter_protection();
+
+  task_rq_t *rq = this_rq();
+  rq->curr_task = rq->idle_task;
+  rq->idle_task->state = TASK_RUNNING;
+  cpu_current()->started = 1;
+
+  idt_leave_protection(state);
+
+  sti();
+  empty_task();
+}
+
+/**
+ * @brief  任务管理器进行任务切换，当前cpu没有就绪任务时先尝试从其它cpu窃取任务
  *
  */
 void task_switch(void) {
   idt_state_t state = idt_enter_protection();  // TODO:加锁
 
   // 1.获取就绪队列中的第一个任务
+  task_rq_t *rq = this_rq();
   task_t *to = task_ready_first();
+  if (to == (task_t *)0) {
+    to = task_steal();
+  }
 
   // 2.若获取到的任务不是当前任务就进行切换
-  if (to != task_manager.curr_task) {
+  if (to != rq->curr_task) {
     // 3.获取当前任务
-    task_t *from = task_manager.curr_task;
+    task_t *from = rq->curr_task;
 
     // 4.目标任务若为空，则所有任务都在延时，让cpu运行空闲任务
     if (to == (task_t *)0) {
-      to = &task_manager.empty_task;
+      to = rq->idle_task;
     }
     // 5.切换当前任务, 并将当前任务置为运行态
     to->state = TASK_RUNNING;
     if (from->state == TASK_RUNNING) {
       from->state = TASK_READY;
     } 
-    task_manager.curr_task = to;
+    rq->curr_task = to;
+
+    // BSP离开空闲进程时恢复周期时钟
+    if (from == &task_manager.empty_task) {
+      time_reprogram();
+    }
 
     // 6.进行任务切换
     task_switch_from_to(from, to);
@@ -486,115 +982,98 @@ void task_switch(void) {
 /**
  * @brief  提供给时钟中断使用，每中断一次，当前任务的时间片使用完一次
  *         减少当前任务的时间片数，并判断是否还有剩余时间片，若没有就进行任务切换
+ *         延时到期的任务已在此之前由定时器唤醒
  *
  */
 void task_slice_end(void) {
-  // 1.遍历当前延时队列，判断是否有可唤醒的任务
-  list_node_t *curr_sleep_node = list_get_first(&task_manager.sleep_list);
-
-  // 2.遍历并判断每一个任务执行完当前时间片是否可被唤醒，若可以则唤醒
-  while (curr_sleep_node) {
-    list_node_t *next_sleep_node = list_node_next(curr_sleep_node);
-
-    task_t *curr_sleep_task =
-        list_node_parent(curr_sleep_node, task_t, ready_node);
-    if (--curr_sleep_task->sleep == 0) {
-      task_set_wakeup(curr_sleep_task);  // 从延时队列中取下
-      task_set_ready(curr_sleep_task);   // 加入就绪队列
-    }
-
-    curr_sleep_node = next_sleep_node;
+  // 1.优先级提升周期由BSP计时，到期后将所有cpu上的任务恢复到其基础优先级
+  if (cpu_id() == 0 && --task_manager.boost_ticks == 0) {
+    task_manager.boost_ticks = TASK_BOOST_TICKS;
+    task_priority_boost();
   }
 
-  // task_switch(); 没有必要立马进行任务切换，当前任务时间片用完后会自动切换
-  // 3.获取当前任务
-  task_t *curr_task = task_current();
-
-  // 4.若当前任务为空闲任务，则判断就绪队列是否为空
-  if (curr_task == &task_manager.empty_task) {
-    if (list_is_empty(&task_manager.ready_list)) return;
+  // 2.获取当前任务
+  task_rq_t *rq = this_rq();
+  task_t *curr_task = rq->curr_task;
 
-    task_manager.empty_task.state = TASK_CREATED;
-
-    task_switch();  // 就绪队列有任务，则直接切换任务
+  // 3.若当前任务为空闲任务，则切换到就绪队列中的任务，或从其它cpu窃取任务
+  if (curr_task == rq->idle_task) {
+    task_switch();
+    return;
   }
 
-  // 5.若当前任务为普通任务则，减小当前时间片数
-  if (curr_task != &task_manager.empty_task && --curr_task->slice_curr == 0) {
-    // 6.时间片数用完了，重置时间片并进行任务切换
-    curr_task->slice_curr = curr_task->slice_max;
-    task_set_unready(curr_task);
-    task_set_ready(curr_task);
+  // 4.若当前任务为普通任务则，减小当前时间片数
+  if (--curr_task->slice_curr == 0) {
+    // 5.时间片数用完了，视为计算型任务，降低一级优先级并获得该级的时间片，再进行任务切换
+    ready_list_remove(curr_task);
+    if (curr_task->priority < TASK_PRIORITY_COUNT - 1) {
+      curr_task->priority++;
+    }
+    curr_task->slice_max = curr_task->slice_curr =
+        task_priority_slice(curr_task->priority);
+    ready_list_insert(curr_task);
+    task_switch();
+  } else if (task_ready_first() != curr_task) {
+    // 6.有更高优先级的任务被唤醒或优先级被提升，抢占当前任务
     task_switch();
   }
 }
 
 /**
- * @brief  设置进程延时的时间片数
+ * @brief  设置进程延时的时间，进程需已离开就绪队列
  *
  * @param task 需要延时的进程
- * @param slice 延时的时间片数
+ * @param ms 延时的时间，以ms为单位，不超过TASK_SLEEP_MAX_MS
  */
-void task_set_sleep(task_t *task, uint32_t slice) {
-  ASSERT(task != (task_t *)0);
-  if (slice == 0) return;
+void task_set_sleep(task_t *task, uint32_t ms) {
+  ASSERT(task != (task_t *)0 && ms <= TASK_SLEEP_MAX_MS);
 
-  task->sleep = slice;
+  // 1.以振荡次数计算到期时间，不再取整到时间片边界
   task->state = TASK_SLEEP;
-  list_insert_last(&task_manager.sleep_list, &task->ready_node);
+  task->sleep_deadline = time_now() + ms * TIME_CYCLES_PER_MS;
+
+  // 2.启动任务的延时定时器，到期后由task_sleep_timeout唤醒任务，已到期则直接唤醒
+  if (time_hrtimer_start(&task->sleep_timer, task->sleep_deadline) < 0) {
+    task->state = TASK_CREATED;
+    task_set_ready(task);
+  }
 }
 
 /**
- * @brief  唤醒正在延时的进程
+ * @brief  提前唤醒正在延时的进程，取消其延时定时器，但不将其加入就绪队列
  *
  * @param task
  */
 void task_set_wakeup(task_t *task) {
   ASSERT(task != (task_t *)0);
-  list_remove(&task_manager.sleep_list, &task->ready_node);
+  timer_remove(&task->sleep_timer);
   task->state = TASK_CREATED;
 }
 
 /**
- * @brief 从静态任务表中分配一个任务对象
+ * @brief 从任务对象缓存中分配一个任务对象
  *
  * @return task_t*
  */
 static task_t *alloc_task(void) {
-  task_t *task = 0;
-
-  //TODO:加锁
-  mutex_lock(&task_table_lock);
-
-  // 遍历静态任务表，取出未被分配的任务对象空间
-  for (int i = 0; i < TASK_COUNT; ++i) {
-    task_t *curr = task_table + i;
-    if (curr->pid == 0) {
-      task = curr;
-      break;
-    }
+  task_t *task = (task_t *)kmem_cache_alloc(&task_cache);
+  if (task) {
+    kernel_memset(task, 0, sizeof(task_t));
   }
 
-  //TODO:解锁
-  mutex_unlock(&task_table_lock);
-
   return task;
 }
 
 /**
- * @brief 释放静态任务表的任务对象
+ * @brief 将任务对象归还给任务对象缓存
  *
  * @param task
  */
 static void free_task(task_t *task) {
-  //TODO:加锁
-  mutex_lock(&task_table_lock);
-
   task->pid = 0;
   task->parent = (task_t*)0;
 
-  //TODO:解锁
-  mutex_unlock(&task_table_lock);
+  kmem_cache_free(&task_cache, task);
 }
 
 /**
@@ -608,17 +1087,20 @@ void sys_sleep(uint32_t ms) {
   // 1.获取当前任务
   task_t *curr_task = task_current();
 
-  // 2.将当前任务离开就绪队列
-  task_set_unready(curr_task);
+  // 2.到期时间以振荡次数计算，过长的延时分多次进行，防止时间差值溢出
+  do {
+    uint32_t curr_ms = ms > TASK_SLEEP_MAX_MS ? TASK_SLEEP_MAX_MS : ms;
+    ms -= curr_ms;
 
-  // 3.计算出需要延时的时间片数，对时间片数向上取整，保证进程至少能延时指定时间
-  uint32_t slice = (ms + (OS_TICKS_MS - 1)) / OS_TICKS_MS;
+    // 3.将当前任务离开就绪队列
+    task_set_unready(curr_task);
 
-  // 4.将当前任务放入延时队列，并设置延时时间片数
-  task_set_sleep(curr_task, slice);
+    // 4.将当前任务设为延时态，并启动其延时定时器
+    task_set_sleep(curr_task, curr_ms);
 
-  // 5.切换任务
-  task_switch();
+    // 5.切换任务
+    task_switch();
+  } while (ms && !curr_task->group->exiting);  // 进程正在退出时提前结束延时
 
   idt_leave_protection(state);  // TODO:解锁
 }
@@ -637,12 +1119,12 @@ int sys_getpid(void) { return task_current()->pid; }
  * @param child_task 
  */
 static void copy_opened_files(task_t *child_task) {
-  task_t *parent = task_current();
+  task_group_t *parent = task_current()->group;
   for (int i = 0; i < TASK_OFILE_SIZE; ++i) {
     file_t *file = parent->file_table[i];
     if (file) {
       file_inc_ref(file);
-      child_task->file_table[i] = file;
+      child_task->group->file_table[i] = file;
     }
   }
 }
@@ -669,52 +1151,65 @@ int sys_fork(void) {
   int err = task_init(child_task, parent_task->name, frame->eip,
                       frame->esp + sizeof(uint32_t) * SYSCALL_PARAM_COUNT,
                       TASK_FLAGS_USER);
-  if (err < 0) goto fork_failed;
+  if (err < 0) {  // tss初始化失败时已自行释放资源，只需归还任务对象
+    free_task(child_task);
+    child_task = (task_t *)0;
+    goto fork_failed;
+  }
 
   //让子进程继承父进程的打开文件表
   copy_opened_files(child_task);
 
+  //让子进程继承父进程的基础优先级
+  child_task->priority = child_task->nice = parent_task->nice;
+  child_task->slice_max = child_task->slice_curr =
+      task_priority_slice(child_task->priority);
+
 
-  // 5.恢复到父进程的上下文环境
-  tss_t *tss = &(child_task->tss);
+  // 5.将父进程的系统调用栈帧复制到子进程内核栈的相同位置，子进程从调用门返回时恢复到父进程的上下文环境
+  syscall_frame_t *child_frame =
+      (syscall_frame_t *)(child_task->tss.esp0 - sizeof(syscall_frame_t));
+  kernel_memcpy(child_frame, frame, sizeof(syscall_frame_t));
   // 子进程执行的第一条指令就是从eax中取出系统用的返回值，即进程id，子进程固定获取0
-  tss->eax = 0;
-  tss->ebx = frame->ebx;
-  tss->ecx = frame->ecx;
-  tss->edx = frame->edx;
-  tss->edi = frame->edi;
-  tss->esi = frame->esi;
-  tss->eflags = frame->eflags;
-  tss->ebp = frame->ebp;
-
-  // 复用父进程的段寄存器
-  tss->cs = frame->cs;
-  tss->ds = frame->ds;
-  tss->es = frame->es;
-  tss->fs = frame->fs;
-  tss->gs = frame->gs;
-  tss->ss = frame->ss;
-
-  // 记录父进程地址
-  child_task->parent = parent_task;
+  child_frame->eax = 0;
+
+  // 6.构造子进程第一次被切换到时的内核栈，simple_switch返回到系统调用的返回流程，
+  // 此时栈顶为系统调用入口压入的栈帧地址，之后为栈帧本身
+  // 子进程与父进程一样处于系统调用中，持有一层内核锁，在返回流程中释放
+  uint32_t *stack = (uint32_t *)child_frame;
+  *(--stack) = (uint32_t)child_frame;
+  *(--stack) = (uint32_t)task_fork_entry;
+  for (int i = 0; i < 4; ++i) {  // simple_switch恢复的ebp, ebx, esi, edi
+    *(--stack) = 0;
+  }
+  child_task->kernel_esp = stack;
+  child_task->lock_depth = 1;
+
+  // 记录父进程地址，由线程fork出的子进程也属于其所在进程
+  child_task->parent = parent_task->group->leader;
 
   //记录父进程堆空间
-  child_task->heap_start = parent_task->heap_start;
-  child_task->heap_end = parent_task->heap_end;
+  task_group_t *child_group = child_task->group, *parent_group = parent_task->group;
+  child_group->heap_start = parent_group->heap_start;
+  child_group->heap_end = parent_group->heap_end;
+
+  //继承父进程的按需分配区域，未被访问过的页在父子进程中都还未分配
+  kernel_memcpy(child_group->mem_regions, parent_group->mem_regions,
+                sizeof(child_group->mem_regions));
 
   // 7.拷贝进程虚拟页目录表和页表，即拷贝其映射关系
-  if (memory_copy_uvm(tss->cr3, parent_task->tss.cr3) < 0) goto fork_failed;
+  if (memory_copy_uvm(child_task->tss.cr3, parent_task->tss.cr3) < 0) goto fork_failed;
 
-  // 8.子进程控制块初始化完毕，设为可被调度态
+  // 8.子进程控制块初始化完毕，加入父进程的子进程队列，并设为可被调度态
+  list_insert_last(&child_task->parent->children, &child_task->child_node);
   task_start(child_task);
   // 反回子进程id
   return child_task->pid;
 
 // fork失败，清理资源
 fork_failed:
-  if (child_task) {  // 初始化失败，释放对应资源
+  if (child_task) {  // 初始化失败，释放对应资源，task_uninit会一并归还任务对象
     task_uninit(child_task);
-    free_task(child_task);
   }
 
   return -1;
@@ -728,40 +1223,89 @@ fork_failed:
 int sys_yield(void) {
   idt_state_t state = idt_enter_protection();  // TODO:加锁
 
-  // 1.判断当前就绪队列中是否有多个任务
-  if (list_get_size(&task_manager.ready_list) > 1) {
-    // 2.获取当前任务
-    task_t *curr_task = task_current();
+  // 1.获取当前任务
+  task_t *curr_task = task_current();
 
-    // 3.将当前任务从就绪队列中取下
-    task_set_unready(curr_task);
+  // 2.将当前任务移到同一优先级就绪队列的队尾，主动让出cpu不改变优先级
+  ready_list_remove(curr_task);
+  ready_list_insert(curr_task);
 
-    // 4.将当前任务重新加入到就绪队列的队尾
-    task_set_ready(curr_task);
+  // 3.任务管理器运行下一个任务，没有其它同级或更高优先级任务时仍运行当前任务
+  task_switch();
 
-    // 5.任务管理器运行下一个任务，从而释放cpu使用权
-    task_switch();
+  idt_leave_protection(state);  // TODO:解锁
+  return 0;
+}
+
+/**
+ * @brief  调整当前任务的基础优先级，inc为正时降低优先级，为负时提高优先级
+ *
+ * @param inc 基础优先级的增量
+ * @return int 调整后的基础优先级
+ */
+int sys_nice(int inc) {
+  idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+  // 1.计算新的基础优先级，并限制在有效范围内
+  task_t *curr_task = task_current();
+  int nice = curr_task->nice + inc;
+  if (nice < 0) {
+    nice = 0;
+  } else if (nice >= TASK_PRIORITY_COUNT) {
+    nice = TASK_PRIORITY_COUNT - 1;
   }
+  curr_task->nice = nice;
+
+  // 2.将当前任务直接移入新的基础优先级队列
+  ready_list_remove(curr_task);
+  curr_task->priority = nice;
+  curr_task->slice_max = curr_task->slice_curr = task_priority_slice(nice);
+  ready_list_insert(curr_task);
+
+  // 3.优先级降低后可能有更高优先级的任务可以运行
+  task_switch();
 
   idt_leave_protection(state);  // TODO:解锁
-  return 0;
+  return nice;
 }
 
 /**
  * @brief 将elf文件的程序段表项对应的程序段加载到page_dir对应的地址空间中
  *
+ * @param task 加载该程序段的任务，用于记录按需分配区域
  * @param file elf文件描述符
  * @param elf_phdr  程序段表项
  * @param page_dir 需要加载到的目标空间的页目录表地址
  * @return int
  */
-static int load_phdr(int file, Elf32_Phdr *elf_phdr, uint32_t page_dir) {
+static int load_phdr(task_t *task, int file, Elf32_Phdr *elf_phdr,
+                     uint32_t page_dir) {
   // 获取该段的权限
   uint32_t privilege = PTE_P | PTE_U;
   if (elf_phdr->p_flags & PT_W) {  // 该段具有写权限
     privilege |= PTE_W;
   }
 
+#if MEM_DEMAND_PAGING
+  // 只为含有文件内容的页分配页空间并创建映射关系，
+  // 剩余的bss部分记录为按需分配区域，在第一次访问时再分配清零的页
+  uint32_t vstart = down2(elf_phdr->p_vaddr, MEM_PAGE_SIZE);
+  uint32_t file_end = elf_phdr->p_filesz
+                          ? up2(elf_phdr->p_vaddr + elf_phdr->p_filesz, MEM_PAGE_SIZE)
+                          : vstart;
+  int err = memory_alloc_for_page_dir(page_dir, vstart, file_end - vstart,
+                                      privilege);
+  if (err < 0) {
+    log_printf("no memory\n");
+    return -1;
+  }
+
+  err = memory_add_region(task, file_end, elf_phdr->p_vaddr + elf_phdr->p_memsz,
+                          privilege);
+  if (err < 0) {
+    return -1;
+  }
+#else
   // 为该段分配页空间并创建映射关系
   int err = memory_alloc_for_page_dir(page_dir, elf_phdr->p_vaddr,
                                       elf_phdr->p_memsz, privilege);
@@ -769,6 +1313,7 @@ static int load_phdr(int file, Elf32_Phdr *elf_phdr, uint32_t page_dir) {
     log_printf("no memory\n");
     return -1;
   }
+#endif
 
   // 使文件的读取位置偏移到该程序段的起始位置
   if (sys_lseek(file, elf_phdr->p_offset, 0) < 0) {
@@ -867,15 +1412,15 @@ static uint32_t load_elf_file(task_t *task, const char *name,
     }
 
     // 加载该程序段
-    int err = load_phdr(file, &elf_phdr, page_dir);
+    int err = load_phdr(task, file, &elf_phdr, page_dir);
     if (err < 0) {
       log_printf("load program failed\n");
       goto load_failed;
     }
 
     // 更新堆空间的位置，紧靠最后一个可加载段
-    task->heap_start = elf_phdr.p_vaddr + elf_phdr.p_memsz;
-    task->heap_end = task->heap_start;
+    task->group->heap_start = elf_phdr.p_vaddr + elf_phdr.p_memsz;
+    task->group->heap_end = task->group->heap_start;
   }
 
   // 成功解析并加载完整个elf文件后关闭文件，并返回程序入口地址
@@ -949,11 +1494,21 @@ static int copy_args(uint32_t to_page_dir, char *stack_top, char *const *argv,
  * @return int
  */
 int sys_execve(char *name, char *const *argv, char *const *env) {
-  // 1.获取当前任务进程
+  // 1.获取当前任务进程，进程中还有其它线程时不能替换其地址空间
   task_t *task = task_current();
+  task_group_t *group = task->group;
+  if (group->threads > 1) {
+    log_printf("execve: task %s has other threads\n", task->name);
+    return -1;
+  }
 
-  // 2.获取当前任务的页目录表
+  // 2.获取当前任务的页目录表，并保存原进程的内存区域记录，以便加载失败时恢复
   uint32_t old_page_dir = task->tss.cr3;
+  uint32_t old_heap_start = group->heap_start;
+  uint32_t old_heap_end = group->heap_end;
+  task_mem_region_t old_regions[TASK_MEM_REGION_COUNT];
+  kernel_memcpy(old_regions, group->mem_regions, sizeof(old_regions));
+  kernel_memset(group->mem_regions, 0, sizeof(group->mem_regions));
 
   // 3.创建一个新的页目录表
   uint32_t new_page_dir = memory_creat_uvm();
@@ -966,9 +1521,19 @@ int sys_execve(char *name, char *const *argv, char *const *env) {
 
   // 5.为新进程分配用户栈空间
   uint32_t stack_top = MEM_TASK_STACK_TOP - MEM_TASK_ARG_SIZE;
+#if MEM_DEMAND_PAGING
+  // 只为入口参数区分配页空间，其余栈空间在第一次访问时再分配
+  int err = memory_alloc_for_page_dir(new_page_dir, stack_top,
+                                      MEM_TASK_ARG_SIZE, PTE_P | PTE_U | PTE_W);
+  if (err < 0) goto exec_failed;
+
+  err = memory_add_region(task, MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE,
+                          stack_top, PTE_P | PTE_U | PTE_W);
+#else
   int err = memory_alloc_for_page_dir(
       new_page_dir, MEM_TASK_STACK_TOP - MEM_TASK_STACK_SIZE,
       MEM_TASK_STACK_SIZE, PTE_P | PTE_U | PTE_W);
+#endif
 
   if (err < 0) goto exec_failed;
 
@@ -995,13 +1560,17 @@ int sys_execve(char *name, char *const *argv, char *const *env) {
   kernel_strncpy(task->name, get_file_name(name), TASK_NAME_SIZE);
 
   // 11.记录并设置新页目录表，并销毁原页目录表的虚拟映射关系
-  task->tss.cr3 = new_page_dir;
+  vsys_set_pid(new_page_dir, task->pid);
+  task->tss.cr3 = group->page_dir = new_page_dir;
   mmu_set_page_dir(new_page_dir);
   memory_destroy_uvm(old_page_dir);
   return 0;
 
 exec_failed:
   // 执行失败，释放资源并恢复到原进程状态
+  group->heap_start = old_heap_start;
+  group->heap_end = old_heap_end;
+  kernel_memcpy(group->mem_regions, old_regions, sizeof(old_regions));
   if (new_page_dir) {
     task->tss.cr3 = old_page_dir;
     mmu_set_page_dir(old_page_dir);
@@ -1011,71 +1580,139 @@ exec_failed:
 }
 
 /**
- * @brief 任务进程主动退出
+ * @brief 判断子进程的所有线程是否都已退出，可以被父进程回收
  *
+ * @param child 子进程的主线程
+ * @return int
  */
-void sys_exit(int status) {
-  // 1.获取当前任务
-  task_t *curr_task = task_current();
+static inline int task_reapable(task_t *child) {
+  return child->group->threads == 0;
+}
 
-  // 2.关闭当前任务打开的文件
-  for (int fd = 0; fd < TASK_OFILE_SIZE; ++fd) {
-    file_t *file = curr_task->file_table[fd];
-    if (file) {
-      sys_close(fd);
-      curr_task->file_table[fd] = (file_t *)0;
+/**
+ * @brief 子进程的所有线程都已退出，直接唤醒一个正在等待的父进程线程并交给它回收，
+ *        没有线程在等待时放到父进程子进程队列的头部，调用者需已将其从子进程队列中取下
+ *
+ * @param child 子进程的主线程
+ */
+static void task_child_exited(task_t *child) {
+  task_t *parent = child->parent;
+
+  list_node_t *node = list_remove_first(&parent->wait_list);
+  if (node) {
+    task_t *waiter = list_node_parent(node, task_t, wait_node);
+    waiter->wait_child = child;
+    waiter->wait_queue = (list_t *)0;
+    task_set_ready(waiter);
+    waiter->state = TASK_READY;
+  } else {
+    list_insert_first(&parent->children, &child->child_node);
+  }
+}
+
+/**
+ * @brief 唤醒任务等待队列中的所有任务
+ *
+ * @param task
+ */
+static void task_wakeup_waiters(task_t *task) {
+  list_node_t *node;
+  while ((node = list_remove_first(&task->wait_list)) != (list_node_t *)0) {
+    task_t *waiter = list_node_parent(node, task_t, wait_node);
+    waiter->wait_queue = (list_t *)0;
+    task_set_ready(waiter);
+    waiter->state = TASK_READY;
+  }
+}
+
+/**
+ * @brief 进程只剩一个还未退出的线程时，将其pid写入vsys数据页
+ *
+ * @param group
+ * @param exiting 正在退出的线程，其状态还未被设置为僵尸态
+ */
+static void task_group_single_pid(task_group_t *group, task_t *exiting) {
+  for (list_node_t *node = list_get_first(&group->members); node; node = list_node_next(node)) {
+    task_t *task = list_node_parent(node, task_t, group_node);
+    if (task != exiting && task->state != TASK_ZOMBIE) {
+      vsys_set_pid(group->page_dir, task->pid);
+      return;
     }
   }
+}
 
-  //3.将该进程的子进程的父进程设为first_task，由其进行统一回收
-  int move_child = 0; //标志位，判断是否当前进程已有子进程进入僵尸态
-  //TODO:加锁
-  mutex_lock(&task_table_lock);
-  for (int i = 0; i < TASK_COUNT; ++i) {
-    task_t *task = task_table + i;
-    if (task->parent == curr_task) {
-      task->parent = &task_manager.first_task;
-      if (task->state == TASK_ZOMBIE) { //已有子进程提前退出进入僵尸态，则设置标志位
-        move_child = 1;
+/**
+ * @brief 当前线程退出并进入僵尸态，内核栈与对线程组的引用在被回收时才释放
+ *        进程的最后一个线程退出时关闭打开的文件，将子进程交给first_task，并通知父进程
+ *
+ * @param status 线程退出的状态值
+ */
+static void task_exit(int status) {
+  // 1.获取当前任务及其所属的进程
+  task_t *curr_task = task_current();
+  task_group_t *group = curr_task->group;
+  task_t *leader = group->leader;
+  int last = (--group->threads == 0);
+
+  // 2.进程的最后一个线程关闭进程打开的文件
+  if (last) {
+    for (int fd = 0; fd < TASK_OFILE_SIZE; ++fd) {
+      file_t *file = group->file_table[fd];
+      if (file) {
+        sys_close(fd);
+        group->file_table[fd] = (file_t *)0;
       }
     }
+
+    //进程不是经exit退出时，以最后退出的线程的状态值作为进程的状态值
+    if (!group->exiting) {
+      group->status = status;
+    }
   }
-  //TODO:解锁
-  mutex_unlock(&task_table_lock);
- 
 
   // TODO:加锁
   idt_state_t state = idt_enter_protection();
 
+  if (last) {
+    //3.将该进程的子进程逐个交给first_task，已退出的子进程由其直接回收
+    task_t *first_task = &task_manager.first_task;
+    list_node_t *node;
+    while ((node = list_remove_first(&leader->children)) != (list_node_t *)0) {
+      task_t *child = list_node_parent(node, task_t, child_node);
+      child->parent = first_task;
+      if (task_reapable(child)) {
+        task_child_exited(child);
+      } else {
+        list_insert_last(&first_task->children, &child->child_node);
+      }
+    }
 
-  // 4.获取父进程，判断父进程是否在等待回收子进程资源
-  task_t *parent = (task_t *)curr_task->parent;
-  
-  if (move_child && (parent != &task_manager.first_task)) {  
-    //当前进程的父进程不是first_task,
-    //需要对first_task进行唤醒，以使first_task
-    //对当前进程的提前死亡的子进程进行资源回收
-    if (task_manager.first_task.state == TASK_WAITTING) {
-      task_set_ready(&task_manager.first_task);
+    // 4.通知父进程回收当前进程，内核任务没有父进程
+    if (leader->parent) {
+      list_remove(&leader->parent->children, &leader->child_node);
+      task_child_exited(leader);
     }
+  } else {
+    // 4.进程中还有其它线程，唤醒正在等待回收当前线程的线程
+    task_wakeup_waiters(curr_task);
 
+    //只剩一个线程时，应用程序可重新从vsys数据页中直接读取该线程的pid
+    if (group->threads == 1) {
+      task_group_single_pid(group, curr_task);
+    }
   }
-  
 
-  if (parent->state ==
-      TASK_WAITTING) {  // 父进程处于阻塞并等待回收子进程资源的状态，需要唤醒父进程
-    task_set_ready(parent);
-    parent->state = TASK_READY;
-  }
+  // 5.释放线程仍持有的互斥锁，线程对象被回收后不能再作为锁的拥有者
+  mutex_release_all(curr_task);
 
-  // 3.设置进程状态标志为僵尸态并保存状态值
+  // 6.设置线程状态标志为僵尸态并保存状态值
   curr_task->state = TASK_ZOMBIE;
   curr_task->status = status;
 
-  // 5.将任务进程从就绪队列中取下
+  // 7.将线程从就绪队列中取下
   task_set_unready(curr_task);
 
-  // 6.切换任务进程
+  // 8.切换任务进程
   task_switch();
 
   // TODO:解锁
@@ -1083,54 +1720,306 @@ void sys_exit(int status) {
 }
 
 /**
- * @brief 回收进程资源
+ * @brief 将进程中可被中断地等待或正在延时的其它线程唤醒，使其返回用户态前经task_exit_check退出
+ *        在互斥锁、磁盘等有限时间内就会完成的等待上阻塞的线程，等待结束后同样会退出
+ *
+ * @param group
+ */
+static void task_group_interrupt(task_group_t *group) {
+  task_t *curr_task = task_current();
+
+  // TODO:加锁
+  idt_state_t state = idt_enter_protection();
+
+  for (list_node_t *node = list_get_first(&group->members); node; node = list_node_next(node)) {
+    task_t *task = list_node_parent(node, task_t, group_node);
+    if (task == curr_task) {
+      continue;
+    }
+
+    if (task->wait_queue) {
+      // 1.从所在的等待队列中取下，并标记等待被中断
+      list_remove(task->wait_queue, &task->wait_node);
+      task->wait_queue = (list_t *)0;
+      task->wait_intr = 1;
+      task_set_ready(task);
+      task->state = TASK_READY;
+    } else if (task->state == TASK_SLEEP) {
+      // 2.取消延时
+      task_set_wakeup(task);
+      task_set_ready(task);
+    }
+  }
+
+  // TODO:解锁
+  idt_leave_protection(state);
+}
+
+/**
+ * @brief 任务进程主动退出，进程中的其它线程在返回用户态前随之退出
+ *
+ */
+void sys_exit(int status) {
+  task_group_t *group = task_current()->group;
+  if (!group->exiting) {
+    group->exiting = 1;
+    group->status = status;
+
+    //唤醒在用户空间地址上等待的其它线程，使其随之退出
+    futex_wake_group(group);
+
+    //唤醒在管道、终端、子进程或线程退出上等待以及正在延时的其它线程
+    task_group_interrupt(group);
+  }
+
+  task_exit(status);
+}
+
+/**
+ * @brief 只退出当前线程，最后一个线程退出时进程随之结束
+ *
+ * @param status 线程退出的状态值，由sys_thread_join获取
+ */
+void sys_thread_exit(int status) {
+  task_exit(status);
+}
+
+/**
+ * @brief  进程已被其中的某个线程经exit退出时，使当前线程随之退出
+ *         在系统调用返回及时钟中断从用户态进入时调用，此时线程不持有除内核锁外的任何资源
+ *
+ */
+void task_exit_check(void) {
+  task_group_t *group = task_current()->group;
+  if (group->exiting) {
+    task_exit(group->status);
+  }
+}
+
+/**
+ * @brief  当前任务进入可被进程退出中断的等待，由唤醒者将其从等待队列中取下并清除wait_queue，
+ *         调用者需已获取内核锁
+ *
+ * @param queue 等待队列
+ * @return int 0:被唤醒, -1:进程正在退出，未进入等待或等待被中断
+ */
+int task_wait_intr(list_t *queue) {
+  task_t *curr_task = task_current();
+  if (curr_task->group->exiting) {
+    return -1;
+  }
+
+  // 1.进入等待队列并记录，进程退出时由task_group_interrupt取下
+  curr_task->wait_intr = 0;
+  curr_task->wait_queue = queue;
+  list_insert_last(queue, &curr_task->wait_node);
+  task_set_unready(curr_task);
+  curr_task->state = TASK_WAITTING;
+  task_switch();
+
+  // 2.被唤醒后判断等待是否被中断
+  curr_task->wait_queue = (list_t *)0;
+  return curr_task->wait_intr ? -1 : 0;
+}
+
+/**
+ * @brief 回收进程中所有已退出的线程，最后回收主线程
+ *
+ * @param leader 进程的主线程
+ */
+static void task_group_reap(task_t *leader) {
+  list_t *members = &leader->group->members;
+  list_node_t *node = list_get_first(members);
+  while (node) {
+    list_node_t *next = list_node_next(node);
+    task_t *task = list_node_parent(node, task_t, group_node);
+    if (task != leader) {
+      task_uninit(task);
+    }
+    node = next;
+  }
+
+  task_uninit(leader);
+}
+
+/**
+ * @brief 回收进程资源，已退出的子进程总在子进程队列头部，
+ *        没有时在父进程的等待队列中等待，由退出的子进程直接唤醒
  *
  * @param status 传入参数，记录被回收的进程状态值
- * @return int  被回收的进程的pid
+ * @return int  被回收的进程的pid，等待被进程退出中断时为-1
  */
 int sys_wait(int *status) {
-  // 1.获取当前进程
+  // 1.获取当前进程，进程中的任何线程都可以回收该进程的子进程
   task_t *curr_task = task_current();
+  task_t *leader = curr_task->group->leader;
+  task_t *child = (task_t *)0;
 
-  for (;;) {
-    // TODO:加锁
-    mutex_lock(&task_table_lock);
-
-    // 2.遍历任务表,寻找子进程
-    for (int i = 0; i < TASK_COUNT; ++i) {
-      task_t *task = task_table + i;
-      if (task->pid == 0 || task->parent != curr_task) {
-        continue;
-      }
-      // 3.找到一个子进程，判断是否为僵尸态
-      if (task->state == TASK_ZOMBIE) {  // 僵尸态，进行资源回收
-        int pid = task->pid;
-        *status = task->status;
+  // TODO:加锁
+  idt_state_t state = idt_enter_protection();
+
+  while (child == (task_t *)0) {
+    // 2.子进程队列头部为已退出的子进程时直接回收
+    list_node_t *node = list_get_first(&leader->children);
+    if (node && task_reapable(list_node_parent(node, task_t, child_node))) {
+      list_remove(&leader->children, node);
+      child = list_node_parent(node, task_t, child_node);
+      break;
+    }
+
+    // 3.没有已退出的子进程，当前线程进入父进程的等待队列，进程正在退出时放弃等待
+    curr_task->wait_child = (task_t *)0;
+    if (task_wait_intr(&leader->wait_list) < 0) {
+      break;
+    }
+
+    // 4.被退出的子进程唤醒，并直接获得该子进程
+    child = curr_task->wait_child;
+  }
+
+  // 5.释放子进程的所有线程
+  int pid = -1;
+  if (child) {
+    pid = child->pid;
+    *status = child->group->status;
+    task_group_reap(child);
+  }
+
+  // TODO:解锁
+  idt_leave_protection(state);
+
+  return pid;
+}
+
+/**
+ * @brief 在当前进程中创建一个线程，与进程中的其它线程共享页目录表、堆空间与打开文件表
+ *
+ * @param entry 线程在用户空间的入口地址
+ * @param stack 线程的用户栈顶，由调用者分配，栈顶已放好入口函数的返回地址与参数
+ * @return int 线程的id，失败时为-1
+ */
+int sys_clone(uint32_t entry, uint32_t stack) {
+  // 1.进程正在退出时不再创建线程
+  task_t *parent_task = task_current();
+  task_group_t *group = parent_task->group;
+  if (group->exiting) {
+    return -1;
+  }
+
+  // 2.分配线程控制块，不创建新的页目录表
+  task_t *thread = alloc_task();
+  if (thread == (task_t *)0) {
+    return -1;
+  }
+
+  int err = task_init(thread, parent_task->name, entry, stack,
+                      TASK_FLAGS_USER | TASK_FLAGS_THREAD);
+  if (err < 0) {  // tss初始化失败时已自行释放资源，只需归还任务对象
+    free_task(thread);
+    return -1;
+  }
+
+  // 3.加入当前进程的线程组，并继承创建者的基础优先级与系统调用跟踪
+  // 进程有多个线程后，应用程序不能再从vsys数据页中直接读取pid
+  task_group_join(thread, group);
+  vsys_set_pid(group->page_dir, 0);
+  thread->priority = thread->nice = parent_task->nice;
+  thread->trace = parent_task->trace;
+  thread->slice_max = thread->slice_curr = task_priority_slice(thread->priority);
+
+  // 4.线程初始化完毕，设为可被调度态
+  task_start(thread);
+  return thread->pid;
+}
+
+/**
+ * @brief 等待同一进程中的线程退出并回收其资源
+ *
+ * @param tid 线程id，不能是主线程或当前线程
+ * @param status 传出参数，记录线程退出的状态值，可以为0
+ * @return int 0:成功, -1:进程中没有该线程或等待被进程退出中断
+ */
+int sys_thread_join(int tid, int *status) {
+  task_t *curr_task = task_current();
+  task_group_t *group = curr_task->group;
+  int err = -1;
 
-        //释放任务
-        task_uninit(task);
+  // TODO:加锁
+  idt_state_t state = idt_enter_protection();
 
-        // TODO:解锁
-        mutex_unlock(&task_table_lock);
+  for (;;) {
+    // 1.通过pid散列表查找同一进程中的目标线程
+    task_t *thread = task_find(tid);
+    if (thread == (task_t *)0 || thread->group != group ||
+        thread == curr_task || thread == group->leader) {
+      break;
+    }
 
-        // 3.4返回该进程的pid
-        return pid;
+    // 2.线程已退出，进行资源回收
+    if (thread->state == TASK_ZOMBIE) {
+      if (status) {
+        *status = thread->status;
       }
+      task_uninit(thread);
+      err = 0;
+      break;
     }
 
-    // TODO:解锁
-    mutex_unlock(&task_table_lock);
+    // 3.线程还未退出，当前线程进入该线程的等待队列，由其退出时唤醒，进程正在退出时放弃等待
+    if (task_wait_intr(&thread->wait_list) < 0) {
+      break;
+    }
+  }
 
-    // 4.未找到僵尸态的子进程，则当前进程进入阻塞状态
-    // TODO:加锁
-    idt_state_t state = idt_enter_protection();
+  // TODO:解锁
+  idt_leave_protection(state);
+  return err;
+}
 
-    task_set_unready(curr_task);
-    curr_task->state = TASK_WAITTING;
-    task_switch();
+/**
+ * @brief  内核线程的入口函数返回后到达此处，退出当前线程，由first_task回收
+ *
+ */
+static void kthread_exit(void) {
+  // 内核任务运行时不持有内核锁，退出前先获取，之后不会再返回
+  idt_enter_protection();
+  sys_thread_exit(0);
+}
 
-    // TODO:解锁
-    idt_leave_protection(state);
+/**
+ * @brief  创建运行内核函数的内核线程，线程以其内核栈为栈，func返回后线程自动退出
+ *
+ * @param name 线程名称
+ * @param func 线程执行的内核函数
+ * @param arg 传给func的参数
+ * @return task_t* 已开始调度的线程，失败时为0
+ */
+task_t *kthread_create(const char *name, void (*func)(void *), void *arg) {
+  idt_state_t state = idt_enter_protection();
+
+  // 1.分配任务控制块，内核线程不指定栈，由tss_init使用其内核栈
+  task_t *task = alloc_task();
+  if (task == (task_t *)0) {
+    goto kthread_failed;
   }
-  return 0;
-}
\ No newline at end of file
+
+  if (task_init(task, name, (uint32_t)func, 0, TASK_FLAGS_SYSTEM) < 0) {
+    free_task(task);
+    task = (task_t *)0;
+    goto kthread_failed;
+  }
+
+  // 2.在栈顶预留处放入func的返回地址与参数，iret进入func后即可像被调用一样访问参数
+  uint32_t *stack = (uint32_t *)task->tss.esp;
+  stack[0] = (uint32_t)kthread_exit;
+  stack[1] = (uint32_t)arg;
+
+  // 3.内核线程退出后由first_task统一回收
+  task->parent = &task_manager.first_task;
+  list_insert_last(&task_manager.first_task.children, &task->child_node);
+  task_start(task);
+
+kthread_failed:
+  idt_leave_protection(state);
+  return task;
+}
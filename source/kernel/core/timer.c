@@ -0,0 +1,216 @@
+/**
+ * @file timer.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义内核定时器，用分层时间轮管理所有已启动的定时器
+ *         启动和取消定时器的时间复杂度为O(1)，每个时间片只处理第0层的一个槽位，
+ *         高层槽位只在低层时间轮转完一圈时才重新分配，均摊开销也为O(1)
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "core/timer.h"
+#include "cpu/idt.h"
+
+static timer_manager_t timer_manager;
+
+/**
+ * @brief  根据定时器的到期时间将其插入对应层的槽位
+ *
+ * @param timer
+ */
+static void timer_enqueue(ktimer_t *timer) {
+    int delta = (int)(timer->expire - timer_manager.curr_tick);
+    list_t *slot;
+
+    if (delta < 0) {
+        //1.已经到期的定时器放入下一个需要处理的槽位，在下一个时间片立即处理
+        slot = &timer_manager.wheels[0][timer_manager.curr_tick & TIMER_WHEEL_MASK];
+    } else {
+        //2.超出时间轮范围的定时器截断为最大超时时间
+        if (delta > TIMER_MAX_TICKS) {
+            delta = TIMER_MAX_TICKS;
+            timer->expire = timer_manager.curr_tick + TIMER_MAX_TICKS;
+        }
+
+        //3.找到能容纳该超时时间的最低层，第n层能表示的范围为2^((n+1)*TIMER_WHEEL_BITS)
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1 << ((level + 1) * TIMER_WHEEL_BITS))) {
+            level++;
+        }
+
+        uint32_t index = (timer->expire >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+        slot = &timer_manager.wheels[level][index];
+    }
+
+    list_insert_last(slot, &timer->node);
+    timer->slot = slot;
+}
+
+/**
+ * @brief  将高层槽位中的所有定时器重新分配到更低层的槽位
+ *
+ * @param slot
+ */
+static void timer_cascade(list_t *slot) {
+    list_node_t *node;
+    while ((node = list_remove_first(slot)) != (list_node_t *)0) {
+        timer_enqueue(list_node_parent(node, ktimer_t, node));
+    }
+}
+
+/**
+ * @brief  初始化定时器管理器
+ *
+ */
+void timer_manager_init(void) {
+    timer_manager.curr_tick = 0;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        for (int i = 0; i < TIMER_WHEEL_SIZE; ++i) {
+            list_init(&timer_manager.wheels[level][i]);
+        }
+    }
+}
+
+/**
+ * @brief  初始化定时器
+ *
+ * @param timer 定时器对象
+ * @param func 到期回调函数
+ * @param arg 回调函数的参数
+ */
+void timer_init(ktimer_t *timer, timer_func_t func, void *arg) {
+    list_node_init(&timer->node);
+    timer->slot = (list_t *)0;
+    timer->expire = 0;
+    timer->period = 0;
+    timer->func = func;
+    timer->arg = arg;
+}
+
+/**
+ * @brief  启动定时器，定时器已启动时重新设置其到期时间
+ *
+ * @param timer 定时器对象
+ * @param ticks 经过多少个时间片后到期，为0时按1处理
+ * @param period 到期后再次启动的周期，为0表示单次定时器
+ */
+void timer_add(ktimer_t *timer, uint32_t ticks, uint32_t period) {
+    ASSERT(timer->func != (timer_func_t)0);
+    idt_state_t state = idt_enter_protection();
+
+    //1.定时器已启动则先将其从原槽位中取下
+    if (timer->slot) {
+        list_remove(timer->slot, &timer->node);
+        timer->slot = (list_t *)0;
+    }
+
+    //2.curr_tick为下一个需要处理的时间片，经过ticks个时间片后到期即在curr_tick + ticks - 1时处理
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    timer->expire = timer_manager.curr_tick + ticks - 1;
+    timer->period = period;
+
+    //3.插入时间轮
+    timer_enqueue(timer);
+
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  取消定时器，定时器未启动时不做任何操作
+ *
+ * @param timer
+ */
+void timer_remove(ktimer_t *timer) {
+    idt_state_t state = idt_enter_protection();
+
+    if (timer->slot) {
+        list_remove(timer->slot, &timer->node);
+        timer->slot = (list_t *)0;
+    }
+    timer->period = 0;
+
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  判断定时器是否已启动且未到期
+ *
+ * @param timer
+ * @return int
+ */
+int timer_is_active(ktimer_t *timer) {
+    return timer->slot != (list_t *)0;
+}
+
+/**
+ * @brief  获取距离下一次需要处理时间轮的时间片数，用于空闲时跳过中间的时间片
+ *         结果不晚于第0层最近一个非空槽位的到期时间，也不晚于下一次高层槽位的重新分配，
+ *         因此在返回的时间片数之前不会有定时器到期
+ *
+ * @return uint32_t 时间片数，至少为1，为1表示下一个时间片就需要处理
+ */
+uint32_t timer_next_ticks(void) {
+    uint32_t index = timer_manager.curr_tick & TIMER_WHEEL_MASK;
+
+    //1.第0层转完一圈时需要重新分配高层槽位
+    uint32_t ticks = TIMER_WHEEL_SIZE - index + 1;
+    if (index == 0) {
+        return 1;
+    }
+
+    //2.查找第0层中最近的非空槽位
+    for (uint32_t i = 0; i < TIMER_WHEEL_SIZE && i + 1 < ticks; ++i) {
+        if (!list_is_empty(&timer_manager.wheels[0][(index + i) & TIMER_WHEEL_MASK])) {
+            return i + 1;
+        }
+    }
+
+    return ticks;
+}
+
+/**
+ * @brief  提供给时钟中断使用，每个时间片处理一次，执行所有在当前时间片到期的定时器
+ *
+ */
+void timer_tick(void) {
+    uint32_t index = timer_manager.curr_tick & TIMER_WHEEL_MASK;
+
+    //1.第0层转完一圈，将上一层对应槽位中的定时器重新分配，上一层也转完一圈时继续向上分配
+    if (index == 0) {
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+            uint32_t slot_index = (timer_manager.curr_tick >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+            timer_cascade(&timer_manager.wheels[level][slot_index]);
+            if (slot_index != 0) {
+                break;
+            }
+        }
+    }
+
+    //2.将当前槽位中的定时器整体取出并推进时间，周期为TIMER_WHEEL_SIZE整数倍的定时器
+    //重新启动时会插入同一槽位，不能在处理过程中再次被取出
+    list_t expired = timer_manager.wheels[0][index];
+    list_init(&timer_manager.wheels[0][index]);
+    for (list_node_t *node = list_get_first(&expired); node; node = list_node_next(node)) {
+        list_node_parent(node, ktimer_t, node)->slot = &expired;
+    }
+    timer_manager.curr_tick++;
+
+    //3.依次执行取出的所有定时器，周期定时器在回调前重新启动
+    list_node_t *node;
+    while ((node = list_remove_first(&expired)) != (list_node_t *)0) {
+        ktimer_t *timer = list_node_parent(node, ktimer_t, node);
+        timer->slot = (list_t *)0;
+
+        if (timer->period) {
+            timer->expire += timer->period;
+            timer_enqueue(timer);
+        }
+
+        timer->func(timer->arg);
+    }
+}
@@ -0,0 +1,105 @@
+/**
+ * @file vsys.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  映射到每个进程中的只读数据页
+ *         共享页记录时间片数与对应的时间戳计数器，应用程序用当前的时间戳计数器推算出最新的时间片数；
+ *         私有页记录进程的pid，只有一个线程时应用程序可直接读取
+ * @version 0.1
+ * @date 2023-09-29
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "core/vsys.h"
+#include "common/cpu_instr.h"
+#include "core/memory.h"
+#include "cpu/mmu.h"
+#include "dev/time.h"
+#include "tools/assert.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+//所有进程共享的时间数据页，内核空间为恒等映射，可直接通过物理地址访问
+static vsys_data_t *vsys_data;
+
+/**
+ * @brief  分配共享的时间数据页，并用定时器校准时间戳计数器的频率
+ *         需在内存管理与定时器初始化之后、创建第一个进程之前调用
+ *
+ */
+void vsys_init(void) {
+    vsys_data = (vsys_data_t *)memory_alloc_shared_page();
+    ASSERT(vsys_data != (vsys_data_t *)0);
+    kernel_memset_page(vsys_data);
+
+    uint64_t start = rdtsc();
+    time_delay(VSYS_CALIBRATE_MS * 1000);
+    uint32_t cycles = (uint32_t)(rdtsc() - start);
+    vsys_data->tsc_per_tick = cycles / (VSYS_CALIBRATE_MS / OS_TICKS_MS);
+
+    //记录初始的时间基准，之后由时钟中断更新
+    vsys_update(0);
+
+    log_printf("vsys: %d tsc cycles per tick\n", vsys_data->tsc_per_tick);
+}
+
+/**
+ * @brief  将共享页与新分配的私有页以只读权限映射到进程的虚拟空间中
+ *
+ * @param page_dir 新创建的页目录表
+ * @return int 0:成功, -1:分配失败，已映射的页由调用者销毁页目录表时一并释放
+ */
+int vsys_map(uint32_t page_dir) {
+    //1.共享页由内核持有，映射时不增加引用，进程销毁时不会被释放
+    int err = memory_creat_map((pde_t *)page_dir, MEM_VSYS_BASE, (uint32_t)vsys_data, 1,
+                               PTE_P | PTE_U | PTE_KERNEL);
+    if (err < 0) {
+        return -1;
+    }
+
+    //2.私有页在进程销毁时随页目录表一起释放
+    uint32_t page = memory_alloc_page();
+    if (page == 0) {
+        return -1;
+    }
+    kernel_memset_page((void *)page);
+
+    err = memory_creat_map((pde_t *)page_dir, MEM_VSYS_PROC, page, 1, PTE_P | PTE_U);
+    if (err < 0) {
+        memory_free_page(page);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief  设置进程私有页中的pid
+ *
+ * @param page_dir 进程的页目录表
+ * @param pid 为0时应用程序需经系统调用获取pid
+ */
+void vsys_set_pid(uint32_t page_dir, int pid) {
+    vsys_proc_t *proc = (vsys_proc_t *)memory_get_paddr(page_dir, MEM_VSYS_PROC);
+    if (proc != (vsys_proc_t *)0) {
+        proc->pid = pid;
+    }
+}
+
+/**
+ * @brief  在时间片边界的时钟中断中记录时间片数与当前的时间戳计数器
+ *
+ * @param ticks
+ */
+void vsys_update(uint32_t ticks) {
+    uint64_t tsc = rdtsc();
+
+    vsys_data->seq++;
+    __asm__ __volatile__("" ::: "memory");
+    vsys_data->ticks = ticks;
+    vsys_data->tsc_low = (uint32_t)tsc;
+    vsys_data->tsc_high = (uint32_t)(tsc >> 32);
+    __asm__ __volatile__("" ::: "memory");
+    vsys_data->seq++;
+}
@@ -0,0 +1,228 @@
+/**
+ * @file apic.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  本地APIC的初始化与处理器间中断的发送
+ *         外部设备的中断仍由8259芯片经BSP的LINT0引脚传入，本地APIC只用于处理器间中断与AP的时钟
+ * @version 0.1
+ * @date 2023-09-24
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "cpu/apic.h"
+#include "common/cpu_instr.h"
+#include "common/exc_frame.h"
+#include "cpu/idt.h"
+#include "cpu/smp.h"
+#include "core/task.h"
+#include "dev/time.h"
+#include "os_cfg.h"
+
+//本地APIC是否已映射并开启
+static int lapic_ready = 0;
+//本地时钟在一个时间片内的计数值，由BSP用可编程定时器校准
+static uint32_t lapic_ticks_count = 0;
+
+/**
+ * @brief  读取本地APIC寄存器
+ *
+ * @param reg 寄存器偏移量
+ * @return uint32_t
+ */
+static inline uint32_t lapic_read(uint32_t reg) {
+    return *(volatile uint32_t *)(LAPIC_VADDR + reg);
+}
+
+/**
+ * @brief  写入本地APIC寄存器
+ *
+ * @param reg 寄存器偏移量
+ * @param value
+ */
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t *)(LAPIC_VADDR + reg) = value;
+}
+
+/**
+ * @brief  用可编程定时器校准本地时钟在一个时间片内的计数值
+ *
+ */
+static void lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | IRQ_LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+
+    time_delay(10 * OS_TICKS_MS * 1000);
+
+    uint32_t count = 0xffffffff - lapic_read(LAPIC_TIMER_CURR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+    lapic_ticks_count = count / 10;
+}
+
+/**
+ * @brief  开启当前cpu的本地APIC，并接收所有优先级的中断
+ *
+ */
+static void lapic_enable(void) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | IRQ_SPURIOUS);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_eoi();
+}
+
+/**
+ * @brief  初始化BSP的本地APIC，安装本地APIC使用的中断处理函数并校准本地时钟
+ *         BSP保持BIOS设置的虚拟线模式，外部设备的中断仍经LINT0传入
+ *
+ */
+void lapic_init(void) {
+    //1.开启本地APIC
+    lapic_enable();
+
+    //2.安装本地APIC使用的中断处理函数，所有cpu共用同一个IDT
+    idt_install(IRQ_LAPIC_TIMER, (idt_handler_t)exception_handler_lapic_timer);
+    idt_install(IRQ_RESCHEDULE, (idt_handler_t)exception_handler_reschedule);
+    idt_install(IRQ_TLB_FLUSH, (idt_handler_t)exception_handler_tlb_flush);
+    idt_install(IRQ_SPURIOUS, (idt_handler_t)exception_handler_spurious);
+
+    //3.校准本地时钟，供AP启动周期时钟使用
+    lapic_timer_calibrate();
+
+    lapic_ready = 1;
+}
+
+/**
+ * @brief  初始化AP的本地APIC，屏蔽LINT0与LINT1，外部设备的中断只交给BSP处理
+ *
+ */
+void lapic_ap_init(void) {
+    lapic_enable();
+    lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+}
+
+/**
+ * @brief  以周期模式启动当前cpu的本地时钟，每个时间片产生一次中断，只用于AP的调度
+ *
+ */
+void lapic_timer_start(void) {
+    lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | IRQ_LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, lapic_ticks_count);
+}
+
+/**
+ * @brief  判断本地APIC是否已开启
+ *
+ * @return int
+ */
+int lapic_enabled(void) {
+    return lapic_ready;
+}
+
+/**
+ * @brief  获取当前cpu的APIC ID
+ *
+ * @return uint8_t
+ */
+uint8_t lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/**
+ * @brief  向本地APIC发送中断结束信号
+ *
+ */
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/**
+ * @brief  写入中断命令寄存器发送处理器间中断，并等待发送完成
+ *
+ * @param apic_id 目标cpu的APIC ID
+ * @param command 中断命令寄存器低32位的值
+ */
+static void lapic_send_command(uint8_t apic_id, uint32_t command) {
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        pause();
+    }
+}
+
+/**
+ * @brief  向目标cpu发送固定向量号的处理器间中断
+ *
+ * @param apic_id
+ * @param vector
+ */
+void lapic_send_ipi(uint8_t apic_id, int vector) {
+    lapic_send_command(apic_id, vector);
+}
+
+/**
+ * @brief  向目标cpu发送INIT中断，使其进入等待STARTUP中断的状态
+ *
+ * @param apic_id
+ */
+void lapic_send_init(uint8_t apic_id) {
+    lapic_send_command(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    time_delay(10000);
+    lapic_send_command(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+}
+
+/**
+ * @brief  向目标cpu发送STARTUP中断，使其从addr处以实模式开始执行
+ *
+ * @param apic_id
+ * @param addr 启动代码的物理地址，按4kb对齐且位于1mb以下
+ */
+void lapic_send_startup(uint8_t apic_id, uint32_t addr) {
+    lapic_send_command(apic_id, LAPIC_ICR_STARTUP | (addr >> 12));
+    time_delay(200);
+}
+
+/**
+ * @brief  AP本地时钟中断的处理函数，每个时间片调度一次，AP不处理时间轮
+ *
+ * @param frame
+ */
+void do_handler_lapic_timer(const exception_frame_t *frame) {
+    lapic_eoi();
+    task_slice_end();
+
+    //进程已被其它线程退出时，当前线程不再返回用户态
+    if (frame->cs & 0x3) {
+        task_exit_check();
+    }
+}
+
+/**
+ * @brief  其它cpu向当前cpu的就绪队列加入任务后发送的重新调度中断
+ *
+ * @param frame
+ */
+void do_handler_reschedule(const exception_frame_t *frame) {
+    lapic_eoi();
+    task_preempt();
+}
+
+/**
+ * @brief  其它cpu修改了共享的页表后发送的刷新TLB中断，刷新通常已在进入时等待内核锁的自旋中完成
+ *
+ * @param frame
+ */
+void do_handler_tlb_flush(const exception_frame_t *frame) {
+    lapic_eoi();
+    smp_tlb_flush_ack(cpu_current());
+}
+
+/**
+ * @brief  本地APIC的伪中断，不需要发送EOI
+ *
+ * @param frame
+ */
+void do_handler_spurious(const exception_frame_t *frame) {
+}
@@ -87,7 +87,18 @@ void gdt_init(void) {
 
     is_alloc[KERNEL_SELECTOR_CS >> 3] = 1;
 
-    //3.初始化调用门描述符，调用门的 DPL >= CPL = 3 && DPL >= RPL = 0, 若目标代码段的特权级更高则发生特权级转换
+    //3.设置应用程序的代码段与数据段，sysenter/sysexit根据内核代码段的选择子推算出它们的位置
+    segment_desc_set(APP_SELECTOR_CS, 0, 0xffffffff,
+                    SEG_ATTR_P | SEG_ATTR_DPL_3 | SEG_ATTR_S_NORMAL |
+                    SEG_ATTR_TYPE_CODE | SEG_ATTR_TYPE_RW | SEG_ATTR_D_OR_B);
+    segment_desc_set(APP_SELECTOR_DS, 0, 0xffffffff,
+                    SEG_ATTR_P | SEG_ATTR_DPL_3 | SEG_ATTR_S_NORMAL |
+                    SEG_ATTR_TYPE_DATA | SEG_ATTR_TYPE_RW | SEG_ATTR_D_OR_B);
+
+    is_alloc[APP_SELECTOR_CS >> 3] = 1;
+    is_alloc[APP_SELECTOR_DS >> 3] = 1;
+
+    //4.初始化调用门描述符，调用门的 DPL >= CPL = 3 && DPL >= RPL = 0, 若目标代码段的特权级更高则发生特权级转换
     gate_desc_set((gate_desc_t*)(gdt_table + (SYSCALL_SELECTOR >> 3)), 
         KERNEL_SELECTOR_CS, (uint32_t)exception_handler_syscall, 
         GATE_ATTR_P | GATE_ATTR_DPL_3 | GATE_TYPE_SYSCALL | SYSCALL_PARAM_COUNT);
@@ -95,11 +106,11 @@ void gdt_init(void) {
     is_alloc[SYSCALL_SELECTOR >> 3] = 1;
 
 
-    //4.加载新的GDT表
+    //5.加载新的GDT表
     lgdt((uint32_t)gdt_table, sizeof(gdt_table));
 
-    //4.初始化互斥锁
-    mutex_init(&mutex);
+    //6.初始化互斥锁
+    mutex_init(&mutex, "gdt");
 }
 
 
@@ -16,6 +16,8 @@
 #include "tools/log.h"
 #include  "cpu/gate.h"
 #include "core/task.h"
+#include "core/memory.h"
+#include "ipc/spinlock.h"
 
 //定义中断门描述符表
 static gate_desc_t idt_table[IDT_TABLE_SIZE];
@@ -174,6 +176,20 @@ void do_handler_general_protection(const exception_frame_t *frame) {
  * @param frame 
  */
 void do_handler_page_fault(const exception_frame_t *frame) {
+    //对存在的页进行写操作触发的异常，可能是写时复制页，处理成功则直接返回重新执行该指令
+    if ((frame->error_code & ERR_PAGE_P) && (frame->error_code & ERR_PAGE_WR)) {
+        if (memory_copy_on_write(read_cr2()) == 0) {
+            return;
+        }
+    }
+
+    //访问的页不存在，可能是按需分配区域中还未分配的页，处理成功则直接返回重新执行该指令
+    if (!(frame->error_code & ERR_PAGE_P)) {
+        if (memory_alloc_on_demand(read_cr2()) == 0) {
+            return;
+        }
+    }
+
     log_printf("--------------------------------\n");
     log_printf("IRQ/Exception happend: Page fault.\n");
     if (frame->error_code & ERR_PAGE_P) {
@@ -302,12 +318,20 @@ void idt_init(void) {
   idt_install(IDT21_CP, (idt_handler_t)exception_handler_control_exception);
 
   //3.加载IDT
-  lidt((uint32_t)idt_table, sizeof(idt_table));
+  idt_load();
 
   //4.初始化8259设备中断芯片
   init_pic();
 }
 
+/**
+ * @brief  加载IDT，所有cpu共用同一个IDT，AP启动时直接加载
+ *
+ */
+void idt_load(void) {
+  lidt((uint32_t)idt_table, sizeof(idt_table));
+}
+
 /**
  * @brief  开启外部设备的中断
  * 
@@ -394,21 +418,23 @@ void pic_send_eoi(int irq_num) {
 
 
 /**
- * @brief  
+ * @brief  进入临界区，关中断防止当前cpu被打断，并获取内核锁防止其它cpu同时进入内核
  * 
  */
 idt_state_t idt_enter_protection(void) {
   idt_state_t state = read_eflags();
   idt_disable_global();
-  return state;;
+  kernel_lock_acquire();
+  return state;
 }
 
 /**
- * @brief  
+ * @brief  离开临界区，释放一层内核锁并恢复进入前的中断状态
  * 
  * @return idt_state_t 
  */
 void idt_leave_protection(idt_state_t state){
+  kernel_lock_release();
   write_eflags(state);
 }
 
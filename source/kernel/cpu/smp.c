@@ -0,0 +1,328 @@
+/**
+ * @file smp.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  多处理器的检测与启动
+ *         从BIOS提供的多处理器配置表中获取所有cpu的APIC ID，BSP通过INIT-STARTUP中断序列启动AP，
+ *         AP进入保护模式与分页后加载与BSP共用的GDT和IDT，使用各自的TSS并运行各自的空闲进程
+ * @version 0.1
+ * @date 2023-09-24
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "cpu/smp.h"
+#include "common/cpu_instr.h"
+#include "cpu/apic.h"
+#include "cpu/gdt.h"
+#include "cpu/idt.h"
+#include "cpu/syscall.h"
+#include "core/task.h"
+#include "dev/time.h"
+#include "os_cfg.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+//BIOS数据区中记录EBDA段地址与基本内存大小(kb)的位置
+#define BDA_EBDA_SEG        0x40E
+#define BDA_BASE_MEM_KB     0x413
+
+// 定义在smp_start.S中的AP启动代码
+extern char smp_ap_start[], smp_ap_param[], smp_ap_end[];
+
+static cpu_t cpus[SMP_CPU_MAX];
+static int cpu_count = 1;
+
+/**
+ * @brief  计算一段内存所有字节之和
+ *
+ * @param addr
+ * @param size
+ * @return uint8_t 为0表示校验通过
+ */
+static uint8_t mp_checksum(const uint8_t *addr, int size) {
+    uint8_t sum = 0;
+    for (int i = 0; i < size; ++i) {
+        sum += addr[i];
+    }
+    return sum;
+}
+
+/**
+ * @brief  在一段内存中按16字节对齐查找多处理器浮点结构
+ *
+ * @param start 起始物理地址
+ * @param size 查找的长度
+ * @return mp_float_t*
+ */
+static mp_float_t *mp_search(uint32_t start, int size) {
+    for (uint32_t addr = start; addr + sizeof(mp_float_t) <= start + size; addr += 16) {
+        mp_float_t *mp = (mp_float_t *)addr;
+        if (mp->signature == MP_FLOAT_SIGNATURE &&
+            mp_checksum((uint8_t *)mp, sizeof(mp_float_t)) == 0) {
+            return mp;
+        }
+    }
+
+    return (mp_float_t *)0;
+}
+
+/**
+ * @brief  依次在EBDA的第一个1kb、基本内存的最后1kb及BIOS只读区中查找多处理器浮点结构
+ *
+ * @return mp_float_t*
+ */
+static mp_float_t *mp_find(void) {
+    mp_float_t *mp;
+
+    uint32_t ebda = (uint32_t)(*(uint16_t *)BDA_EBDA_SEG) << 4;
+    if (ebda && (mp = mp_search(ebda, 1024)) != (mp_float_t *)0) {
+        return mp;
+    }
+
+    uint32_t base_mem = (uint32_t)(*(uint16_t *)BDA_BASE_MEM_KB) * 1024;
+    if (base_mem && (mp = mp_search(base_mem - 1024, 1024)) != (mp_float_t *)0) {
+        return mp;
+    }
+
+    return mp_search(0xF0000, 0x10000);
+}
+
+/**
+ * @brief  解析多处理器配置表，记录所有可用cpu的APIC ID，BSP固定为0号cpu
+ *         必须在内存管理初始化之前调用，此时loader建立的低4mb恒等映射仍然有效
+ *
+ */
+void smp_detect(void) {
+    cpu_count = 1;
+    cpus[0].id = 0;
+    cpus[0].started = 1;
+
+    //1.查找多处理器浮点结构，没有配置表时使用默认配置的情况按单处理器处理
+    mp_float_t *mp = mp_find();
+    if (mp == (mp_float_t *)0 || mp->config_addr == 0 || mp->config_addr >= MP_MAPPED_END) {
+        return;
+    }
+
+    //2.检查配置表，本地APIC不在默认地址时不启用多处理器
+    mp_config_t *config = (mp_config_t *)mp->config_addr;
+    if (config->signature != MP_CONFIG_SIGNATURE ||
+        mp_checksum((uint8_t *)config, config->length) != 0 ||
+        config->lapic_addr != LAPIC_PADDR) {
+        return;
+    }
+
+    //3.遍历配置表项，处理器表项为20字节，其它表项为8字节
+    uint8_t *entry = (uint8_t *)(config + 1);
+    for (int i = 0; i < config->entry_count; ++i) {
+        if (*entry != MP_ENTRY_PROCESSOR) {
+            entry += 8;
+            continue;
+        }
+
+        mp_processor_t *proc = (mp_processor_t *)entry;
+        entry += sizeof(mp_processor_t);
+        if (!(proc->flags & MP_PROCESSOR_EN)) {
+            continue;
+        }
+
+        if (proc->flags & MP_PROCESSOR_BSP) {
+            cpus[0].apic_id = proc->apic_id;
+        } else if (cpu_count < SMP_CPU_MAX) {
+            cpus[cpu_count].id = cpu_count;
+            cpus[cpu_count].apic_id = proc->apic_id;
+            cpus[cpu_count].started = 0;
+            cpu_count++;
+        }
+    }
+}
+
+/**
+ * @brief  初始化每个cpu的TSS，多处理器时开启BSP的本地APIC
+ *         需在内存管理与定时器初始化之后调用，本地APIC的寄存器已被映射，本地时钟需用定时器校准
+ *
+ */
+void smp_cpu_init(void) {
+    //1.每个cpu使用各自的TSS，所有任务只在特权级提升时使用其中的ss0与esp0
+    for (int i = 0; i < cpu_count; ++i) {
+        cpu_t *cpu = cpus + i;
+        kernel_memset(&cpu->tss, 0, sizeof(cpu->tss));
+        cpu->tss.ss0 = KERNEL_SELECTOR_DS;
+        cpu->tss_selector = gdt_alloc_desc();
+        segment_desc_set(cpu->tss_selector, (uint32_t)&cpu->tss, sizeof(cpu->tss),
+                         SEG_ATTR_P | SEG_ATTR_DPL_0 | SEG_ATTR_TYPE_TSS);
+        cpu->lock_depth = 0;
+        cpu->tlb_flush = 0;
+    }
+
+    //BSP的快速系统调用入口，AP在启动时各自设置
+    syscall_sysenter_init(cpus);
+
+    //2.只有一个cpu时不使用本地APIC
+    if (cpu_count == 1) {
+        return;
+    }
+
+    lapic_init();
+    cpus[0].apic_id = lapic_id();
+}
+
+/**
+ * @brief  AP进入内核的c入口函数，运行在其空闲进程的栈上，不会返回
+ *
+ * @param cpu AP的cpu结构
+ */
+static void ap_main(cpu_t *cpu) {
+    //1.加载所有cpu共用的IDT，以及当前cpu的TSS，之后即可通过TR识别当前cpu
+    idt_load();
+    write_tr(cpu->tss_selector);
+    syscall_sysenter_init(cpu);
+
+    //2.开启本地APIC，并启动本地时钟用于调度
+    lapic_ap_init();
+    lapic_timer_start();
+
+    //3.当前执行流成为该cpu的空闲进程，开中断后等待其它cpu分配任务或从其它cpu窃取任务
+    task_ap_enter();
+}
+
+/**
+ * @brief  依次启动所有AP，并等待其完成初始化
+ *
+ */
+void smp_start_aps(void) {
+    if (cpu_count == 1) {
+        return;
+    }
+
+    //1.将启动代码拷贝到1mb以下的页对齐处，低64kb已被内核恒等映射
+    kernel_memcpy((void *)SMP_AP_START_ADDR, smp_ap_start, smp_ap_end - smp_ap_start);
+    smp_start_param_t *param =
+        (smp_start_param_t *)(SMP_AP_START_ADDR + (smp_ap_param - smp_ap_start));
+
+    //2.所有AP使用与BSP相同的GDT与控制寄存器
+    __asm__ __volatile__("sgdt %[p]" : [p] "=m"(*param));
+    param->cr0 = read_cr0();
+    param->cr4 = read_cr4();
+    param->entry = (uint32_t)ap_main;
+
+    for (int i = 1; i < cpu_count; ++i) {
+        cpu_t *cpu = cpus + i;
+        task_t *idle = task_idle_task(i);
+
+        //3.AP使用其空闲进程的栈与页目录表，页目录表中包含所有内核映射
+        param->cr3 = idle->tss.cr3;
+        param->esp = idle->tss.esp;
+        param->cpu = (uint32_t)cpu;
+
+        //4.发送INIT-STARTUP-STARTUP中断序列
+        lapic_send_init(cpu->apic_id);
+        lapic_send_startup(cpu->apic_id, SMP_AP_START_ADDR);
+        if (!cpu->started) {
+            lapic_send_startup(cpu->apic_id, SMP_AP_START_ADDR);
+        }
+
+        //5.等待AP完成初始化后再启动下一个AP，下一个AP会覆盖启动参数
+        for (int ms = 0; ms < SMP_AP_TIMEOUT_MS && !cpu->started; ++ms) {
+            time_delay(1000);
+        }
+
+        if (!cpu->started) {
+            log_printf("cpu %d (apic %d) start failed\n", i, cpu->apic_id);
+        }
+    }
+
+    int online = 0;
+    for (int i = 0; i < cpu_count; ++i) {
+        online += cpus[i].started ? 1 : 0;
+    }
+    log_printf("smp: %d cpus online\n", online);
+}
+
+/**
+ * @brief  获取检测到的cpu数量，包括启动失败的AP
+ *
+ * @return int
+ */
+int smp_cpu_count(void) {
+    return cpu_count;
+}
+
+/**
+ * @brief  获取逻辑编号对应的cpu结构
+ *
+ * @param id
+ * @return cpu_t*
+ */
+cpu_t *smp_cpu(int id) {
+    return cpus + id;
+}
+
+/**
+ * @brief  获取当前cpu的逻辑编号，通过TR中的TSS选择子识别，初始化阶段未加载TSS时只有BSP在运行
+ *
+ * @return int
+ */
+int cpu_id(void) {
+    uint16_t tss_selector = read_tr();
+    if (tss_selector == 0) {
+        return 0;
+    }
+
+    for (int i = 1; i < cpu_count; ++i) {
+        if (cpus[i].tss_selector == tss_selector) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief  获取当前cpu的cpu结构
+ *
+ * @return cpu_t*
+ */
+cpu_t *cpu_current(void) {
+    return cpus + cpu_id();
+}
+
+/**
+ * @brief  请求其它所有cpu刷新TLB并等待完成，调用者需持有内核锁
+ *         用于修改了被多个线程共享的页表项之后，防止其它cpu继续使用旧的映射
+ *
+ */
+void smp_tlb_shootdown(void) {
+    if (!lapic_enabled()) {
+        return;
+    }
+
+    //1.标记需要刷新的cpu，并发送刷新中断唤醒在用户态运行或空闲的cpu
+    int self = cpu_id();
+    for (int i = 0; i < cpu_count; ++i) {
+        if (i != self && cpus[i].started) {
+            cpus[i].tlb_flush = 1;
+            lapic_send_ipi(cpus[i].apic_id, IRQ_TLB_FLUSH);
+        }
+    }
+
+    //2.等待所有cpu完成刷新，它们进入内核时会因获取内核锁而自旋，在自旋中完成刷新
+    for (int i = 0; i < cpu_count; ++i) {
+        while (cpus[i].tlb_flush) {
+            pause();
+        }
+    }
+}
+
+/**
+ * @brief  其它cpu请求过刷新时，重新加载页目录表刷新当前cpu的TLB
+ *         在等待内核锁的自旋中调用，持有内核锁的cpu可能正在等待当前cpu完成刷新
+ *
+ * @param cpu 当前cpu
+ */
+void smp_tlb_flush_ack(cpu_t *cpu) {
+    if (cpu->tlb_flush) {
+        write_cr3(read_cr3());
+        cpu->tlb_flush = 0;
+    }
+}
@@ -10,10 +10,18 @@
  */
 
 #include "cpu/syscall.h"
+#include "common/cpu_instr.h"
+#include "cpu/smp.h"
 #include "core/memory.h"
 #include "core/task.h"
+#include "tools/klib.h"
 #include "tools/log.h"
 #include "fs/fs.h"
+#include "fs/pipe.h"
+#include "fs/bcache.h"
+#include "ipc/futex.h"
+#include "cpu/systrace.h"
+#include "os_cfg.h"
 
 
 /**
@@ -44,11 +52,22 @@ static const sys_handler_t sys_table[] = {
     [SYS_dup] = (sys_handler_t)sys_dup,
     [SYS_exit] = (sys_handler_t)sys_exit,
     [SYS_wait] = (sys_handler_t)sys_wait,
+    [SYS_nice] = (sys_handler_t)sys_nice,
+    [SYS_clone] = (sys_handler_t)sys_clone,
+    [SYS_thread_exit] = (sys_handler_t)sys_thread_exit,
+    [SYS_thread_join] = (sys_handler_t)sys_thread_join,
+    [SYS_futex_wait] = (sys_handler_t)sys_futex_wait,
+    [SYS_futex_wake] = (sys_handler_t)sys_futex_wake,
+    [SYS_trace] = (sys_handler_t)sys_trace,
+    [SYS_trace_read] = (sys_handler_t)sys_trace_read,
+    [SYS_trace_stat] = (sys_handler_t)sys_trace_stat,
     [SYS_opendir] = (sys_handler_t)sys_opendir,
     [SYS_readdir] = (sys_handler_t)sys_readdir,
     [SYS_closedir] = (sys_handler_t)sys_closedir,
     [SYS_ioctl] = (sys_handler_t)sys_ioctl,
     [SYS_unlink] = (sys_handler_t)sys_unlink,
+    [SYS_pipe] = (sys_handler_t)sys_pipe,
+    [SYS_bcache_stat] = (sys_handler_t)sys_bcache_stat,
 
 };
 
@@ -61,13 +80,21 @@ void do_handler_syscall(syscall_frame_t* frame) {
     if (frame->function_id < sizeof(sys_table) / sizeof(sys_table[0])) {    //当前系统调用存在
         sys_handler_t handler = sys_table[frame->function_id];
         if (handler) {
+            //execve会改写栈帧，先保存参数用于跟踪记录
+            uint32_t args[4] = {frame->arg0, frame->arg1, frame->arg2, frame->arg3};
+            uint64_t start = systrace_begin(frame->function_id, args);
+
             //直接将4个参数全部传入即可，
             //因为是按从右到左的顺序将参数压栈，所以原始的参数只要是从arg0开始赋值的即可，
             //多余的参数在高地址处，不影响handler对应的真正的系统调用
-            int ret = handler(frame->arg0, frame->arg1, frame->arg2, frame->arg3);
+            int ret = handler(args[0], args[1], args[2], args[3]);
             //正常函数返回后会将返回值先存放到eax寄存器中，再eax中的值放入对应接收返回值的内存中
             //此处用eax先接收ret，在调用门返回后再从eax中取处该值
             frame->eax = ret;
+            systrace_end(frame->function_id, args, start, ret);
+
+            //进程已被其它线程退出时，当前线程不再返回用户态
+            task_exit_check();
             return;
         }
     }
@@ -77,4 +104,60 @@ void do_handler_syscall(syscall_frame_t* frame) {
     log_printf("task: %s, Unknown syscall_id: %d\n", task->name, frame->function_id);
     frame->eax = -1;
 
-}
\ No newline at end of file
+}
+
+/**
+ * @brief sysenter入口的处理函数，cpu没有从用户栈中拷贝参数，在持有内核锁后经页表读取参数填入栈帧
+ *        用户栈顶非法或未映射时不进行系统调用，直接返回-1
+ *
+ * @param frame
+ */
+void do_handler_sysenter(syscall_frame_t* frame) {
+    //1.用户栈顶须在用户空间内，且参数不越过vsys数据页
+    uint32_t addr = frame->esp;
+    uint32_t size = SYSCALL_PARAM_COUNT * sizeof(uint32_t);
+    if (addr < SYSENTER_ARG_BASE || addr > SYSENTER_ARG_END - size) {
+        frame->eax = -1;
+        return;
+    }
+
+    //2.参数可能跨越页边界，逐页经物理地址拷贝，不直接访问用户地址
+    uint8_t *dest = (uint8_t *)&frame->function_id;
+    while (size) {
+        uint32_t paddr = memory_get_user_paddr(addr);
+        if (paddr == 0) {
+            frame->eax = -1;
+            return;
+        }
+
+        uint32_t curr_size = MEM_PAGE_SIZE - (addr & (MEM_PAGE_SIZE - 1));
+        if (curr_size > size) {
+            curr_size = size;
+        }
+        kernel_memcpy(dest, (void *)paddr, curr_size);
+        dest += curr_size;
+        addr += curr_size;
+        size -= curr_size;
+    }
+
+    //3.与调用门相同地处理系统调用
+    do_handler_syscall(frame);
+}
+
+/**
+ * @brief 在当前cpu上开启sysenter快速系统调用入口，cpu不支持时应用程序继续使用调用门
+ *        每个cpu的MSR独立，BSP与AP都需调用，内核栈顶取自该cpu的TSS中随任务切换更新的esp0
+ *
+ * @param cpu 当前cpu
+ */
+void syscall_sysenter_init(cpu_t *cpu) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_SEP)) {
+        return;
+    }
+
+    wrmsr(MSR_SYSENTER_CS, KERNEL_SELECTOR_CS);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&cpu->tss.esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)exception_handler_sysenter);
+}
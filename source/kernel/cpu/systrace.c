@@ -0,0 +1,229 @@
+/**
+ * @file systrace.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  系统调用跟踪与耗时统计
+ *         每次系统调用都按耗时的log2计入所在cpu的直方图；
+ *         开启了跟踪的任务还会将调用号、参数、返回值与耗时写入所在cpu的跟踪缓冲区，由应用程序读取
+ * @version 0.1
+ * @date 2023-09-30
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "cpu/systrace.h"
+#include "common/cpu_instr.h"
+#include "core/memory.h"
+#include "core/task.h"
+#include "cpu/idt.h"
+#include "cpu/smp.h"
+#include "cpu/syscall.h"
+#include "tools/assert.h"
+#include "tools/klib.h"
+
+//每个cpu的跟踪缓冲区与统计，按cpu的逻辑编号索引
+static systrace_cpu_t *systrace_cpus;
+
+//跟踪记录的全局序号
+static uint32_t systrace_seq;
+
+/**
+ * @brief  为每个cpu分配跟踪缓冲区与统计，需在探测cpu数量之后、创建第一个进程之前调用
+ *
+ */
+void systrace_init(void) {
+    int pages = up2(sizeof(systrace_cpu_t) * smp_cpu_count(), MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    systrace_cpus = (systrace_cpu_t *)memory_alloc_pages(pages);
+    ASSERT(systrace_cpus != (systrace_cpu_t *)0);
+    kernel_memset(systrace_cpus, 0, pages * MEM_PAGE_SIZE);
+}
+
+/**
+ * @brief  将一次系统调用写入当前cpu的跟踪缓冲区，缓冲区满时覆盖最旧的记录
+ *
+ * @param cpu
+ * @param id
+ * @param args
+ * @param ret
+ * @param cycles
+ */
+static void systrace_record(systrace_cpu_t *cpu, int id, const uint32_t *args, int ret,
+                            uint32_t cycles) {
+    systrace_entry_t *entry = cpu->ring + (cpu->head & (SYSTRACE_RING_SIZE - 1));
+    entry->seq = systrace_seq++;
+    entry->pid = task_current()->pid;
+    entry->id = id;
+    kernel_memcpy(entry->args, (void *)args, sizeof(entry->args));
+    entry->ret = ret;
+    entry->cycles = cycles;
+
+    cpu->head++;
+}
+
+/**
+ * @brief  系统调用开始时记录时间戳计数器，不会返回的调用在此写入跟踪记录
+ *
+ * @param id
+ * @param args
+ * @return uint64_t 开始时的时间戳计数器
+ */
+uint64_t systrace_begin(int id, const uint32_t *args) {
+    if ((id == SYS_exit || id == SYS_thread_exit) && task_current()->trace) {
+        idt_state_t state = idt_enter_protection();  // TODO:加锁
+        systrace_record(systrace_cpus + cpu_id(), id, args, 0, 0);
+        idt_leave_protection(state);  // TODO:解锁
+    }
+
+    return rdtsc();
+}
+
+/**
+ * @brief  系统调用返回前计入耗时统计，任务开启了跟踪时写入跟踪记录
+ *         阻塞过的调用可能在另一个cpu上结束，记录在结束时所在的cpu上
+ *
+ * @param id
+ * @param args 调用开始时的参数，execve会改写栈帧，不能再从栈帧中读取
+ * @param start 调用开始时的时间戳计数器
+ * @param ret
+ */
+void systrace_end(int id, const uint32_t *args, uint64_t start, int ret) {
+    if (systrace_cpus == (systrace_cpu_t *)0 || id >= SYSTRACE_ID_MAX) {
+        return;
+    }
+
+    //1.耗时超过32位时按最大值计算
+    uint64_t elapsed = rdtsc() - start;
+    uint32_t cycles = (elapsed >> 32) ? 0xFFFFFFFF : (uint32_t)elapsed;
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    //2.计入当前cpu的统计，耗时的最高有效位即为直方图的桶号
+    systrace_cpu_t *cpu = systrace_cpus + cpu_id();
+    systrace_stat_t *stat = cpu->stats + id;
+    stat->count++;
+    stat->cycles_total += cycles;
+    if (cycles > stat->cycles_max) {
+        stat->cycles_max = cycles;
+    }
+    stat->hist[cycles ? 31 - __builtin_clz(cycles) : 0]++;
+
+    //3.任务开启了跟踪时写入跟踪缓冲区
+    if (task_current()->trace) {
+        systrace_record(cpu, id, args, ret, cycles);
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  开启或关闭任务的系统调用跟踪，只能设置当前任务或当前进程的子进程
+ *         只影响该任务自身，之后由它创建的线程继承该设置，fork出的子进程不继承
+ *
+ * @param pid 为0时设置当前任务
+ * @param enable
+ * @return int 0:成功, -1:任务不存在或无权设置
+ */
+int sys_trace(int pid, int enable) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    task_t *curr = task_current();
+    task_t *task = pid ? task_find(pid) : curr;
+    if (task == (task_t *)0 || (task != curr && task->parent != curr->group->leader)) {
+        idt_leave_protection(state);  // TODO:解锁
+        return -1;
+    }
+
+    task->trace = enable ? 1 : 0;
+
+    idt_leave_protection(state);  // TODO:解锁
+    return 0;
+}
+
+/**
+ * @brief  按序号顺序取出各cpu跟踪缓冲区中的记录，被覆盖的记录会被跳过
+ *         缓冲区由所有读取者共享，同时有多个读取者时各自只能读到部分记录
+ *
+ * @param buf 用户空间的缓冲区
+ * @param count 最多读取的记录数
+ * @param pid 被跟踪的任务，不为0时若该任务已退出且没有剩余记录，返回-1
+ * @return int 读取的记录数，-1:参数错误或被跟踪的任务已退出
+ */
+int sys_trace_read(systrace_entry_t *buf, int count, int pid) {
+    if ((uint32_t)buf < MEM_TASK_BASE || count <= 0) {
+        return -1;
+    }
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    //1.先判断任务是否已退出，退出前写入的记录都会在本次被读取
+    task_t *task = pid ? task_find(pid) : (task_t *)0;
+    int exited = pid && (task == (task_t *)0 || task->state == TASK_ZOMBIE);
+
+    //2.每次取出各cpu中序号最小的记录，写入用户空间时可能触发缺页异常，在内核锁的保护下完成
+    int n = 0;
+    while (n < count) {
+        systrace_cpu_t *first = (systrace_cpu_t *)0;
+        systrace_entry_t *first_entry = (systrace_entry_t *)0;
+
+        for (int i = 0; i < smp_cpu_count(); ++i) {
+            systrace_cpu_t *cpu = systrace_cpus + i;
+            if (cpu->head - cpu->tail > SYSTRACE_RING_SIZE) {
+                cpu->tail = cpu->head - SYSTRACE_RING_SIZE;
+            }
+            if (cpu->head == cpu->tail) {
+                continue;
+            }
+
+            systrace_entry_t *entry = cpu->ring + (cpu->tail & (SYSTRACE_RING_SIZE - 1));
+            if (first == (systrace_cpu_t *)0 || (int)(entry->seq - first_entry->seq) < 0) {
+                first = cpu;
+                first_entry = entry;
+            }
+        }
+
+        if (first == (systrace_cpu_t *)0) {
+            break;
+        }
+
+        buf[n++] = *first_entry;
+        first->tail++;
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+    return (n == 0 && exited) ? -1 : n;
+}
+
+/**
+ * @brief  获取系统调用在所有cpu上的耗时统计之和
+ *
+ * @param id 系统调用id
+ * @param stat 用户空间的传出参数
+ * @return int 0:成功, -1:参数错误
+ */
+int sys_trace_stat(int id, systrace_stat_t *stat) {
+    if (id < 0 || id >= SYSTRACE_ID_MAX || (uint32_t)stat < MEM_TASK_BASE) {
+        return -1;
+    }
+
+    systrace_stat_t sum;
+    kernel_memset(&sum, 0, sizeof(sum));
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    for (int i = 0; i < smp_cpu_count(); ++i) {
+        systrace_stat_t *cpu_stat = systrace_cpus[i].stats + id;
+        sum.count += cpu_stat->count;
+        sum.cycles_total += cpu_stat->cycles_total;
+        if (cpu_stat->cycles_max > sum.cycles_max) {
+            sum.cycles_max = cpu_stat->cycles_max;
+        }
+        for (int j = 0; j < SYSTRACE_HIST_SIZE; ++j) {
+            sum.hist[j] += cpu_stat->hist[j];
+        }
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+
+    *stat = sum;
+    return 0;
+}
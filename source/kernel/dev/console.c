@@ -281,7 +281,7 @@ int console_init(int index) {
                        (index * CONSOLE_CLO_MAX * CONSOLE_ROW_MAX);
 
   //初始化终端互斥锁
-  mutex_init(&console->mutex);
+  mutex_init(&console->mutex, "console");
   return 0;
 }
 
@@ -238,7 +238,7 @@ void disk_init(void) {
   kernel_memset(disk_table, 0, sizeof(disk_table));
 
   //初始化磁盘锁与操作信号量
-  mutex_init(&mutex);
+  mutex_init(&mutex, "disk");
   sem_init(&op_sem, 0);
 
   // 遍历并初始化化primary信道上的磁盘信息
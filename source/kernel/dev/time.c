@@ -2,11 +2,16 @@
  * @file time.c
  * @author kbpoyo (kbpoyo.com)
  * @brief  初始化定时器
+ *         定时器工作在单次定时模式，每次中断后根据下一个事件重新设置计数值:
+ *         有任务运行时定时到下一个时间片边界，模拟周期时钟;
+ *         只有空闲进程时跳过中间的时间片，直接定时到下一个定时器到期的时间;
+ *         高精度定时器在时间片之间到期时，定时到其到期时间
+ *         定时器中断只发送给BSP，时间轮与高精度定时器由BSP统一处理，AP使用各自的本地时钟调度
  * @version 0.1
  * @date 2023-01-14
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
+ *
  */
 
 #include "dev/time.h"
@@ -15,40 +20,253 @@
 #include "os_cfg.h"
 #include "cpu/idt.h"
 #include "core/task.h"
+#include "core/timer.h"
+#include "core/vsys.h"
 
 static uint32_t sys_tick = 0;
 
+static uint32_t prog_start;     //最近一次设置计数值时的时间，以振荡次数为单位
+static uint32_t prog_count;     //最近一次设置的计数值
+static uint32_t next_tick;      //下一个时间片边界的时间
+static list_t hrtimer_list;     //在下一个时间片边界之前到期的高精度定时器，按到期时间排序
+static time_stat_t time_stat;   //定时器中断的统计信息
+
+/**
+ * @brief  锁存并读取计数器的当前值
+ *
+ * @return uint16_t
+ */
+static uint16_t pit_read_counter(void) {
+    outb(PIT_COMMAND_MODE_PORT, PIT_SELECT_COUNTER | PIT_LATCH);
+    uint8_t low = inb(PIT_CHANNEL_DATA_PORT);
+    uint8_t high = inb(PIT_CHANNEL_DATA_PORT);
+    return ((uint16_t)high << 8) | low;
+}
+
+/**
+ * @brief  获取当前时间，以晶体振荡次数为单位，约1小时回绕一次，比较时间需用差值
+ *
+ * @return uint32_t
+ */
+uint32_t time_now(void) {
+    idt_state_t state = idt_enter_protection();
+
+    //计数到0后计数器继续从0xffff递减，计数值不超过TIME_MAX_CYCLES时按16位取差值仍能得到经过的时间
+    uint32_t now = prog_start + ((prog_count - pit_read_counter()) & 0xffff);
+
+    idt_leave_protection(state);
+    return now;
+}
+
+/**
+ * @brief  设置定时器在cycles次振荡后产生一次中断
+ *
+ * @param now 当前时间
+ * @param cycles
+ */
+static void pit_program(uint32_t now, int cycles) {
+    if (cycles < TIME_MIN_CYCLES) {
+        cycles = TIME_MIN_CYCLES;
+    } else if (cycles > TIME_MAX_CYCLES) {
+        cycles = TIME_MAX_CYCLES;
+    }
+
+    prog_start = now;
+    prog_count = cycles;
+
+    //写入控制字后计数器停止计数，先写入低8位，再写入高8位后开始计数
+    outb(PIT_COMMAND_MODE_PORT, PIT_SELECT_COUNTER | PIT_READ_LOAD | PIT_MODE_ONESHOT);
+    outb(PIT_CHANNEL_DATA_PORT, cycles & 0xff);
+    outb(PIT_CHANNEL_DATA_PORT, (cycles >> 8) & 0xff);
+}
+
+/**
+ * @brief  根据下一个需要处理的事件重新设置定时器
+ *
+ */
+void time_reprogram(void) {
+    idt_state_t state = idt_enter_protection();
+
+    uint32_t now = time_now();
+
+    //1.默认在下一个时间片边界产生中断
+    uint32_t next = next_tick;
+
+    //2.只有空闲进程可运行时不需要时间片，跳到时间轮中下一个可能有定时器到期的时间片
+    if (OS_TICKLESS_IDLE && task_is_idle()) {
+        next += (timer_next_ticks() - 1) * TIME_CYCLES_PER_TICK;
+    }
+
+    //3.高精度定时器在此之前到期，则在其到期时间产生中断
+    list_node_t *node = list_get_first(&hrtimer_list);
+    if (node) {
+        ktimer_t *timer = list_node_parent(node, ktimer_t, node);
+        if ((int)(timer->expire - next) < 0) {
+            next = timer->expire;
+        }
+    }
+
+    pit_program(now, (int)(next - now));
+
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  启动高精度定时器，在deadline时刻调用定时器的回调函数
+ *         到期时间在下一个时间片边界之后时，先用时间轮定时到不晚于deadline的最后一个时间片边界，
+ *         此时回调函数会被提前调用，需再次调用本函数定时剩余不足一个时间片的部分，直到返回-1
+ *
+ * @param timer 已初始化的定时器
+ * @param deadline 到期时间，以振荡次数为单位
+ * @return int 0:已启动，-1:已经到期，定时器未启动
+ */
+int time_hrtimer_start(ktimer_t *timer, uint32_t deadline) {
+    int ret = 0;
+    idt_state_t state = idt_enter_protection();
+
+    //1.定时器已启动则先将其取下
+    timer_remove(timer);
+
+    //2.到期时间已过或过近，直接视为到期
+    if ((int)(deadline - time_now()) < TIME_MIN_CYCLES) {
+        ret = -1;
+        goto start_end;
+    }
+
+    //3.到期时间在下一个时间片边界之后，交给时间轮处理到最后一个时间片边界
+    if ((int)(deadline - next_tick) >= 0) {
+        timer_add(timer, (deadline - next_tick) / TIME_CYCLES_PER_TICK + 1, 0);
+
+        //BSP空闲时可能跳过了该时间片，由其它cpu启动的定时器需重新设置下一次中断
+        if (OS_TICKLESS_IDLE && task_is_idle()) {
+            time_reprogram();
+        }
+        goto start_end;
+    }
+
+    //4.在下一个时间片边界之前到期，按到期时间顺序插入高精度定时器链表
+    timer->expire = deadline;
+    timer->period = 0;
+    list_node_t *node = list_get_first(&hrtimer_list);
+    while (node && (int)(list_node_parent(node, ktimer_t, node)->expire - deadline) <= 0) {
+        node = list_node_next(node);
+    }
+    list_insert_before(&hrtimer_list, node, &timer->node);
+    timer->slot = &hrtimer_list;
+
+    //5.成为最早到期的定时器，则提前下一次中断
+    if (list_get_first(&hrtimer_list) == &timer->node) {
+        time_reprogram();
+    }
+
+start_end:
+    idt_leave_protection(state);
+    return ret;
+}
+
+/**
+ * @brief  获取定时器中断的统计信息
+ *
+ * @param stat
+ */
+void time_get_stat(time_stat_t *stat) {
+    idt_state_t state = idt_enter_protection();
+    *stat = time_stat;
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  忙等待指定的时间，只在关中断的初始化阶段使用，如启动AP时的等待
+ *         按16位取差值累计计数器经过的振荡次数，两次读取的间隔需小于计数器回绕一圈的时间
+ *
+ * @param us 等待的时间，以微秒为单位
+ */
+void time_delay(uint32_t us) {
+    uint32_t cycles = us * TIME_CYCLES_PER_MS / 1000;
+    uint32_t passed = 0;
+    uint16_t last = pit_read_counter();
+
+    while (passed < cycles) {
+        uint16_t curr = pit_read_counter();
+        passed += (uint16_t)(last - curr);
+        last = curr;
+    }
+}
+
 /**
  * @brief  处理定时器中断的c函数
- * 
+ *
  * @param frame 异常栈帧
  */
 void do_handler_time(const exception_frame_t *frame) {
-    sys_tick++;
+    time_stat.irq_count++;
+    uint32_t now = time_now();
+
+    //1.处理所有已经过的时间片边界，空闲时跳过的时间片在此一并补上
+    int ticks = 0;
+    while ((int)(now - next_tick) >= 0) {
+        sys_tick++;
+        next_tick += TIME_CYCLES_PER_TICK;
+        ticks++;
+
+        //处理在当前时间片到期的内核定时器，如唤醒延时到期的任务
+        timer_tick();
+    }
+    time_stat.tick_count += ticks;
+    if (ticks > 0) {
+        //记录到应用程序可直接读取的vsys数据页中
+        vsys_update(sys_tick);
+    }
+    if (ticks > 1) {
+        time_stat.idle_skip += ticks - 1;
+    }
+
+    //2.处理已到期的高精度定时器
+    list_node_t *node;
+    while ((node = list_get_first(&hrtimer_list)) != (list_node_t *)0) {
+        ktimer_t *timer = list_node_parent(node, ktimer_t, node);
+        if ((int)(timer->expire - now) >= TIME_MIN_CYCLES) {
+            break;
+        }
+
+        list_remove_first(&hrtimer_list);
+        timer->slot = (list_t *)0;
+        timer->func(timer->arg);
+    }
+
+    //3.根据是否还有任务需要运行，设置下一次中断的时间
+    time_reprogram();
 
     //因为ICW4的EOI位为0，所以要手动发送EOI即中断结束信号
     pic_send_eoi(IRQ0_TIMER);
 
     //运行完一个时间片，判断是否需要执行任务切换，若需要则执行
     //必须写在发送eoi之后，防止发生任务切换导致eoi没有发送，从而无法进行下一次中断
-    task_slice_end();   
+    if (ticks) {
+        task_slice_end();
+    } else {
+        //只有高精度定时器到期，被唤醒的任务优先级更高时立即抢占
+        task_preempt();
+    }
+
+    //进程已被其它线程退出时，当前线程不再返回用户态
+    if (frame->cs & 0x3) {
+        task_exit_check();
+    }
 }
 
 
 /**
  * @brief  初始化可编程定时器
- * 
+ *
  */
 static void init_pit(void) {
-    //1.选择定时器的计算器，读取与加载初始值模式，以及工作模式
-    outb(PIT_COMMAND_MODE_PORT, PIT_SELECT_COUNTER | PIT_READ_LOAD | PIT_MODE);
-
-    //2.写入16位初始值,即一个中断后期晶体的振荡次数，由确定的加载方式知，先写入低8位，再写入高8位
-    uint16_t reload_count = (PIT_OSC_FREQ / 1000) * OS_TICKS_MS;   //确定晶体一个中断周期的震荡次数
-    outb(PIT_CHANNEL_DATA_PORT, reload_count & 0xff);
-    outb(PIT_CHANNEL_DATA_PORT, (reload_count >> 8) & 0xff);
+    //1.以单次定时模式启动定时器，在第一个时间片边界产生中断
+    prog_start = 0;
+    next_tick = TIME_CYCLES_PER_TICK;
+    pit_program(0, TIME_CYCLES_PER_TICK);
 
-    //3.绑定定时器中断的异常处理程序,并开启该中断
+    //2.绑定定时器中断的异常处理程序,并开启该中断
     idt_install(IRQ0_TIMER, (idt_handler_t)exception_handler_time);
     idt_enable(IRQ0_TIMER);
 
@@ -57,9 +275,11 @@ static void init_pit(void) {
 
 /**
  * @brief  初始化定时器
- * 
+ *
  */
 void time_init(void) {
     sys_tick = 0;
+    list_init(&hrtimer_list);
+    timer_manager_init();
     init_pit();
-}
\ No newline at end of file
+}
@@ -15,6 +15,8 @@
 #include "dev/keyboard.h"
 #include "dev/console.h"
 #include "cpu/idt.h"
+#include "common/cpu_instr.h"
+#include "tools/klib.h"
 
 static tty_t tty_table[TTY_TABLE_SIZE]; //全局tty设备表
 static int curr_tty_index = 0;    //系统当前使用tty设备索引
@@ -135,6 +137,10 @@ int tty_open(device_t *dev) {
     tty->oflags = TTY_OCRLF;    //默认开启输出模式下'\n'转换为'\r\n'的模式
     tty->iflags = TTY_INCLR | TTY_IECHO; //默认开启输入模式下的换行转换和字符回显
 
+    //清空按键延迟统计
+    tty->in_stamp = 0;
+    kernel_memset(&tty->latency, 0, sizeof(tty_latency_t));
+
     //初始化tty设备需要的键盘与终端
     kbd_init();
     console_init(index);
@@ -199,6 +205,26 @@ int tty_write(device_t *dev, int addr, char *buf, int size) {
 } 
 
 
+/**
+ * @brief 记录一次按键到回显的延迟，延迟包含了读取进程被唤醒并调度运行的时间
+ * 
+ * @param tty 
+ */
+static void tty_latency_record(tty_t *tty) {
+    idt_state_t state = idt_enter_protection();
+    if (tty->in_stamp) {
+        uint32_t delay = (uint32_t)((rdtsc() - tty->in_stamp) >> 10);
+        tty->in_stamp = 0;
+
+        tty->latency.count++;
+        tty->latency.total += delay;
+        if (delay > tty->latency.max) {
+            tty->latency.max = delay;
+        }
+    }
+    idt_leave_protection(state);
+}
+
 /**
  * @brief 读取读取设备
  * 
@@ -216,8 +242,10 @@ int tty_read(device_t *dev, int addr, char *buf, int size) {
     
     //2.从输入缓冲队列中读取字符到缓冲区buf中
     while (len < size) {
-        //2.1等待资源就绪
-        sem_wait(&tty->in_sem);
+        //2.1等待资源就绪，进程正在退出时返回已读取的字符
+        if (sem_wait_intr(&tty->in_sem) < 0) {
+            break;
+        }
 
         //2.2资源已就绪，读取一个字符
         char ch;
@@ -251,6 +279,9 @@ int tty_read(device_t *dev, int addr, char *buf, int size) {
             tty_write(dev, 0, &ch, 1);
         }
 
+        //记录按键从中断到达到被读取并回显的延迟
+        tty_latency_record(tty);
+
         //若输入回车或者换行则直接停止读取
         if (ch == '\n' || ch == '\r') {
             break;
@@ -280,6 +311,14 @@ int tty_control(device_t *dev, int cmd, int arg0, int arg1) {
 			    *(int *)arg0 = sem_count(&tty->in_sem); 
 		    }
 		    break;
+        case TTY_CMD_LATENCY:   //获取按键到回显的延迟统计
+            if (arg0) {
+                kernel_memcpy((void *)arg0, &tty->latency, sizeof(tty_latency_t));
+            }
+            if (arg1) {
+                kernel_memset(&tty->latency, 0, sizeof(tty_latency_t));
+            }
+            break;
         default :
             break;
     }
@@ -311,8 +350,11 @@ void tty_in(char ch) {
         return;
     }
 
-    //3.将字符写入输入缓冲队列
+    //3.将字符写入输入缓冲队列，并记录还没有被读取的最早按键的到达时间
     tty_fifo_put(&tty->in_fifo, ch);
+    if (tty->in_stamp == 0) {
+        tty->in_stamp = rdtsc();
+    }
     
     //4.准备好一份可读资源，唤醒等待的进程或添加可获取资源
     sem_notify(&tty->in_sem);
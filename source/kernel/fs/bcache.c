@@ -0,0 +1,730 @@
+/**
+ * @file bcache.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  块设备的缓冲区缓存
+ *         缓存块按(设备id, 块号)散列到哈希表中查找，引用计数为0的块按最近使用的顺序放入lru链表，
+ *         需要新块时换出最久未使用的干净块；修改过的块只标记为脏，在换出或同步时批量写回磁盘
+ *         预读请求放入队列后立即返回，由预读线程在后台读入，读取者稍后即可命中缓存
+ * @version 0.1
+ * @date 2023-10-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "fs/bcache.h"
+#include "dev/dev.h"
+#include "core/memory.h"
+#include "core/task.h"
+#include "cpu/idt.h"
+#include "ipc/sem.h"
+#include "tools/assert.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+static bcache_buf_t *bcache_bufs;               //所有缓存块的描述结构
+static int bcache_buf_cnt;                      //缓存块的总数
+static list_t bcache_hash[BCACHE_HASH_SIZE];    //按(设备id, 块号)散列的哈希表
+static list_t bcache_lru;                       //引用计数为0的块，表头为最久未使用的块
+static sem_t bcache_io_sem;                     //等待缓存块读入完成的任务，只作为等待队列使用
+static bcache_stat_t bcache_stat;               //命中与磁盘访问统计
+
+static bcache_ra_req_t bcache_ra_queue[BCACHE_RA_QUEUE_SIZE];   //预读请求队列
+static uint32_t bcache_ra_head;                 //已放入队列的请求总数
+static uint32_t bcache_ra_tail;                 //已取出的请求总数
+static sem_t bcache_ra_sem;                     //队列中待处理的请求数
+
+/**
+ * @brief  初始化缓存，按内存上限分配数据区与描述结构，所有块都放入lru链表
+ *
+ */
+void bcache_init(void) {
+    //1.分配数据区与描述结构
+    bcache_buf_cnt = BCACHE_MEM_SIZE / BCACHE_BLOCK_SIZE;
+    uint8_t *data = (uint8_t *)memory_alloc_pages(BCACHE_MEM_SIZE / MEM_PAGE_SIZE);
+    int desc_pages = up2(bcache_buf_cnt * sizeof(bcache_buf_t), MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    bcache_bufs = (bcache_buf_t *)memory_alloc_pages(desc_pages);
+    ASSERT(data != (uint8_t *)0 && bcache_bufs != (bcache_buf_t *)0);
+
+    //2.初始化哈希表与lru链表
+    for (int i = 0; i < BCACHE_HASH_SIZE; ++i) {
+        list_init(bcache_hash + i);
+    }
+    list_init(&bcache_lru);
+    sem_init(&bcache_io_sem, 0);
+    sem_init(&bcache_ra_sem, 0);
+    bcache_ra_head = bcache_ra_tail = 0;
+
+    //3.初始化每个缓存块，均未缓存任何块
+    for (int i = 0; i < bcache_buf_cnt; ++i) {
+        bcache_buf_t *buf = bcache_bufs + i;
+        list_node_init(&buf->hash_node);
+        list_node_init(&buf->lru_node);
+        buf->dev_id = -1;
+        buf->block = 0;
+        buf->ref = 0;
+        buf->flags = 0;
+        buf->data = data + i * BCACHE_BLOCK_SIZE;
+        list_insert_last(&bcache_lru, &buf->lru_node);
+    }
+
+    kernel_memset(&bcache_stat, 0, sizeof(bcache_stat));
+    bcache_stat.blocks = bcache_buf_cnt;
+}
+
+/**
+ * @brief  获取块所在的哈希桶，相邻的块落在相邻的桶中
+ *
+ * @param dev_id
+ * @param block
+ * @return list_t*
+ */
+static list_t *bcache_bucket(int dev_id, uint32_t block) {
+    return bcache_hash + ((block + (uint32_t)dev_id * 31) & (BCACHE_HASH_SIZE - 1));
+}
+
+/**
+ * @brief  在哈希表中查找缓存块
+ *
+ * @param dev_id
+ * @param block
+ * @return bcache_buf_t* 未缓存时返回0
+ */
+static bcache_buf_t *bcache_find(int dev_id, uint32_t block) {
+    list_t *bucket = bcache_bucket(dev_id, block);
+    for (list_node_t *node = list_get_first(bucket); node; node = list_node_next(node)) {
+        bcache_buf_t *buf = list_node_parent(node, bcache_buf_t, hash_node);
+        if (buf->dev_id == dev_id && buf->block == block) {
+            return buf;
+        }
+    }
+
+    return (bcache_buf_t *)0;
+}
+
+/**
+ * @brief  增加缓存块的引用，使其不会被换出
+ *
+ * @param buf
+ */
+static void bcache_hold(bcache_buf_t *buf) {
+    if (buf->ref++ == 0) {
+        list_remove(&bcache_lru, &buf->lru_node);
+    }
+}
+
+/**
+ * @brief  唤醒所有等待缓存块读入的任务，被唤醒者需重新检查缓存块的状态
+ *
+ */
+static void bcache_wakeup_all(void) {
+    while (!list_is_empty(&bcache_io_sem.wait_list)) {
+        sem_notify(&bcache_io_sem);
+    }
+}
+
+
+/**
+ * @brief  减少缓存块的引用，引用计数为0时放入lru链表的表尾，调用者需在临界区中
+ *
+ * @param buf
+ */
+static void bcache_put(bcache_buf_t *buf) {
+    ASSERT(buf->ref > 0);
+    if (--buf->ref == 0) {
+        list_insert_last(&bcache_lru, &buf->lru_node);
+    }
+}
+
+/**
+ * @brief  读写磁盘上的连续块，磁盘io期间任务会阻塞，先离开临界区
+ *         调用者需持有涉及的各缓存块的引用，保证它们不会被换出
+ *
+ * @param state 调用者进入临界区时的状态
+ * @param write 1:写磁盘, 0:读磁盘
+ * @param dev_id
+ * @param block
+ * @param buf
+ * @param count
+ * @return int 读写的块数，-1:失败
+ */
+static int bcache_dev_io(idt_state_t state, int write, int dev_id, uint32_t block,
+                         uint8_t *buf, int count) {
+    idt_leave_protection(state);  // TODO:解锁
+    int cnt = write ? dev_write(dev_id, block, (char *)buf, count)
+                    : dev_read(dev_id, block, (char *)buf, count);
+    idt_enter_protection();  // TODO:加锁
+    return cnt;
+}
+
+/**
+ * @brief  将一组连续的脏块用一条写命令写回磁盘，调用者需持有各块的引用
+ *
+ * @param state
+ * @param run
+ * @param count
+ * @return int 0:成功, -1:失败，各块重新标记为脏
+ */
+static int bcache_write_run(idt_state_t state, bcache_buf_t **run, int count) {
+    //1.先清除脏标志，写回期间再次修改的块会重新被标记
+    for (int i = 0; i < count; ++i) {
+        run[i]->flags &= ~BCACHE_DIRTY;
+        bcache_stat.dirty--;
+    }
+
+    //2.单个块直接从数据区写回，多个块经中转缓冲区合并为一次写命令
+    uint8_t *bounce = count > 1 ? (uint8_t *)memory_alloc_page() : run[0]->data;
+    int cnt = -1;
+    if (bounce) {
+        if (count > 1) {
+            for (int i = 0; i < count; ++i) {
+                kernel_memcpy(bounce + i * BCACHE_BLOCK_SIZE, run[i]->data, BCACHE_BLOCK_SIZE);
+            }
+        }
+
+        cnt = bcache_dev_io(state, 1, run[0]->dev_id, run[0]->block, bounce, count);
+        bcache_stat.disk_writes++;
+        bcache_stat.write_blocks += count;
+
+        if (count > 1) {
+            memory_free_page((uint32_t)bounce);
+        }
+    }
+
+    //3.写回失败时重新标记为脏
+    if (cnt != count) {
+        for (int i = 0; i < count; ++i) {
+            if (!(run[i]->flags & BCACHE_DIRTY)) {
+                run[i]->flags |= BCACHE_DIRTY;
+                bcache_stat.dirty++;
+            }
+        }
+        log_printf("bcache: write block %d failed\n", run[0]->block);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief  将一组连续的块用一条读命令读入，完成后清除各块的读入标志并唤醒等待者
+ *         调用者需持有各块的引用并已设置读入标志
+ *
+ * @param state
+ * @param run
+ * @param count
+ * @return int 0:成功, -1:失败，各块仍为无效
+ */
+static int bcache_read_run(idt_state_t state, bcache_buf_t **run, int count) {
+    //1.单个块直接读入数据区，多个块经中转缓冲区读入
+    uint8_t *bounce = count > 1 ? (uint8_t *)memory_alloc_page() : run[0]->data;
+    int cnt = -1;
+    if (bounce) {
+        cnt = bcache_dev_io(state, 0, run[0]->dev_id, run[0]->block, bounce, count);
+        bcache_stat.disk_reads++;
+        bcache_stat.read_blocks += count;
+    }
+
+    //2.读入成功时拷贝到各块的数据区并标记为有效
+    for (int i = 0; i < count; ++i) {
+        if (cnt == count) {
+            if (count > 1) {
+                kernel_memcpy(run[i]->data, bounce + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+            }
+            run[i]->flags |= BCACHE_VALID;
+        }
+        run[i]->flags &= ~BCACHE_BUSY;
+    }
+
+    if (bounce && count > 1) {
+        memory_free_page((uint32_t)bounce);
+    }
+
+    bcache_wakeup_all();
+    return (cnt == count) ? 0 : -1;
+}
+
+/**
+ * @brief  写回包含块block的一段连续脏块，最多BCACHE_RUN_MAX块合并为一条写命令
+ *
+ * @param state
+ * @param dev_id
+ * @param block 脏块的块号
+ * @return int 0:成功, -1:失败
+ */
+static int bcache_flush_run(idt_state_t state, int dev_id, uint32_t block) {
+    //1.向前找到连续脏块的起点
+    uint32_t start = block;
+    for (int n = 1; n < BCACHE_RUN_MAX && start > 0; ++n) {
+        bcache_buf_t *pre = bcache_find(dev_id, start - 1);
+        if (pre == (bcache_buf_t *)0 || !(pre->flags & BCACHE_DIRTY)) {
+            break;
+        }
+        start--;
+    }
+
+    //2.从起点开始收集连续的脏块并持有引用，一次写回
+    bcache_buf_t *run[BCACHE_RUN_MAX];
+    int count = 0;
+    while (count < BCACHE_RUN_MAX) {
+        bcache_buf_t *next = bcache_find(dev_id, start + count);
+        if (next == (bcache_buf_t *)0 || !(next->flags & BCACHE_DIRTY)) {
+            break;
+        }
+        bcache_hold(next);
+        run[count++] = next;
+    }
+
+    int err = bcache_write_run(state, run, count);
+    for (int i = 0; i < count; ++i) {
+        bcache_put(run[i]);
+    }
+
+    return err;
+}
+
+/**
+ * @brief  查找(dev_id, block)对应的缓存块并持有引用，未缓存时换出lru链表中最久未使用的干净块
+ *         没有干净块时，may_block为1则先写回最久未使用的脏块所在的一段连续脏块再重试，否则返回0
+ *
+ * @param state
+ * @param dev_id
+ * @param block
+ * @param may_block 是否允许为写回脏块而阻塞
+ * @return bcache_buf_t* 缓存块，数据不一定有效，0:没有可用的块
+ */
+static bcache_buf_t *bcache_lookup(idt_state_t state, int dev_id, uint32_t block, int may_block) {
+    while (1) {
+        //1.已缓存时直接持有
+        bcache_buf_t *buf = bcache_find(dev_id, block);
+        if (buf) {
+            bcache_hold(buf);
+            return buf;
+        }
+
+        //2.从表头开始查找最久未使用的干净块，将其换出
+        for (list_node_t *node = list_get_first(&bcache_lru); node; node = list_node_next(node)) {
+            buf = list_node_parent(node, bcache_buf_t, lru_node);
+            if (buf->flags & BCACHE_DIRTY) {
+                continue;
+            }
+
+            if (buf->dev_id >= 0) {
+                list_remove(bcache_bucket(buf->dev_id, buf->block), &buf->hash_node);
+                if (buf->flags & BCACHE_VALID) {
+                    bcache_stat.evictions++;
+                }
+            }
+
+            buf->dev_id = dev_id;
+            buf->block = block;
+            buf->flags = 0;
+            list_insert_first(bcache_bucket(dev_id, block), &buf->hash_node);
+            bcache_hold(buf);
+            return buf;
+        }
+
+        //3.没有干净块，写回最久未使用的脏块，写回期间其它任务可能已缓存了该块，需重新查找
+        list_node_t *node = list_get_first(&bcache_lru);
+        if (node == (list_node_t *)0 || !may_block) {
+            return (bcache_buf_t *)0;
+        }
+
+        buf = list_node_parent(node, bcache_buf_t, lru_node);
+        if (bcache_flush_run(state, buf->dev_id, buf->block) < 0) {
+            return (bcache_buf_t *)0;
+        }
+    }
+}
+
+/**
+ * @brief  读取块并持有其缓存块，未命中时连同其后最多ahead个未缓存的连续块用一条命令读入
+ *         预读的块只留在缓存中，之后顺序读取时即可命中
+ *
+ * @param dev_id
+ * @param block
+ * @param ahead 可顺带读入的后续块数
+ * @return bcache_buf_t* 数据有效的缓存块，使用完毕后需调用bcache_release，0:读取失败
+ */
+bcache_buf_t *bcache_read(int dev_id, uint32_t block, int ahead) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    //1.获取缓存块
+    bcache_buf_t *buf = bcache_lookup(state, dev_id, block, 1);
+    if (buf == (bcache_buf_t *)0) {
+        idt_leave_protection(state);  // TODO:解锁
+        return (bcache_buf_t *)0;
+    }
+
+    //2.其它任务正在读入该块，等待读入完成
+    while (buf->flags & BCACHE_BUSY) {
+        sem_wait(&bcache_io_sem);
+    }
+
+    if (buf->flags & BCACHE_VALID) {
+        bcache_stat.hits++;
+        idt_leave_protection(state);  // TODO:解锁
+        return buf;
+    }
+
+    //3.未命中，收集其后连续的未缓存块，不为预读而阻塞
+    bcache_stat.misses++;
+    bcache_buf_t *run[BCACHE_RUN_MAX];
+    int count = 0;
+    buf->flags |= BCACHE_BUSY;
+    run[count++] = buf;
+    while (count <= ahead && count < BCACHE_RUN_MAX) {
+        bcache_buf_t *next = bcache_lookup(state, dev_id, block + count, 0);
+        if (next == (bcache_buf_t *)0) {
+            break;
+        }
+
+        if (next->flags & (BCACHE_VALID | BCACHE_BUSY)) {
+            bcache_put(next);
+            break;
+        }
+
+        next->flags |= BCACHE_BUSY;
+        run[count++] = next;
+    }
+
+    //4.一次读入，预读的块不再持有
+    int err = bcache_read_run(state, run, count);
+    for (int i = 1; i < count; ++i) {
+        bcache_put(run[i]);
+    }
+
+    if (err < 0) {
+        bcache_put(buf);
+        buf = (bcache_buf_t *)0;
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+    return buf;
+}
+
+/**
+ * @brief  获取块的缓存块但不从磁盘读入，用于整块覆盖写，写入数据后需调用bcache_mark_dirty
+ *
+ * @param dev_id
+ * @param block
+ * @return bcache_buf_t* 数据不一定有效的缓存块，0:没有可用的块
+ */
+bcache_buf_t *bcache_get(int dev_id, uint32_t block) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    bcache_buf_t *buf = bcache_lookup(state, dev_id, block, 1);
+    while (buf && (buf->flags & BCACHE_BUSY)) {
+        sem_wait(&bcache_io_sem);
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+    return buf;
+}
+
+/**
+ * @brief  释放对缓存块的引用
+ *
+ * @param buf
+ */
+void bcache_release(bcache_buf_t *buf) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+    bcache_put(buf);
+    idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  标记缓存块已被修改，数据在换出或同步时写回磁盘
+ *
+ * @param buf
+ */
+void bcache_mark_dirty(bcache_buf_t *buf) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    if (!(buf->flags & BCACHE_DIRTY)) {
+        bcache_stat.dirty++;
+    }
+    buf->flags |= BCACHE_VALID | BCACHE_DIRTY;
+
+    idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  将设备的所有脏块写回磁盘，块号连续的脏块合并为一条写命令
+ *
+ * @param dev_id
+ * @return int 0:成功, -1:有块写回失败
+ */
+int bcache_sync(int dev_id) {
+    int err = 0;
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    for (int i = 0; i < bcache_buf_cnt; ++i) {
+        bcache_buf_t *buf = bcache_bufs + i;
+        if (buf->dev_id != dev_id || !(buf->flags & BCACHE_DIRTY)) {
+            continue;
+        }
+
+        if (bcache_flush_run(state, dev_id, buf->block) < 0) {
+            err = -1;
+        }
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+    return err;
+}
+
+/**
+ * @brief  写回设备的所有脏块后丢弃该设备的缓存，用于卸载文件系统
+ *
+ * @param dev_id
+ */
+void bcache_invalidate(int dev_id) {
+    bcache_sync(dev_id);
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    for (int i = 0; i < bcache_buf_cnt; ++i) {
+        bcache_buf_t *buf = bcache_bufs + i;
+        if (buf->dev_id != dev_id || buf->ref) {
+            continue;
+        }
+
+        //写回失败的块也一并丢弃，空闲块移到lru链表的表头优先被使用
+        if (buf->flags & BCACHE_DIRTY) {
+            bcache_stat.dirty--;
+        }
+        list_remove(bcache_bucket(buf->dev_id, buf->block), &buf->hash_node);
+        buf->dev_id = -1;
+        buf->flags = 0;
+        list_remove(&bcache_lru, &buf->lru_node);
+        list_insert_first(&bcache_lru, &buf->lru_node);
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  绕过缓存将连续的块用一条命令直接读入buf，用于整簇的大块读取
+ *         缓存中的有效块可能比磁盘上的更新，读入后用其覆盖buf中的对应部分
+ *
+ * @param dev_id
+ * @param block
+ * @param count
+ * @param buf
+ * @return int 0:成功, -1:失败
+ */
+int bcache_read_direct(int dev_id, uint32_t block, int count, uint8_t *buf) {
+    int cnt = dev_read(dev_id, block, (char *)buf, count);
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    bcache_stat.direct_reads++;
+    bcache_stat.direct_read_blocks += count;
+
+    if (cnt == count) {
+        for (int i = 0; i < count; ++i) {
+            bcache_buf_t *cache = bcache_find(dev_id, block + i);
+            if (cache && (cache->flags & BCACHE_VALID)) {
+                kernel_memcpy(buf + i * BCACHE_BLOCK_SIZE, cache->data, BCACHE_BLOCK_SIZE);
+            }
+        }
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+    return (cnt == count) ? 0 : -1;
+}
+
+/**
+ * @brief  绕过缓存将buf用一条命令直接写入连续的块，用于整簇的大块写入
+ *         先用新数据更新缓存中已有的块，使之后的读取与写回都不会使用旧数据
+ *
+ * @param dev_id
+ * @param block
+ * @param count
+ * @param buf
+ * @return int 0:成功, -1:失败
+ */
+int bcache_write_direct(int dev_id, uint32_t block, int count, const uint8_t *buf) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    //1.等待正在读入的块完成后再覆盖，已缓存的块保持为脏，
+    //  防止正在写回的旧数据晚于本次写入到达磁盘
+    for (int i = 0; i < count; ++i) {
+        bcache_buf_t *cache = bcache_find(dev_id, block + i);
+        if (cache == (bcache_buf_t *)0) {
+            continue;
+        }
+
+        bcache_hold(cache);
+        while (cache->flags & BCACHE_BUSY) {
+            sem_wait(&bcache_io_sem);
+        }
+        kernel_memcpy(cache->data, (void *)(buf + i * BCACHE_BLOCK_SIZE), BCACHE_BLOCK_SIZE);
+        if (!(cache->flags & BCACHE_DIRTY)) {
+            bcache_stat.dirty++;
+        }
+        cache->flags |= BCACHE_VALID | BCACHE_DIRTY;
+        bcache_put(cache);
+    }
+
+    bcache_stat.direct_writes++;
+    bcache_stat.direct_write_blocks += count;
+
+    idt_leave_protection(state);  // TODO:解锁
+
+    //2.整段数据直接写入磁盘
+    int cnt = dev_write(dev_id, block, (char *)buf, count);
+    return (cnt == count) ? 0 : -1;
+}
+
+/**
+ * @brief  判断块是否已缓存或正在读入，已缓存的块应经缓存读取，不再直接读磁盘
+ *
+ * @param dev_id
+ * @param block
+ * @return int 1:已缓存或正在读入, 0:未缓存
+ */
+int bcache_cached(int dev_id, uint32_t block) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    bcache_buf_t *buf = bcache_find(dev_id, block);
+    int cached = buf && (buf->flags & (BCACHE_VALID | BCACHE_BUSY));
+
+    idt_leave_protection(state);  // TODO:解锁
+    return cached;
+}
+
+/**
+ * @brief  提交异步预读请求，不等待读入完成，队列已满时丢弃该请求
+ *
+ * @param dev_id
+ * @param block
+ * @param count
+ */
+void bcache_prefetch(int dev_id, uint32_t block, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    if (bcache_ra_head - bcache_ra_tail >= BCACHE_RA_QUEUE_SIZE) {
+        bcache_stat.ra_dropped++;
+    } else {
+        bcache_ra_req_t *req = bcache_ra_queue + bcache_ra_head % BCACHE_RA_QUEUE_SIZE;
+        req->dev_id = dev_id;
+        req->block = block;
+        req->count = count;
+        bcache_ra_head++;
+        bcache_stat.ra_requests++;
+        sem_notify(&bcache_ra_sem);
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  将预读线程收集的一段连续块读入，并放弃对它们的引用
+ *
+ * @param state
+ * @param run
+ * @param count
+ */
+static void bcache_ra_read(idt_state_t state, bcache_buf_t **run, int count) {
+    if (count == 0) {
+        return;
+    }
+
+    if (bcache_read_run(state, run, count) == 0) {
+        bcache_stat.ra_blocks += count;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        bcache_put(run[i]);
+    }
+}
+
+/**
+ * @brief  处理一个预读请求，将范围内未缓存的块按连续段读入，已缓存或正在读入的块跳过
+ *         不为预读写回脏块，没有干净块可换出时放弃剩余部分
+ *
+ * @param state
+ * @param req
+ */
+static void bcache_ra_do(idt_state_t state, const bcache_ra_req_t *req) {
+    bcache_buf_t *run[BCACHE_RUN_MAX];
+    int count = 0;
+
+    for (int i = 0; i < req->count; ++i) {
+        bcache_buf_t *buf = bcache_lookup(state, req->dev_id, req->block + i, 0);
+        if (buf == (bcache_buf_t *)0) {
+            break;
+        }
+
+        //1.已缓存或正在读入的块结束当前段
+        if (buf->flags & (BCACHE_VALID | BCACHE_BUSY)) {
+            bcache_put(buf);
+            bcache_ra_read(state, run, count);
+            count = 0;
+            continue;
+        }
+
+        //2.收集未缓存的块，段已满时读入
+        buf->flags |= BCACHE_BUSY;
+        run[count++] = buf;
+        if (count == BCACHE_RUN_MAX) {
+            bcache_ra_read(state, run, count);
+            count = 0;
+        }
+    }
+
+    bcache_ra_read(state, run, count);
+}
+
+/**
+ * @brief  预读线程，依次处理队列中的预读请求，队列为空时阻塞
+ *
+ * @param arg
+ */
+static void bcache_ra_entry(void *arg) {
+    for (;;) {
+        idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+        sem_wait(&bcache_ra_sem);
+        bcache_ra_req_t req = bcache_ra_queue[bcache_ra_tail % BCACHE_RA_QUEUE_SIZE];
+        bcache_ra_tail++;
+        bcache_ra_do(state, &req);
+
+        idt_leave_protection(state);  // TODO:解锁
+    }
+}
+
+/**
+ * @brief  创建预读线程，需在第一个任务初始化之后调用
+ *
+ */
+void bcache_readahead_start(void) {
+    task_t *task = kthread_create("bcache_ra", bcache_ra_entry, (void *)0);
+    ASSERT(task != (task_t *)0);
+}
+
+/**
+ * @brief  获取缓存的命中与磁盘访问统计
+ *
+ * @param stat 用户空间的传出参数
+ * @return int 0:成功, -1:参数错误
+ */
+int sys_bcache_stat(bcache_stat_t *stat) {
+    if ((uint32_t)stat < MEM_TASK_BASE) {
+        return -1;
+    }
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+    bcache_stat_t curr = bcache_stat;
+    idt_leave_protection(state);  // TODO:解锁
+
+    *stat = curr;
+    return 0;
+}
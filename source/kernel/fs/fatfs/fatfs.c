@@ -10,11 +10,13 @@
  */
 
 #include "fs/fatfs/fatfs.h"
+#include "fs/bcache.h"
 #include "fs/file.h"
 #include "fs/fs.h"
 #include "dev/dev.h"
 #include "tools/log.h"
 #include "core/memory.h"
+#include "core/kmalloc.h"
 #include "tools/klib.h"
 #include <sys/fcntl.h>
 
@@ -95,38 +97,105 @@ static int cluster_is_valid(cluster_t cluster) {
 
 
 /**
- * @brief 以缓存的方式读取扇区sector到fat_buffer中
+ * @brief 通过块缓存读取分区中的扇区sector
  * 
  * @param fat 
  * @param sector 
- * @return int 
+ * @return bcache_buf_t* 扇区所在的缓存块，使用完毕后需调用bcache_release，0:读取失败
  */
-static int fat_read_sector(fat_t *fat, int sector) {
-    //要读扇区已被缓存，直接返回即可
-    if (sector == fat->curr_sector) {
-        return 0;
-    }
+static bcache_buf_t *fat_read_sector(fat_t *fat, int sector) {
+    return bcache_read(fat->fs->dev_id, sector, 0);
+}
 
-    //读取信的扇区，并记录扇区号
-    int cnt = dev_read(fat->fs->dev_id, sector, fat->fat_buffer, 1);
-    if (cnt == 1) {
-        fat->curr_sector = sector;
-        return 0;
+/**
+ * @brief 将挂载时读入内存的fat表中已修改的扇区写回磁盘
+ *          连续的脏扇区合并为一次写操作，并依次写入每个fat表
+ * 
+ * @param fat 
+ * @return int 0:成功, -1:有扇区写回失败
+ */
+static int fat_flush_table(fat_t *fat) {
+    int err = 0;
+    int start = bitmap_find_bit(&fat->tbl_dirty, 1, 0);
+    while (start >= 0) {
+        //1.找到从start开始的连续脏扇区，先清除脏标志，写回期间再次修改的扇区会重新被标记
+        int end = bitmap_find_bit(&fat->tbl_dirty, 0, start);
+        if (end < 0) {
+            end = fat->tbl_sectors;
+        }
+        bitmap_set_bit(&fat->tbl_dirty, start, end - start, 0);
+
+        //2.将这些扇区写入每个fat表的对应位置
+        char *buf = (char *)fat->tbl + start * fat->bytes_per_sector;
+        for (int i = 0; i < fat->tbl_cnt; ++i) {
+            int sector = fat->tbl_start_sector + i * fat->tbl_sectors + start;
+            int cnt = dev_write(fat->fs->dev_id, sector, buf, end - start);
+            if (cnt != end - start) {
+                log_printf("write fat table failed: sector %d\n", sector);
+                bitmap_set_bit(&fat->tbl_dirty, start, end - start, 1);
+                err = -1;
+            }
+        }
+
+        start = bitmap_find_bit(&fat->tbl_dirty, 1, end);
     }
 
-    return -1;
+    return err;
 }
+
 /**
- * @brief 以将fat_buffer写回到扇区sector中
+ * @brief 挂载时将第一个fat表读入内存，并根据表项建立空闲簇位图
  * 
  * @param fat 
- * @param sector 
- * @return int 
+ * @param total_sectors 分区的总扇区数，用于计算数据区实际拥有的簇数
+ * @return int 0:成功, -1:失败
  */
-static int fat_write_sector(fat_t *fat, int sector) {
-    int cnt = dev_write(fat->fs->dev_id, sector, fat->fat_buffer, 1);
+static int fat_load_table(fat_t *fat, uint32_t total_sectors) {
+    //1.可分配的簇号不能超出fat表的表项数，也不能超出数据区的大小
+    uint32_t tbl_bytes = fat->tbl_sectors * fat->bytes_per_sector;
+    fat->cluster_cnt = tbl_bytes / sizeof(cluster_t);
+    uint32_t data_clusters = (total_sectors - fat->data_start_sector) / fat->sec_per_cluster + 2;
+    if (data_clusters < fat->cluster_cnt) {
+        fat->cluster_cnt = data_clusters;
+    }
+
+    //2.fat表副本、空闲簇位图与其摘要层分配在连续的页中
+    int map_bytes = bitmap_byte_count(fat->cluster_cnt);
+    int summary_bytes = bitmap_summary_byte_count(fat->cluster_cnt);
+    fat->tbl_pages = up2(tbl_bytes + map_bytes + summary_bytes, MEM_PAGE_SIZE) / MEM_PAGE_SIZE;
+    fat->tbl = (uint16_t *)memory_alloc_pages(fat->tbl_pages);
+    if (fat->tbl == (uint16_t *)0) {
+        log_printf("alloc fat table failed\n");
+        return -1;
+    }
+
+    //3.一次读入整个fat表
+    int cnt = dev_read(fat->fs->dev_id, fat->tbl_start_sector, (char *)fat->tbl, fat->tbl_sectors);
+    if (cnt != fat->tbl_sectors) {
+        log_printf("read fat table failed\n");
+        memory_free_pages((uint32_t)fat->tbl, fat->tbl_pages);
+        fat->tbl = (uint16_t *)0;
+        return -1;
+    }
 
-    return (cnt == 1) ? 0 : -1;
+    bitmap_init(&fat->tbl_dirty, (uint8_t *)fat->tbl_dirty_bits, fat->tbl_sectors, 0);
+
+    //4.根据表项建立空闲簇位图，0、1号簇不可分配
+    uint8_t *map_bits = (uint8_t *)fat->tbl + tbl_bytes;
+    bitmap_init(&fat->free_map, map_bits, fat->cluster_cnt, 0);
+    bitmap_set_bit(&fat->free_map, 0, 2, 1);
+    fat->free_cnt = 0;
+    for (uint32_t i = 2; i < fat->cluster_cnt; ++i) {
+        if (fat->tbl[i] != CLUSTER_FAT_FREE) {
+            bitmap_set_bit(&fat->free_map, i, 1, 1);
+        } else {
+            fat->free_cnt++;
+        }
+    }
+    bitmap_init_summary(&fat->free_map, (uint32_t *)(map_bits + map_bytes));
+    fat->next_free = 2;
+
+    return 0;
 }
 
 /**
@@ -143,29 +212,19 @@ static int cluster_get_next(fat_t *fat, cluster_t cblk) {
         return FAT_CLUSTER_INVALID;
     }
 
-    //计算当前簇cblk在对应分区中的扇区号
-    //fat表保存了簇链关系，
-    int offset = cblk * sizeof(cluster_t);
-    int sector = offset / fat->bytes_per_sector;
-    //计算该簇在扇区中的偏移量
-    int off_in_sector = offset % fat->bytes_per_sector;
-
-    if (sector >= fat->tbl_sectors) {
+    if (cblk >= fat->cluster_cnt) {
         log_printf("cluster too big: %d\n", cblk);
         return FAT_CLUSTER_INVALID;
     }
 
-    int err = fat_read_sector(fat, fat->tbl_start_sector + sector);
-    if (err < 0) {
-        return FAT_CLUSTER_INVALID;
-    }
-
-    return *(cluster_t *)(fat->fat_buffer + off_in_sector);
+    //fat表保存了簇链关系，直接从内存中的副本读取
+    return fat->tbl[cblk];
 }
 
 
 /**
  * @brief 设置fat表种簇号start对应的下一个簇号为next
+ *          只修改内存中的副本并标记所在扇区，之后批量写回磁盘
  * 
  * @param fat 
  * @param start 
@@ -177,38 +236,29 @@ static int cluster_set_next(fat_t *fat, cluster_t start, cluster_t next) {
         return FAT_CLUSTER_INVALID;
     }
 
-    //计算当前簇cblk在对应分区中的扇区号
-    //fat表保存了簇链关系，
-    int offset = start * sizeof(cluster_t);
-    int sector = offset / fat->bytes_per_sector;
-    //计算该簇在扇区中的偏移量
-    int off_in_sector = offset % fat->bytes_per_sector;
-
-    if (sector >= fat->tbl_sectors) {
+    if (start >= fat->cluster_cnt) {
         log_printf("cluster too big: %d\n", start);
         return FAT_CLUSTER_INVALID;
     }
 
-    //将该簇号所在的扇区读到缓冲区fat_buffer中
-    int err = fat_read_sector(fat, fat->tbl_start_sector + sector);
-    if (err < 0) {
-        return FAT_CLUSTER_INVALID;
-    }
-
-    //将缓冲区中该表项的值设未next
-    *(cluster_t *)(fat->fat_buffer + off_in_sector) = next;
-    //再将缓冲区覆盖到磁盘对应区域
-    for (int i = 0; i < fat->tbl_cnt; ++i) {
-        err = fat_write_sector(fat, fat->tbl_start_sector + sector);
-        if (err < 0) {
-            log_printf("write cluster failed.\n");
-            return -1;
+    //1.簇在空闲与使用之间转换时更新空闲簇位图与计数
+    cluster_t old = fat->tbl[start];
+    if (old == CLUSTER_FAT_FREE && next != CLUSTER_FAT_FREE) {
+        bitmap_set_bit(&fat->free_map, start, 1, 1);
+        fat->free_cnt--;
+    } else if (old != CLUSTER_FAT_FREE && next == CLUSTER_FAT_FREE) {
+        bitmap_set_bit(&fat->free_map, start, 1, 0);
+        fat->free_cnt++;
+        if (start < fat->next_free) {
+            fat->next_free = start;
         }
-
-        //偏移一个fat表的大小，将相邻的第二个fat表的对应位置也清空
-        sector += fat->tbl_sectors;
     }
 
+    //2.修改表项，并标记其所在的扇区待写回
+    fat->tbl[start] = next;
+    int sector = start * sizeof(cluster_t) / fat->bytes_per_sector;
+    bitmap_set_bit(&fat->tbl_dirty, sector, 1, 1);
+
     return 0;
 
 }
@@ -232,6 +282,7 @@ void cluster_free_chain(fat_t *fat, cluster_t start) {
 
 /**
  * @brief 在fat表中分配空闲簇，并建立簇链关系
+ *          通过空闲簇位图按字查找空闲簇，空闲簇不足时直接失败
  * 
  * @param fat 
  * @param cnt 
@@ -240,42 +291,33 @@ void cluster_free_chain(fat_t *fat, cluster_t start) {
 static cluster_t cluster_alloc_free(fat_t *fat, int cnt) {
     cluster_t start = FAT_CLUSTER_INVALID;
     cluster_t pre = FAT_CLUSTER_INVALID;
-    cluster_t curr;
-    
-    //计算一个fat表中有多少个簇号
-    int c_total = fat->tbl_sectors * fat->bytes_per_sector / sizeof(cluster_t);
-    //0,1簇号未使用
-    for (curr = 2; cnt && (curr < c_total); ++curr) {
-        cluster_t free = cluster_get_next(fat, curr);
-        //当前簇curr没有链接关系，可供分配
-        if (free == CLUSTER_FAT_FREE) {
-            if (!cluster_is_valid(start)) {
-                //链头还未分配，先分配链头
-                start = curr;
-            }
 
-            if (cluster_is_valid(pre)) {
-                //前驱簇号有效且刚分配，则设置curr为pre的后继
-                int err = cluster_set_next(fat, pre, curr);
-                if (err < 0) {
-                    cluster_free_chain(fat, start);
-                    return FAT_CLUSTER_INVALID;
-                }
-            }
-            
-            //分配成功一个簇，更新pre和cnt
-            pre = curr;
-            cnt--;
-        }
+    if (cnt <= 0 || cnt > fat->free_cnt) {
+        return FAT_CLUSTER_INVALID;
     }
 
-    //设置最后一个簇的后继为无效簇标志
-    if (cnt == 0) {
-        int err = cluster_set_next(fat, pre, FAT_CLUSTER_INVALID);
-        if (err < 0) {
+    while (cnt) {
+        //1.从上次分配的位置开始查找空闲簇，到达末尾后从头查找
+        int curr = bitmap_find_bit(&fat->free_map, 0, fat->next_free);
+        if (curr < 0) {
+            curr = bitmap_find_bit(&fat->free_map, 0, 2);
+        }
+        if (curr < 0) {
             cluster_free_chain(fat, start);
             return FAT_CLUSTER_INVALID;
         }
+
+        //2.先将其设为链尾，使簇链始终完整，再链接到前驱簇之后
+        cluster_set_next(fat, curr, FAT_CLUSTER_INVALID);
+        if (cluster_is_valid(pre)) {
+            cluster_set_next(fat, pre, curr);
+        } else {
+            start = curr;
+        }
+
+        pre = curr;
+        fat->next_free = curr + 1;
+        cnt--;
     }
 
     return start;
@@ -283,6 +325,186 @@ static cluster_t cluster_alloc_free(fat_t *fat, int cnt) {
 
 
 
+/**
+ * @brief 清空文件的簇区段缓存，文件的簇链被截断或拓展后调用
+ * 
+ * @param file 
+ */
+static void extent_reset(file_t *file) {
+    fat_file_t *ff = (fat_file_t *)file->data;
+    if (ff) {
+        fat_extent_cache_t *cache = &ff->extent;
+        cache->count = 0;
+        cache->clusters = 0;
+    }
+}
+
+/**
+ * @brief 将文件中第index个簇追加到区段缓存，与最后一个区段物理相邻时直接并入该区段
+ *          只追加紧接在已覆盖部分之后的簇，区段数已满时不再缓存
+ * 
+ * @param cache 
+ * @param index 
+ * @param cluster 
+ */
+static void extent_append(fat_extent_cache_t *cache, uint32_t index, cluster_t cluster) {
+    if (index != cache->clusters) {
+        return;
+    }
+
+    fat_extent_t *last = cache->extents + cache->count - 1;
+    if (cache->count > 0 && last->start + last->count == cluster && last->count < 0xFFFF) {
+        last->count++;
+    } else if (cache->count < FAT_EXTENT_MAX) {
+        last = cache->extents + cache->count++;
+        last->index = index;
+        last->start = cluster;
+        last->count = 1;
+    } else {
+        return;
+    }
+
+    cache->clusters++;
+}
+
+/**
+ * @brief 获取文件中第index个簇的簇号
+ *          在区段缓存覆盖的范围内二分查找，超出时从最后一个已缓存的簇沿簇链继续查找，
+ *          并将经过的簇追加到缓存中
+ * 
+ * @param file 
+ * @param fat 
+ * @param index 簇在文件中的序号
+ * @return cluster_t 簇号，超出簇链时为FAT_CLUSTER_INVALID
+ */
+static cluster_t file_get_cluster(file_t *file, fat_t *fat, uint32_t index) {
+    fat_file_t *ff = (fat_file_t *)file->data;
+    fat_extent_cache_t *cache = ff ? &ff->extent : (fat_extent_cache_t *)0;
+
+    //1.在已覆盖的范围内，二分查找起始序号不大于index的最后一个区段
+    if (cache && index < cache->clusters) {
+        int low = 0, high = cache->count - 1;
+        while (low < high) {
+            int mid = (low + high + 1) / 2;
+            if (cache->extents[mid].index <= index) {
+                low = mid;
+            } else {
+                high = mid - 1;
+            }
+        }
+
+        fat_extent_t *extent = cache->extents + low;
+        return extent->start + (index - extent->index);
+    }
+
+    //2.确定沿簇链查找的起点，没有缓存时从文件的起始簇开始
+    cluster_t curr = file->sblk;
+    uint32_t curr_index = 0;
+    if (cache && cache->count > 0) {
+        fat_extent_t *last = cache->extents + cache->count - 1;
+        curr = last->start + last->count - 1;
+        curr_index = cache->clusters - 1;
+    } else if (cache && cluster_is_valid(curr)) {
+        extent_append(cache, 0, curr);
+    }
+
+    //3.沿簇链查找到第index个簇
+    while (cluster_is_valid(curr) && curr_index < index) {
+        curr = cluster_get_next(fat, curr);
+        curr_index++;
+        if (cache && cluster_is_valid(curr)) {
+            extent_append(cache, curr_index, curr);
+        }
+    }
+
+    return cluster_is_valid(curr) ? curr : FAT_CLUSTER_INVALID;
+}
+
+/**
+ * @brief 分配并初始化打开文件的私有数据，从打开时的读取位置开始的读取视为顺序读取
+ * 
+ * @param file 
+ */
+static void fatfs_file_init(file_t *file) {
+    fat_file_t *ff = (fat_file_t *)kmalloc(sizeof(fat_file_t));
+    file->data = ff;
+    if (ff) {
+        extent_reset(file);
+        ff->ra.next_pos = file->pos;
+        ff->ra.window = 0;
+        ff->ra.end = 0;
+    }
+}
+
+/**
+ * @brief 读取完成后更新文件的顺序预读状态，顺序读取时在已预读的部分不足半个窗口时
+ *          将窗口翻倍并异步预读下一段，非顺序读取时重置窗口
+ * 
+ * @param file 
+ * @param fat 
+ * @param pos 本次读取的起始位置
+ * @param nbytes 本次读取的字节数
+ */
+static void file_readahead(file_t *file, fat_t *fat, uint32_t pos, uint32_t nbytes) {
+    fat_file_t *ff = (fat_file_t *)file->data;
+    if (ff == (fat_file_t *)0 || nbytes == 0) {
+        return;
+    }
+
+    //1.读取位置与上次读取的末尾不相接，不是顺序读取
+    fat_readahead_t *ra = &ff->ra;
+    if (pos != ra->next_pos) {
+        ra->next_pos = pos + nbytes;
+        ra->window = 0;
+        ra->end = 0;
+        return;
+    }
+    ra->next_pos = pos + nbytes;
+
+    //2.本次读取之后已预读的簇数超过半个窗口，或已预读到文件末尾时，暂不预读
+    uint32_t read_end = (pos + nbytes + fat->cluster_bytes_size - 1) / fat->cluster_bytes_size;
+    uint32_t file_end = (file->size + fat->cluster_bytes_size - 1) / fat->cluster_bytes_size;
+    if (ra->end < read_end) {
+        ra->end = read_end;
+    }
+    if (ra->end >= file_end || ra->end - read_end > ra->window / 2) {
+        return;
+    }
+
+    //3.窗口从初始大小开始，每次预读后翻倍，不超过最大值
+    uint32_t init = FAT_RA_INIT_SECTORS / fat->sec_per_cluster;
+    uint32_t max = FAT_RA_MAX_SECTORS / fat->sec_per_cluster;
+    ra->window = ra->window ? ra->window * 2 : (init ? init : 1);
+    if (ra->window > max) {
+        ra->window = max ? max : 1;
+    }
+
+    uint32_t stop = read_end + ra->window;
+    if (stop > file_end) {
+        stop = file_end;
+    }
+
+    //4.将[ra->end, stop)中物理连续的簇合并为一个预读请求
+    uint32_t index = ra->end;
+    while (index < stop) {
+        cluster_t start = file_get_cluster(file, fat, index);
+        if (!cluster_is_valid(start)) {
+            break;
+        }
+
+        uint32_t count = 1;
+        while (index + count < stop && file_get_cluster(file, fat, index + count) == start + count) {
+            count++;
+        }
+
+        bcache_prefetch(fat->fs->dev_id, fat->data_start_sector + (start - 2) * fat->sec_per_cluster,
+                        count * fat->sec_per_cluster);
+        index += count;
+    }
+
+    ra->end = index;
+}
+
 /**
  * @brief 拓展文件空间大小
  * 
@@ -330,6 +552,8 @@ static int expand_file(file_t *file, int inc_bytes) {
         }
     }
 
+    //簇链已改变，之后按需重新建立区段缓存
+    extent_reset(file);
     return 0;
 
 }
@@ -368,6 +592,55 @@ static int move_file_pos(file_t *file,
         return 0;
 }
 
+/**
+ * @brief 将文件的读取位置pos移动move_bytes个字节，可跨越多个簇，每跨越一个簇移动一次当前簇号
+ * 
+ * @param file 
+ * @param fat 
+ * @param move_bytes 
+ * @param expand 
+ * @return int 
+ */
+static int move_file_pos_run(file_t *file, 
+    fat_t *fat, uint32_t move_bytes, int expand) {
+    while (move_bytes > 0) {
+        uint32_t curr_move = fat->cluster_bytes_size - file->pos % fat->cluster_bytes_size;
+        if (curr_move > move_bytes) {
+            curr_move = move_bytes;
+        }
+
+        int err = move_file_pos(file, fat, curr_move, expand);
+        if (err < 0) {
+            return -1;
+        }
+        move_bytes -= curr_move;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 统计从簇cblk开始在磁盘上物理连续的簇数
+ * 
+ * @param fat 
+ * @param cblk 
+ * @param max 最多统计的簇数，同时受单条磁盘命令的扇区数限制
+ * @return int 至少为1
+ */
+static int cluster_run_length(fat_t *fat, cluster_t cblk, int max) {
+    int limit = FAT_IO_MAX_SECTORS / fat->sec_per_cluster;
+    if (max > limit) {
+        max = limit;
+    }
+
+    int run = 1;
+    while (run < max && cluster_get_next(fat, cblk + run - 1) == cblk + run) {
+        run++;
+    }
+
+    return run;
+}
+
 /**
  * @brief 从根目录项中获取该项的文件类型
  * 
@@ -478,16 +751,15 @@ static int write_dir_entry(fat_t *fat, diritem_t *item, int dir_index) {
     //计算该目录项所在根目录区的扇区的扇区号
     int offset = dir_index * sizeof(diritem_t);
     int sector = fat->root_start_sector + offset / fat->bytes_per_sector;
-    int err = fat_read_sector(fat, sector);
-    if (err < 0) {
+    bcache_buf_t *buf = fat_read_sector(fat, sector);
+    if (buf == (bcache_buf_t *)0) {
         return -1;
     }
 
-    //将该目录项拷贝到扇区缓存的指定对应位置
-    kernel_memcpy(fat->fat_buffer + offset % fat->bytes_per_sector, item, sizeof(diritem_t));
-
-    //将扇区重新覆盖到磁盘上
-    fat_write_sector(fat, sector);
+    //将该目录项拷贝到扇区缓存的指定对应位置，并标记为待写回
+    kernel_memcpy(buf->data + offset % fat->bytes_per_sector, item, sizeof(diritem_t));
+    bcache_mark_dirty(buf);
+    bcache_release(buf);
     
     return 0;
 }
@@ -496,27 +768,30 @@ static int write_dir_entry(fat_t *fat, diritem_t *item, int dir_index) {
 
 
 /**
- * @brief 从根目录区读取索引为dir_index的目录项
+ * @brief 从根目录区读取索引为dir_index的目录项到item中
  * 
  * @param fat 
  * @param dir_index 
- * @return diritem_t* 
+ * @param item 传出参数
+ * @return int 0:成功, -1:失败
  */
-static diritem_t * read_dir_entry(fat_t *fat, int dir_index) {
+static int read_dir_entry(fat_t *fat, int dir_index, diritem_t *item) {
     if (dir_index < 0 || dir_index >= fat->root_ent_cnt) {
-        return (diritem_t*)0;
+        return -1;
     }
 
     //计算该目录项所在根目录区的扇区的扇区号
     int offset = dir_index * sizeof(diritem_t);
     int sector = fat->root_start_sector + offset / fat->bytes_per_sector;
-    int err = fat_read_sector(fat, sector);
-    if (err < 0) {
-        return (diritem_t*)0;
+    bcache_buf_t *buf = fat_read_sector(fat, sector);
+    if (buf == (bcache_buf_t *)0) {
+        return -1;
     }
 
-    //计算出该目录项的起始地址并返回
-    return (diritem_t*)(fat->fat_buffer + offset % fat->bytes_per_sector);
+    //拷贝出该目录项，缓存块可能在释放后被换出
+    kernel_memcpy(item, buf->data + offset % fat->bytes_per_sector, sizeof(diritem_t));
+    bcache_release(buf);
+    return 0;
 }
 
 
@@ -567,9 +842,7 @@ int fatfs_mount(struct _fs_t *fs, int major, int minor) {
     fat->root_start_sector = fat->tbl_start_sector + fat->tbl_sectors * fat->tbl_cnt;
     fat->data_start_sector = fat->root_start_sector + fat->root_ent_cnt * 32 / dbr->BPB_BytsPerSec;
     fat->cluster_bytes_size = fat->sec_per_cluster * dbr->BPB_BytsPerSec;
-    fat->fat_buffer = (uint8_t*)dbr;
     fat->fs = fs;
-    fat->curr_sector = -1;
 
     if (fat->tbl_cnt != 2) {    //fat表数量一般为2， 不为2则出错
         log_printf("%s: fat table error: major: %x, minor: %x\n", major, minor);
@@ -582,9 +855,29 @@ int fatfs_mount(struct _fs_t *fs, int major, int minor) {
 
     }
 
+    if (fat->bytes_per_sector != BCACHE_BLOCK_SIZE) {   //扇区大小需与块缓存的块大小一致
+        log_printf("sector size not supported: %d\n", fat->bytes_per_sector);
+        goto mount_failed;
+    }
+
+    if (fat->tbl_sectors > FAT_TBL_SECTORS_MAX) {   //超出FAT16的表项数量
+        log_printf("fat table too big: %d sectors\n", fat->tbl_sectors);
+        goto mount_failed;
+    }
+
+    //dbr的信息已解析完毕，之后的扇区都经块缓存读写
+    uint32_t total_sectors = dbr->BPB_TotSec16 ? dbr->BPB_TotSec16 : dbr->BPB_TotSec32;
+    memory_free_page((uint32_t)dbr);
+    dbr = (dbr_t *)0;
+
+    //将fat表读入内存
+    fs->dev_id = dev_id;
+    if (fat_load_table(fat, total_sectors) < 0) {
+        goto mount_failed;
+    }
+
     fs->type = FS_FAT16;
     fs->data = &fs->fat_data;
-    fs->dev_id = dev_id;
 
     return 0;
 
@@ -606,10 +899,31 @@ mount_failed:
  * @param fs 
  */
 void fatfs_unmount(struct _fs_t *fs) {
-    fat_t * fat = (fat_t *)fs->data;
+    fat_t *fat = (fat_t *)fs->data;
+
+    //写回fat表，再写回并丢弃该分区的块缓存
+    fat_flush_table(fat);
+    bcache_invalidate(fs->dev_id);
     dev_close(fs->dev_id);
 
-    memory_free_page((uint32_t)fat->fat_buffer);
+    memory_free_pages((uint32_t)fat->tbl, fat->tbl_pages);
+}
+
+/**
+ * @brief 将fat表与块缓存中该分区已修改的内容写回磁盘
+ * 
+ * @param fs 
+ * @return int 0:成功, -1:有数据写回失败
+ */
+int fatfs_sync(struct _fs_t *fs) {
+    fat_t *fat = (fat_t *)fs->data;
+
+    int err = fat_flush_table(fat);
+    if (bcache_sync(fs->dev_id) < 0) {
+        err = -1;
+    }
+
+    return err;
 }
 
 /**
@@ -625,41 +939,44 @@ int fatfs_open(struct _fs_t *fs, const char *path, file_t *file) {
     fat_t *fat = (fat_t*)fs->data;
 
     //遍历读取根目录区的目录项,按路径path匹配对应目录项
-    diritem_t *file_item = (diritem_t*)0;
+    diritem_t file_item;
+    int found = 0;
     int p_index = -1;   //记录匹配到的目录项的索引
     for (int i = 0; i < fat->root_ent_cnt; ++i) {
-        diritem_t * item = read_dir_entry(fat, i);
-        if (item == (diritem_t *)0) {
+        if (read_dir_entry(fat, i, &file_item) < 0) {
             return -1;
         }
 
         //记录所遍历到的目录项的索引
         p_index = i;
 
-        if (item->DIR_Name[0] == DIRITEM_NAME_END) {
+        if (file_item.DIR_Name[0] == DIRITEM_NAME_END) {
             continue;
         }
 
-        if (item->DIR_Name[0] == DIRITEM_NAEM_FREE) {
+        if (file_item.DIR_Name[0] == DIRITEM_NAEM_FREE) {
             continue;
         }
 
         //进行路径匹配
-        if (diritem_name_match(item, path)) {
-            file_item = item;
+        if (diritem_name_match(&file_item, path)) {
+            found = 1;
             break;
         }
     }
 
     
-    if (file_item) {//从目录项中读取文件信息到file结构中
-        read_from_diritem(fat, file, file_item, p_index);
+    if (found) {//从目录项中读取文件信息到file结构中
+        read_from_diritem(fat, file, &file_item, p_index);
 
         if (file->mode & O_TRUNC) { //以截断模式打开文件，需清空文件
             cluster_free_chain(fat, file->sblk);
             file->cblk = file->sblk = FAT_CLUSTER_INVALID;
             file->size = 0;
         }
+
+        //分配文件的私有数据，分配失败时查找簇号退化为沿簇链查找，且不预读
+        fatfs_file_init(file);
         return 0;
     } else if ((file->mode & O_CREAT) && p_index >= 0){//创建文件模式下未找到对应的目录项，创建新一个文件
         //初始化一个目录项信息
@@ -675,6 +992,7 @@ int fatfs_open(struct _fs_t *fs, const char *path, file_t *file) {
 
         //将目录项信息读到file结构中
         read_from_diritem(fat, file, &item, p_index);
+        fatfs_file_init(file);
         return 0;
 
     }
@@ -683,6 +1001,87 @@ int fatfs_open(struct _fs_t *fs, const char *path, file_t *file) {
 }
 
 
+/**
+ * @brief 经块缓存读取簇中从offset开始的size个字节到buf中
+ *          未命中时簇内其后的扇区一并读入，顺序读取该簇的后续部分时即可命中
+ * 
+ * @param fat 
+ * @param start_sector 簇的起始扇区号
+ * @param offset 簇内偏移
+ * @param buf 
+ * @param size 不超过簇的末尾
+ * @return int 0:成功, -1:失败
+ */
+static int cluster_read(fat_t *fat, uint32_t start_sector, 
+    uint32_t offset, char *buf, uint32_t size) {
+    while (size > 0) {
+        //计算当前位置所在的扇区与扇区内偏移
+        uint32_t sector = offset / fat->bytes_per_sector;
+        uint32_t s_offset = offset % fat->bytes_per_sector;
+        uint32_t curr_size = fat->bytes_per_sector - s_offset;
+        if (curr_size > size) {
+            curr_size = size;
+        }
+
+        bcache_buf_t *cache = bcache_read(fat->fs->dev_id, start_sector + sector, 
+                                            fat->sec_per_cluster - sector - 1);
+        if (cache == (bcache_buf_t *)0) {
+            return -1;
+        }
+        kernel_memcpy(buf, cache->data + s_offset, curr_size);
+        bcache_release(cache);
+
+        buf += curr_size;
+        offset += curr_size;
+        size -= curr_size;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 经块缓存将buf中的size个字节写入簇中从offset开始的位置
+ *          整扇区覆盖时不需要先从磁盘读入该扇区
+ * 
+ * @param fat 
+ * @param start_sector 簇的起始扇区号
+ * @param offset 簇内偏移
+ * @param buf 
+ * @param size 不超过簇的末尾
+ * @return int 0:成功, -1:失败
+ */
+static int cluster_write(fat_t *fat, uint32_t start_sector, 
+    uint32_t offset, const char *buf, uint32_t size) {
+    while (size > 0) {
+        //计算当前位置所在的扇区与扇区内偏移
+        uint32_t sector = offset / fat->bytes_per_sector;
+        uint32_t s_offset = offset % fat->bytes_per_sector;
+        uint32_t curr_size = fat->bytes_per_sector - s_offset;
+        if (curr_size > size) {
+            curr_size = size;
+        }
+
+        bcache_buf_t *cache;
+        if (curr_size == fat->bytes_per_sector) {
+            cache = bcache_get(fat->fs->dev_id, start_sector + sector);
+        } else {
+            cache = bcache_read(fat->fs->dev_id, start_sector + sector, 0);
+        }
+        if (cache == (bcache_buf_t *)0) {
+            return -1;
+        }
+        kernel_memcpy(cache->data + s_offset, (void *)buf, curr_size);
+        bcache_mark_dirty(cache);
+        bcache_release(cache);
+
+        buf += curr_size;
+        offset += curr_size;
+        size -= curr_size;
+    }
+
+    return 0;
+}
+
 /**
  * @brief fat文件系统读取文件
  * 
@@ -701,6 +1100,7 @@ int fatfs_read(char *buf, int size, file_t *file) {
     }
 
     uint32_t total_read = 0;
+    uint32_t start_pos = file->pos;
   
     //读取nbytes个字节到buf中
     while (nbytes > 0) {
@@ -714,39 +1114,47 @@ int fatfs_read(char *buf, int size, file_t *file) {
         //[0] = 0xfff8, [1] = 0xffff 固定值
         uint32_t start_sector = fat->data_start_sector + (file->cblk - 2) * fat->sec_per_cluster;
 
-        //当前读取位置刚好在簇的开头，且读取大小为一个簇，直接进行整簇读取即可
-        if (cluster_offset == 0 && nbytes == fat->cluster_bytes_size) {
-            int err = dev_read(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_read;
+        int err;
+        if (cluster_offset == 0 && nbytes >= fat->cluster_bytes_size
+            && !bcache_cached(fat->fs->dev_id, start_sector)) {
+            //从簇的开头读取整簇，将物理连续的簇合并为一次磁盘读取，直接读入buf
+            //已被预读到缓存中的簇不再从磁盘读取，在此结束本次合并
+            int run = cluster_run_length(fat, file->cblk, nbytes / fat->cluster_bytes_size);
+            for (int i = 1; i < run; ++i) {
+                if (bcache_cached(fat->fs->dev_id, start_sector + i * fat->sec_per_cluster)) {
+                    run = i;
+                    break;
+                }
             }
-
-            curr_read = fat->cluster_bytes_size;
-        } else {//当前读取内容需要进行跨簇读取
+            curr_read = run * fat->cluster_bytes_size;
+            err = bcache_read_direct(fat->fs->dev_id, start_sector, 
+                                        run * fat->sec_per_cluster, (uint8_t *)buf);
+        } else {
+            //本次最多读到当前簇的末尾
             if (cluster_offset + curr_read > fat->cluster_bytes_size) {
                 curr_read = fat->cluster_bytes_size - cluster_offset;
             }
 
-            //先将当前簇中的内容读取到fat_buffer中
-            fat->curr_sector = start_sector;
-            int err = dev_read(fat->fs->dev_id, start_sector, fat->fat_buffer, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_read;
-            }
-            //再从fat_buffer中读取文件相关部分到buf中
-            kernel_memcpy(buf, fat->fat_buffer + cluster_offset, curr_read);
+            //不足一簇或已被预读的部分经块缓存读取到buf中
+            err = cluster_read(fat, start_sector, cluster_offset, buf, curr_read);
+        }
+        if (err < 0) {
+            return total_read;
         }
         buf += curr_read;
         nbytes -= curr_read;
         total_read += curr_read;
 
         //移动文件的读取位置file->pos
-        int err = move_file_pos(file, fat, curr_read, 0);
+        err = move_file_pos_run(file, fat, curr_read, 0);
         if (err < 0) {
             return total_read;
         }
     
     }
+
+    //顺序读取时异步预读之后的簇，读取者处理本次数据期间磁盘继续工作
+    file_readahead(file, fat, start_pos, total_read);
     return total_read;
 }
 
@@ -772,6 +1180,16 @@ int fatfs_write(char *buf, int size, file_t *file) {
         if (err < 0) {
             return 0;
         }
+
+        //写入位置位于簇的边界时，当前簇可能是其前一个簇(如定位到大小为整簇的文件末尾)，
+        //新簇链接在当前簇之后，重新获取写入位置所在的簇
+        if (file->pos > 0 && file->pos % fat->cluster_bytes_size == 0) {
+            cluster_t cblk = file_get_cluster(file, fat, file->pos / fat->cluster_bytes_size);
+            if (!cluster_is_valid(cblk)) {
+                return 0;
+            }
+            file->cblk = cblk;
+        }
     }
 
     uint32_t nbytes = size;
@@ -786,41 +1204,36 @@ int fatfs_write(char *buf, int size, file_t *file) {
         //[2],[3],[4]
         uint32_t start_sector = fat->data_start_sector + (file->cblk - 2) * fat->sec_per_cluster;
 
-        //当前写入位置刚好在簇的开头，且大小为一个簇，直接进行整簇写入即可
-        if (cluster_offset == 0 && nbytes == fat->cluster_bytes_size) {
-            int err = dev_write(fat->fs->dev_id, start_sector, buf, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_write;
-            }
-
-            curr_write = fat->cluster_bytes_size;
-        } else {//当前写入内容需要进行跨簇写入
+        int err;
+        if (cluster_offset == 0 && nbytes >= fat->cluster_bytes_size) {
+            //从簇的开头写入整簇，簇链已预先拓展，将物理连续的簇合并为一次磁盘写入
+            int run = cluster_run_length(fat, file->cblk, nbytes / fat->cluster_bytes_size);
+            curr_write = run * fat->cluster_bytes_size;
+            err = bcache_write_direct(fat->fs->dev_id, start_sector, 
+                                        run * fat->sec_per_cluster, (uint8_t *)buf);
+        } else {
+            //本次最多写到当前簇的末尾
             if (cluster_offset + curr_write > fat->cluster_bytes_size) {
                 curr_write = fat->cluster_bytes_size - cluster_offset;
             }
 
-            //先将当前簇中的内容读取到fat_buffer中
-            fat->curr_sector = start_sector;
-            int err = dev_read(fat->fs->dev_id, start_sector, fat->fat_buffer, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_write;
-            }
-            //再将需要写入的内容写入fat_buffer中对应位置
-            kernel_memcpy(fat->fat_buffer + cluster_offset, buf, curr_write);
-
-            //再将fat_buffer覆盖回磁盘
-            err = dev_write(fat->fs->dev_id, start_sector, fat->fat_buffer, fat->sec_per_cluster);
-            if (err < 0) {
-                return total_write;
-            }
+            //不足一簇的部分经块缓存写入，数据在关闭文件或块被换出时写回磁盘
+            err = cluster_write(fat, start_sector, cluster_offset, buf, curr_write);
+        }
+        if (err < 0) {
+            return total_write;
         }
         buf += curr_write;
         nbytes -= curr_write;
         total_write += curr_write;
-        file->size += curr_write;
+
+        //覆盖已有数据时文件大小不变
+        if (file->pos + curr_write > file->size) {
+            file->size = file->pos + curr_write;
+        }
 
         //移动文件的读取位置file->pos
-        int err = move_file_pos(file, fat, curr_write, 1);
+        err = move_file_pos_run(file, fat, curr_write, 1);
         if (err < 0) {
             return total_write;
         }
@@ -836,6 +1249,12 @@ int fatfs_write(char *buf, int size, file_t *file) {
  * @param file 
  */
 void fatfs_close(file_t *file) {
+    //释放簇区段缓存与预读状态
+    if (file->data) {
+        kfree(file->data);
+        file->data = (void *)0;
+    }
+
     if (file->mode == O_RDONLY) {
         //文件只进行读操作，不需要回写到磁盘上
         return;
@@ -844,16 +1263,19 @@ void fatfs_close(file_t *file) {
     fat_t *fat = (fat_t*)file->fs->data;
 
     //读取文件所属的根目录区的目录项
-    diritem_t *item = read_dir_entry(fat, file->p_index);
-    if (item == (diritem_t *)0) {
+    diritem_t item;
+    if (read_dir_entry(fat, file->p_index, &item) < 0) {
         return;
     }
 
-    //更新目录项信息,并回写到磁盘上
-    item->DIR_FileSize = file->size;
-    item->DIR_FstClusHI = (uint16_t)(file->sblk << 16);
-    item->DIR_FstClusLo = (uint16_t)(file->sblk & 0xffff);
-    write_dir_entry(fat, item, file->p_index);
+    //更新目录项信息
+    item.DIR_FileSize = file->size;
+    item.DIR_FstClusHI = (uint16_t)(file->sblk << 16);
+    item.DIR_FstClusLo = (uint16_t)(file->sblk & 0xffff);
+    write_dir_entry(fat, &item, file->p_index);
+
+    //将文件数据、fat表与目录项的修改一并写回磁盘
+    fatfs_sync(file->fs);
 }
 
 /**
@@ -870,39 +1292,39 @@ int fatfs_seek(file_t *file, uint32_t offset, int dir) {
     }
 
     fat_t *fat = (fat_t *)file->fs->data;
-    cluster_t current_cluster = file->cblk;
-    uint32_t curr_pos = 0;
-    uint32_t offset_to_move = offset;
-
-    //进行偏移处理
-    while (offset_to_move) {
-        //计算文件pos在当前簇中的偏移量
-        uint32_t c_offset = curr_pos % fat->cluster_bytes_size;
-        //初始化此次循环预备移动的字节量
-        uint32_t curr_move = offset_to_move;
-
-        if (c_offset + curr_move < fat->cluster_bytes_size) {
-            //此处循环移动后，pos还在当前簇中
-            curr_pos += curr_move;
-            break;
-        }
 
-        //此次循环移动后pos将移动到下一个簇
-        //所以先将本簇中的剩余字节量偏移
-        curr_move = fat->cluster_bytes_size - c_offset;
-        curr_pos += curr_move;
-        offset_to_move -= curr_move;
+    //偏移到上次读取末尾以外的位置时重置预读窗口，之后连续两次顺序读取才重新开始预读
+    fat_file_t *ff = (fat_file_t *)file->data;
+    if (ff && offset != ff->ra.next_pos) {
+        ff->ra.next_pos = FAT_RA_POS_NONE;
+        ff->ra.window = 0;
+        ff->ra.end = 0;
+    }
 
-        //获取下一个簇号
-        current_cluster = cluster_get_next(fat, current_cluster);
-        if (!cluster_is_valid(current_cluster)) {
+    //偏移到文件开头时不需要查找，文件可能还没有分配簇
+    if (offset == 0) {
+        file->cblk = file->sblk;
+        file->pos = 0;
+        return 0;
+    }
+
+    //计算偏移所在的簇在文件中的序号，经区段缓存获取其簇号
+    uint32_t index = offset / fat->cluster_bytes_size;
+    cluster_t cblk = file_get_cluster(file, fat, index);
+    if (!cluster_is_valid(cblk)) {
+        //文件大小为整簇时，文件末尾恰好位于簇链之后，定位到最后一个簇，写入时再移动到拓展出的簇
+        if (offset != file->size || offset % fat->cluster_bytes_size != 0) {
             return -1;
         }
 
+        cblk = file_get_cluster(file, fat, index - 1);
+        if (!cluster_is_valid(cblk)) {
+            return -1;
+        }
     }
 
-    file->cblk = current_cluster;
-    file->pos = curr_pos;
+    file->cblk = cblk;
+    file->pos = offset;
     
     return 0;
 
@@ -938,19 +1360,19 @@ int fatfs_readdir(struct _fs_t *fs, DIR *dir, struct dirent *dirent) {
     fat_t *fat = (fat_t*)fs->data;
 
     while (dir->index < fat->root_ent_cnt) {
-        diritem_t *item = read_dir_entry(fat, dir->index);
-        if (item == (diritem_t *)0) {
+        diritem_t item;
+        if (read_dir_entry(fat, dir->index, &item) < 0) {
             return -1;
         }
 
 
         //该目录项有效,获取目录项信息到dirent中
-        if (item->DIR_Name[0] != DIRITEM_NAEM_FREE && item->DIR_Name[0] != DIRITEM_NAME_END) {
-            file_type_t type = diritem_get_type(item);
+        if (item.DIR_Name[0] != DIRITEM_NAEM_FREE && item.DIR_Name[0] != DIRITEM_NAME_END) {
+            file_type_t type = diritem_get_type(&item);
             if ((type == FILE_NORMAL) || (type == FILE_DIR)) {
-                dirent->size = item->DIR_FileSize;
+                dirent->size = item.DIR_FileSize;
                 dirent->type = type;
-                diritem_get_name(item, dirent->name);
+                diritem_get_name(&item, dirent->name);
 
                 //记录目录项在该目录中的索引
                 dirent->index = dir->index++;
@@ -989,30 +1411,34 @@ int fatfs_unlink(struct _fs_t *fs, const char *path) {
     fat_t *fat = (fat_t*)fs->data;
 
     for (int i = 0; i < fat->root_ent_cnt; ++i) {
-        diritem_t * item = read_dir_entry(fat, i);
-        if (item == (diritem_t *)0) {
+        diritem_t item;
+        if (read_dir_entry(fat, i, &item) < 0) {
             return -1;
         }
 
-        if (item->DIR_Name[0] == DIRITEM_NAME_END) {
+        if (item.DIR_Name[0] == DIRITEM_NAME_END) {
             continue;
         }
 
-        if (item->DIR_Name[0] == DIRITEM_NAEM_FREE) {
+        if (item.DIR_Name[0] == DIRITEM_NAEM_FREE) {
             continue;
         }
 
         //进行路径匹配
-        if (diritem_name_match(item, path)) {
+        if (diritem_name_match(&item, path)) {
             //找到文件，进行删除操作
             //获取文件的起始簇号，并清除fat表中的簇链关系
-            int cluster = (item->DIR_FstClusHI << 16) | item->DIR_FstClusLo;
+            int cluster = (item.DIR_FstClusHI << 16) | item.DIR_FstClusLo;
             cluster_free_chain(fat, cluster);
 
             //将磁盘上该目录项的位置清空
             diritem_t file_item;
             kernel_memset(&file_item, 0, sizeof(diritem_t));
-            return write_dir_entry(fat, &file_item, i);
+            int err = write_dir_entry(fat, &file_item, i);
+
+            //将fat表与目录项的修改写回磁盘
+            fatfs_sync(fs);
+            return err;
         }
     }
 
@@ -1034,4 +1460,5 @@ fs_op_t fatfs_op = {
     .readdir = fatfs_readdir,
     .closedir = fatfs_closedir,
     .unlink = fatfs_unlink,
+    .sync = fatfs_sync,
 };
\ No newline at end of file
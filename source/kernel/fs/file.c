@@ -12,44 +12,34 @@
 #include "fs/file.h"
 #include "ipc/mutex.h"
 #include "tools/klib.h"
+#include "core/kmalloc.h"
 
-static file_t file_table[FILE_TABLE_SIZE];
-static mutex_t file_alloc_mutex;    //互斥锁，保护file_table的正确分配
+static kmem_cache_t file_cache;     //file结构的对象缓存
+static mutex_t file_alloc_mutex;    //互斥锁，保护文件引用计数的正确修改
 
 
 /**
- * @brief 初始化file_table
+ * @brief 初始化file结构的对象缓存
  * 
  */
 void file_table_init(void) {
-    mutex_init(&file_alloc_mutex);
-    kernel_memset(file_table, 0, sizeof(file_table));
+    mutex_init(&file_alloc_mutex, "file_table");
+    kmem_cache_init(&file_cache, "file_t", sizeof(file_t));
 }
 
 /**
- * @brief 从file_table中分配一个file结构
+ * @brief 从对象缓存中分配一个file结构
  * 
  * @return file_t* 
  */
 file_t *file_alloc(void) {
-    file_t *file = (file_t*)0;
-
-    //TODO:加锁
-    mutex_lock(&file_alloc_mutex);
-
-    //在file_table中获取分配一个资源
-    for (int i = 0; i < FILE_TABLE_SIZE; ++i) {
-        file_t * p_file = file_table + i;
-        if (p_file->ref == 0) { //当前资源未被分配
-            kernel_memset(p_file, 0, sizeof(file_t));
-            p_file->ref = 1;    //记录被外部引用
-            file = p_file;
-            break;
-        }
+    //在对象缓存中获取分配一个资源
+    file_t *file = (file_t*)kmem_cache_alloc(&file_cache);
+    if (file) {
+        kernel_memset(file, 0, sizeof(file_t));
+        file->ref = 1;    //记录被外部引用
     }
 
-    //TODO:解锁
-    mutex_unlock(&file_alloc_mutex);
     return file;
 }
 
@@ -68,8 +58,14 @@ void file_free(file_t *file) {
         file->ref--;
     }
 
+    int ref = file->ref;
+
     //TODO:解锁
     mutex_unlock(&file_alloc_mutex);
+
+    if (ref == 0) { //已无外部引用，归还给对象缓存
+        kmem_cache_free(&file_cache, file);
+    }
 }
 
 /**
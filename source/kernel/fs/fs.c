@@ -17,9 +17,12 @@
 #include "dev/console.h"
 #include "dev/dev.h"
 #include "fs/file.h"
+#include "fs/pipe.h"
+#include "fs/bcache.h"
 #include "tools/klib.h"
 #include "tools/list.h"
 #include "tools/log.h"
+#include "cpu/idt.h"
 #include "dev/disk.h"
 #include "os_cfg.h"
 #include <sys/file.h>
@@ -350,7 +353,7 @@ int sys_close(int fd) {
     fs_t *fs = file->fs;
     fs_protect(fs);
     fs->op->close(file);
-    fs_protect(fs);
+    fs_unprotect(fs);
 
     //关闭文件后释放文件结构
     file_free(file);
@@ -445,7 +448,7 @@ int sys_dup(int fd) {
   }
 
   file_inc_ref(file);  // 分配成功，该文件引用次数加一
-  return fd;
+  return new_fd;
 }
 
 /**
@@ -578,11 +581,11 @@ static fs_op_t *get_fs_op(fs_type_t type, int major) {
 static mutex_t *get_fs_mutex(fs_type_t type) {
   switch (type) {
     case FS_DEVFS:
-      mutex_init(&devfs_mutex);
+      mutex_init(&devfs_mutex, "devfs");
       return &devfs_mutex;
       break;
     case FS_FAT16:
-      mutex_init(&fatfs_mutex);
+      mutex_init(&fatfs_mutex, "fatfs");
       return &fatfs_mutex;
       break;
     default:
@@ -671,6 +674,8 @@ mount_failed:
 void fs_init(void) {
   mount_list_init();
   file_table_init();
+  pipe_init();
+  bcache_init();
 
   disk_init();
 
@@ -681,4 +686,37 @@ void fs_init(void) {
   ASSERT(root_fs != (fs_t *)0);
 }
 
+/**
+ * @brief 定期写回线程，每隔FS_SYNC_MS将各挂载的文件系统缓存的修改写回磁盘
+ *
+ * @param arg
+ */
+static void fs_sync_entry(void *arg) {
+  for (;;) {
+    sys_sleep(FS_SYNC_MS);
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    for (list_node_t *node = list_get_first(&mounted_list); node; node = list_node_next(node)) {
+      fs_t *fs = list_node_parent(node, fs_t, node);
+      if (fs->op->sync) {
+        fs_protect(fs);
+        fs->op->sync(fs);
+        fs_unprotect(fs);
+      }
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+  }
+}
+
+/**
+ * @brief 创建定期写回的内核线程，需在第一个任务初始化之后调用
+ *
+ */
+void fs_sync_start(void) {
+  task_t *task = kthread_create("fs_sync", fs_sync_entry, (void *)0);
+  ASSERT(task != (task_t *)0);
+}
+
 
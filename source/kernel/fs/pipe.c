@@ -0,0 +1,384 @@
+/**
+ * @file pipe.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  管道，读端与写端作为文件结构放入进程的打开文件表，通过fs_op_t完成读写与关闭
+ *         数据经一页大小的环形缓冲区传递，缓冲区空时读者阻塞，满时写者阻塞；
+ *         读者以不小于一页的缓冲区等待时，写者将大块数据直接写入读者的物理页，省去经过环形缓冲区的一次拷贝
+ * @version 0.1
+ * @date 2023-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "fs/pipe.h"
+#include "fs/fs.h"
+#include "core/kmalloc.h"
+#include "core/memory.h"
+#include "core/task.h"
+#include "cpu/idt.h"
+#include "tools/klib.h"
+#include <sys/file.h>
+#include <sys/stat.h>
+
+static kmem_cache_t pipe_cache;     //pipe结构的对象缓存
+static fs_t pipe_fs;                //管道不属于任何挂载的文件系统，所有管道文件共用该文件系统对象
+
+/**
+ * @brief 唤醒在信号量上等待的一个任务，没有任务等待时不累计信号量
+ *        信号量只作为等待队列使用，被唤醒者需重新检查管道状态
+ *
+ * @param sem
+ */
+static void pipe_wakeup(sem_t *sem) {
+  if (!list_is_empty(&sem->wait_list)) {
+    sem_notify(sem);
+  }
+}
+
+/**
+ * @brief 唤醒在信号量上等待的所有任务，用于管道一端关闭时
+ *
+ * @param sem
+ */
+static void pipe_wakeup_all(sem_t *sem) {
+  while (!list_is_empty(&sem->wait_list)) {
+    sem_notify(sem);
+  }
+}
+
+/**
+ * @brief 在读者的上下文中写入缓冲区的每一页，提前完成按需分配与写时复制，
+ *        使写者能直接通过页表找到可写的物理页
+ *
+ * @param buf
+ * @param size
+ */
+static void pipe_prefault(char *buf, int size) {
+  uint32_t addr = (uint32_t)buf;
+  uint32_t end = addr + size;
+  while (addr < end) {
+    volatile char *c = (volatile char *)addr;
+    *c = *c;
+    addr = down2(addr, MEM_PAGE_SIZE) + MEM_PAGE_SIZE;
+  }
+}
+
+/**
+ * @brief 将当前写者的数据按页直接写入登记的读者缓冲区，遇到不可写的页时停止
+ *
+ * @param pipe
+ * @param buf 写者的缓冲区
+ * @param size 写者剩余的字节数
+ * @return int 写入的字节数
+ */
+static int pipe_direct_copy(pipe_t *pipe, const char *buf, int size) {
+  uint32_t total = size < pipe->direct_size ? size : pipe->direct_size;
+  uint32_t copied = 0;
+
+  while (copied < total) {
+    //1.读者缓冲区的页可能已被其它线程的fork设为写时复制，此时不能直接写入
+    uint32_t paddr = memory_get_write_paddr(pipe->direct_page_dir, pipe->direct_buf + copied);
+    if (paddr == 0) {
+      break;
+    }
+
+    //2.内核空间为恒等映射，直接拷贝到物理页中
+    uint32_t curr_size = MEM_PAGE_SIZE - (paddr & (MEM_PAGE_SIZE - 1));
+    if (curr_size > total - copied) {
+      curr_size = total - copied;
+    }
+    kernel_memcpy((void *)paddr, (void *)(buf + copied), curr_size);
+    copied += curr_size;
+  }
+
+  pipe->direct_count = copied;
+  return copied;
+}
+
+/**
+ * @brief 从管道中读取数据，没有数据时阻塞，写端已关闭且没有数据时返回0
+ *
+ * @param buf
+ * @param size
+ * @param file
+ * @return int 读取的字节数
+ */
+static int pipe_read(char *buf, int size, file_t *file) {
+  pipe_t *pipe = (pipe_t *)file->data;
+
+  idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+  //1.没有数据时等待写者写入或写端关闭
+  while (pipe->wpos == pipe->rpos) {
+    if (!pipe->writers) {
+      idt_leave_protection(state);  // TODO:解锁
+      return 0;
+    }
+
+    //2.缓冲区足够大且没有其它读者登记时，登记缓冲区供写者直接写入
+    int direct = 0;
+    if (size >= PIPE_DIRECT_MIN && pipe->direct_buf == 0) {
+      pipe_prefault(buf, size);
+      if (pipe->wpos != pipe->rpos || !pipe->writers) {
+        continue;  //预先分配页时可能发生了任务切换，重新检查
+      }
+
+      pipe->direct_buf = (uint32_t)buf;
+      pipe->direct_size = size;
+      pipe->direct_page_dir = task_current()->group->page_dir;
+      pipe->direct_count = 0;
+      direct = 1;
+    }
+
+    int intr = sem_wait_intr(&pipe->read_sem);
+
+    //3.写者已直接写入缓冲区，不需要再从环形缓冲区中读取
+    if (direct) {
+      int count = pipe->direct_count;
+      pipe->direct_buf = 0;
+      pipe->direct_count = 0;
+      if (count) {
+        idt_leave_protection(state);  // TODO:解锁
+        return count;
+      }
+    }
+
+    //进程正在退出，放弃等待
+    if (intr < 0) {
+      idt_leave_protection(state);  // TODO:解锁
+      return -1;
+    }
+  }
+
+  //4.从环形缓冲区中读取，跨越缓冲区末尾时分两次拷贝
+  uint32_t used = pipe->wpos - pipe->rpos;
+  uint32_t count = (uint32_t)size < used ? size : used;
+  uint32_t start = pipe->rpos % PIPE_SIZE;
+  uint32_t first = count < PIPE_SIZE - start ? count : PIPE_SIZE - start;
+  kernel_memcpy(buf, pipe->buf + start, first);
+  kernel_memcpy(buf + first, pipe->buf, count - first);
+  pipe->rpos += count;
+
+  //5.唤醒等待空闲空间的写者
+  pipe_wakeup(&pipe->write_sem);
+
+  idt_leave_protection(state);  // TODO:解锁
+  return count;
+}
+
+/**
+ * @brief 向管道写入数据，缓冲区满时阻塞直到全部写入，读端已关闭时停止写入
+ *
+ * @param buf
+ * @param size
+ * @param file
+ * @return int 写入的字节数，-1:读端已关闭
+ */
+static int pipe_write(char *buf, int size, file_t *file) {
+  pipe_t *pipe = (pipe_t *)file->data;
+  int written = 0;
+
+  idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+  while (written < size && pipe->readers) {
+    uint32_t used = pipe->wpos - pipe->rpos;
+    int remain = size - written;
+
+    //1.读者正以足够大的缓冲区等待且环形缓冲区为空时，直接写入读者的缓冲区
+    if (pipe->direct_buf && pipe->direct_count == 0 && used == 0 && remain >= PIPE_DIRECT_MIN) {
+      int count = pipe_direct_copy(pipe, buf + written, remain);
+      if (count > 0) {
+        written += count;
+        pipe_wakeup(&pipe->read_sem);
+        continue;
+      }
+    }
+
+    //2.环形缓冲区已满，等待读者读出数据，进程正在退出时放弃等待
+    if (used == PIPE_SIZE) {
+      if (sem_wait_intr(&pipe->write_sem) < 0) {
+        break;
+      }
+      continue;
+    }
+
+    //3.写入环形缓冲区，跨越缓冲区末尾时分两次拷贝
+    uint32_t count = (uint32_t)remain < PIPE_SIZE - used ? remain : PIPE_SIZE - used;
+    uint32_t start = pipe->wpos % PIPE_SIZE;
+    uint32_t first = count < PIPE_SIZE - start ? count : PIPE_SIZE - start;
+    kernel_memcpy(pipe->buf + start, buf + written, first);
+    kernel_memcpy(pipe->buf, buf + written + first, count - first);
+    pipe->wpos += count;
+    written += count;
+
+    //4.唤醒等待数据的读者
+    pipe_wakeup(&pipe->read_sem);
+  }
+
+  idt_leave_protection(state);  // TODO:解锁
+  return written ? written : -1;
+}
+
+/**
+ * @brief 关闭管道的一端，唤醒另一端的等待者，两端都关闭后释放管道
+ *
+ * @param file
+ */
+static void pipe_close(file_t *file) {
+  pipe_t *pipe = (pipe_t *)file->data;
+
+  idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+  if (file->mode == O_RDONLY) {
+    pipe->readers = 0;
+    pipe_wakeup_all(&pipe->write_sem);
+  } else {
+    pipe->writers = 0;
+    pipe_wakeup_all(&pipe->read_sem);
+  }
+
+  if (!pipe->readers && !pipe->writers) {
+    memory_free_page((uint32_t)pipe->buf);
+    kmem_cache_free(&pipe_cache, pipe);
+  }
+
+  idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief 管道不支持偏移
+ *
+ * @param file
+ * @param offset
+ * @param dir
+ * @return int
+ */
+static int pipe_seek(file_t *file, uint32_t offset, int dir) {
+  return -1;
+}
+
+/**
+ * @brief 获取管道的状态，大小为缓冲区中还未被读出的字节数
+ *
+ * @param file
+ * @param st
+ * @return int
+ */
+static int pipe_stat(file_t *file, struct stat *st) {
+  pipe_t *pipe = (pipe_t *)file->data;
+  st->st_mode = S_IFIFO;
+  st->st_size = pipe->wpos - pipe->rpos;
+  return 0;
+}
+
+/**
+ * @brief 管道不支持io控制
+ *
+ * @param file
+ * @param cmd
+ * @param arg0
+ * @param arg1
+ * @return int
+ */
+static int pipe_ioctl(file_t *file, int cmd, int arg0, int arg1) {
+  return -1;
+}
+
+static fs_op_t pipe_op = {
+    .read = pipe_read,
+    .write = pipe_write,
+    .close = pipe_close,
+    .seek = pipe_seek,
+    .stat = pipe_stat,
+    .ioctl = pipe_ioctl,
+};
+
+/**
+ * @brief 初始化pipe结构的对象缓存与管道共用的文件系统对象
+ *
+ */
+void pipe_init(void) {
+  kmem_cache_init(&pipe_cache, "pipe_t", sizeof(pipe_t));
+
+  kernel_strncpy(pipe_fs.mount_point, "pipe", FS_MOUNT_POINT_SIZE);
+  pipe_fs.type = FS_PIPE;
+  pipe_fs.op = &pipe_op;
+}
+
+/**
+ * @brief 创建管道，fd[0]为读端，fd[1]为写端
+ *
+ * @param fd 传出参数
+ * @return int 0:成功, -1:失败
+ */
+int sys_pipe(int *fd) {
+  file_t *rfile = (file_t *)0, *wfile = (file_t *)0;
+  int rfd = -1, wfd = -1;
+
+  //1.分配管道与环形缓冲区
+  pipe_t *pipe = (pipe_t *)kmem_cache_alloc(&pipe_cache);
+  if (pipe == (pipe_t *)0) {
+    return -1;
+  }
+  kernel_memset(pipe, 0, sizeof(pipe_t));
+  pipe->buf = (char *)memory_alloc_page();
+  if (pipe->buf == (char *)0) {
+    goto sys_pipe_failed;
+  }
+  pipe->readers = pipe->writers = 1;
+  sem_init(&pipe->read_sem, 0);
+  sem_init(&pipe->write_sem, 0);
+
+  //2.分配读端与写端的文件结构，并放入当前进程的打开文件表
+  rfile = file_alloc();
+  wfile = file_alloc();
+  if (rfile == (file_t *)0 || wfile == (file_t *)0) {
+    goto sys_pipe_failed;
+  }
+
+  rfd = task_alloc_fd(rfile);
+  if (rfd < 0) {
+    goto sys_pipe_failed;
+  }
+  wfd = task_alloc_fd(wfile);
+  if (wfd < 0) {
+    goto sys_pipe_failed;
+  }
+
+  kernel_strncpy(rfile->file_name, "pipe", FILE_NAME_SIZE);
+  rfile->type = FILE_PIPE;
+  rfile->fs = &pipe_fs;
+  rfile->mode = O_RDONLY;
+  rfile->data = pipe;
+
+  kernel_strncpy(wfile->file_name, "pipe", FILE_NAME_SIZE);
+  wfile->type = FILE_PIPE;
+  wfile->fs = &pipe_fs;
+  wfile->mode = O_WRONLY;
+  wfile->data = pipe;
+
+  fd[0] = rfd;
+  fd[1] = wfd;
+  return 0;
+
+// 创建失败，回收资源
+sys_pipe_failed:
+  if (rfd >= 0) {
+    task_remove_fd(rfd);
+  }
+  if (wfd >= 0) {
+    task_remove_fd(wfd);
+  }
+  if (rfile) {
+    file_free(rfile);
+  }
+  if (wfile) {
+    file_free(wfile);
+  }
+  if (pipe->buf) {
+    memory_free_page((uint32_t)pipe->buf);
+  }
+  kmem_cache_free(&pipe_cache, pipe);
+  return -1;
+}
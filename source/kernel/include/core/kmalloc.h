@@ -0,0 +1,64 @@
+/**
+ * @file kmalloc.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义内核对象缓存(slab)及kmalloc相关数据结构
+ * @version 0.1
+ * @date 2023-09-15
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include "common/types.h"
+#include "tools/list.h"
+#include "ipc/mutex.h"
+
+//每个slab占用一页内存，页首存放slab的管理结构
+#define KMEM_SLAB_SIZE          4096
+//kmalloc的尺寸等级个数，从16字节到2048字节，每级翻倍
+#define KMEM_SIZE_CLASS_COUNT   8
+//kmalloc最小的尺寸等级
+#define KMEM_SIZE_MIN           16
+//kmalloc最大的尺寸等级，超过该大小直接分配整页
+#define KMEM_SIZE_MAX           2048
+
+//内核对象缓存，同一缓存中的所有对象大小相同
+typedef struct _kmem_cache_t {
+    const char *name;       //缓存的名称，用于打印统计信息
+    uint32_t obj_size;      //对象大小
+    int obj_per_slab;       //每个slab可容纳的对象数
+
+    list_t partial_list;    //还有空闲对象的slab链表
+    list_t full_list;       //对象已全部分配的slab链表
+    list_node_t node;       //挂载到全局缓存链表的节点
+
+    int slab_count;         //当前持有的slab数
+    int obj_in_use;         //当前已分配的对象数
+    int alloc_count;        //累计分配次数
+    int free_count;         //累计释放次数
+
+    mutex_t mutex;          //分配和释放时进行临界资源管理
+}kmem_cache_t;
+
+//slab的管理结构，存放在slab页的起始处，其后为对象区域
+typedef struct _kmem_slab_t {
+    kmem_cache_t *cache;    //所属的缓存，为0时表示该页为kmalloc的大块分配
+    list_node_t node;       //挂载到缓存partial_list或full_list的节点
+    void *free_obj;         //空闲对象单链表，对象的前4字节存放下一个空闲对象的地址
+    int in_use;             //已分配的对象数，大块分配时记录页数
+}kmem_slab_t;
+
+void kmem_init(void);
+void kmem_cache_init(kmem_cache_t *cache, const char *name, uint32_t obj_size);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+void *kmalloc(uint32_t size);
+void kfree(void *ptr);
+
+void kmem_show_info(void);
+
+#endif
@@ -13,9 +13,10 @@
 #define MEMORY_H
 
 #include "common/types.h"
-#include "tools/bitmap.h"
 #include "ipc/mutex.h"
+#include "core/task.h"
 #include "common/boot_info.h"
+#include "cpu/mmu.h"
 
 //实模式下的1mb内存空间
 #define MEM_EXT_START (1024*1024)
@@ -33,14 +34,30 @@
 //定义分配给每个应用程序的入口参数的空间大小
 #define MEM_TASK_ARG_SIZE   (MEM_PAGE_SIZE * 4)
 
-//内存分配对象
+//是否开启按需分配，开启后用户栈、堆与bss段只预留虚拟地址，在第一次访问触发page_fault时才分配清零的物理页
+#define MEM_DEMAND_PAGING   1
+
+//伙伴系统的阶数，最大的空闲块为 2^(MEM_BUDDY_ORDER_COUNT - 1) 页，即4mb
+#define MEM_BUDDY_ORDER_COUNT   11
+//空闲链表中的空索引
+#define MEM_BUDDY_NONE          0xffff
+//标记页为空闲块的首页，低位为该块的阶数
+#define MEM_BUDDY_FREE          (1 << 7)
+
+//内存分配对象，用伙伴系统管理物理页
 typedef struct _addr_alloc_t {
     mutex_t mutex;      //分配内存时进行临界资源管理
-    bitmap_t bitmap;    //管理内存页的位图结构
     uint32_t start;     //管理内存区域的起始地址
     uint32_t size;      //内存区域的大小
     uint32_t page_size; //页的大小
-    uint8_t  page_ref[(MEM_EXT_END - MEM_EXT_START) / MEM_PAGE_SIZE];  //TODO,由于引用计数占用空间较大，经计算，在1mb一下加载内核，管理内存大小不能超过1gb
+    int page_count;     //管理的页数
+    int free_count;     //空闲的页数
+
+    uint16_t free_list[MEM_BUDDY_ORDER_COUNT];  //每一阶的空闲链表，记录第一个空闲块首页的索引
+    uint16_t *pre;      //空闲块首页在空闲链表中的前驱索引
+    uint16_t *next;     //空闲块首页在空闲链表中的后继索引
+    uint16_t *page_ref; //页的引用计数，写时复制页可能被大量fork出的进程共享，不能用8位计数
+    uint8_t *order;     //空闲块首页的阶数及空闲标志
 
 }addr_alloc_t;
 
@@ -56,13 +73,22 @@ typedef struct _memory_map_t {
 void memory_init(boot_info_t *boot_info);
 uint32_t memory_creat_uvm(void);
 int memory_copy_uvm(uint32_t to_page_dir, uint32_t from_page_dir);
+int memory_copy_on_write(uint32_t vaddr);
+int memory_add_region(task_t *task, uint32_t vstart, uint32_t vend, uint32_t privilege);
+int memory_alloc_on_demand(uint32_t vaddr);
 void memory_destroy_uvm(uint32_t page_dir);
+int memory_creat_map(pde_t *page_dir, uint32_t vstart, uint32_t pstart, int page_count, uint32_t privilege);
 int memory_alloc_for_page_dir(uint32_t page_dir, uint32_t vaddr, uint32_t alloc_size, uint32_t privilege);
 uint32_t memory_get_paddr(uint32_t page_dir, uint32_t vaddr);
+uint32_t memory_get_write_paddr(uint32_t page_dir, uint32_t vaddr);
+uint32_t memory_get_user_paddr(uint32_t vaddr);
 
 int memory_alloc_page_for(uint32_t vaddr, uint32_t alloc_size, uint32_t priority);
 uint32_t memory_alloc_page();
 void memory_free_page(uint32_t addr);
+uint32_t memory_alloc_pages(int page_count);
+uint32_t memory_alloc_shared_page(void);
+void memory_free_pages(uint32_t addr, int page_count);
 int memory_copy_uvm_data(uint32_t to_vaddr, uint32_t to_page_dir, uint32_t from_vaddr, uint32_t size); 
 
 char *sys_sbrk(int incr);
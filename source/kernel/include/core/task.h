@@ -15,25 +15,44 @@
 #include "cpu/tss.h"
 #include "tools/list.h"
 #include "fs/file.h"
+#include "core/timer.h"
+#include "cpu/smp.h"
 
 // 定义任务名称缓冲区大小
 #define TASK_NAME_SIZE 32
 
-//静态分配任务，定义任务数量
-#define TASK_COUNT 128
 
-//定义每个进程所能拥有的时间切片数量
-#define TASK_TIME_SLICE_DEFAULT 10
+//定义多级反馈队列的优先级数量，0为最高优先级
+#define TASK_PRIORITY_COUNT 8
+
+//定义最高优先级进程所能拥有的时间切片数量，优先级每降低一级时间片数翻倍
+#define TASK_TIME_SLICE_MIN 2
+
+//定义优先级提升的周期(时间片数)，每个周期将所有进程恢复到其基础优先级，防止低优先级进程饥饿
+#define TASK_BOOST_TICKS 1000
+
+//定义单次延时的最长时间(ms)，更长的延时分多次进行，保证以振荡次数计算的时间差不溢出
+#define TASK_SLEEP_MAX_MS 1000000
 
 //定义空闲进程的栈空间大小
 #define EMPTY_TASK_STACK_SIZE 128
 
+//定义内核线程栈顶为入口函数预留的返回地址与参数的大小
+#define TASK_KTHREAD_ARG_SIZE (2 * sizeof(uint32_t))
+
+//定义pid散列表的桶数量
+#define TASK_PID_HASH_SIZE 64
+
 //定义进程可打开的文件数量大小
 #define TASK_OFILE_SIZE 128
 
+//定义每个进程可记录的按需分配内存区域数量
+#define TASK_MEM_REGION_COUNT 8
+
 //设置任务进程的特权级标志位
 #define TASK_FLAGS_SYSTEM   (1 << 0)  //内核特权级即最高特权级
 #define TASK_FLAGS_USER   (0 << 0)  //用户特权级
+#define TASK_FLAGS_THREAD (1 << 1)  //线程，不创建自己的地址空间，由调用者加入创建者的线程组
 // 定义任务状态枚举类型
 typedef enum _task_state_t {
   TASK_CREATED,   // 已创建，任务被创建，但为加入就绪队列
@@ -46,46 +65,103 @@ typedef enum _task_state_t {
   TASK_ORPHAN,    //孤儿态，进程已死掉，并且其父进程提前死掉
 } state_t;
 
+//定义进程按需分配的内存区域，区域内的页在第一次被访问时才分配清零的物理页
+typedef struct _task_mem_region_t {
+  uint32_t start;       //区域起始虚拟地址，按页对齐
+  uint32_t end;         //区域结束虚拟地址，按页对齐，为0表示该项未使用
+  uint32_t privilege;   //区域内页的权限
+}task_mem_region_t;
+
+struct _task_t;
+struct _mutex_t;
+
+//定义线程组，即进程中所有线程共享的地址空间与打开文件表，最后一个引用它的任务被回收时才释放
+typedef struct _task_group_t {
+  int refs;                 //引用该组的任务数，包括已退出但还未被回收的线程
+  int threads;              //还未退出的线程数，为0时关闭打开的文件，父进程可回收整个进程
+  int exiting;              //进程已调用exit退出，其它线程在返回用户态前随之退出
+  int status;               //进程退出的状态值
+  struct _task_t *leader;   //创建该组的主线程，代表整个进程作为子进程的父进程
+  list_t members;           //组内所有还未被回收的线程
+
+  uint32_t page_dir;        //所有线程共用的页目录表
+  uint32_t heap_start;      //进程堆空间的起始地址
+  uint32_t heap_end;        //进程堆空间的结束地址
+  task_mem_region_t mem_regions[TASK_MEM_REGION_COUNT];  //已预留但还未分配物理页的内存区域(栈与bss段)
+
+  file_t *file_table[TASK_OFILE_SIZE];  //进程所拥有的文件表
+}task_group_t;
+
 // 定义可执行任务的数据结构,即PCB进程控制块，书p406
 typedef struct _task_t {
   state_t state;            //任务状态
   struct _task_t *parent;   //父进程控制块的地址
-  int pid;                  //进程id
+  int pid;                  //进程id，线程也拥有自己的id
   int status;               //进程退出的状态值
 
-  uint32_t heap_start;      //进程堆空间的起始地址
-  uint32_t heap_end;        //进程堆空间的结束地址
+  task_group_t *group;      //任务所属的线程组，共享地址空间、堆空间与打开文件表
+
+  list_t children;          //子进程队列，只用于主线程，所有线程都已退出的子进程位于队列头部
+  list_t wait_list;         //等待该任务的队列，主线程上为等待子进程退出的线程，其它线程上为等待回收它的线程
+  struct _task_t *wait_child;  //在wait_list中等待时，由退出的子进程填入自身后唤醒
+  list_t *wait_queue;       //任务可被中断地等待时所在的等待队列，进程退出时据此将其取下
+  int wait_intr;            //任务的等待是否因进程退出而被中断
+
+  int priority;             //任务当前所在的优先级队列，越小优先级越高
+  int nice;                 //任务的基础优先级，提升时不会高于该优先级
+  int blocked;              //任务是否因等待资源离开了就绪队列，再次就绪时提升一级优先级
+  int inherit_priority;     //从持有的互斥锁的等待者继承的优先级，高于priority时按该优先级调度
+  list_t held_mutexes;      //任务持有的互斥锁，释放锁时据此重新计算继承的优先级
+  struct _mutex_t *wait_mutex;  //任务正在等待的互斥锁，用于沿持有者链传递继承的优先级
+
+  int cpu;                  //任务所在就绪队列所属的cpu，被其它cpu窃取时随之改变
+  int last_cpu;             //任务最近一次运行的cpu，迁移后需重新加载页目录表以清除过期的TLB项
+  int lock_depth;           //任务切换时保存的内核锁嵌套深度，为0表示任务不在内核中
+  int trace;                //为1时将任务的每次系统调用记录到所在cpu的跟踪缓冲区中
 
   int slice_max;            //任务所能拥有的最大时间分片数
   int slice_curr;           //任务当前的所拥有的时间分片数
-  int sleep;                //当前任务延时的时间片数
+  ktimer_t sleep_timer;      //任务延时使用的定时器，到期后将任务重新加入就绪队列
+  uint32_t sleep_deadline;  //任务延时的到期时间，以定时器晶体振荡次数为单位
 
   char name[TASK_NAME_SIZE];//任务名称
 
   list_node_t ready_node;   // 用于插入就绪队列的节点，标记task在就绪队列中的位置
   list_node_t task_node;    // 用于插入任务队列的节点，标记task在任务队列中的位置
-  list_node_t wait_node;   //用于插入信号量对象的等待队列的节点，标记task正在等待信号量
+  list_node_t wait_node;   //用于插入信号量对象或任务的等待队列的节点，标记task正在等待
+  list_node_t child_node;  //用于插入父进程子进程队列的节点
+  list_node_t pid_node;    //用于插入pid散列表的节点
+  list_node_t group_node;  //用于插入线程组成员队列的节点
   
-  tss_t tss;                // 任务对应的TSS描述符
-  uint32_t tss_selector;    // 任务对应的TSS选择子
-
-  file_t *file_table[TASK_OFILE_SIZE];  //任务进程所拥有的文件表
+  tss_t tss;                // 任务的上下文记录(入口、用户栈、esp0、cr3等)，cpu不再通过它进行任务切换
+  uint32_t *kernel_esp;     // 软件任务切换时保存的内核栈指针，栈中保存了被调用者保存的寄存器
 } task_t;
 
 int task_init(task_t *task, const char *name, uint32_t entry, uint32_t esp, uint32_t flag);
 void task_switch_from_to(task_t *from, task_t *to);
+void task_start(task_t *task);
+
 
+//定义每个cpu的调度队列
+typedef struct _task_rq_t {
+  task_t *curr_task;  // 当前cpu正在执行的任务
+  task_t *idle_task;  // 当前cpu的空闲进程，不在就绪队列中
+
+  list_t ready_lists[TASK_PRIORITY_COUNT];  // 各优先级的就绪队列，包含分配给该cpu的所有可执行任务
+  uint32_t ready_bitmap;  //就绪位图，第i位为1表示第i级就绪队列非空
+  int ready_count;        //就绪队列中的任务数，包括正在运行的任务
+} task_rq_t;
 
 // 定义任务管理器
 typedef struct _task_manager_t {
-  task_t *curr_task;  // 当前正在执行的任务
-
-  list_t ready_list;  // 就绪队列，包含所有已准备好的可执行任务
+  task_rq_t rqs[SMP_CPU_MAX];  // 每个cpu的调度队列
+  uint32_t boost_ticks;   //距离下一次优先级提升剩余的时间片数
   list_t task_list;  // 任务队列，包含所有的任务
-  list_t sleep_list;  //延时队列，包含当前需要延时的任务
+  list_t pid_hash[TASK_PID_HASH_SIZE];  // 按pid散列的任务队列，用于根据pid查找任务
+  int next_pid;      // 下一个分配的pid
 
   task_t first_task;  // 执行的第一个任务
-  task_t empty_task;  //一个空的空闲进程，当所有进程都延时运行时，让cpu运行空闲进程
+  task_t empty_task;  //BSP的空闲进程，当所有进程都延时运行时，让cpu运行空闲进程
 
   uint32_t app_code_selector; //应用程序代码段的选择子
   uint32_t app_data_selector; //应用程序数据段的选择子
@@ -107,11 +183,23 @@ void task_first_init(void);
 task_t *task_first_task(void);
 void task_set_ready(task_t *task);
 void task_set_unready(task_t *task);
-void task_set_sleep(task_t *task, uint32_t slice);
+task_t *task_ready_first(void);
+int task_sched_priority(task_t *task);
+void task_set_inherit_priority(task_t *task, int priority);
+void task_set_sleep(task_t *task, uint32_t ms);
 void task_set_wakeup(task_t *task);
 void task_slice_end(void);
+int task_is_idle(void);
+void task_preempt(void);
 void task_switch(void);
+void task_switch_finish(void);
 task_t* task_current(void);
+task_t *task_find(int pid);
+task_t *task_idle_task(int cpu);
+void task_ap_enter(void);
+void task_exit_check(void);
+int task_wait_intr(list_t *queue);
+task_t *kthread_create(const char *name, void (*func)(void *), void *arg);
 
 
 //系统调用函数
@@ -122,6 +210,10 @@ int sys_fork(void);
 int sys_execve(char *name, char * const *argv, char * const *env );
 void sys_exit(int status);
 int sys_wait(int *status);
+int sys_nice(int inc);
+int sys_clone(uint32_t entry, uint32_t stack);
+void sys_thread_exit(int status);
+int sys_thread_join(int tid, int *status);
 
 //文件系统函数
 file_t *task_file(int fd);
@@ -0,0 +1,56 @@
+/**
+ * @file timer.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义内核定时器及分层时间轮相关数据结构
+ * @version 0.1
+ * @date 2023-09-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "common/types.h"
+#include "tools/list.h"
+
+//时间轮的层数
+#define TIMER_WHEEL_LEVELS      4
+//每层时间轮的槽位数为2^TIMER_WHEEL_BITS
+#define TIMER_WHEEL_BITS        6
+#define TIMER_WHEEL_SIZE        (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK        (TIMER_WHEEL_SIZE - 1)
+//时间轮能表示的最大超时时间片数，更长的超时会被截断
+#define TIMER_MAX_TICKS         ((1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+//定时器到期时调用的回调函数，在时钟中断中以关中断的状态执行
+typedef void (*timer_func_t)(void *arg);
+
+//内核定时器
+typedef struct _ktimer_t {
+    list_node_t node;   //挂载到时间轮槽位的节点
+    list_t *slot;       //当前所在的时间轮槽位，为0表示定时器未启动
+    uint32_t expire;    //到期的绝对时间片数
+    uint32_t period;    //周期定时器的周期，为0表示单次定时器
+    timer_func_t func;  //到期回调函数
+    void *arg;          //回调函数的参数
+}ktimer_t;
+
+//定时器管理器，即分层时间轮
+//第0层每个槽位对应一个时间片，第n层每个槽位对应第n-1层转一圈的时间，
+//高层槽位中的定时器在低层时间轮转完一圈时被重新分配到低层，每个时间片的开销为O(1)
+typedef struct _timer_manager_t {
+    uint32_t curr_tick;     //下一个需要处理的时间片
+    list_t wheels[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];  //各层时间轮的槽位
+}timer_manager_t;
+
+void timer_manager_init(void);
+void timer_init(ktimer_t *timer, timer_func_t func, void *arg);
+void timer_add(ktimer_t *timer, uint32_t ticks, uint32_t period);
+void timer_remove(ktimer_t *timer);
+int timer_is_active(ktimer_t *timer);
+uint32_t timer_next_ticks(void);
+void timer_tick(void);
+
+#endif
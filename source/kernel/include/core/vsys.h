@@ -0,0 +1,48 @@
+/**
+ * @file vsys.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义映射到每个进程中的只读数据页，应用程序直接读取其中的时间与pid，不必进入内核
+ *         该文件也被应用程序库包含，只定义数据结构与固定地址
+ * @version 0.1
+ * @date 2023-09-29
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef VSYS_H
+#define VSYS_H
+
+#include "common/types.h"
+
+//所有进程共享的时间数据页的虚拟地址，位于用户栈之上
+#define MEM_VSYS_BASE       0xF0000000
+//每个进程私有的数据页的虚拟地址，紧随共享页之后
+#define MEM_VSYS_PROC       (MEM_VSYS_BASE + 4096)
+//两个数据页的结束地址
+#define MEM_VSYS_END        (MEM_VSYS_BASE + 2 * 4096)
+
+//校准时间戳计数器时等待的时间(ms)
+#define VSYS_CALIBRATE_MS   10
+
+//所有进程共享的时间数据，由BSP在时钟中断中更新
+//更新时序号先变为奇数，更新完成后变为偶数，读取者在序号为奇数或读取前后不一致时重新读取
+typedef struct _vsys_data_t {
+    volatile uint32_t seq;          //更新序号
+    volatile uint32_t ticks;        //最近一次更新时经过的时间片数
+    volatile uint32_t tsc_low;      //最近一次更新时时间戳计数器的值
+    volatile uint32_t tsc_high;
+    volatile uint32_t tsc_per_tick; //每个时间片的时间戳计数器周期数，为0表示未校准
+}vsys_data_t;
+
+//每个进程私有的数据
+typedef struct _vsys_proc_t {
+    volatile int pid;               //进程只有一个线程时为该线程的pid，有多个线程时为0，需经系统调用获取
+}vsys_proc_t;
+
+void vsys_init(void);
+int vsys_map(uint32_t page_dir);
+void vsys_set_pid(uint32_t page_dir, int pid);
+void vsys_update(uint32_t ticks);
+
+#endif
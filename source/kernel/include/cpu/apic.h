@@ -0,0 +1,70 @@
+/**
+ * @file apic.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义本地APIC的寄存器及相关操作，用于多处理器间的中断与每个cpu的时钟
+ * @version 0.1
+ * @date 2023-09-24
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef APIC_H
+#define APIC_H
+
+#include "common/types.h"
+
+//本地APIC寄存器所在的物理地址，多处理器配置表中给出的地址与之不同时不启用多处理器
+#define LAPIC_PADDR         0xFEE00000u
+//本地APIC寄存器在内核空间中映射到的虚拟地址，位于内核可用的物理内存之上，所有进程共享
+#define LAPIC_VADDR         0x7FFFF000u
+
+//本地APIC寄存器的偏移量
+#define LAPIC_ID            0x020   //APIC ID，高8位有效
+#define LAPIC_TPR           0x080   //任务优先级寄存器，为0时接收所有中断
+#define LAPIC_EOI           0x0B0   //写入0表示中断处理结束
+#define LAPIC_SVR           0x0F0   //伪中断向量寄存器，第8位为APIC的软件使能位
+#define LAPIC_ESR           0x280   //错误状态寄存器
+#define LAPIC_ICR_LOW       0x300   //中断命令寄存器低32位，写入后发送处理器间中断
+#define LAPIC_ICR_HIGH      0x310   //中断命令寄存器高32位，高8位为目标APIC ID
+#define LAPIC_LVT_TIMER     0x320   //本地时钟的中断向量表项
+#define LAPIC_LVT_LINT0     0x350   //LINT0引脚的中断向量表项
+#define LAPIC_LVT_LINT1     0x360   //LINT1引脚的中断向量表项
+#define LAPIC_TIMER_INIT    0x380   //本地时钟的初始计数值
+#define LAPIC_TIMER_CURR    0x390   //本地时钟的当前计数值
+#define LAPIC_TIMER_DIV     0x3E0   //本地时钟的分频寄存器
+
+#define LAPIC_SVR_ENABLE        (1 << 8)
+#define LAPIC_LVT_MASKED        (1 << 16)
+#define LAPIC_TIMER_PERIODIC    (1 << 17)
+#define LAPIC_TIMER_DIV_16      0x3
+
+//中断命令寄存器的各字段
+#define LAPIC_ICR_INIT          (5 << 8)    //INIT中断，使目标处理器复位
+#define LAPIC_ICR_STARTUP       (6 << 8)    //STARTUP中断，使目标处理器从指定页开始执行实模式代码
+#define LAPIC_ICR_PENDING       (1 << 12)   //中断正在发送
+#define LAPIC_ICR_ASSERT        (1 << 14)
+#define LAPIC_ICR_LEVEL         (1 << 15)
+
+//本地APIC使用的中断向量号，位于8259芯片的中断向量号之后
+#define IRQ_LAPIC_TIMER     0x30    //AP的本地时钟中断
+#define IRQ_RESCHEDULE      0x31    //其它cpu请求当前cpu重新调度的处理器间中断
+#define IRQ_TLB_FLUSH       0x32    //其它cpu请求当前cpu刷新TLB的处理器间中断
+#define IRQ_SPURIOUS        0xFF    //伪中断，不需要发送EOI
+
+void lapic_init(void);
+void lapic_ap_init(void);
+void lapic_timer_start(void);
+int lapic_enabled(void);
+uint8_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_send_ipi(uint8_t apic_id, int vector);
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint32_t addr);
+
+void exception_handler_lapic_timer(void);
+void exception_handler_reschedule(void);
+void exception_handler_tlb_flush(void);
+void exception_handler_spurious(void);
+
+#endif
@@ -146,6 +146,7 @@ void exception_handler_control_exception (void);    //IDT21
 typedef void (*idt_handler_t)(void);
 
 void idt_init(void);
+void idt_load(void);
 void idt_enable(uint8_t irq_num);
 void idt_disable(uint8_t irq_num);
 void idt_enable_global(void);
@@ -22,11 +22,34 @@
 #define PDE_P   (1 << 0)    //第0位，present位, 当前pde存在
 #define PDE_W   (1 << 1)    //第1位，write位，当前pde对应的页表所对应的页都可读写
 #define PDE_U   (1 << 2)    //第2位，user位，访问权限为user，即普通用户和超级用户都可访问
+#define PDE_PS  (1 << 7)    //第7位，page size位，当前pde直接映射一个4mb的大页，需开启CR4.PSE
+#define PDE_G   (1 << 8)    //第8位，global位，只对4mb大页有效，需开启CR4.PGE
+
+//定义4mb大页的大小
+#define PDE_LARGE_PAGE_SIZE (4 * 1024 * 1024)
 
 //定义页表项相关的宏
 #define PTE_P   (1 << 0)    //第0位，present位，页表存在
 #define PTE_W   (1 << 1)    //第1位，页表项对应的页可读写
 #define PTE_U   (1 << 2)    //第2位，user位，该页访问权限为user，即普通用户和超级用户都可以访问
+#define PTE_PWT (1 << 3)    //第3位，直写位，用于设备寄存器的映射
+#define PTE_PCD (1 << 4)    //第4位，禁止缓存位，用于设备寄存器的映射
+#define PTE_G   (1 << 8)    //第8位，global位，写cr3时不从TLB中驱逐该页，需开启CR4.PGE
+#define PTE_COW (1 << 9)    //第9位，操作系统可用位，标记该页为写时复制页，写操作触发page_fault后再进行复制
+#define PTE_KERNEL (1 << 10) //第10位，操作系统可用位，标记该页由内核持有，映射到进程及进程销毁时不增减其引用计数
+
+//定义CR0的WP位，置1后内核对只读页的写操作也会触发page_fault，写时复制依赖该位
+#define CR0_WP  (1 << 16)
+//定义CR0中与协处理器相关的位，MP:监控协处理器，EM:模拟协处理器，TS:任务已切换
+#define CR0_MP  (1 << 1)
+#define CR0_EM  (1 << 2)
+#define CR0_TS  (1 << 3)
+//定义CR4的PSE位与PGE位，分别开启4mb大页与全局页
+#define CR4_PSE (1 << 4)
+#define CR4_PGE (1 << 7)
+//定义CR4中开启SSE指令的位，OSFXSR:支持fxsave/fxrstor及SSE指令，OSXMMEXCPT:支持SSE浮点异常
+#define CR4_OSFXSR      (1 << 9)
+#define CR4_OSXMMEXCPT  (1 << 10)
 
 
 
@@ -0,0 +1,113 @@
+/**
+ * @file smp.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义多处理器的检测与启动，以及每个cpu私有的数据
+ * @version 0.1
+ * @date 2023-09-24
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SMP_H
+#define SMP_H
+
+#include "common/types.h"
+#include "cpu/tss.h"
+
+//支持的最大cpu数量
+#define SMP_CPU_MAX         8
+
+//等待AP启动完成的最长时间(ms)
+#define SMP_AP_TIMEOUT_MS   100
+
+//loader恒等映射的低4mb，多处理器配置表需位于其中
+#define MP_MAPPED_END       0x400000
+
+//多处理器浮点结构与配置表的签名
+#define MP_FLOAT_SIGNATURE  0x5f504d5f  //"_MP_"
+#define MP_CONFIG_SIGNATURE 0x504d4350  //"PCMP"
+
+//多处理器配置表表项的类型
+#define MP_ENTRY_PROCESSOR  0
+#define MP_PROCESSOR_EN     (1 << 0)    //处理器可用
+#define MP_PROCESSOR_BSP    (1 << 1)    //处理器为BSP
+
+#pragma pack(1)
+
+//多处理器浮点结构，由BIOS放在EBDA或0xf0000~0xfffff中
+typedef struct _mp_float_t {
+    uint32_t signature;     //"_MP_"
+    uint32_t config_addr;   //多处理器配置表的物理地址，为0表示使用默认配置
+    uint8_t length;         //结构的长度，以16字节为单位
+    uint8_t version;
+    uint8_t checksum;       //所有字节之和为0
+    uint8_t feature[5];
+}mp_float_t;
+
+//多处理器配置表的表头
+typedef struct _mp_config_t {
+    uint32_t signature;     //"PCMP"
+    uint16_t length;        //基本表的长度，包括表头
+    uint8_t version;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_size;
+    uint16_t entry_count;   //表项的数量
+    uint32_t lapic_addr;    //本地APIC寄存器的物理地址
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+}mp_config_t;
+
+//多处理器配置表中的处理器表项，其它类型的表项都为8字节
+typedef struct _mp_processor_t {
+    uint8_t type;           //MP_ENTRY_PROCESSOR
+    uint8_t apic_id;
+    uint8_t apic_version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t feature;
+    uint32_t reserved[2];
+}mp_processor_t;
+
+//AP启动代码使用的参数，位于启动代码的末尾，由BSP在发送STARTUP中断前填写
+typedef struct _smp_start_param_t {
+    uint16_t gdt_limit;     //内核GDT表，AP进入保护模式时直接加载
+    uint32_t gdt_base;
+    uint32_t cr0;           //开启分页后的控制寄存器，与BSP相同
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t esp;           //AP的初始栈，即其空闲进程的栈
+    uint32_t entry;         //AP进入内核的c入口函数
+    uint32_t cpu;           //AP的cpu结构的地址，作为入口函数的参数
+}smp_start_param_t;
+
+#pragma pack()
+
+//每个cpu私有的数据
+typedef struct _cpu_t {
+    int id;                 //逻辑编号，BSP为0
+    uint8_t apic_id;        //本地APIC的ID
+    volatile int started;   //AP是否已完成初始化并进入空闲进程
+
+    tss_t tss;              //该cpu上所有任务共享的TSS，只用于特权级提升时提供ss0与esp0
+    uint32_t tss_selector;  //TSS的选择子，也用于识别当前cpu
+
+    int lock_depth;         //当前cpu持有内核锁的嵌套深度，为0表示未持有
+    volatile int tlb_flush; //其它cpu请求当前cpu刷新TLB，刷新后清零
+}cpu_t;
+
+void smp_detect(void);
+void smp_cpu_init(void);
+void smp_start_aps(void);
+int smp_cpu_count(void);
+cpu_t *smp_cpu(int id);
+cpu_t *cpu_current(void);
+int cpu_id(void);
+void smp_tlb_shootdown(void);
+void smp_tlb_flush_ack(cpu_t *cpu);
+
+#endif
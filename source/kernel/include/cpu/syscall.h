@@ -16,6 +16,14 @@
 //定义调用门描述符中，参数个数属性，即系统调用函数的参数个数
 #define SYSCALL_PARAM_COUNT 5
 
+//sysenter使用的模型特定寄存器，分别为内核代码段选择子、内核栈顶与入口地址
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+//cpuid功能号1返回的edx中，表示支持sysenter/sysexit的位
+#define CPUID_FEAT_EDX_SEP  (1 << 11)
+
 //定义进程相关系统调用的id
 #define SYS_sleep       0   //延时函数
 #define SYS_getpid      1   //获取pid
@@ -24,6 +32,15 @@
 #define SYS_yield       4   //进程主动放弃cpu
 #define SYS_exit        5   //进程主动退出
 #define SYS_wait        6   //回收进程资源
+#define SYS_nice        7   //调整进程的基础优先级
+#define SYS_clone       8   //创建共享地址空间的线程
+#define SYS_thread_exit 9   //只退出当前线程
+#define SYS_thread_join 11  //回收同一进程中的线程
+#define SYS_futex_wait  12  //用户空间地址处的值未改变时进入等待
+#define SYS_futex_wake  13  //唤醒在用户空间地址上等待的线程
+#define SYS_trace       14  //开启或关闭任务的系统调用跟踪
+#define SYS_trace_read  15  //读取系统调用的跟踪记录
+#define SYS_trace_stat  16  //获取系统调用的耗时统计
 
 //文件相关系统调用
 #define SYS_open        50 
@@ -45,6 +62,12 @@
 //内存分配系统调用
 #define SYS_sbrk        63
 
+//进程间通信系统调用
+#define SYS_pipe        64
+
+//块缓存相关系统调用
+#define SYS_bcache_stat 65
+
 #define SYS_printmsg    10   //临时使用的打印函数
 
 
@@ -64,6 +87,10 @@ typedef struct _syscall_frame_t {
 
 typedef int(*sys_handler_t)(uint32_t arg0, uint32_t arg1, uint32_t arg2, uint32_t arg3);
 
+struct _cpu_t;
+
 void exception_handler_syscall (void);
+void exception_handler_sysenter(void);
+void syscall_sysenter_init(struct _cpu_t *cpu);
 
 #endif
\ No newline at end of file
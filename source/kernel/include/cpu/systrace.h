@@ -0,0 +1,61 @@
+/**
+ * @file systrace.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义系统调用的跟踪记录与耗时统计
+ *         该文件也被应用程序库包含，只定义数据结构与常量
+ * @version 0.1
+ * @date 2023-09-30
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef SYSTRACE_H
+#define SYSTRACE_H
+
+#include "common/types.h"
+
+//可统计的系统调用id的范围，所有系统调用的id都小于该值
+#define SYSTRACE_ID_MAX         80
+
+//耗时直方图的桶数，第i个桶记录耗时在[2^i, 2^(i+1))个时间戳计数器周期内的调用次数，耗时为0的调用记在第0个桶
+#define SYSTRACE_HIST_SIZE      32
+
+//每个cpu的跟踪缓冲区可容纳的记录数，需为2的幂，缓冲区满时覆盖最旧的记录
+#define SYSTRACE_RING_SIZE      256
+
+//一次系统调用的跟踪记录
+typedef struct _systrace_entry_t {
+    uint32_t seq;       //全局递增的序号，用于合并各cpu的记录，不连续时表示有记录被覆盖
+    int pid;            //发起调用的任务
+    int id;             //系统调用id
+    uint32_t args[4];   //调用参数
+    int ret;            //返回值，不会返回的调用(如exit)在进入时记录，返回值为0
+    uint32_t cycles;    //调用耗时的时间戳计数器周期数
+}systrace_entry_t;
+
+//单个系统调用的耗时统计
+typedef struct _systrace_stat_t {
+    uint32_t count;                     //调用次数
+    uint32_t cycles_max;                //单次调用的最长耗时
+    uint64_t cycles_total;              //所有调用的总耗时
+    uint32_t hist[SYSTRACE_HIST_SIZE];  //按耗时的log2划分的调用次数
+}systrace_stat_t;
+
+//每个cpu私有的跟踪缓冲区与统计，只在持有内核锁时访问
+typedef struct _systrace_cpu_t {
+    systrace_entry_t ring[SYSTRACE_RING_SIZE];  //跟踪缓冲区
+    uint32_t head;                              //已写入的记录总数
+    uint32_t tail;                              //已被读取的记录总数
+    systrace_stat_t stats[SYSTRACE_ID_MAX];     //每个系统调用的耗时统计
+}systrace_cpu_t;
+
+void systrace_init(void);
+uint64_t systrace_begin(int id, const uint32_t *args);
+void systrace_end(int id, const uint32_t *args, uint64_t start, int ret);
+
+int sys_trace(int pid, int enable);
+int sys_trace_read(systrace_entry_t *buf, int count, int pid);
+int sys_trace_stat(int id, systrace_stat_t *stat);
+
+#endif
@@ -14,6 +14,8 @@
 #define TIME_H
 
 #include "common/types.h"
+#include "core/timer.h"
+#include "os_cfg.h"
 
 //书p350
 //定时器晶体振荡器的频率，即晶体振荡1193182次的时间为1s，PIT:可编程定时器
@@ -28,8 +30,33 @@
 #define PIT_READ_LOAD           ((uint8_t)(3 << 4))
 //选择定时器工作模式 3, 使定时器产生周期中断
 #define PIT_MODE                ((uint8_t)(3 << 1))
+//选择定时器工作模式 0, 计数到0时产生一次中断，之后计数器继续从0xffff递减
+#define PIT_MODE_ONESHOT        ((uint8_t)(0 << 1))
+//锁存计数器的当前值，之后可从数据端口先低后高读出
+#define PIT_LATCH               ((uint8_t)(0 << 4))
+
+//每毫秒晶体的振荡次数，内核的高精度时间以振荡次数为单位
+#define TIME_CYCLES_PER_MS      (PIT_OSC_FREQ / 1000)
+//每个时间片晶体的振荡次数
+#define TIME_CYCLES_PER_TICK    (TIME_CYCLES_PER_MS * OS_TICKS_MS)
+//单次定时的最小振荡次数，过近的到期时间直接视为已到期
+#define TIME_MIN_CYCLES         16
+//单次定时的最大振荡次数，计数器为16位，留出余量使中断延迟时仍能正确计算经过的时间
+#define TIME_MAX_CYCLES         0xc000
+
+//定时器中断的统计信息
+typedef struct _time_stat_t {
+    uint32_t irq_count;     //定时器中断的次数
+    uint32_t tick_count;    //经过的时间片数
+    uint32_t idle_skip;     //空闲时跳过的时间片数
+}time_stat_t;
 
 void time_init(void);
+uint32_t time_now(void);
+int time_hrtimer_start(ktimer_t *timer, uint32_t deadline);
+void time_reprogram(void);
+void time_get_stat(time_stat_t *stat);
+void time_delay(uint32_t us);
 //处理定时器中断请求的程序的汇编入口函数声明
 void exception_handler_time(void);
 
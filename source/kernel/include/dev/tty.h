@@ -12,6 +12,7 @@
 #ifndef TTY_H
 #define TTY_H
 
+#include "common/types.h"
 #include "ipc/sem.h"
 
 //tty缓存队列
@@ -36,6 +37,15 @@ typedef struct _tty_fifo_t {
 #define TTY_CMD_ECHO        0x1
 //获取tty输入缓冲区的字符个数
 #define TTY_CMD_IN_COUNT    0x2
+//获取按键到回显的延迟统计，arg0为tty_latency_t结构的地址，arg1不为0时清空统计
+#define TTY_CMD_LATENCY     0x3
+
+//按键到回显的延迟统计，延迟以1024个时钟周期为单位
+typedef struct _tty_latency_t {
+    uint32_t count; //统计的按键次数
+    uint32_t total; //总延迟
+    uint32_t max;   //最大延迟
+}tty_latency_t;
 
 //tty设备结构
 typedef struct _tty_t {
@@ -51,6 +61,9 @@ typedef struct _tty_t {
     
     char out_buf[TTY_OBUF_SIZE];    //输入缓存
     char in_buf[TTY_IBUF_SIZE];     //输出缓存
+
+    uint64_t in_stamp;      //最早一个未被读取的按键到达时的时间戳，为0表示没有
+    tty_latency_t latency;  //按键到回显的延迟统计
 }tty_t;
 
 
@@ -0,0 +1,93 @@
+/**
+ * @file bcache.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义块设备的缓冲区缓存，以(设备id, 块号)为键缓存磁盘扇区
+ *         该文件也被应用程序库包含，用于获取缓存的命中统计
+ * @version 0.1
+ * @date 2023-10-03
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "common/types.h"
+#include "tools/list.h"
+
+//缓存块的大小，与磁盘扇区大小相同
+#define BCACHE_BLOCK_SIZE       512
+
+//缓存的数据区占用的内存上限，需为页大小的整数倍
+#define BCACHE_MEM_SIZE         (256 * 1024)
+
+//哈希表的桶数，需为2的幂
+#define BCACHE_HASH_SIZE        128
+
+//一次磁盘命令最多读写的连续块数，数据经一页大小的中转缓冲区拷贝
+#define BCACHE_RUN_MAX          8
+
+//异步预读请求队列的长度，需为2的幂，队列满时丢弃新的请求
+#define BCACHE_RA_QUEUE_SIZE    32
+
+#define BCACHE_VALID            (1 << 0)    //缓存块中的数据有效
+#define BCACHE_DIRTY            (1 << 1)    //缓存块已被修改，还未写回磁盘
+#define BCACHE_BUSY             (1 << 2)    //正在从磁盘读入缓存块
+
+//缓存块的描述结构
+typedef struct _bcache_buf_t {
+    list_node_t hash_node;  //所在哈希桶中的节点
+    list_node_t lru_node;   //引用计数为0时在lru链表中的节点
+
+    int dev_id;             //所属的设备，为-1时未缓存任何块
+    uint32_t block;         //缓存的块号，即设备上的扇区号
+    int ref;                //正在使用该块的次数，不为0时不会被换出
+    int flags;              //BCACHE_VALID等标志
+
+    uint8_t *data;          //缓存的数据，大小为BCACHE_BLOCK_SIZE
+}bcache_buf_t;
+
+//异步预读请求，由预读线程将[block, block + count)中未缓存的块读入缓存
+typedef struct _bcache_ra_req_t {
+    int dev_id;
+    uint32_t block;
+    int count;
+}bcache_ra_req_t;
+
+//缓存的命中与磁盘访问统计
+typedef struct _bcache_stat_t {
+    uint32_t blocks;        //缓存块的总数
+    uint32_t dirty;         //还未写回磁盘的块数
+    uint32_t hits;          //读取时命中的次数
+    uint32_t misses;        //读取时未命中的次数
+    uint32_t evictions;     //被换出的有效块数
+    uint32_t disk_reads;    //读磁盘的命令数
+    uint32_t read_blocks;   //从磁盘读入的块数
+    uint32_t disk_writes;   //写磁盘的命令数
+    uint32_t write_blocks;  //写回磁盘的块数
+    uint32_t direct_reads;          //绕过缓存直接读磁盘的命令数
+    uint32_t direct_read_blocks;    //绕过缓存直接读入的块数
+    uint32_t direct_writes;         //绕过缓存直接写磁盘的命令数
+    uint32_t direct_write_blocks;   //绕过缓存直接写入的块数
+    uint32_t ra_requests;   //预读请求数
+    uint32_t ra_blocks;     //预读线程读入的块数
+    uint32_t ra_dropped;    //队列已满被丢弃的预读请求数
+}bcache_stat_t;
+
+void bcache_init(void);
+bcache_buf_t *bcache_read(int dev_id, uint32_t block, int ahead);
+bcache_buf_t *bcache_get(int dev_id, uint32_t block);
+void bcache_release(bcache_buf_t *buf);
+void bcache_mark_dirty(bcache_buf_t *buf);
+int bcache_sync(int dev_id);
+void bcache_invalidate(int dev_id);
+int bcache_read_direct(int dev_id, uint32_t block, int count, uint8_t *buf);
+int bcache_write_direct(int dev_id, uint32_t block, int count, const uint8_t *buf);
+int bcache_cached(int dev_id, uint32_t block);
+void bcache_prefetch(int dev_id, uint32_t block, int count);
+void bcache_readahead_start(void);
+
+int sys_bcache_stat(bcache_stat_t *stat);
+
+#endif
@@ -13,6 +13,7 @@
 #define FATFS_H
 
 #include "common/types.h"
+#include "tools/bitmap.h"
 
 
 //清空簇链关系时,该簇号标志此FAT表项空闲
@@ -35,6 +36,19 @@
 
 #define SFN_LEN                 11// sfn系统文件名长
 
+//FAT16最多65536个表项，一个fat表最多占用的扇区数
+#define FAT_TBL_SECTORS_MAX     256
+
+//整簇读写时物理连续的簇合并为一条磁盘命令，一条命令最多传输的扇区数
+#define FAT_IO_MAX_SECTORS      1024
+
+//顺序读取时预读窗口的初始与最大扇区数，窗口每次预读后翻倍，不足一簇时按一簇计
+#define FAT_RA_INIT_SECTORS     8
+#define FAT_RA_MAX_SECTORS      128
+
+//预读状态中表示没有预期读取位置的值，下一次读取不会被视为顺序读取
+#define FAT_RA_POS_NONE         0xFFFFFFFF
+
 #pragma pack(1)
 //根目录区的目录项结构
 typedef struct _diritem_t {
@@ -103,9 +117,17 @@ typedef struct _fat_t {
     uint32_t data_start_sector;    //文件数据区域的起始地址
     uint32_t cluster_bytes_size;    //一簇的字节大小
 
-    uint32_t curr_sector;   //fat_buffer当前缓存的扇区号
-    uint8_t *fat_buffer;    //fat表结构的缓冲区，可用于存放读取到内存的dbr区域
-    
+    //挂载时读入内存的fat表，簇链的查找与修改都在内存中完成
+    uint16_t *tbl;          //第一个fat表在内存中的副本，写回时同时写入所有fat表
+    int tbl_pages;          //fat表副本与空闲簇位图共占用的页数
+    bitmap_t tbl_dirty;     //fat表中已修改还未写回的扇区
+    uint32_t tbl_dirty_bits[FAT_TBL_SECTORS_MAX / 32];
+
+    bitmap_t free_map;      //簇的使用位图，置1表示已使用或不可分配
+    uint32_t cluster_cnt;   //可分配的簇号上限，包括不可用的0、1号簇
+    uint32_t free_cnt;      //空闲簇的数量
+    uint32_t next_free;     //下次查找空闲簇的起始簇号
+
     struct _fs_t *fs;   //该分区所属的文件系统
 
         
@@ -113,4 +135,35 @@ typedef struct _fat_t {
 
 typedef uint16_t cluster_t;
 
+//每个打开的文件最多缓存的簇区段数量
+#define FAT_EXTENT_MAX          63
+
+//文件中一段物理上连续的簇
+typedef struct _fat_extent_t {
+    uint32_t index;     //区段第一个簇在文件中的簇序号
+    cluster_t start;    //区段的起始簇号
+    uint16_t count;     //区段包含的簇数
+}fat_extent_t;
+
+//打开文件的簇链区段缓存，区段按簇序号递增排列，连续覆盖文件开头的clusters个簇
+//按需从簇链建立，文件被截断或拓展时清空
+typedef struct _fat_extent_cache_t {
+    int count;          //已缓存的区段数
+    uint32_t clusters;  //已覆盖的簇数
+    fat_extent_t extents[FAT_EXTENT_MAX];
+}fat_extent_cache_t;
+
+//打开文件的顺序预读状态，读取位置与上次读取的末尾相接时视为顺序读取
+typedef struct _fat_readahead_t {
+    uint32_t next_pos;  //上次读取的末尾，即顺序读取时下次读取的起始位置
+    uint32_t window;    //预读窗口的簇数，为0时还未开始预读
+    uint32_t end;       //已提交预读请求的簇序号上限(不含)
+}fat_readahead_t;
+
+//打开文件的私有数据，存放于file->data中
+typedef struct _fat_file_t {
+    fat_extent_cache_t extent;  //簇链区段缓存
+    fat_readahead_t ra;         //顺序预读状态
+}fat_file_t;
+
 #endif
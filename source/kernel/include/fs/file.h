@@ -13,7 +13,6 @@
 
 #include "common/types.h"
 
-#define FILE_TABLE_SIZE 2048
 #define FILE_NAME_SIZE  32
 
 //文件类型的枚举
@@ -22,6 +21,7 @@ typedef enum _file_type_t {
     FILE_TTY,
     FILE_DIR,
     FILE_NORMAL,
+    FILE_PIPE,
 
 }file_type_t;
 
@@ -45,6 +45,9 @@ typedef struct  _file_t {
     int sblk;       //文件起始簇号或块号
     int cblk;       //文件当前读取的簇号或块号
     int p_index;    //文件所属目录项在根目录区的索引
+
+    //文件系统的私有数据
+    void *data;     //管道文件所属的管道，fat文件的簇区段缓存与预读状态
    
 }file_t;
 
@@ -39,6 +39,7 @@ typedef struct _fs_op_t {
     int (*opendir)(struct _fs_t *fs, const char *name, DIR *dir);
     int (*readdir)(struct _fs_t *fs, DIR *dir, struct dirent *dirent);
     int (*closedir)(struct _fs_t *fs, DIR *dir);
+    int (*sync)(struct _fs_t *fs);  //将缓存的修改写回磁盘，可为空
 
 }fs_op_t;
 
@@ -46,10 +47,14 @@ typedef struct _fs_op_t {
 //定义挂载点名称的大小
 #define FS_MOUNT_POINT_SIZE    512
 
+//定期将各文件系统缓存的修改写回磁盘的间隔(ms)
+#define FS_SYNC_MS             1000
+
 //定义文件系统类型的枚举
 typedef enum _fs_type_t {
     FS_DEVFS,  //设备文件系统
     FS_FAT16,   //fat文件系统
+    FS_PIPE,    //管道，不挂载，由pipe系统调用创建
 }fs_type_t;
 
 //定义文件系统的顶层抽象类型
@@ -74,6 +79,7 @@ typedef struct _fs_t {
 
 
 void fs_init(void);
+void fs_sync_start(void);
 
 int path_to_num(const char * path, int *num);
 const char *path_next_child(const char *path);
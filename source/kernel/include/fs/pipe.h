@@ -0,0 +1,47 @@
+/**
+ * @file pipe.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义管道，进程间通过一页大小的内核环形缓冲区传递数据
+ * @version 0.1
+ * @date 2023-10-01
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "common/types.h"
+#include "ipc/sem.h"
+#include "fs/file.h"
+
+//环形缓冲区的大小，为一页
+#define PIPE_SIZE           4096
+
+//单次读写不小于该大小时，写者可跳过环形缓冲区，直接写入正在等待的读者的缓冲区
+#define PIPE_DIRECT_MIN     4096
+
+//管道对象，读端与写端各为一个文件结构，两端都关闭后释放
+typedef struct _pipe_t {
+    char *buf;          //环形缓冲区，占用一整页
+    uint32_t rpos;      //已读出的字节总数
+    uint32_t wpos;      //已写入的字节总数
+    int readers;        //读端是否还未关闭
+    int writers;        //写端是否还未关闭
+
+    sem_t read_sem;     //读者等待数据或写端关闭
+    sem_t write_sem;    //写者等待空闲空间或读端关闭
+
+    //正在等待数据的读者登记的缓冲区，写者直接按页写入其物理页，只需一次拷贝
+    uint32_t direct_buf;        //读者缓冲区的虚拟地址，为0表示没有读者登记
+    uint32_t direct_size;       //读者缓冲区的大小
+    uint32_t direct_page_dir;   //读者的页目录表
+    int direct_count;           //写者已直接写入的字节数
+}pipe_t;
+
+void pipe_init(void);
+
+int sys_pipe(int *fd);
+
+#endif
@@ -0,0 +1,38 @@
+/**
+ * @file futex.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义以用户空间地址为键的等待队列，用户态同步原语只在发生竞争时才进入内核
+ * @version 0.1
+ * @date 2023-09-28
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "common/types.h"
+#include "tools/list.h"
+
+//等待队列哈希表的大小，需为2的幂
+#define FUTEX_HASH_SIZE     64
+
+struct _task_t;
+struct _task_group_t;
+
+//在用户空间地址上等待的任务，位于等待任务的内核栈中
+typedef struct _futex_waiter_t {
+    list_node_t node;               //插入等待队列哈希表的节点
+    struct _task_t *task;           //等待的任务
+    struct _task_group_t *group;    //任务所属的线程组，与地址一起作为键，不同进程的相同地址互不影响
+    uint32_t addr;                  //等待的用户空间地址
+}futex_waiter_t;
+
+void futex_init(void);
+void futex_wake_group(struct _task_group_t *group);
+
+int sys_futex_wait(uint32_t *addr, uint32_t val);
+int sys_futex_wake(uint32_t *addr, int count);
+
+#endif
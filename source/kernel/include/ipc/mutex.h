@@ -15,15 +15,36 @@
 #include "tools/list.h"
 #include "core/task.h"
 
+//互斥锁的竞争统计，时间以时间片为单位
+typedef struct _mutex_stat_t {
+    uint32_t acquire_count;     //累计加锁次数，不包括持有者的嵌套加锁
+    uint32_t contend_count;     //加锁时锁已被其它任务持有的次数
+    uint32_t wait_ticks;        //等待锁的总时间
+    uint32_t wait_max;          //单次等待锁的最长时间
+    uint32_t hold_ticks;        //持有锁的总时间
+    uint32_t hold_max;          //单次持有锁的最长时间
+}mutex_stat_t;
+
 typedef struct  _mutex_t{
+    const char *name;   //锁的名称，用于打印统计信息
     task_t *owner;      //当前锁的拥有者
     int locked_count;   //当前锁被上锁了几次
     list_t wait_list;   //等待该锁的任务队列
+    list_node_t held_node;  //挂载到拥有者持有的锁队列的节点
+    list_node_t node;   //挂载到全局锁链表的节点
+
+    uint32_t lock_time; //拥有者获取锁的时间，以晶体振荡次数为单位
+    uint32_t wait_cycles;   //累计等待时间中不足一个时间片的部分
+    uint32_t hold_cycles;   //累计持有时间中不足一个时间片的部分
+    mutex_stat_t stat;  //竞争统计
 }mutex_t;
 
 
-void mutex_init(mutex_t *mutex);
+void mutex_init(mutex_t *mutex, const char *name);
 void mutex_lock(mutex_t *mutex);
 void mutex_unlock(mutex_t *mutex);
+void mutex_release_all(task_t *task);
+void mutex_get_stat(mutex_t *mutex, mutex_stat_t *stat);
+void mutex_show_info(void);
 
 #endif
\ No newline at end of file
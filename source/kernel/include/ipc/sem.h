@@ -21,6 +21,7 @@ typedef struct  _sem_t {
 
 void sem_init(sem_t *sem, int init_count);
 void sem_wait(sem_t *sem);
+int sem_wait_intr(sem_t *sem);
 void sem_notify(sem_t *sem);
 int sem_count(sem_t *sem);
 
@@ -0,0 +1,32 @@
+/**
+ * @file spinlock.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义自旋锁，以及保护整个内核的内核锁
+ * @version 0.1
+ * @date 2023-09-24
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "common/types.h"
+
+typedef struct _spinlock_t {
+    volatile uint32_t locked;   //为1表示已被某个cpu持有
+}spinlock_t;
+
+void spinlock_init(spinlock_t *lock);
+void spinlock_lock(spinlock_t *lock);
+void spinlock_unlock(spinlock_t *lock);
+
+void kernel_lock_acquire(void);
+void kernel_lock_release(void);
+int kernel_lock_depth(void);
+void kernel_lock_set_depth(int depth);
+void kernel_lock_enter(void);
+void kernel_lock_leave(void);
+
+#endif
@@ -18,8 +18,18 @@
 //内核数据段的选择子,gdt_table[2]
 #define KERNEL_SELECTOR_DS (0x0002 << 3)
 
+//应用程序代码段与数据段的选择子,gdt_table[3]与gdt_table[4]
+//sysexit要求用户代码段与数据段依次紧随内核代码段与数据段之后，位置固定
+#define APP_SELECTOR_CS    (0x0003 << 3)
+#define APP_SELECTOR_DS    (0x0004 << 3)
+
 //系统调用门描述符的选择子
-#define SYSCALL_SELECTOR    (0x0003 << 3)
+#define SYSCALL_SELECTOR    (0x0005 << 3)
+
+//sysenter入口从用户栈中读取参数时允许的地址范围[base, end)，
+//即用户空间的起始地址MEM_TASK_BASE到vsys数据页的起始地址MEM_VSYS_BASE
+#define SYSENTER_ARG_BASE   0x80000000
+#define SYSENTER_ARG_END    0xF0000000
 
 //内核栈空间的大小为8kb
 #define KERNEL_STACK_SIZE (8 * 1024)
@@ -27,6 +37,12 @@
 //确定定时器多长时间发出一次中断,单位为ms
 #define OS_TICKS_MS 1
 
+//只有空闲进程可运行时是否停止周期时钟，直接定时到下一个定时器到期的时间,1:开启 0:关闭
+#define OS_TICKLESS_IDLE 1
+
+//AP启动代码被拷贝到的物理地址，STARTUP中断以页号的形式给出，需按4kb对齐且位于1mb以下
+#define SMP_AP_START_ADDR 0x7000
+
 //定义操作系统版本
 #define OS_VERSION "1.0.0"
 
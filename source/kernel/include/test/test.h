@@ -13,6 +13,14 @@
 #define TEST_H
 
 void list_test();
+void bitmap_bench(void);
+void klib_bench(void);
+void tlb_bench(void);
+void yield_bench(void);
+void time_bench(void);
+void smp_bench(void);
+void kthread_test(void);
+void mutex_pi_test(void);
 
 
 #endif
\ No newline at end of file
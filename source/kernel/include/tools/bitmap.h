@@ -4,9 +4,9 @@
  * @brief  定义位图数据结构
  * @version 0.1
  * @date 2023-02-04
- * 
+ *
  * @copyright Copyright (c) 2023
- * 
+ *
  */
 
 #ifndef BITMAP_H
@@ -14,21 +14,29 @@
 
 #include "common/types.h"
 
+//位图每次按一个32位的字进行扫描
+#define BITMAP_WORD_BITS 32
+
 /**
  * @brief  位图数据结构
  * @param bit_count 位图对象管理的内存的分页数量
  * @param bits 位图数组，记录某一页是否被分配
+ * @param summary 可选的摘要层，每一位对应bits中的一个字，为1表示该字已全部置1
  */
 typedef struct  _bitmap_t {
     int bit_count;  //位图管理的bit数量
-    uint8_t *bits;  //位图管理的内存空间起始地址
+    uint8_t *bits;  //位图管理的内存空间起始地址, 按字访问，大小为bitmap_byte_count字节
+    uint32_t *summary;  //摘要层，为0时不使用，查找空闲位时可跳过已全部置1的字
 }bitmap_t;
 
 void bitmap_init(bitmap_t *bitmap, uint8_t *bits, int count, int init_bit);
+void bitmap_init_summary(bitmap_t *bitmap, uint32_t *summary);
 uint8_t bitmap_get_bit(bitmap_t *bitmap, int index);
 void bitmap_set_bit(bitmap_t *bitmap, int index, int count, int bit);
 int bitmap_is_set(bitmap_t *bitmap, int index);
+int bitmap_find_bit(bitmap_t *bitmap, int bit, int start);
 int bitmap_alloc_nbits(bitmap_t *bitmap, int bit, int count);
 int bitmap_byte_count(int bit_count);
+int bitmap_summary_byte_count(int bit_count);
 
-#endif
\ No newline at end of file
+#endif
@@ -46,6 +46,10 @@ int kernel_strlen(const char *str);
 void kernel_memcpy(void *dest, const void *src, int size);
 void kernel_memset(void *dest, uint8_t v, int size);
 int kernel_memcmp(const void *dest1, const void *dest2, int size);
+void kernel_memcpy_page(void *dest, const void *src);
+void kernel_memset_page(void *dest);
+void kernel_sse2_init(void);
+int kernel_sse2_enabled(void);
 
 void kernel_sprintf(char *buf, const char *formate, ...);
 void kernel_vsprintf(char *buf, const char *formate, va_list args);
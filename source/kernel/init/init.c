@@ -23,10 +23,15 @@
 #include "test/test.h"
 #include "tools/klib.h"
 #include  "ipc/sem.h"
+#include "ipc/futex.h"
 #include "core/memory.h"
+#include "core/vsys.h"
 #include "dev/console.h"
 #include "dev/keyboard.h"
 #include "fs/fs.h"
+#include "fs/bcache.h"
+#include "cpu/smp.h"
+#include "cpu/systrace.h"
 
 /**
  * @brief  对内核进行初始化操作
@@ -45,6 +50,12 @@ void kernel_init(boot_info_t* boot_info) {
     //4.初始化日志程序,便于后期调用
     log_init();
 
+    //检测并开启SSE2指令，用于整页的拷贝与清零
+    kernel_sse2_init();
+
+    //从多处理器配置表中检测所有cpu，需在loader建立的低4mb映射被替换之前进行
+    smp_detect();
+
     //5.初始化内存管理
     memory_init(boot_info);  
     
@@ -53,9 +64,21 @@ void kernel_init(boot_info_t* boot_info) {
 
     //6.初始化定时器的中断处理
     time_init();
+
+    //初始化每个cpu的TSS与BSP的本地APIC，本地时钟需用定时器校准
+    smp_cpu_init();
     
+    //为每个cpu分配系统调用的跟踪缓冲区与耗时统计
+    systrace_init();
+
+    //用定时器校准时间戳计数器，并分配映射到每个进程中的vsys数据页
+    vsys_init();
+
     //7.初始化任务管理器
     task_manager_init();
+
+    //初始化用户态同步使用的等待队列
+    futex_init();
     
    
     //初始化完成后将在汇编里重新加载内核代码段与数据段的选择子，并为内核程序分配栈空间
@@ -107,6 +130,15 @@ void init_main(void) {
     //当前任务作为任务管理器启用时的第一个任务
     task_first_init();
 
+    //启动文件系统的定期写回线程
+    fs_sync_start();
+
+    //启动块缓存的异步预读线程
+    bcache_readahead_start();
+
+    //启动所有AP，AP在空闲进程中等待分配或窃取任务
+    smp_start_aps();
+
     //跳转到第一个任务进程去运行
     move_to_first_task();
 }
\ No newline at end of file
@@ -0,0 +1,155 @@
+/**
+ * @file futex.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  以用户空间地址为键的等待队列
+ *         用户态的锁与条件变量在无竞争时只用原子指令完成，发生竞争时才通过该等待队列睡眠与唤醒，
+ *         比较值与进入等待在内核锁的保护下完成，不会丢失在两者之间发生的唤醒
+ * @version 0.1
+ * @date 2023-09-28
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ipc/futex.h"
+#include "core/task.h"
+#include "core/memory.h"
+#include "core/vsys.h"
+#include "cpu/idt.h"
+
+//等待队列哈希表，相同哈希值的等待者在同一个桶中按等待的先后排列
+static list_t futex_table[FUTEX_HASH_SIZE];
+
+/**
+ * @brief  初始化等待队列哈希表
+ *
+ */
+void futex_init(void) {
+    for (int i = 0; i < FUTEX_HASH_SIZE; ++i) {
+        list_init(futex_table + i);
+    }
+}
+
+/**
+ * @brief  获取线程组中的地址对应的哈希桶
+ *
+ * @param group
+ * @param addr
+ * @return list_t*
+ */
+static list_t *futex_bucket(task_group_t *group, uint32_t addr) {
+    uint32_t hash = (addr >> 2) ^ ((uint32_t)group >> 4);
+    hash ^= hash >> 12;
+    return futex_table + (hash & (FUTEX_HASH_SIZE - 1));
+}
+
+/**
+ * @brief  检查地址是否为用户空间中4字节对齐的地址，不包括顶部的vsys数据页
+ *
+ * @param addr
+ * @return int
+ */
+static int futex_addr_valid(uint32_t addr) {
+    return addr >= MEM_TASK_BASE && addr < MEM_VSYS_BASE && (addr & 0x3) == 0;
+}
+
+/**
+ * @brief  地址处的值仍等于val时，当前线程进入等待，直到被sys_futex_wake唤醒
+ *
+ * @param addr 用户空间地址
+ * @param val 期望的值
+ * @return int 0:被唤醒, -1:地址非法、值已改变或进程正在退出
+ */
+int sys_futex_wait(uint32_t *addr, uint32_t val) {
+    if (!futex_addr_valid((uint32_t)addr)) {
+        return -1;
+    }
+
+    task_t *curr = task_current();
+    futex_waiter_t waiter;
+    waiter.task = curr;
+    waiter.group = curr->group;
+    waiter.addr = (uint32_t)addr;
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    //1.地址未映射、值已被其它线程修改或进程正在退出，不进入等待，由用户态重新检查
+    //  内核空间为恒等映射，经物理地址读取用户空间中的值
+    uint32_t paddr = memory_get_user_paddr((uint32_t)addr);
+    if (curr->group->exiting || paddr == 0 || *(volatile uint32_t *)paddr != val) {
+        idt_leave_protection(state);  // TODO:解锁
+        return -1;
+    }
+
+    //2.将当前线程加入哈希桶并从就绪队列中取下，waiter在被唤醒前一直有效
+    list_insert_last(futex_bucket(waiter.group, waiter.addr), &waiter.node);
+    task_set_unready(curr);
+    curr->state = TASK_WAITTING;
+
+    //3.切换任务，被唤醒时waiter已被唤醒者从哈希桶中移除
+    task_switch();
+
+    idt_leave_protection(state);  // TODO:解锁
+    return 0;
+}
+
+/**
+ * @brief  唤醒最多count个在地址上等待的线程
+ *
+ * @param addr 用户空间地址
+ * @param count 最多唤醒的线程数
+ * @return int 实际唤醒的线程数，-1:地址非法
+ */
+int sys_futex_wake(uint32_t *addr, int count) {
+    if (!futex_addr_valid((uint32_t)addr)) {
+        return -1;
+    }
+
+    task_group_t *group = task_current()->group;
+    list_t *bucket = futex_bucket(group, (uint32_t)addr);
+    int woken = 0;
+
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    list_node_t *node = list_get_first(bucket);
+    while (node && woken < count) {
+        list_node_t *next = list_node_next(node);
+        futex_waiter_t *waiter = list_node_parent(node, futex_waiter_t, node);
+        if (waiter->group == group && waiter->addr == (uint32_t)addr) {
+            list_remove(bucket, node);
+            waiter->task->state = TASK_READY;
+            task_set_ready(waiter->task);
+            woken++;
+        }
+        node = next;
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+    return woken;
+}
+
+/**
+ * @brief  唤醒线程组中所有在等待的线程，进程退出时调用，被唤醒的线程在返回用户态前随之退出
+ *
+ * @param group
+ */
+void futex_wake_group(task_group_t *group) {
+    idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+    for (int i = 0; i < FUTEX_HASH_SIZE; ++i) {
+        list_t *bucket = futex_table + i;
+        list_node_t *node = list_get_first(bucket);
+        while (node) {
+            list_node_t *next = list_node_next(node);
+            futex_waiter_t *waiter = list_node_parent(node, futex_waiter_t, node);
+            if (waiter->group == group) {
+                list_remove(bucket, node);
+                waiter->task->state = TASK_READY;
+                task_set_ready(waiter->task);
+            }
+            node = next;
+        }
+    }
+
+    idt_leave_protection(state);  // TODO:解锁
+}
@@ -2,6 +2,7 @@
  * @file mutex.c
  * @author kbpoyo (kbpoyo.com)
  * @brief  定义互斥锁(互斥信号量)
+ *         锁被低优先级任务持有时，持有者继承等待者中的最高优先级，防止高优先级任务被长时间阻塞
  * @version 0.1
  * @date 2023-02-01
  *
@@ -12,17 +13,154 @@
 #include "ipc/mutex.h"
 
 #include "cpu/idt.h"
+#include "dev/time.h"
+#include "tools/klib.h"
+#include "tools/log.h"
+
+//所有已初始化的互斥锁，用于打印竞争统计
+static list_t mutex_list;
+
 /**
- * @brief  初始化互斥锁
+ * @brief  初始化互斥锁，并将其加入全局锁链表，重复初始化时不会重复加入
  *
  * @param mutex
+ * @param name 锁的名称，用于打印统计信息
  */
-void mutex_init(mutex_t *mutex) {
+void mutex_init(mutex_t *mutex, const char *name) {
   ASSERT(mutex != (mutex_t *)0);
 
+  mutex->name = name;
   mutex->locked_count = 0;
   mutex->owner = (task_t *)0;
   list_init(&mutex->wait_list);
+  list_node_init(&mutex->held_node);
+
+  mutex->lock_time = 0;
+  mutex->wait_cycles = 0;
+  mutex->hold_cycles = 0;
+  kernel_memset(&mutex->stat, 0, sizeof(mutex->stat));
+
+  idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+  for (list_node_t *node = list_get_first(&mutex_list); node; node = list_node_next(node)) {
+    if (node == &mutex->node) {
+      idt_leave_protection(state);  // TODO:解锁
+      return;
+    }
+  }
+  list_insert_last(&mutex_list, &mutex->node);
+
+  idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  累计一段等待或持有锁的时间，不足一个时间片的部分留到下次累计
+ *
+ * @param ticks 累计的时间片数
+ * @param cycles 累计时间中不足一个时间片的部分
+ * @param max 单次的最长时间
+ * @param elapsed 本次经过的晶体振荡次数
+ */
+static void mutex_stat_add(uint32_t *ticks, uint32_t *cycles, uint32_t *max, uint32_t elapsed) {
+  *cycles += elapsed;
+  *ticks += *cycles / TIME_CYCLES_PER_TICK;
+  *cycles %= TIME_CYCLES_PER_TICK;
+
+  if (elapsed / TIME_CYCLES_PER_TICK > *max) {
+    *max = elapsed / TIME_CYCLES_PER_TICK;
+  }
+}
+
+/**
+ * @brief  计算任务应从其持有的锁的等待者中继承的优先级
+ *
+ * @param task
+ * @return int 等待者中的最高优先级，没有等待者时为TASK_PRIORITY_COUNT
+ */
+static int mutex_inherit_priority(task_t *task) {
+  int priority = TASK_PRIORITY_COUNT;
+
+  for (list_node_t *node = list_get_first(&task->held_mutexes); node; node = list_node_next(node)) {
+    mutex_t *mutex = list_node_parent(node, mutex_t, held_node);
+    for (list_node_t *wait = list_get_first(&mutex->wait_list); wait; wait = list_node_next(wait)) {
+      task_t *waiter = list_node_parent(wait, task_t, wait_node);
+      int waiter_priority = task_sched_priority(waiter);
+      if (waiter_priority < priority) {
+        priority = waiter_priority;
+      }
+    }
+  }
+
+  return priority;
+}
+
+/**
+ * @brief  锁的持有者继承等待者的优先级，持有者也在等待其它锁时沿持有者链继续传递
+ *
+ * @param mutex 等待者所等待的锁
+ * @param priority 等待者的优先级
+ */
+static void mutex_boost_owner(mutex_t *mutex, int priority) {
+  task_t *owner = mutex->owner;
+
+  //持有者链中出现环(死锁)时，环上的任务已继承该优先级，循环随之结束
+  while (owner && priority < task_sched_priority(owner)) {
+    task_set_inherit_priority(owner, priority);
+    if (owner->wait_mutex == (mutex_t *)0) {
+      break;
+    }
+    owner = owner->wait_mutex->owner;
+  }
+}
+
+/**
+ * @brief  任务成为锁的拥有者
+ *
+ * @param mutex
+ * @param task
+ */
+static void mutex_set_owner(mutex_t *mutex, task_t *task) {
+  mutex->locked_count = 1;
+  mutex->owner = task;
+  mutex->lock_time = time_now();
+  mutex->stat.acquire_count++;
+  list_insert_last(&task->held_mutexes, &mutex->held_node);
+}
+
+/**
+ * @brief  拥有者完全释放锁，有等待者时将锁交给优先级最高的等待者，不重新计算拥有者继承的优先级
+ *
+ * @param mutex
+ * @param owner 锁当前的拥有者
+ */
+static void mutex_release(mutex_t *mutex, task_t *owner) {
+  //1.将锁的所有者置空，并记录持有时间
+  mutex->locked_count = 0;
+  mutex->owner = (task_t*)0;
+  list_remove(&owner->held_mutexes, &mutex->held_node);
+  mutex_stat_add(&mutex->stat.hold_ticks, &mutex->hold_cycles, &mutex->stat.hold_max,
+                 time_now() - mutex->lock_time);
+
+  //2.判断当前等待队列是否为空
+  if (list_is_empty(&mutex->wait_list)) {
+    return;
+  }
+
+  //3.当前等待队列不为空,将锁交给优先级最高的等待者，相同优先级按等待的先后顺序
+  task_t *task_wait = (task_t *)0;
+  for (list_node_t *node = list_get_first(&mutex->wait_list); node; node = list_node_next(node)) {
+    task_t *task = list_node_parent(node, task_t, wait_node);
+    if (task_wait == (task_t *)0 || task_sched_priority(task) < task_sched_priority(task_wait)) {
+      task_wait = task;
+    }
+  }
+  list_remove(&mutex->wait_list, &task_wait->wait_node);
+  task_wait->wait_mutex = (mutex_t *)0;
+  mutex_set_owner(mutex, task_wait);
+
+  //4.新的拥有者继承锁中其余等待者的优先级，并让该任务进入就绪队列
+  task_set_inherit_priority(task_wait, mutex_inherit_priority(task_wait));
+  task_set_ready(task_wait);
 }
 
 /**
@@ -41,18 +179,28 @@ void mutex_lock(mutex_t *mutex) {
   }
 
   // 2.判断该锁是否已被加锁
-  if (mutex->locked_count == 0) {  
+  if (mutex->locked_count == 0) {
     //3.还未被加锁，则加锁并记录拥有该锁的任务
-    mutex->locked_count++;
-    mutex->owner = curr;
+    mutex_set_owner(mutex, curr);
   } else if (mutex->owner == curr) {
     //4.已被加锁，但当前加锁请求的任务为当前锁的拥有者，直接再加锁即可
     mutex->locked_count++;
-  } else {  
+  } else {
     //5.已被加锁，且当前任务不是锁的拥有者，则当前任务进入锁的等待队列，被阻塞住
+    mutex->stat.contend_count++;
+    uint32_t wait_start = time_now();
+
     task_set_unready(curr);
     list_insert_last(&mutex->wait_list, &curr->wait_node);
+    curr->wait_mutex = mutex;
+
+    //6.持有者优先级较低时继承当前任务的优先级，使其尽快释放锁
+    mutex_boost_owner(mutex, task_sched_priority(curr));
     task_switch();
+
+    //7.被唤醒时锁已由解锁者直接交给当前任务
+    mutex_stat_add(&mutex->stat.wait_ticks, &mutex->wait_cycles, &mutex->stat.wait_max,
+                   time_now() - wait_start);
   }
 
   idt_leave_protection(state);  // TODO:解锁
@@ -76,20 +224,70 @@ void mutex_unlock(mutex_t *mutex) {
   if (mutex->owner == curr) {
     //2.当前任务是锁的拥有者,对锁进行一次解锁，并判断是否已完全解锁
     if (--mutex->locked_count == 0) {
-      //3.锁已被完全解锁,将锁的所有者置空
-      mutex->owner = (task_t*)0;
-      //4.判断当前等待队列是否为空
-      if (!list_is_empty(&mutex->wait_list)) { 
-        //5.当前等待队列不为空,对锁进行加锁，并交给等待队列的第一个任务
-        list_node_t *node = list_remove_first(&mutex->wait_list);
-        task_t *task_wait = list_node_parent(node, task_t, wait_node);
-        mutex->locked_count = 1;
-        mutex->owner = task_wait;
-        //6.让该任务进入就绪队列
-        task_set_ready(task_wait);
+      //3.锁已被完全解锁，释放锁或将其交给等待者
+      mutex_release(mutex, curr);
+
+      //4.重新计算当前任务继承的优先级，失去继承的优先级后让出cpu给更高优先级的任务
+      int inherited = curr->inherit_priority;
+      task_set_inherit_priority(curr, mutex_inherit_priority(curr));
+      if (curr->inherit_priority > inherited && task_ready_first() != curr) {
+        task_switch();
       }
     }
   }
 
   idt_leave_protection(state);  // TODO:解锁
 }
+
+/**
+ * @brief  任务退出时释放其仍持有的所有锁，有等待者的锁交给等待者，
+ *         防止锁的拥有者指向已被回收的任务对象
+ *
+ * @param task 正在退出的任务
+ */
+void mutex_release_all(task_t *task) {
+  idt_state_t state = idt_enter_protection();  // TODO:加锁
+
+  list_node_t *node;
+  while ((node = list_get_first(&task->held_mutexes)) != (list_node_t *)0) {
+    mutex_t *mutex = list_node_parent(node, mutex_t, held_node);
+    log_printf("task %s exits holding mutex %s\n", task->name, mutex->name);
+    mutex_release(mutex, task);
+  }
+
+  //任务不再持有锁，也不再继承等待者的优先级
+  task_set_inherit_priority(task, TASK_PRIORITY_COUNT);
+
+  idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  获取锁的竞争统计
+ *
+ * @param mutex
+ * @param stat 传出参数
+ */
+void mutex_get_stat(mutex_t *mutex, mutex_stat_t *stat) {
+  idt_state_t state = idt_enter_protection();  // TODO:加锁
+  *stat = mutex->stat;
+  idt_leave_protection(state);  // TODO:解锁
+}
+
+/**
+ * @brief  打印所有锁的竞争统计，用于找出负载下竞争激烈的锁
+ *
+ */
+void mutex_show_info(void) {
+  log_printf("mutex info:\n");
+  log_printf("%s\t%s\t%s\t%s\t%s\t%s\t%s\n", "name", "acquire", "contend", "wait", "wait max",
+             "hold", "hold max");
+
+  //锁初始化后不会被移出链表，打印时不需要一直持有锁
+  for (list_node_t *node = list_get_first(&mutex_list); node; node = list_node_next(node)) {
+    mutex_t *mutex = list_node_parent(node, mutex_t, node);
+    mutex_stat_t stat;
+    mutex_get_stat(mutex, &stat);
+    log_printf("%s\t%d\t%d\t%d\t%d\t%d\t%d\n", mutex->name, stat.acquire_count,
+               stat.contend_count, stat.wait_ticks, stat.wait_max, stat.hold_ticks, stat.hold_max);
+  }
+}
@@ -59,6 +59,33 @@ void sem_wait(sem_t *sem) {
     idt_leave_protection(state);//TODO:解锁
 }
 
+/**
+ * @brief  与sem_wait相同，但等待可被进程退出中断，用于可能无限期等待的信号量
+ *
+ * @param sem
+ * @return int 0:获取到信号量, -1:进程正在退出，未获取到信号量
+ */
+int sem_wait_intr(sem_t *sem) {
+    idt_state_t state = idt_enter_protection();//TODO:加锁
+
+    task_t *curr = task_current();
+    int err = 0;
+    if (curr == 0) {  //内核单进程模式，不等待
+        idt_leave_protection(state);  // TODO:解锁
+        return 0;
+    }
+
+    //1.信号量有剩余时直接获取，否则进入信号量等待队列，由sem_notify唤醒或被进程退出中断
+    if (sem->count > 0) {
+        --sem->count;
+    } else {
+        err = task_wait_intr(&sem->wait_list);
+    }
+
+    idt_leave_protection(state);//TODO:解锁
+    return err;
+}
+
 /**
  * @brief 任务将信号量归还，即归还入场券，让给等待队列中的任务
  *        等待队列中若有任务则直接获取该信号量，继续执行即访问资源
@@ -78,6 +105,7 @@ void sem_notify(sem_t *sem) {
     if (!list_is_empty(&sem->wait_list)) {
         list_node_t *node = list_remove_first(&sem->wait_list);
         task_t *task = list_node_parent(node, task_t, wait_node);
+        task->wait_queue = (list_t *)0;
         task_set_ready(task);
         task_switch();
     } else {
@@ -0,0 +1,126 @@
+/**
+ * @file spinlock.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  定义自旋锁，以及保护整个内核的内核锁
+ *         内核锁在进入中断、异常和系统调用时获取，返回时释放，同一时刻只有一个cpu执行内核代码，
+ *         用户态代码可以在所有cpu上并行执行。内核锁可在同一cpu上嵌套获取，
+ *         任务切换时嵌套深度随任务保存，切换到的任务不在内核中时释放内核锁
+ * @version 0.1
+ * @date 2023-09-24
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include "ipc/spinlock.h"
+#include "common/cpu_instr.h"
+#include "cpu/smp.h"
+#include "tools/assert.h"
+
+static spinlock_t kernel_lock;
+
+/**
+ * @brief  初始化自旋锁
+ *
+ * @param lock
+ */
+void spinlock_init(spinlock_t *lock) {
+  lock->locked = 0;
+}
+
+/**
+ * @brief  获取自旋锁，锁已被其它cpu持有时自旋等待，调用者需已关中断
+ *
+ * @param lock
+ */
+void spinlock_lock(spinlock_t *lock) {
+  while (xchg(&lock->locked, 1)) {
+    //只读等待锁被释放，避免反复加锁写总线
+    while (lock->locked) {
+      pause();
+    }
+  }
+}
+
+/**
+ * @brief  释放自旋锁
+ *
+ * @param lock
+ */
+void spinlock_unlock(spinlock_t *lock) {
+  xchg(&lock->locked, 0);
+}
+
+/**
+ * @brief  当前cpu获取内核锁，已持有时只增加嵌套深度，调用者需已关中断
+ *
+ */
+void kernel_lock_acquire(void) {
+  cpu_t *cpu = cpu_current();
+  if (cpu->lock_depth++ == 0) {
+    //自旋期间响应持有内核锁的cpu发出的TLB刷新请求，该cpu会一直等待刷新完成后才释放内核锁
+    while (xchg(&kernel_lock.locked, 1)) {
+      while (kernel_lock.locked) {
+        smp_tlb_flush_ack(cpu);
+        pause();
+      }
+    }
+  }
+}
+
+/**
+ * @brief  当前cpu释放一层内核锁，嵌套深度减为0时真正释放，调用者需已关中断
+ *
+ */
+void kernel_lock_release(void) {
+  cpu_t *cpu = cpu_current();
+  ASSERT(cpu->lock_depth > 0);
+  if (--cpu->lock_depth == 0) {
+    spinlock_unlock(&kernel_lock);
+  }
+}
+
+/**
+ * @brief  获取当前cpu持有内核锁的嵌套深度，任务切换前保存到被切换的任务中
+ *
+ * @return int
+ */
+int kernel_lock_depth(void) {
+  return cpu_current()->lock_depth;
+}
+
+/**
+ * @brief  任务切换完成后恢复切换到的任务的嵌套深度，当前cpu此时一定持有内核锁，
+ *         深度为0表示该任务不在内核中，释放内核锁
+ *
+ * @param depth
+ */
+void kernel_lock_set_depth(int depth) {
+  cpu_t *cpu = cpu_current();
+  cpu->lock_depth = depth;
+  if (depth == 0) {
+    spinlock_unlock(&kernel_lock);
+  }
+}
+
+/**
+ * @brief  提供给中断、异常与系统调用的入口使用，系统调用经调用门进入时不会关中断，需在此关中断
+ *
+ */
+void kernel_lock_enter(void) {
+  uint32_t eflags = read_eflags();
+  cli();
+  kernel_lock_acquire();
+  write_eflags(eflags);
+}
+
+/**
+ * @brief  提供给中断、异常与系统调用的返回流程使用
+ *
+ */
+void kernel_lock_leave(void) {
+  uint32_t eflags = read_eflags();
+  cli();
+  kernel_lock_release();
+  write_eflags(eflags);
+}
@@ -12,6 +12,14 @@
 #include "tools/list.h"
 #include "tools/log.h"
 #include "common/types.h"
+#include "common/cpu_instr.h"
+#include "tools/bitmap.h"
+#include "tools/klib.h"
+#include "cpu/mmu.h"
+#include "cpu/idt.h"
+#include "core/task.h"
+#include "dev/time.h"
+#include "ipc/mutex.h"
 
 void list_test(void) {
     list_t list;
@@ -75,3 +83,561 @@ void list_test(void) {
     log_printf("p addr = 0x%x", (uint32_t)p);  
 
  }
+
+
+//测试用位图的位数，对应126mb内存的页数
+#define BENCH_BITMAP_BITS   (126 * 1024 * 1024 / 4096)
+//每种测试重复的次数
+#define BENCH_REPEAT        64
+
+static uint32_t bench_bits[(BENCH_BITMAP_BITS + 31) / 32];
+static uint32_t bench_summary[(BENCH_BITMAP_BITS / 32 + 31) / 32 + 1];
+
+/**
+ * @brief  原有的逐位查找算法，用于对比
+ * 
+ * @param bitmap 
+ * @param bit 
+ * @param count 
+ * @return int 
+ */
+static int bitmap_alloc_nbits_bitwise(bitmap_t *bitmap, int bit, int count) {
+    int search_index = 0;
+    int ok_index = -1;
+    while (search_index < bitmap->bit_count) {
+        if (bitmap_get_bit(bitmap, search_index) != bit) {
+            search_index++;
+            continue;
+        }
+
+        ok_index = search_index++;
+
+        for (int i = 1; i < count && search_index < bitmap->bit_count; ++i) {
+            if (bitmap_get_bit(bitmap, search_index++) != bit) {
+                ok_index = -1;
+                break;
+            }
+        }
+
+        if (ok_index != -1) {
+            bitmap_set_bit(bitmap, ok_index, count, !bit);
+            return ok_index;
+        }
+    }
+    
+    return -1;
+}
+
+/**
+ * @brief  测量在位图中分配count位再释放的平均时钟周期数
+ * 
+ * @param bitmap 
+ * @param count 
+ * @param bitwise 是否使用原有的逐位查找算法
+ * @return uint32_t 
+ */
+static uint32_t bitmap_bench_alloc(bitmap_t *bitmap, int count, int bitwise) {
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) {
+        int index = bitwise ? bitmap_alloc_nbits_bitwise(bitmap, 0, count) 
+                            : bitmap_alloc_nbits(bitmap, 0, count);
+        if (index >= 0) {
+            bitmap_set_bit(bitmap, index, count, 0);
+        }
+    }
+
+    return (uint32_t)(rdtsc() - start) / BENCH_REPEAT;
+}
+
+/**
+ * @brief  对比逐位查找与按字查找在不同占用率下的分配耗时
+ *         前fill%的位全部置1，其后每隔一位置1，模拟分配后期的碎片化位图
+ * 
+ */
+void bitmap_bench(void) {
+    static const int fills[] = {0, 50, 90, 99};
+    bitmap_t bitmap;
+
+    log_printf("bitmap bench: %d bits, cycles per alloc+free", BENCH_BITMAP_BITS);
+    log_printf("fill  count  bitwise  word  word+summary");
+
+    for (int i = 0; i < sizeof(fills) / sizeof(fills[0]); ++i) {
+        for (int count = 1; count <= 8; count <<= 3) {
+            //1.构造占用率为fills[i]的位图
+            bitmap_init(&bitmap, (uint8_t *)bench_bits, BENCH_BITMAP_BITS, 0);
+            int used = BENCH_BITMAP_BITS / 100 * fills[i];
+            bitmap_set_bit(&bitmap, 0, used, 1);
+            for (int j = used; j < BENCH_BITMAP_BITS; j += 2) {
+                bitmap_set_bit(&bitmap, j, 1, 1);
+            }
+
+            //2.分别测量三种查找方式
+            uint32_t bitwise = bitmap_bench_alloc(&bitmap, count, 1);
+            uint32_t word = bitmap_bench_alloc(&bitmap, count, 0);
+            bitmap_init_summary(&bitmap, bench_summary);
+            uint32_t summary = bitmap_bench_alloc(&bitmap, count, 0);
+
+            log_printf("%d  %d  %d  %d  %d", fills[i], count, bitwise, word, summary);
+        }
+    }
+}
+
+//内存操作测试的缓冲区大小
+#define BENCH_MEM_SIZE  4096
+
+static uint8_t bench_src[BENCH_MEM_SIZE] __attribute__((aligned(4096)));
+static uint8_t bench_dest[BENCH_MEM_SIZE] __attribute__((aligned(4096)));
+
+/**
+ * @brief  原有的逐字节拷贝，用于对比
+ * 
+ * @param dest 
+ * @param src 
+ * @param size 
+ */
+static void memcpy_bytewise(void *dest, const void *src, int size) {
+    uint8_t *d = (uint8_t *)dest;
+    const uint8_t *s = (const uint8_t *)src;
+    while (size--) {
+        *(d++) = *(s++);
+    }
+}
+
+/**
+ * @brief  原有的逐字节赋值，用于对比
+ * 
+ * @param dest 
+ * @param v 
+ * @param size 
+ */
+static void memset_bytewise(void *dest, uint8_t v, int size) {
+    uint8_t *d = (uint8_t *)dest;
+    while (size--) {
+        *(d++) = v;
+    }
+}
+
+/**
+ * @brief  打印每个时钟周期处理的字节数，保留两位小数
+ * 
+ * @param name 
+ * @param size 每次处理的字节数
+ * @param cycles BENCH_REPEAT次的总时钟周期数
+ */
+static void mem_bench_report(const char *name, int size, uint32_t cycles) {
+    if (cycles == 0) {
+        cycles = 1;
+    }
+    uint32_t rate = (uint32_t)size * BENCH_REPEAT * 100 / cycles;
+    log_printf("%s: %d.%d%d bytes/cycle", name, rate / 100, rate / 10 % 10, rate % 10);
+}
+
+/**
+ * @brief  测量各内存操作实现的吞吐量，包括逐字节实现、rep movsl/stosl实现、
+ *         非对齐的rep实现，以及整页拷贝与清零(开启SSE2时使用xmm寄存器)
+ * 
+ */
+void klib_bench(void) {
+    uint64_t start;
+
+    log_printf("klib bench: %d bytes, sse2 %s", BENCH_MEM_SIZE, kernel_sse2_enabled() ? "on" : "off");
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) memcpy_bytewise(bench_dest, bench_src, BENCH_MEM_SIZE);
+    mem_bench_report("memcpy bytewise", BENCH_MEM_SIZE, (uint32_t)(rdtsc() - start));
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) kernel_memcpy(bench_dest, bench_src, BENCH_MEM_SIZE);
+    mem_bench_report("kernel_memcpy", BENCH_MEM_SIZE, (uint32_t)(rdtsc() - start));
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) kernel_memcpy(bench_dest + 1, bench_src + 3, BENCH_MEM_SIZE - 4);
+    mem_bench_report("kernel_memcpy unaligned", BENCH_MEM_SIZE - 4, (uint32_t)(rdtsc() - start));
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) kernel_memcpy_page(bench_dest, bench_src);
+    mem_bench_report("kernel_memcpy_page", BENCH_MEM_SIZE, (uint32_t)(rdtsc() - start));
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) memset_bytewise(bench_dest, 0, BENCH_MEM_SIZE);
+    mem_bench_report("memset bytewise", BENCH_MEM_SIZE, (uint32_t)(rdtsc() - start));
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) kernel_memset(bench_dest, 0, BENCH_MEM_SIZE);
+    mem_bench_report("kernel_memset", BENCH_MEM_SIZE, (uint32_t)(rdtsc() - start));
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) kernel_memset_page(bench_dest);
+    mem_bench_report("kernel_memset_page", BENCH_MEM_SIZE, (uint32_t)(rdtsc() - start));
+
+    start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) kernel_memcmp(bench_dest, bench_src, BENCH_MEM_SIZE);
+    mem_bench_report("kernel_memcmp", BENCH_MEM_SIZE, (uint32_t)(rdtsc() - start));
+}
+
+//切换密集负载中访问的第一个内核地址，从1mb开始，覆盖4kb页映射与4mb大页映射的区域
+#define BENCH_TLB_BASE      (1024 * 1024)
+//每轮访问的内核页数及访问的间隔
+#define BENCH_TLB_PAGES     64
+#define BENCH_TLB_STRIDE    (256 * 1024)
+
+/**
+ * @brief  模拟任务切换密集的负载，每轮重新加载cr3后访问一组分散的内核页
+ * 
+ * @return uint32_t 每轮的平均时钟周期数
+ */
+static uint32_t tlb_bench_run(void) {
+    uint32_t sum = 0;
+
+    uint64_t start = rdtsc();
+    for (int i = 0; i < BENCH_REPEAT; ++i) {
+        //重新加载cr3，与任务切换时的效果相同
+        write_cr3(read_cr3());
+
+        for (int j = 0; j < BENCH_TLB_PAGES; ++j) {
+            sum += *(volatile uint32_t *)(BENCH_TLB_BASE + j * BENCH_TLB_STRIDE);
+        }
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start) / BENCH_REPEAT;
+
+    (void)sum;
+    return cycles;
+}
+
+/**
+ * @brief  对比内核页不是全局页与是全局页时，重新加载cr3后访问内核空间的耗时
+ *         关闭CR4.PGE时全局位被忽略，cr3的写入会驱逐所有内核页的TLB缓存
+ * 
+ */
+void tlb_bench(void) {
+    idt_state_t state = idt_enter_protection();
+    uint32_t cr4 = read_cr4();
+
+    //1.关闭全局页，修改PGE位的同时会清空整个TLB
+    write_cr4(cr4 & ~CR4_PGE);
+    uint32_t non_global = tlb_bench_run();
+
+    //2.开启全局页
+    write_cr4(cr4 | CR4_PGE);
+    uint32_t global = tlb_bench_run();
+
+    write_cr4(cr4);
+    idt_leave_protection(state);
+
+    log_printf("tlb bench: %d kernel pages per cr3 reload, cycles per round", BENCH_TLB_PAGES);
+    log_printf("non-global: %d, global: %d", non_global, global);
+}
+
+//sys_yield乒乓测试中每个任务让出cpu的次数
+#define BENCH_YIELD_ROUNDS  1000
+//乒乓测试任务的栈大小
+#define BENCH_YIELD_STACK_SIZE  1024
+
+static task_t yield_tasks[2];
+static uint32_t yield_stacks[2][BENCH_YIELD_STACK_SIZE];
+static uint64_t yield_start;
+static int yield_done;
+
+/**
+ * @brief  乒乓测试任务，两个任务交替调用sys_yield，最后结束的任务打印平均切换开销
+ * 
+ */
+static void yield_task_entry(void) {
+    idt_state_t state = idt_enter_protection();
+    if (yield_start == 0) {
+        yield_start = rdtsc();
+    }
+    idt_leave_protection(state);
+
+    for (int i = 0; i < BENCH_YIELD_ROUNDS; ++i) {
+        sys_yield();
+    }
+
+    state = idt_enter_protection();
+    if (++yield_done == 2) {
+        uint32_t cycles = (uint32_t)(rdtsc() - yield_start);
+        log_printf("yield bench: %d switches, %d cycles per switch",
+                   BENCH_YIELD_ROUNDS * 2, cycles / (BENCH_YIELD_ROUNDS * 2));
+    }
+
+    //测试结束，任务永久退出就绪队列
+    task_set_unready(task_current());
+    task_switch();
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  创建两个内核任务进行sys_yield乒乓测试，测量一次任务切换的平均时钟周期数
+ *         就绪队列中没有其它任务时结果最准确
+ * 
+ */
+void yield_bench(void) {
+    yield_start = 0;
+    yield_done = 0;
+
+    for (int i = 0; i < 2; ++i) {
+        task_init(yield_tasks + i, "yield_bench", (uint32_t)yield_task_entry,
+                  (uint32_t)&yield_stacks[i][BENCH_YIELD_STACK_SIZE], TASK_FLAGS_SYSTEM);
+        task_start(yield_tasks + i);
+    }
+}
+
+//定时器测试中msleep的次数
+#define BENCH_SLEEP_ROUNDS  100
+//定时器晶体一次振荡的时间，约为838ns
+#define BENCH_PIT_CYCLE_NS  838
+//定时器测试任务的栈大小
+#define BENCH_TIME_STACK_SIZE   1024
+
+static task_t time_task;
+static uint32_t time_stack[BENCH_TIME_STACK_SIZE];
+
+/**
+ * @brief  定时器测试任务，先测量空闲时每秒的定时器中断次数，再测量msleep的唤醒抖动
+ * 
+ */
+static void time_task_entry(void) {
+    //1.延时1s，期间没有其它任务运行时cpu只运行空闲进程
+    time_stat_t start, end;
+    time_get_stat(&start);
+    sys_sleep(1000);
+    time_get_stat(&end);
+    log_printf("time bench: idle %d timer irqs per second, %d ticks skipped",
+               end.irq_count - start.irq_count, end.idle_skip - start.idle_skip);
+
+    //2.延时1~10ms，统计实际唤醒时间与期望唤醒时间的偏差
+    uint32_t total = 0, max = 0;
+    for (int i = 0; i < BENCH_SLEEP_ROUNDS; ++i) {
+        uint32_t ms = i % 10 + 1;
+        uint32_t begin = time_now();
+        sys_sleep(ms);
+        int jitter = (int)(time_now() - begin - ms * TIME_CYCLES_PER_MS);
+        if (jitter < 0) {   //提前唤醒同样计入抖动
+            jitter = -jitter;
+        }
+
+        total += jitter;
+        if (jitter > max) {
+            max = jitter;
+        }
+    }
+    log_printf("time bench: msleep jitter avg %d ns, max %d ns",
+               total / BENCH_SLEEP_ROUNDS * BENCH_PIT_CYCLE_NS, max * BENCH_PIT_CYCLE_NS);
+
+    //测试结束，任务永久退出就绪队列
+    idt_state_t state = idt_enter_protection();
+    task_set_unready(task_current());
+    task_switch();
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  创建一个内核任务测量无滴答空闲模式的效果与msleep的唤醒精度
+ *         系统中没有其它计算型任务时结果最准确
+ * 
+ */
+void time_bench(void) {
+    task_init(&time_task, "time_bench", (uint32_t)time_task_entry,
+              (uint32_t)&time_stack[BENCH_TIME_STACK_SIZE], TASK_FLAGS_SYSTEM);
+    task_start(&time_task);
+}
+
+//多处理器测试中每个计算任务的循环次数
+#define BENCH_SMP_SPIN      20000000
+//多处理器测试任务的栈大小
+#define BENCH_SMP_STACK_SIZE    1024
+
+static task_t smp_task;
+static uint32_t smp_stack[BENCH_SMP_STACK_SIZE];
+//第一轮使用1个计算任务，第二轮每个cpu一个计算任务
+static task_t smp_workers[SMP_CPU_MAX + 1];
+static uint32_t smp_worker_stacks[SMP_CPU_MAX + 1][BENCH_SMP_STACK_SIZE];
+static volatile int smp_done;
+
+/**
+ * @brief  计算任务，完成固定次数的循环后永久退出就绪队列
+ * 
+ */
+static void smp_worker_entry(void) {
+    for (volatile uint32_t i = 0; i < BENCH_SMP_SPIN; ++i) {
+    }
+
+    idt_state_t state = idt_enter_protection();
+    smp_done++;
+    task_set_unready(task_current());
+    task_switch();
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  同时运行count个计算任务，等待全部完成并返回经过的时间
+ * 
+ * @param workers 
+ * @param count 
+ * @return uint32_t 经过的时间(ms)
+ */
+static uint32_t smp_bench_run(task_t *workers, int count) {
+    smp_done = 0;
+    uint32_t begin = time_now();
+
+    for (int i = 0; i < count; ++i) {
+        int index = workers - smp_workers + i;
+        task_init(workers + i, "smp_bench", (uint32_t)smp_worker_entry,
+                  (uint32_t)&smp_worker_stacks[index][BENCH_SMP_STACK_SIZE], TASK_FLAGS_SYSTEM);
+        task_start(workers + i);
+    }
+
+    while (smp_done < count) {
+        sys_sleep(10);
+    }
+
+    return (time_now() - begin) / TIME_CYCLES_PER_MS;
+}
+
+/**
+ * @brief  多处理器测试任务，比较1个与每个cpu一个计算任务的完成时间，
+ *         任务能分散到所有cpu上时两者接近，吞吐量随cpu数量线性增长
+ * 
+ */
+static void smp_task_entry(void) {
+    int cpus = smp_cpu_count();
+
+    uint32_t single = smp_bench_run(smp_workers, 1);
+    uint32_t multi = smp_bench_run(smp_workers + 1, cpus);
+    log_printf("smp bench: 1 task %d ms, %d tasks on %d cpus %d ms",
+               single, cpus, cpus, multi);
+
+    //测试结束，任务永久退出就绪队列
+    idt_state_t state = idt_enter_protection();
+    task_set_unready(task_current());
+    task_switch();
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  创建一个内核任务测量计算任务的吞吐量随cpu数量的扩展情况
+ *         系统中没有其它计算型任务时结果最准确
+ * 
+ */
+void smp_bench(void) {
+    task_init(&smp_task, "smp_bench", (uint32_t)smp_task_entry,
+              (uint32_t)&smp_stack[BENCH_SMP_STACK_SIZE], TASK_FLAGS_SYSTEM);
+    task_start(&smp_task);
+}
+
+//内核线程测试中工作线程的数量
+#define TEST_KTHREAD_COUNT  4
+
+static volatile int kthread_sum;
+
+/**
+ * @brief  工作线程，将参数累加到结果中，返回后线程自动退出
+ * 
+ * @param arg 
+ */
+static void kthread_test_worker(void *arg) {
+    idt_state_t state = idt_enter_protection();
+    kthread_sum += (int)arg;
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  测试线程，创建多个工作线程并等待它们的结果全部累加完成
+ * 
+ * @param arg 工作线程的数量
+ */
+static void kthread_test_main(void *arg) {
+    int count = (int)arg;
+    int expect = count * (count + 1) / 2;
+
+    kthread_sum = 0;
+    for (int i = 1; i <= count; ++i) {
+        if (kthread_create("kthread_worker", kthread_test_worker, (void *)i) == (task_t *)0) {
+            log_printf("kthread test: create worker %d failed", i);
+            return;
+        }
+    }
+
+    while (kthread_sum != expect) {
+        sys_sleep(10);
+    }
+    log_printf("kthread test: %d workers, sum %d", count, kthread_sum);
+}
+
+/**
+ * @brief  测试内核线程的参数传递与自动退出，退出的线程由first_task回收
+ * 
+ */
+void kthread_test(void) {
+    kthread_create("kthread_test", kthread_test_main, (void *)TEST_KTHREAD_COUNT);
+}
+
+static mutex_t pi_mutex;
+static volatile int pi_waiting;
+static volatile int pi_inherited;
+static volatile int pi_done;
+
+/**
+ * @brief  低优先级线程，持有锁期间等待高优先级线程阻塞在锁上，检查是否继承了其优先级
+ * 
+ * @param arg 
+ */
+static void mutex_pi_low(void *arg) {
+    sys_nice(TASK_PRIORITY_COUNT - 1);
+
+    mutex_lock(&pi_mutex);
+    while (!pi_waiting) {
+        sys_sleep(1);
+    }
+    sys_sleep(1);
+    pi_inherited = task_sched_priority(task_current());
+    mutex_unlock(&pi_mutex);
+
+    idt_state_t state = idt_enter_protection();
+    pi_done++;
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  高优先级线程，在低优先级线程持有锁后加锁
+ * 
+ * @param arg 
+ */
+static void mutex_pi_high(void *arg) {
+    sys_sleep(5);
+
+    pi_waiting = 1;
+    mutex_lock(&pi_mutex);
+    mutex_unlock(&pi_mutex);
+
+    idt_state_t state = idt_enter_protection();
+    pi_done++;
+    idt_leave_protection(state);
+}
+
+/**
+ * @brief  测试互斥锁的优先级继承，完成后打印所有锁的竞争统计
+ * 
+ */
+static void mutex_pi_main(void *arg) {
+    mutex_init(&pi_mutex, "pi_test");
+    pi_waiting = pi_done = 0;
+    pi_inherited = TASK_PRIORITY_COUNT;
+
+    kthread_create("pi_low", mutex_pi_low, (void *)0);
+    kthread_create("pi_high", mutex_pi_high, (void *)0);
+    while (pi_done != 2) {
+        sys_sleep(10);
+    }
+
+    log_printf("mutex pi test: holder priority %d while waited\n", pi_inherited);
+    mutex_show_info();
+}
+
+/**
+ * @brief  测试互斥锁的优先级继承与竞争统计
+ * 
+ */
+void mutex_pi_test(void) {
+    kthread_create("mutex_pi_test", mutex_pi_main, (void *)0);
+}
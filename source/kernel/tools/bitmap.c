@@ -12,16 +12,107 @@
 #include "tools/bitmap.h"
 #include "tools/assert.h"
 #include "tools/klib.h"
+#include "common/cpu_instr.h"
 
 
 /**
- * @brief  向上取整获取位图数组中有多少字节
+ * @brief  向上取整获取位图数组中有多少字节，位图按字访问，所以取整到字的大小
  * 
  * @param bit_count  位图数组拥有的bit位数
  * @return int 向上取整得到的字节数
  */
 int bitmap_byte_count(int bit_count) {
-    return (bit_count + 8 - 1) / 8;
+    return (bit_count + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS * sizeof(uint32_t);
+}
+
+/**
+ * @brief  获取位图摘要层需要多少字节
+ * 
+ * @param bit_count 位图数组拥有的bit位数
+ * @return int 
+ */
+int bitmap_summary_byte_count(int bit_count) {
+    int word_count = (bit_count + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+    return bitmap_byte_count(word_count);
+}
+
+/**
+ * @brief  获取位图中字的数量
+ * 
+ * @param bitmap 
+ * @return int 
+ */
+static inline int word_count(bitmap_t *bitmap) {
+    return (bitmap->bit_count + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+}
+
+/**
+ * @brief  获取第w个字中有效位的掩码，只有最后一个字可能包含超出bit_count的无效位
+ * 
+ * @param bitmap 
+ * @param w 
+ * @return uint32_t 
+ */
+static inline uint32_t word_valid_mask(bitmap_t *bitmap, int w) {
+    int tail = bitmap->bit_count % BITMAP_WORD_BITS;
+    if (tail && w == word_count(bitmap) - 1) {
+        return (1u << tail) - 1;
+    }
+
+    return 0xffffffff;
+}
+
+/**
+ * @brief  获取第w个字中值为bit的位的掩码
+ * 
+ * @param bitmap 
+ * @param w 
+ * @param bit 
+ * @return uint32_t 
+ */
+static inline uint32_t word_match(bitmap_t *bitmap, int w, int bit) {
+    uint32_t word = ((uint32_t *)bitmap->bits)[w];
+    return (bit ? word : ~word) & word_valid_mask(bitmap, w);
+}
+
+/**
+ * @brief  根据第w个字是否已全部置1更新摘要层
+ * 
+ * @param bitmap 
+ * @param w 
+ */
+static inline void summary_update(bitmap_t *bitmap, int w) {
+    if (bitmap->summary == (uint32_t *)0) {
+        return;
+    }
+
+    uint32_t word = ((uint32_t *)bitmap->bits)[w];
+    if ((word | ~word_valid_mask(bitmap, w)) == 0xffffffff) {
+        bitmap->summary[w / BITMAP_WORD_BITS] |= 1u << (w % BITMAP_WORD_BITS);
+    } else {
+        bitmap->summary[w / BITMAP_WORD_BITS] &= ~(1u << (w % BITMAP_WORD_BITS));
+    }
+}
+
+/**
+ * @brief  借助摘要层跳过已全部置1的字，一次可跳过32个字
+ * 
+ * @param bitmap 
+ * @param w 开始查找的字索引
+ * @return int 第一个未全部置1的字的索引，可能超出字的数量
+ */
+static inline int summary_skip(bitmap_t *bitmap, int w) {
+    int count = word_count(bitmap);
+    while (w < count) {
+        uint32_t not_full = ~bitmap->summary[w / BITMAP_WORD_BITS] 
+                            & (0xffffffff << (w % BITMAP_WORD_BITS));
+        if (not_full) {
+            return (w & ~(BITMAP_WORD_BITS - 1)) + bsf(not_full);
+        }
+        w = (w & ~(BITMAP_WORD_BITS - 1)) + BITMAP_WORD_BITS;
+    }
+
+    return w;
 }
 
 /**
@@ -38,6 +129,7 @@ void bitmap_init(bitmap_t *bitmap, uint8_t *bits, int count, int init_bit) {
 
     bitmap->bit_count = count;
     bitmap->bits = bits;
+    bitmap->summary = (uint32_t *)0;
 
     //计算该位图需要多少字节
     int bytes = bitmap_byte_count(bitmap->bit_count);
@@ -46,22 +138,41 @@ void bitmap_init(bitmap_t *bitmap, uint8_t *bits, int count, int init_bit) {
 
 }
 
+/**
+ * @brief  为位图开启摘要层，并根据当前位图内容初始化摘要
+ * 
+ * @param bitmap 
+ * @param summary 摘要层数组，大小为bitmap_summary_byte_count字节
+ */
+void bitmap_init_summary(bitmap_t *bitmap, uint32_t *summary) {
+    ASSERT(bitmap != (bitmap_t*)0);
+    ASSERT(summary != (uint32_t*)0);
+
+    bitmap->summary = summary;
+    kernel_memset(summary, 0, bitmap_summary_byte_count(bitmap->bit_count));
+
+    for (int w = 0; w < word_count(bitmap); ++w) {
+        summary_update(bitmap, w);
+    }
+}
+
 /**
  * @brief  获取bitmap中第index位的bit值,index从0开始
  * 
  * @param bitmap 
  * @param index 
- * @return uint8_t 
+ * @return uint8_t 0或1
  */
 uint8_t bitmap_get_bit(bitmap_t *bitmap, int index) {
     ASSERT(bitmap != (bitmap_t*)0);
     ASSERT(index >= 0);
 
-    return (bitmap->bits[index / 8] & (1 << (index % 8)));
+    return (bitmap->bits[index / 8] >> (index % 8)) & 1;
 }
 
 /**
  * @brief  将bitmap中的位图数组从index位开始一共count位，设置为bit
+ *         整字部分一次写入32位，只有首尾两个字需要掩码
  * 
  * @param bitmap 
  * @param index 
@@ -71,12 +182,32 @@ uint8_t bitmap_get_bit(bitmap_t *bitmap, int index) {
 void bitmap_set_bit(bitmap_t *bitmap, int index, int count, int bit) {
     ASSERT(bitmap != (bitmap_t*)0);
     ASSERT(index >= 0 && count >= 0);
-    for (int i = 0; i < count && index < bitmap->bit_count; ++i, ++index) {
+
+    uint32_t *words = (uint32_t *)bitmap->bits;
+    int end = index + count;
+    if (end > bitmap->bit_count) {
+        end = bitmap->bit_count;
+    }
+
+    while (index < end) {
+        //1.计算当前字中需要设置的位
+        int w = index / BITMAP_WORD_BITS;
+        int offset = index % BITMAP_WORD_BITS;
+        int n = BITMAP_WORD_BITS - offset;
+        if (n > end - index) {
+            n = end - index;
+        }
+        uint32_t mask = (n == BITMAP_WORD_BITS) ? 0xffffffff : (((1u << n) - 1) << offset);
+
+        //2.设置这些位并更新摘要层
         if (bit) {
-            bitmap->bits[index / 8] |= (1 << (index % 8));
+            words[w] |= mask;
         } else {
-            bitmap->bits[index / 8] &= ~(1 << (index % 8));
+            words[w] &= ~mask;
         }
+        summary_update(bitmap, w);
+
+        index += n;
     }
 }
 
@@ -91,48 +222,175 @@ int bitmap_is_set(bitmap_t *bitmap, int index) {
     return bitmap_get_bit(bitmap, index) ? 1 : 0;
 }
 
+/**
+ * @brief  从start位开始查找第一个值为bit的位，每次检查一个字，
+ *         查找值为0的位时，若开启了摘要层则直接跳过已全部置1的字
+ * 
+ * @param bitmap 
+ * @param bit 
+ * @param start 
+ * @return int 找到的位索引，-1:不存在
+ */
+int bitmap_find_bit(bitmap_t *bitmap, int bit, int start) {
+    ASSERT(bitmap != (bitmap_t*)0);
+
+    if (start < 0) {
+        start = 0;
+    }
+    if (start >= bitmap->bit_count) {
+        return -1;
+    }
+
+    //1.处理起始字，屏蔽start之前的位
+    int count = word_count(bitmap);
+    int w = start / BITMAP_WORD_BITS;
+    uint32_t match = word_match(bitmap, w, bit) & (0xffffffff << (start % BITMAP_WORD_BITS));
+
+    //2.逐字查找，字中存在匹配的位时用bsf取出最低的一位
+    for (;;) {
+        if (match) {
+            return w * BITMAP_WORD_BITS + bsf(match);
+        }
+
+        w++;
+        if (!bit && bitmap->summary) {
+            w = summary_skip(bitmap, w);
+        }
+
+        if (w >= count) {
+            return -1;
+        }
+
+        match = word_match(bitmap, w, bit);
+    }
+}
+
+
+/**
+ * @brief  按字检查[start, end)范围内的位是否全部为bit
+ * 
+ * @param bitmap 
+ * @param bit 
+ * @param start 
+ * @param end 
+ * @return int 范围内第一个不为bit的位索引，-1:全部为bit
+ */
+static int range_find_mismatch(bitmap_t *bitmap, int bit, int start, int end) {
+    while (start < end) {
+        int w = start / BITMAP_WORD_BITS;
+        int offset = start % BITMAP_WORD_BITS;
+        int n = BITMAP_WORD_BITS - offset;
+        if (n > end - start) {
+            n = end - start;
+        }
+        uint32_t mask = (n == BITMAP_WORD_BITS) ? 0xffffffff : (((1u << n) - 1) << offset);
+
+        uint32_t mismatch = ~word_match(bitmap, w, bit) & mask;
+        if (mismatch) {
+            return w * BITMAP_WORD_BITS + bsf(mismatch);
+        }
+
+        start += n;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief  查找长度不超过一个字的连续位段，将相邻两个字拼成64位，
+ *         通过移位相与计算出每一位开始的count位是否全部为bit，一次判断一个字内的所有起始位置
+ * 
+ * @param bitmap 
+ * @param bit 
+ * @param count 连续位的数量，不超过BITMAP_WORD_BITS
+ * @return int 连续位段的起始索引，-1:不存在
+ */
+static int find_short_run(bitmap_t *bitmap, int bit, int count) {
+    int word_cnt = word_count(bitmap);
+
+    for (int w = 0; w < word_cnt; ++w) {
+        //1.查找值为0的位时，跳过已全部置1的字，这些字中不可能有连续位段的起点
+        if (!bit && bitmap->summary) {
+            w = summary_skip(bitmap, w);
+            if (w >= word_cnt) {
+                break;
+            }
+        }
+
+        //2.拼接当前字与下一个字的匹配位
+        uint64_t run = word_match(bitmap, w, bit);
+        if (run == 0) {
+            continue;
+        }
+        if (w + 1 < word_cnt) {
+            run |= (uint64_t)word_match(bitmap, w + 1, bit) << BITMAP_WORD_BITS;
+        }
+
+        //3.倍增移位相与，使第i位为1当且仅当从第i位开始的count位全部匹配
+        for (int len = 1; len < count;) {
+            int shift = len < count - len ? len : count - len;
+            run &= run >> shift;
+            len += shift;
+        }
+
+        //4.只取起点在当前字中的位段
+        uint32_t start = (uint32_t)run;
+        if (start) {
+            return w * BITMAP_WORD_BITS + bsf(start);
+        }
+    }
+
+    return -1;
+}
 
 /**
  * @brief  在bitmap中分配一块大小为count个位的空间
+ *         不超过一个字的请求按字判断所有起点，更长的请求先找到第一个值为bit的位，
+ *         再按字检查其后count-1位是否都为bit，不满足时从第一个不匹配的位之后继续查找
  * 
  * @param bitmap 
  * @param bit 当某一位的值为bit时表示该位空闲，可供分配
  * @param count 
- * @return int 
+ * @return int 分配空间的起始索引，-1:分配失败
  */
 int bitmap_alloc_nbits(bitmap_t *bitmap, int bit, int count) {
     ASSERT(bitmap != (bitmap_t*)0);
     ASSERT(count >= 0);
 
-    int search_index = 0;
-    int ok_index = -1;
-    while (search_index < bitmap->bit_count) {
-        //确定可分配空间的起始索引
-        if (bitmap_get_bit(bitmap, search_index) != bit) {
-            search_index++;
-            continue;
-        }
+    if (count == 0) {
+        return -1;
+    }
 
-        //记录可分配空间的起始索引
-        ok_index = search_index++;
+    bit = bit ? 1 : 0;
 
-        //判断该空间是否大小满足要求
-        for (int i = 1; i < count && search_index < bitmap->bit_count; ++i) {
-            //空间大小不满足要求, 分配失败
-            if (bitmap_get_bit(bitmap, search_index++) != bit) {
-                ok_index = -1;
-                break;
-            }
+    //不超过一个字的连续位段，逐字判断所有可能的起点
+    if (count <= BITMAP_WORD_BITS) {
+        int index = find_short_run(bitmap, bit, count);
+        if (index >= 0) {
+            bitmap_set_bit(bitmap, index, count, !bit);
+        }
+        return index;
+    }
+
+    //更长的连续位段，先找起点再按字检查其后的位
+    int search_index = 0;
+    for (;;) {
+        //1.确定可分配空间的起始索引
+        int ok_index = bitmap_find_bit(bitmap, bit, search_index);
+        if (ok_index < 0 || ok_index + count > bitmap->bit_count) {
+            return -1;
         }
 
-        if (ok_index != -1) {//分配成功
-            //将该片空间标记为已分配状态, 并返回起始索引
-            bitmap_set_bit(bitmap, ok_index, count, ~bit);
+        //2.检查该段空间是否连续
+        int mismatch_index = range_find_mismatch(bitmap, bit, ok_index + 1, ok_index + count);
+
+        //3.空间大小满足要求，将该片空间标记为已分配状态, 并返回起始索引
+        if (mismatch_index < 0) {
+            bitmap_set_bit(bitmap, ok_index, count, !bit);
             return ok_index;
         }
-    }
-    
-    //遍历完整个位图也没有满足要求的空间则返回-1
-    return -1;
 
-}
\ No newline at end of file
+        //4.空间大小不满足要求，从不匹配的位之后继续查找
+        search_index = mismatch_index + 1;
+    }
+}
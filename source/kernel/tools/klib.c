@@ -10,6 +10,23 @@
  */
 
 #include "tools/klib.h"
+#include "tools/assert.h"
+#include "common/cpu_instr.h"
+#include "cpu/mmu.h"
+#include "cpu/idt.h"
+
+//是否允许整页拷贝与清零使用SSE2指令，运行时还需cpu支持
+#define KLIB_USE_SSE2   1
+//整页操作的页大小
+#define KLIB_PAGE_SIZE  4096
+//cpuid功能号1返回的edx中，fxsave/fxrstor与SSE2的支持位
+#define CPUID_EDX_FXSR  (1 << 24)
+#define CPUID_EDX_SSE2  (1 << 26)
+
+//是否已开启SSE2指令
+static int sse2_enabled = 0;
+//使用SSE寄存器前保存fpu/sse状态的区域，fxsave要求16字节对齐
+static uint8_t fxsave_area[512] __attribute__((aligned(16)));
 
 /**
  * @brief  拷贝字符串
@@ -93,42 +110,62 @@ int kernel_strlen(const char *str) {
 }
 
 /**
- * @brief  内存复制
+ * @brief  拷贝内存区域，先按字节拷贝使目标地址4字节对齐，
+ *         再用rep movsl按字拷贝，最后按字节拷贝剩余的尾部
  *
- * @param dest 目的内存的起始地址
- * @param src 原内存的起始地址
- * @param size 复制的内存字节大小
+ * @param dest 目的区域起始地址
+ * @param src 源区域起始地址
+ * @param size 拷贝的字节数
  */
 void kernel_memcpy(void *dest, const void *src, int size) {
-  if (!dest || !src || !size) return;
-
-  uint8_t *d = (uint8_t *)dest;
-  uint8_t *s = (uint8_t *)src;
-
-  while (size--) {
-    *(d++) = *(s++);
-  }
+  if (!dest || !src || size <= 0) return;
+
+  uint32_t head = (4 - ((uint32_t)dest & 3)) & 3;
+  if (head > size) head = size;
+  uint32_t words = (size - head) >> 2;
+  uint32_t tail = (size - head) & 3;
+
+  __asm__ __volatile__("cld\n\t"
+                       "rep movsb\n\t"
+                       "mov %[w], %%ecx\n\t"
+                       "rep movsl\n\t"
+                       "mov %[t], %%ecx\n\t"
+                       "rep movsb"
+                       : "+D"(dest), "+S"(src), "+c"(head)
+                       : [w] "g"(words), [t] "g"(tail)
+                       : "memory");
 }
 
 /**
- * @brief  对内存区域每一个字节赋值置
+ * @brief  对内存区域每一个字节赋值置，先按字节赋值使目标地址4字节对齐，
+ *         再用rep stosl按字赋值，最后按字节赋值剩余的尾部
  *
  * @param dest 区域起始地址
  * @param v 每个字节的值
  * @param size 赋值的内存的大小
  */
 void kernel_memset(void *dest, uint8_t v, int size) {
-  if (!dest || !size) return;
-
-  uint8_t *d = (uint8_t *)dest;
-
-  while (size--) {
-    *(d++) = v;
-  }
+  if (!dest || size <= 0) return;
+
+  uint32_t word = v * 0x01010101;
+  uint32_t head = (4 - ((uint32_t)dest & 3)) & 3;
+  if (head > size) head = size;
+  uint32_t words = (size - head) >> 2;
+  uint32_t tail = (size - head) & 3;
+
+  __asm__ __volatile__("cld\n\t"
+                       "rep stosb\n\t"
+                       "mov %[w], %%ecx\n\t"
+                       "rep stosl\n\t"
+                       "mov %[t], %%ecx\n\t"
+                       "rep stosb"
+                       : "+D"(dest), "+c"(head)
+                       : "a"(word), [w] "g"(words), [t] "g"(tail)
+                       : "memory");
 }
 
 /**
- * @brief  按按内存区域从低地址到高地址逐字节比较大小
+ * @brief  按按内存区域从低地址到高地址比较大小，先按字跳过相同的部分，再逐字节比较
  *
  * @param d1 区域1的起始地址
  * @param d2 区域2的起始地址
@@ -136,22 +173,163 @@ void kernel_memset(void *dest, uint8_t v, int size) {
  * @return int ==:0, >:1, <:-1
  */
 int kernel_memcmp(const void *dest1, const void *dest2, int size) {
-  if (!dest1 || !dest2 || !size) return 0;
+  if (!dest1 || !dest2 || size <= 0) return 0;
 
-  uint8_t *d1 = (uint8_t *)dest1;
-  uint8_t *d2 = (uint8_t *)dest2;
+  const uint8_t *d1 = (const uint8_t *)dest1;
+  const uint8_t *d2 = (const uint8_t *)dest2;
 
-  while (--size && *d1 == *d2) {
+  //1.按字比较，跳过相同的部分
+  while (size >= 4 && *(const uint32_t *)d1 == *(const uint32_t *)d2) {
+    d1 += 4;
+    d2 += 4;
+    size -= 4;
+  }
+
+  //2.逐字节比较，找到第一个不同的字节
+  while (size--) {
+    if (*d1 != *d2) {
+      return *d1 > *d2 ? 1 : -1;
+    }
     d1++;
     d2++;
   }
 
-  if (*d1 > *d2)
-    return 1;
-  else if (*d1 < *d2)
-    return -1;
-  else
-    return 0;
+  return 0;
+}
+
+/**
+ * @brief  判断是否已开启SSE2指令，开启后整页的拷贝与清零使用128位的xmm寄存器
+ *
+ * @return int
+ */
+int kernel_sse2_enabled(void) {
+  return sse2_enabled;
+}
+
+/**
+ * @brief  检测cpu是否支持SSE2与fxsave，支持则在CR0与CR4中开启SSE指令
+ *
+ */
+void kernel_sse2_init(void) {
+#if KLIB_USE_SSE2
+  uint32_t eax, ebx, ecx, edx;
+  cpuid(1, &eax, &ebx, &ecx, &edx);
+  if (!(edx & CPUID_EDX_FXSR) || !(edx & CPUID_EDX_SSE2)) {
+    return;
+  }
+
+  write_cr0((read_cr0() & ~CR0_EM) | CR0_MP);
+  write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+  sse2_enabled = 1;
+#endif
+}
+
+/**
+ * @brief  进入内核对SSE寄存器的使用，关中断并保存当前的fpu/sse状态
+ *         硬件任务切换会置位CR0.TS，需先清除，否则SSE指令会触发device_unavailable异常
+ *
+ * @param cr0 传出参数，记录原CR0的值
+ * @return idt_state_t
+ */
+static idt_state_t sse2_begin(uint32_t *cr0) {
+  idt_state_t state = idt_enter_protection();
+
+  *cr0 = read_cr0();
+  write_cr0(*cr0 & ~CR0_TS);
+  __asm__ __volatile__("fxsave %[a]" : [a] "=m"(fxsave_area));
+
+  return state;
+}
+
+/**
+ * @brief  结束内核对SSE寄存器的使用，恢复之前的fpu/sse状态
+ *
+ * @param state
+ * @param cr0
+ */
+static void sse2_end(idt_state_t state, uint32_t cr0) {
+  __asm__ __volatile__("fxrstor %[a]" : : [a] "m"(fxsave_area));
+  write_cr0(cr0);
+
+  idt_leave_protection(state);
+}
+
+/**
+ * @brief  拷贝一整页，目的与源地址都需按页对齐
+ *
+ * @param dest
+ * @param src
+ */
+void kernel_memcpy_page(void *dest, const void *src) {
+  ASSERT(((uint32_t)dest & (KLIB_PAGE_SIZE - 1)) == 0);
+  ASSERT(((uint32_t)src & (KLIB_PAGE_SIZE - 1)) == 0);
+
+  if (!sse2_enabled) {
+    uint32_t count = KLIB_PAGE_SIZE / 4;
+    __asm__ __volatile__("cld\n\trep movsl"
+                         : "+D"(dest), "+S"(src), "+c"(count)
+                         :
+                         : "memory");
+    return;
+  }
+
+  //每次用4个xmm寄存器拷贝64字节
+  uint32_t cr0;
+  idt_state_t state = sse2_begin(&cr0);
+
+  const uint8_t *s = (const uint8_t *)src;
+  uint8_t *d = (uint8_t *)dest;
+  for (int i = 0; i < KLIB_PAGE_SIZE; i += 64) {
+    __asm__ __volatile__("movdqa (%[s]), %%xmm0\n\t"
+                         "movdqa 16(%[s]), %%xmm1\n\t"
+                         "movdqa 32(%[s]), %%xmm2\n\t"
+                         "movdqa 48(%[s]), %%xmm3\n\t"
+                         "movdqa %%xmm0, (%[d])\n\t"
+                         "movdqa %%xmm1, 16(%[d])\n\t"
+                         "movdqa %%xmm2, 32(%[d])\n\t"
+                         "movdqa %%xmm3, 48(%[d])"
+                         :
+                         : [s] "r"(s + i), [d] "r"(d + i)
+                         : "memory");
+  }
+
+  sse2_end(state, cr0);
+}
+
+/**
+ * @brief  将一整页清零，目的地址需按页对齐
+ *
+ * @param dest
+ */
+void kernel_memset_page(void *dest) {
+  ASSERT(((uint32_t)dest & (KLIB_PAGE_SIZE - 1)) == 0);
+
+  if (!sse2_enabled) {
+    uint32_t count = KLIB_PAGE_SIZE / 4;
+    __asm__ __volatile__("cld\n\trep stosl"
+                         : "+D"(dest), "+c"(count)
+                         : "a"(0)
+                         : "memory");
+    return;
+  }
+
+  //清零xmm0后每次写入64字节
+  uint32_t cr0;
+  idt_state_t state = sse2_begin(&cr0);
+
+  uint8_t *d = (uint8_t *)dest;
+  __asm__ __volatile__("pxor %%xmm0, %%xmm0" ::);
+  for (int i = 0; i < KLIB_PAGE_SIZE; i += 64) {
+    __asm__ __volatile__("movdqa %%xmm0, (%[d])\n\t"
+                         "movdqa %%xmm0, 16(%[d])\n\t"
+                         "movdqa %%xmm0, 32(%[d])\n\t"
+                         "movdqa %%xmm0, 48(%[d])"
+                         :
+                         : [d] "r"(d + i)
+                         : "memory");
+  }
+
+  sse2_end(state, cr0);
 }
 
 void kernel_sprintf(char *buf, const char *formate, ...) {
@@ -45,7 +45,7 @@ void log_init(void) {
 
 #endif 
     //初始化互斥锁
-    mutex_init(&mutex);
+    mutex_init(&mutex, "log");
 
     //打开一个tty设备用于日志打印
     log_dev_id = dev_open(DEV_TTY, 0, (void*)0);
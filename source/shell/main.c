@@ -171,7 +171,7 @@ static int do_less(int argc, const char **argv) {
       case 'h':
         puts("help:");
         puts("\tshow file content");
-        puts("\tUsage: less [-l] file");
+        puts("\tUsage: less [-l] [file], read from stdin without file");
         return 0;
       case 'l':
         line_mode = 1;
@@ -190,15 +190,17 @@ static int do_less(int argc, const char **argv) {
 
 
 
-  if (optind >
-      argc - 1) {  // argc - 1
-                   // 为message的索引，optind>argc-1表示此次调用未携带message
-    fprintf(stderr, ESC_COLOR_ERROR "no file input\n"ESC_COLOR_DEFAULT);
-    return -1;
+  //没有指定文件时从标准输入读取，如管道的读端，逐行模式需用标准输入读取按键
+  FILE *file = stdin;
+  if (optind > argc - 1) {
+    if (line_mode) {
+      fprintf(stderr, ESC_COLOR_ERROR "no file input\n"ESC_COLOR_DEFAULT);
+      return -1;
+    }
+  } else {
+    //打开文件
+    file = fopen(argv[optind], "r");
   }
-
-  //打开文件
-  FILE *file = fopen(argv[optind], "r");
   if (file == NULL) {
     fprintf(stderr, ESC_COLOR_ERROR"open file failed. %s"ESC_COLOR_DEFAULT, argv[optind]);
     return -1;
@@ -244,7 +246,9 @@ less_quit:
   
 
   free(buf);
-  fclose(file);
+  if (file != stdin) {
+    fclose(file);
+  }
   return 0;
 }
 
@@ -311,6 +315,341 @@ static int do_rm(int argc, const char **argv) {
   return err;
 }
 
+/**
+ * @brief 计算型进程，持续占用cpu，直到按键延迟测试统计到足够的按键次数后退出
+ *
+ * @param keys 需要统计的按键次数
+ */
+static void lat_hog(int keys) {
+  tty_latency_t stat;
+  while (1) {
+    for (volatile int i = 0; i < LAT_HOG_SPIN; ++i) {
+    }
+
+    ioctl(0, TTY_CMD_LATENCY, (int)&stat, 0);
+    if (stat.count >= keys) {
+      exit(0);
+    }
+  }
+}
+
+/**
+ * @brief 测量有计算型进程运行时，按键到回显的延迟
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+static int do_lat(int argc, const char **argv) {
+  optind = 0;
+  int hogs = LAT_HOG_DEFAULT;
+  int keys = LAT_KEY_DEFAULT;
+  int ch;
+  while ((ch = getopt(argc, (char *const *)argv, "n:k:h")) != -1) {
+    switch (ch) {
+      case 'h':
+        puts("help:");
+        puts("	measure keystroke to echo latency while cpu hogs run");
+        puts("	Usage: lat [-n hogs] [-k keys]");
+        return 0;
+      case 'n':
+        hogs = atoi(optarg);
+        break;
+      case 'k':
+        keys = atoi(optarg);
+        break;
+      case '?':
+        if (optarg) {
+          fprintf(stderr,
+                  ESC_COLOR_ERROR "unknown option: -%s\n" ESC_COLOR_DEFAULT,
+                  optarg);
+        }
+        return -1;
+      default:
+        break;
+    }
+  }
+
+  if (keys <= 0) {
+    fprintf(stderr, ESC_COLOR_ERROR "lat: keys must be positive\n" ESC_COLOR_DEFAULT);
+    return -1;
+  }
+
+  // 1.清空tty的按键延迟统计
+  tty_latency_t stat;
+  ioctl(0, TTY_CMD_LATENCY, (int)&stat, 1);
+
+  // 2.创建计算型进程
+  int started = 0;
+  for (; started < hogs; ++started) {
+    int pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "lat: fork failed\n");
+      break;
+    } else if (pid == 0) {
+      lat_hog(keys);
+    }
+  }
+
+  // 3.逐个读取按键，每个按键在tty中回显后记录一次延迟
+  printf("%d hogs running, press %d keys...\n", started, keys);
+  fflush(stdout);
+  char key;
+  for (int i = 0; i < keys; ++i) {
+    read(0, &key, 1);
+  }
+
+  // 4.打印统计结果，并回收计算型进程
+  ioctl(0, TTY_CMD_LATENCY, (int)&stat, 0);
+  printf("\nkeys: %d, avg: %d, max: %d (x1024 cycles)\n", stat.count,
+         stat.count ? stat.total / stat.count : 0, stat.max);
+  for (int i = 0; i < started; ++i) {
+    int status;
+    wait(&status);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief 读取时间戳计数器的低32位，测量的区间远小于其回绕周期
+ *
+ * @return uint32_t
+ */
+static inline uint32_t tsc_low(void) {
+  uint32_t low, high;
+  __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+  return low;
+}
+
+/**
+ * @brief 测量count次getpid系统调用经由sys_call_fn进入内核并返回的平均时钟周期数
+ *
+ * @param sys_call_fn 进入内核的方式
+ * @param count
+ * @return uint32_t
+ */
+static uint32_t sysbench_run(int (*sys_call_fn)(syscall_args_t *), int count) {
+  syscall_args_t args;
+  args.id = SYS_getpid;
+  args.arg0 = args.arg1 = args.arg2 = args.arg3 = 0;
+
+  uint32_t start = tsc_low();
+  for (int i = 0; i < count; ++i) {
+    sys_call_fn(&args);
+  }
+
+  return (tsc_low() - start) / count;
+}
+
+/**
+ * @brief 比较调用门与sysenter两种系统调用入口的往返开销
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+static int do_sysbench(int argc, const char **argv) {
+  optind = 0;
+  int count = SYSBENCH_DEFAULT;
+  int ch;
+  while ((ch = getopt(argc, (char *const *)argv, "n:h")) != -1) {
+    switch (ch) {
+      case 'h':
+        puts("help:");
+        puts("	measure getpid round-trip cycles through the call gate and sysenter");
+        puts("	Usage: sysbench [-n count]");
+        return 0;
+      case 'n':
+        count = atoi(optarg);
+        break;
+      case '?':
+        if (optarg) {
+          fprintf(stderr,
+                  ESC_COLOR_ERROR "unknown option: -%s\n" ESC_COLOR_DEFAULT,
+                  optarg);
+        }
+        return -1;
+      default:
+        break;
+    }
+  }
+
+  if (count <= 0) {
+    fprintf(stderr, ESC_COLOR_ERROR "sysbench: count must be positive\n" ESC_COLOR_DEFAULT);
+    return -1;
+  }
+
+  printf("getpid x %d\n", count);
+  printf("call gate: %d cycles\n", sysbench_run(sys_call_gate, count));
+  if (sysenter_supported()) {
+    printf("sysenter: %d cycles\n", sysbench_run(sys_call_sysenter, count));
+  } else {
+    printf("sysenter: not supported\n");
+  }
+
+  return 0;
+}
+
+/**
+ * @brief 子进程以block字节为单位向管道写入total字节后退出
+ *
+ * @param fd 管道的写端
+ * @param block
+ * @param total
+ */
+static void pipebench_writer(int fd, int block, int total) {
+  char *buf = (char *)malloc(block);
+  memset(buf, 'p', block);
+
+  for (int sent = 0; sent < total; sent += block) {
+    if (write(fd, buf, block) < 0) {
+      break;
+    }
+  }
+
+  exit(0);
+}
+
+/**
+ * @brief 测量以block字节为单位经管道在两个进程间传输total字节的吞吐量
+ *
+ * @param block
+ * @param total
+ * @return int 0:成功, -1:失败
+ */
+static int pipebench_run(int block, int total) {
+  int fd[2];
+  if (pipe(fd) < 0) {
+    fprintf(stderr, "pipebench: pipe failed\n");
+    return -1;
+  }
+
+  // 1.子进程关闭读端后写入数据
+  int pid = fork();
+  if (pid < 0) {
+    fprintf(stderr, "pipebench: fork failed\n");
+    close(fd[0]);
+    close(fd[1]);
+    return -1;
+  } else if (pid == 0) {
+    close(fd[0]);
+    pipebench_writer(fd[1], block, total);
+  }
+
+  // 2.父进程关闭写端，读到文件结束即子进程写完并退出
+  close(fd[1]);
+  char *buf = (char *)malloc(block);
+  int received = 0;
+  int n;
+  uint32_t start = get_ticks();
+  while ((n = read(fd[0], buf, block)) > 0) {
+    received += n;
+  }
+  uint32_t ms = (get_ticks() - start) * OS_TICKS_MS;
+  close(fd[0]);
+  free(buf);
+
+  int status;
+  wait(&status);
+
+  // 3.打印吞吐量，单位为KB/ms，约等于MB/s
+  if (ms == 0) {
+    ms = 1;
+  }
+  int kb_per_s = (received / 1024) * 1000 / ms;
+  printf("block %d: %d KB in %d ms, %d.%d MB/s\n", block, received / 1024, ms,
+         kb_per_s / 1024, (kb_per_s % 1024) * 10 / 1024);
+  return 0;
+}
+
+/**
+ * @brief 测量不同读写大小下管道的吞吐量，不小于一页的读写可直接写入读者的缓冲区
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+static int do_pipebench(int argc, const char **argv) {
+  optind = 0;
+  int total_kb = PIPEBENCH_DEFAULT_KB;
+  int ch;
+  while ((ch = getopt(argc, (char *const *)argv, "s:h")) != -1) {
+    switch (ch) {
+      case 'h':
+        puts("help:");
+        puts("	measure pipe throughput between two processes");
+        puts("	Usage: pipebench [-s size_kb]");
+        return 0;
+      case 's':
+        total_kb = atoi(optarg);
+        break;
+      case '?':
+        if (optarg) {
+          fprintf(stderr,
+                  ESC_COLOR_ERROR "unknown option: -%s\n" ESC_COLOR_DEFAULT,
+                  optarg);
+        }
+        return -1;
+      default:
+        break;
+    }
+  }
+
+  if (total_kb <= 0) {
+    fprintf(stderr, ESC_COLOR_ERROR "pipebench: size must be positive\n" ESC_COLOR_DEFAULT);
+    return -1;
+  }
+
+  static const int blocks[] = {512, 4096, 16384};
+  for (int i = 0; i < sizeof(blocks) / sizeof(blocks[0]); ++i) {
+    if (pipebench_run(blocks[i], total_kb * 1024) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @brief 打印块缓存的命中率与磁盘访问统计
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+static int do_bcstat(int argc, const char **argv) {
+  bcache_stat_t stat;
+  if (bcache_stat(&stat) < 0) {
+    fprintf(stderr, ESC_COLOR_ERROR "bcstat: get stat failed\n" ESC_COLOR_DEFAULT);
+    return -1;
+  }
+
+  //命中率精确到千分之一，次数过大时同时缩小命中数与查找数，避免乘法溢出
+  unsigned int hits = stat.hits;
+  unsigned int lookups = stat.hits + stat.misses;
+  while (hits > 0x3FFFFF) {
+    hits >>= 1;
+    lookups >>= 1;
+  }
+  unsigned int rate = lookups ? hits * 1000 / lookups : 0;
+  printf("blocks: %u (%u KB), dirty: %u\n", (unsigned int)stat.blocks,
+         (unsigned int)stat.blocks * BCACHE_BLOCK_SIZE / 1024, (unsigned int)stat.dirty);
+  printf("hits: %u, misses: %u, hit rate: %u.%u%%, evictions: %u\n",
+         (unsigned int)stat.hits, (unsigned int)stat.misses, rate / 10, rate % 10,
+         (unsigned int)stat.evictions);
+  printf("disk reads: %u (%u blocks), disk writes: %u (%u blocks)\n",
+         (unsigned int)stat.disk_reads, (unsigned int)stat.read_blocks,
+         (unsigned int)stat.disk_writes, (unsigned int)stat.write_blocks);
+  printf("direct reads: %u (%u blocks), direct writes: %u (%u blocks)\n",
+         (unsigned int)stat.direct_reads, (unsigned int)stat.direct_read_blocks,
+         (unsigned int)stat.direct_writes, (unsigned int)stat.direct_write_blocks);
+  printf("readahead: %u requests, %u blocks, %u dropped\n",
+         (unsigned int)stat.ra_requests, (unsigned int)stat.ra_blocks,
+         (unsigned int)stat.ra_dropped);
+  return 0;
+}
+
 // 终端命令表
 static const cli_cmd_t cmd_list[] = {
     {
@@ -348,6 +687,26 @@ static const cli_cmd_t cmd_list[] = {
         .usage = "rm file\tremove file",
         .do_func = do_rm,
     },
+    {
+        .name = "lat",
+        .usage = "lat [-n hogs] [-k keys]\t--keystroke latency with cpu hogs",
+        .do_func = do_lat,
+    },
+    {
+        .name = "sysbench",
+        .usage = "sysbench [-n count]\t--getpid cycles via call gate and sysenter",
+        .do_func = do_sysbench,
+    },
+    {
+        .name = "pipebench",
+        .usage = "pipebench [-s size_kb]\t--pipe throughput between two processes",
+        .do_func = do_pipebench,
+    },
+    {
+        .name = "bcstat",
+        .usage = "bcstat\t--block cache hit rate and disk io",
+        .do_func = do_bcstat,
+    },
     {
         .name = "quit",
         .usage = "quit\t--quit from shell",
@@ -461,6 +820,139 @@ static const char* find_exec_path(const char *file_name) {
     }
 }
 
+/**
+ * @brief 将命令行按空格分割为参数列表
+ *
+ * @param str 被分割的字符串，空格被替换为'\0'
+ * @param argv 传出参数
+ * @return int 参数个数
+ */
+static int parse_args(char *str, const char **argv) {
+  int argc = 0;
+  memset(argv, 0, sizeof(const char *) * CLI_MAX_ARG_COUNT);
+
+  const char *split = " ";
+  char *token = strtok(str, split);  // 将字符串中的第一个split字符换成'\0'并放回起始索引
+  while (token && argc < CLI_MAX_ARG_COUNT - 1) {
+    argv[argc++] = token;
+    token = strtok(NULL, split);  // 填空默认从之前找到的位置的下一个位置开始
+  }
+
+  return argc;
+}
+
+/**
+ * @brief 在子进程中运行管道中的一个命令，内建命令同样在子进程中执行，标准输入输出已被重定向
+ *
+ * @param argc
+ * @param argv
+ */
+static void run_pipeline_stage(int argc, const char **argv) {
+  const cli_cmd_t *cmd = find_builtin(argv[0]);
+  if (cmd) {
+    exit(cmd->do_func(argc, argv) < 0 ? -1 : 0);
+  }
+
+  const char *path = find_exec_path(argv[0]);
+  if (path) {
+    execve(path, (char *const *)argv, (char *const *)0);
+  }
+
+  fprintf(stderr, ESC_COLOR_ERROR "Unknown command: %s\n" ESC_COLOR_DEFAULT, argv[0]);
+  exit(-1);
+}
+
+/**
+ * @brief 运行以'|'连接的多个命令，前一个命令的标准输出经管道连接到后一个命令的标准输入
+ *
+ * @param input 命令行输入
+ */
+static void run_pipeline(char *input) {
+  // 1.按'|'分割出每个命令
+  char *stages[CLI_MAX_PIPE_STAGES];
+  int count = 0;
+  char *start = input;
+  for (;;) {
+    char *bar = strchr(start, '|');
+    if (count == CLI_MAX_PIPE_STAGES) {
+      fprintf(stderr, ESC_COLOR_ERROR "too many commands in pipeline\n" ESC_COLOR_DEFAULT);
+      return;
+    }
+    stages[count++] = start;
+    if (!bar) {
+      break;
+    }
+    *bar = '\0';
+    start = bar + 1;
+  }
+
+  // 2.依次创建每个命令的子进程，in_fd为上一个管道的读端
+  int in_fd = -1;
+  int started = 0;
+  for (int i = 0; i < count; ++i) {
+    const char *argv[CLI_MAX_ARG_COUNT];
+    int argc = parse_args(stages[i], argv);
+    if (argc == 0) {
+      fprintf(stderr, ESC_COLOR_ERROR "empty command in pipeline\n" ESC_COLOR_DEFAULT);
+      break;
+    }
+
+    int fd[2] = {-1, -1};
+    if (i < count - 1 && pipe(fd) < 0) {
+      fprintf(stderr, ESC_COLOR_ERROR "pipe failed\n" ESC_COLOR_DEFAULT);
+      break;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, ESC_COLOR_ERROR "fork failed: %s\n" ESC_COLOR_DEFAULT, argv[0]);
+      if (fd[0] >= 0) {
+        close(fd[0]);
+        close(fd[1]);
+      }
+      break;
+    } else if (pid == 0) {
+      // 3.子进程关闭标准输入输出后，dup分配的最小描述符即为0或1
+      if (in_fd >= 0) {
+        close(0);
+        dup(in_fd);
+        close(in_fd);
+      }
+      if (fd[1] >= 0) {
+        close(1);
+        dup(fd[1]);
+        close(fd[1]);
+        close(fd[0]);
+      }
+      run_pipeline_stage(argc, argv);
+    }
+
+    // 4.父进程关闭已交给子进程的描述符，使管道两端在子进程退出后能被完全关闭
+    started++;
+    if (in_fd >= 0) {
+      close(in_fd);
+    }
+    if (fd[1] >= 0) {
+      close(fd[1]);
+    }
+    in_fd = fd[0];
+  }
+
+  if (in_fd >= 0) {
+    close(in_fd);
+  }
+
+  // 5.回收所有子进程
+  for (int i = 0; i < started; ++i) {
+    int status;
+    int pid = wait(&status);
+    if (status != 0) {
+      fprintf(stderr, ESC_COLOR_ERROR "process exception result: %d, pid=%d\n" ESC_COLOR_DEFAULT,
+              status, pid);
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   // 1.打开shell对应的tty设备绑定为stdin
   int err = open(argv[0], O_RDWR);
@@ -490,24 +982,20 @@ int main(int argc, char **argv) {
       *cr = '\0';
     }
 
-    // 4.2解析命令行输入的程序和参数
-    int argc = 0;
-    const char *argv[CLI_MAX_ARG_COUNT];
-    memset(argv, 0, sizeof(argv));
-    const char *split = " ";
-    char *token =
-        strtok(cli.curr_input,
-               split);  // 将字符串中的第一个split字符换成'\0'并放回起始索引
-    while (token) {
-      argv[argc++] = token;
-      token = strtok(NULL, split);  // 填空默认从之前找到的位置的下一个位置开始
+    // 4.2含有'|'时作为管道运行
+    if (strchr(cli.curr_input, '|')) {
+      run_pipeline(cli.curr_input);
+      continue;
     }
 
+    // 4.3解析命令行输入的程序和参数
+    const char *argv[CLI_MAX_ARG_COUNT];
+    int argc = parse_args(cli.curr_input, argv);
     if (argc == 0) {
       continue;
     }
 
-    // 4.3 获取可执行的命令结构，并执行
+    // 4.4 获取可执行的命令结构，并执行
     const cli_cmd_t *cmd = find_builtin(argv[0]);
     if (cmd) {
       run_builtin(cmd, argc, argv);
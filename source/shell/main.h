@@ -18,6 +18,21 @@
 //定义shell终端一次性接收的参数数量
 #define CLI_MAX_ARG_COUNT   10
 
+//按键延迟测试默认的计算型进程数量与按键次数
+#define LAT_HOG_DEFAULT 2
+#define LAT_KEY_DEFAULT 20
+//计算型进程每次查询统计结果之间的空循环次数
+#define LAT_HOG_SPIN    100000
+
+//系统调用入口测试默认的调用次数
+#define SYSBENCH_DEFAULT 10000
+
+//管道吞吐量测试默认传输的数据量(KB)
+#define PIPEBENCH_DEFAULT_KB 4096
+
+//管道中最多连接的命令数量
+#define CLI_MAX_PIPE_STAGES 8
+
 //定义ESC序列生成宏
 #define  ESC_CMD2(Pn, cmd)  "\x1b["#Pn#cmd  //'#'用来将数字解析为字符串
 #define ESC_CLEAR_SCREEN    ESC_CMD2(2, J)  //清屏序列
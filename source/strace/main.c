@@ -0,0 +1,241 @@
+/**
+ * @file main.c
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  创建子进程运行指定程序，并实时打印子进程的每次系统调用
+ *         用法: strace [-c] 程序 [参数...]
+ *         -c 子进程退出后打印其运行期间各系统调用的次数、平均耗时与耗时分布
+ * @version 0.1
+ * @date 2023-09-30
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "lib_syscall.h"
+#include "main.h"
+
+static const strace_call_t call_table[SYSTRACE_ID_MAX] = {
+    [SYS_sleep] = {"sleep", 1},
+    [SYS_getpid] = {"getpid", 0},
+    [SYS_fork] = {"fork", 0},
+    [SYS_execve] = {"execve", 3},
+    [SYS_yield] = {"yield", 0},
+    [SYS_exit] = {"exit", 1},
+    [SYS_wait] = {"wait", 1},
+    [SYS_nice] = {"nice", 1},
+    [SYS_clone] = {"clone", 2},
+    [SYS_thread_exit] = {"thread_exit", 1},
+    [SYS_printmsg] = {"printmsg", 2},
+    [SYS_thread_join] = {"thread_join", 2},
+    [SYS_futex_wait] = {"futex_wait", 2},
+    [SYS_futex_wake] = {"futex_wake", 2},
+    [SYS_trace] = {"trace", 2},
+    [SYS_trace_read] = {"trace_read", 3},
+    [SYS_trace_stat] = {"trace_stat", 2},
+    [SYS_open] = {"open", 2},
+    [SYS_read] = {"read", 3},
+    [SYS_write] = {"write", 3},
+    [SYS_close] = {"close", 1},
+    [SYS_lseek] = {"lseek", 3},
+    [SYS_isatty] = {"isatty", 1},
+    [SYS_fstat] = {"fstat", 2},
+    [SYS_dup] = {"dup", 1},
+    [SYS_ioctl] = {"ioctl", 4},
+    [SYS_unlink] = {"unlink", 1},
+    [SYS_opendir] = {"opendir", 1},
+    [SYS_readdir] = {"readdir", 1},
+    [SYS_closedir] = {"closedir", 1},
+    [SYS_sbrk] = {"sbrk", 1},
+    [SYS_pipe] = {"pipe", 1},
+    [SYS_bcache_stat] = {"bcache_stat", 1},
+};
+
+//子进程运行前后的耗时统计，用于计算子进程运行期间的差值
+static systrace_stat_t stat_before[SYSTRACE_ID_MAX];
+static systrace_stat_t stat_after[SYSTRACE_ID_MAX];
+
+/**
+ * @brief 打印一条跟踪记录
+ *
+ * @param entry
+ */
+static void print_entry(const systrace_entry_t *entry) {
+    const strace_call_t *call = (const strace_call_t *)0;
+    if (entry->id >= 0 && entry->id < SYSTRACE_ID_MAX && call_table[entry->id].name) {
+        call = call_table + entry->id;
+    }
+
+    if (call) {
+        printf("[%d] %s(", entry->pid, call->name);
+    } else {
+        printf("[%d] syscall_%d(", entry->pid, entry->id);
+    }
+
+    int argc = call ? call->argc : 4;
+    for (int i = 0; i < argc; ++i) {
+        printf(i ? ", 0x%x" : "0x%x", (unsigned int)entry->args[i]);
+    }
+
+    //不会返回的调用在进入时记录，没有返回值
+    if (entry->id == SYS_exit || entry->id == SYS_thread_exit) {
+        printf(") = ?\n");
+    } else {
+        printf(") = %d <%u cycles>\n", entry->ret, (unsigned int)entry->cycles);
+    }
+}
+
+/**
+ * @brief 计算平均耗时，总耗时超过32位时同时缩小总耗时与次数，避免64位除法
+ *
+ * @param total
+ * @param count
+ * @return uint32_t
+ */
+static uint32_t cycles_avg(uint64_t total, uint32_t count) {
+    while (total >> 32) {
+        total >>= 1;
+        count >>= 1;
+    }
+
+    return count ? (uint32_t)total / count : 0;
+}
+
+/**
+ * @brief 打印子进程运行期间各系统调用的次数、平均耗时与按log2划分的耗时分布
+ *        统计为所有进程共享，期间其它进程的系统调用也会被计入
+ *
+ */
+static void print_summary(void) {
+    for (int id = 0; id < SYSTRACE_ID_MAX; ++id) {
+        trace_stat(id, stat_after + id);
+    }
+
+    printf("%-12s %8s %10s %10s\n", "syscall", "calls", "avg", "max");
+    for (int id = 0; id < SYSTRACE_ID_MAX; ++id) {
+        systrace_stat_t *before = stat_before + id;
+        systrace_stat_t *after = stat_after + id;
+        uint32_t count = after->count - before->count;
+        if (count == 0) {
+            continue;
+        }
+
+        char name[16];
+        if (call_table[id].name) {
+            snprintf(name, sizeof(name), "%s", call_table[id].name);
+        } else {
+            snprintf(name, sizeof(name), "syscall_%d", id);
+        }
+
+        //最长耗时无法求差值，为开机以来的最大值
+        printf("%-12s %8u %10u %10u\n", name, (unsigned int)count,
+               (unsigned int)cycles_avg(after->cycles_total - before->cycles_total, count),
+               (unsigned int)after->cycles_max);
+
+        printf("    ");
+        for (int i = 0; i < SYSTRACE_HIST_SIZE; ++i) {
+            uint32_t n = after->hist[i] - before->hist[i];
+            if (n) {
+                printf(" 2^%d:%u", i, (unsigned int)n);
+            }
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * @brief 子进程开启对自身的跟踪后加载程序，跟踪从execve开始
+ *
+ * @param argv
+ */
+static void run_child(char **argv) {
+    static char path[255];
+
+    trace(0, 1);
+    execve(argv[0], argv, (char * const *)0);
+
+    //程序名不带后缀时尝试加上.elf后缀
+    snprintf(path, sizeof(path), "%s.elf", argv[0]);
+    execve(path, argv, (char * const *)0);
+
+    trace(0, 0);
+    fprintf(stderr, "strace: exec failed: %s\n", argv[0]);
+    exit(-1);
+}
+
+int main(int argc, char **argv) {
+    int summary = 0;
+    int ch;
+
+    //遇到第一个非选项参数即停止解析，其后的选项属于被跟踪的程序
+    while ((ch = getopt(argc, argv, "+ch")) != -1) {
+        switch (ch) {
+            case 'c':
+                summary = 1;
+                break;
+            case 'h':
+                puts("strace: trace system calls of a program");
+                puts("Usage: strace [-c] program [args...]");
+                return 0;
+            default:
+                return -1;
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: strace [-c] program [args...]\n");
+        return -1;
+    }
+
+    if (summary) {
+        for (int id = 0; id < SYSTRACE_ID_MAX; ++id) {
+            trace_stat(id, stat_before + id);
+        }
+    }
+
+    //1.创建子进程运行程序
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "strace: fork failed\n");
+        return -1;
+    } else if (pid == 0) {
+        run_child(argv + optind);
+    }
+
+    //2.读取并打印跟踪记录，直到子进程退出且没有剩余记录
+    static systrace_entry_t entries[STRACE_BATCH];
+    uint32_t next_seq = 0;
+    int first = 1;
+    int n;
+    while ((n = trace_read(entries, STRACE_BATCH, pid)) >= 0) {
+        if (n == 0) {
+            msleep(STRACE_POLL_MS);
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            //序号不连续说明跟踪缓冲区已满，旧的记录被覆盖
+            if (!first && entries[i].seq != next_seq) {
+                printf("... %u entries lost\n", (unsigned int)(entries[i].seq - next_seq));
+            }
+            first = 0;
+            next_seq = entries[i].seq + 1;
+
+            print_entry(entries + i);
+        }
+    }
+
+    //3.回收子进程
+    int status;
+    wait(&status);
+    printf("+++ exited with %d +++\n", status);
+
+    if (summary) {
+        print_summary();
+    }
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file main.h
+ * @author kbpoyo (kbpoyo.com)
+ * @brief  跟踪子进程系统调用的程序
+ * @version 0.1
+ * @date 2023-09-30
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef MAIN_H
+#define MAIN_H
+
+//每次读取的跟踪记录数
+#define STRACE_BATCH        32
+
+//没有新的跟踪记录时的等待时间(ms)
+#define STRACE_POLL_MS      10
+
+//系统调用的名称与参数个数
+typedef struct _strace_call_t {
+    const char *name;
+    int argc;
+}strace_call_t;
+
+#endif